@@ -153,40 +153,156 @@ bgp_advertise_unintern (struct hash *hash, struct bgp_advertise_attr *baa)
 }
 
 /* BGP adjacency keeps minimal advertisement information.  */
+static struct bgp_adj_out *
+bgp_adj_out_new (struct attr *attr, int size)
+{
+  struct bgp_adj_out *adj;
+
+  adj = XCALLOC (MTYPE_BGP_ADJ_OUT, BGP_ADJ_OUT_SIZE (size));
+  adj->attr = attr;
+  adj->size = size;
+  return adj;
+}
+
 static void
 bgp_adj_out_free (struct bgp_adj_out *adj)
 {
-  peer_unlock (adj->peer); /* adj_out peer reference */
   XFREE (MTYPE_BGP_ADJ_OUT, adj);
 }
 
-int
-bgp_adj_out_lookup (struct peer *peer, struct prefix *p,
-		    afi_t afi, safi_t safi, struct bgp_node *rn)
+/* Adjacency holding the attribute sent to peer.  */
+struct bgp_adj_out *
+bgp_adj_out_peer (struct bgp_node *rn, struct peer *peer)
 {
   struct bgp_adj_out *adj;
 
   for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
+    if (BGP_ADJ_OUT_CHECK (adj, peer->adj_index))
+      return adj;
+
+  return NULL;
+}
+
+/* Advertisement pending for peer.  */
+static struct bgp_advertise *
+bgp_adj_out_adv (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_advertise *adv;
+
+  for (adv = rn->adv; adv; adv = adv->rn_next)
+    if (adv->peer == peer)
+      return adv;
+
+  return NULL;
+}
+
+/* Add peer to the adjacency of attr, creating it if needed.  */
+static void
+bgp_adj_out_join (struct bgp_node *rn, struct peer *peer, struct attr *attr)
+{
+  struct bgp_adj_out *adj;
+  struct bgp_adj_out *new;
+  int size;
+
+  size = BGP_ADJ_INDEX_WORD (peer->adj_index) + 1;
+  attr = bgp_attr_intern (attr);
+
+  for (adj = rn->adj_out; adj; adj = adj->next)
+    if (adj->attr == attr)
       break;
 
-  if (! adj)
-    return 0;
+  if (adj)
+    {
+      bgp_attr_unintern (attr);
+
+      /* Bitmap is too small for this peer, replace the adjacency.  */
+      if (adj->size < size)
+	{
+	  new = bgp_adj_out_new (adj->attr, size);
+	  new->count = adj->count;
+	  memcpy (new->peers, adj->peers, adj->size * sizeof (u_int32_t));
+
+	  BGP_ADJ_OUT_DEL (rn, adj);
+	  BGP_ADJ_OUT_ADD (rn, new);
+	  bgp_adj_out_free (adj);
+	  adj = new;
+	}
+    }
+  else
+    {
+      if (size < peer->bgp->adj_index_size)
+	size = peer->bgp->adj_index_size;
+
+      adj = bgp_adj_out_new (attr, size);
+      BGP_ADJ_OUT_ADD (rn, adj);
+    }
+
+  adj->peers[BGP_ADJ_INDEX_WORD (peer->adj_index)]
+    |= BGP_ADJ_INDEX_BIT (peer->adj_index);
+  adj->count++;
+
+  peer_lock (peer); /* adj_out peer reference */
+  bgp_lock_node (rn);
+}
+
+/* Remove peer from the adjacency, which is freed with its last peer.  */
+static void
+bgp_adj_out_leave (struct bgp_node *rn, struct bgp_adj_out *adj,
+		   struct peer *peer)
+{
+  adj->peers[BGP_ADJ_INDEX_WORD (peer->adj_index)]
+    &= ~BGP_ADJ_INDEX_BIT (peer->adj_index);
+
+  if (--adj->count == 0)
+    {
+      BGP_ADJ_OUT_DEL (rn, adj);
+      bgp_attr_unintern (adj->attr);
+      bgp_adj_out_free (adj);
+    }
 
-  return (adj->adv 
-	  ? (adj->adv->baa ? 1 : 0)
-	  : (adj->attr ? 1 : 0));
+  peer_unlock (peer); /* adj_out peer reference */
+  bgp_unlock_node (rn);
+}
+
+/* Queue a new advertisement for peer.  */
+static struct bgp_advertise *
+bgp_adj_out_adv_new (struct bgp_node *rn, struct peer *peer)
+{
+  struct bgp_advertise *adv;
+
+  adv = bgp_advertise_new ();
+  adv->rn = rn;
+  adv->peer = peer_lock (peer); /* bgp_advertise peer reference */
+
+  adv->rn_next = rn->adv;
+  if (rn->adv)
+    rn->adv->rn_prev = adv;
+  rn->adv = adv;
+  bgp_lock_node (rn);
+
+  return adv;
+}
+
+int
+bgp_adj_out_lookup (struct peer *peer, struct prefix *p,
+		    afi_t afi, safi_t safi, struct bgp_node *rn)
+{
+  struct bgp_advertise *adv;
+
+  if ((adv = bgp_adj_out_adv (rn, peer)) != NULL)
+    return adv->baa ? 1 : 0;
+
+  return bgp_adj_out_peer (rn, peer) ? 1 : 0;
 }
 
 struct bgp_advertise *
-bgp_advertise_clean (struct peer *peer, struct bgp_adj_out *adj,
+bgp_advertise_clean (struct peer *peer, struct bgp_advertise *adv,
 		     afi_t afi, safi_t safi)
 {
-  struct bgp_advertise *adv;
   struct bgp_advertise_attr *baa;
   struct bgp_advertise *next;
+  struct bgp_node *rn;
 
-  adv = adj->adv;
   baa = adv->baa;
   next = NULL;
 
@@ -205,9 +321,19 @@ bgp_advertise_clean (struct peer *peer, struct bgp_adj_out *adj,
   /* Unlink myself from advertisement FIFO.  */
   FIFO_DEL (adv);
 
+  /* Unlink myself from the prefix.  */
+  rn = adv->rn;
+  if (adv->rn_next)
+    adv->rn_next->rn_prev = adv->rn_prev;
+  if (adv->rn_prev)
+    adv->rn_prev->rn_next = adv->rn_next;
+  else
+    rn->adv = adv->rn_next;
+
   /* Free memory.  */
-  bgp_advertise_free (adj->adv);
-  adj->adv = NULL;
+  peer_unlock (adv->peer); /* bgp_advertise peer reference */
+  bgp_advertise_free (adv);
+  bgp_unlock_node (rn);
 
   return next;
 }
@@ -217,39 +343,15 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
 		 struct attr *attr, afi_t afi, safi_t safi,
 		 struct bgp_info *binfo)
 {
-  struct bgp_adj_out *adj = NULL;
   struct bgp_advertise *adv;
+  struct bgp_advertise *old;
 
   if (DISABLE_BGP_ANNOUNCE)
     return;
 
-  /* Look for adjacency information. */
-  if (rn)
-    {
-      for (adj = rn->adj_out; adj; adj = adj->next)
-	if (adj->peer == peer)
-	  break;
-    }
-
-  if (! adj)
-    {
-      adj = XCALLOC (MTYPE_BGP_ADJ_OUT, sizeof (struct bgp_adj_out));
-      adj->peer = peer_lock (peer); /* adj_out peer reference */
-      
-      if (rn)
-        {
-          BGP_ADJ_OUT_ADD (rn, adj);
-          bgp_lock_node (rn);
-        }
-    }
-
-  if (adj->adv)
-    bgp_advertise_clean (peer, adj, afi, safi);
-  
-  adj->adv = bgp_advertise_new ();
+  old = bgp_adj_out_adv (rn, peer);
 
-  adv = adj->adv;
-  adv->rn = rn;
+  adv = bgp_adj_out_adv_new (rn, peer);
   
   assert (adv->binfo == NULL);
   adv->binfo = bgp_info_lock (binfo); /* bgp_info adj_out reference */
@@ -258,80 +360,180 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
     adv->baa = bgp_advertise_intern (peer->hash[afi][safi], attr);
   else
     adv->baa = baa_new ();
-  adv->adj = adj;
 
   /* Add new advertisement to advertisement attribute list. */
   bgp_advertise_add (adv->baa, adv);
 
   FIFO_ADD (&peer->sync[afi][safi]->update, &adv->fifo);
+
+  /* Replaces previous advertisement.  */
+  if (old)
+    {
+      struct bgp_adj_out *adj;
+
+      /* Only a pending update is superseded, not a withdraw. */
+      if (old->baa)
+	peer->update_suppressed++;
+      bgp_advertise_clean (peer, old, afi, safi);
+
+      /* The prefix changed back to what the peer already has before
+	 the intermediate state was sent, nothing needs to be sent.  */
+      adj = bgp_adj_out_peer (rn, peer);
+      if (adj && adv->baa->attr && adj->attr == adv->baa->attr)
+	{
+	  bgp_advertise_clean (peer, adv, afi, safi);
+	  return;
+	}
+    }
+
+  bgp_routeadv_update (peer);
 }
 
 void
 bgp_adj_out_unset (struct bgp_node *rn, struct peer *peer, struct prefix *p, 
 		   afi_t afi, safi_t safi)
 {
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
+  struct bgp_advertise *old;
 
   if (DISABLE_BGP_ANNOUNCE)
     return;
 
-  /* Lookup existing adjacency, if it is not there return immediately.  */
-  for (adj = rn->adj_out; adj; adj = adj->next)
-    if (adj->peer == peer)
-      break;
+  old = bgp_adj_out_adv (rn, peer);
 
-  if (! adj)
-    return;
-
-  /* Clearn up previous advertisement.  */
-  if (adj->adv)
-    bgp_advertise_clean (peer, adj, afi, safi);
-
-  if (adj->attr)
+  /* Withdraw is only needed when something was sent.  */
+  if (bgp_adj_out_peer (rn, peer))
     {
       /* We need advertisement structure.  */
-      adj->adv = bgp_advertise_new ();
-      adv = adj->adv;
-      adv->rn = rn;
-      adv->adj = adj;
+      adv = bgp_adj_out_adv_new (rn, peer);
 
       /* Add to synchronization entry for withdraw announcement.  */
       FIFO_ADD (&peer->sync[afi][safi]->withdraw, &adv->fifo);
 
       /* Schedule packet write. */
       BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      bgp_routeadv_update (peer);
     }
-  else
+
+  /* Clearn up previous advertisement.  */
+  if (old)
     {
-      /* Remove myself from adjacency. */
-      BGP_ADJ_OUT_DEL (rn, adj);
-      
-      /* Free allocated information.  */
-      bgp_adj_out_free (adj);
+      if (old->baa)
+	peer->update_suppressed++;
+      bgp_advertise_clean (peer, old, afi, safi);
+    }
+}
+
+/* Update of adv has been sent to peer, synchronize the adjacency.
+   Returns the next advertisement with the same attribute.  */
+struct bgp_advertise *
+bgp_adj_out_sent (struct peer *peer, struct bgp_advertise *adv,
+		  afi_t afi, safi_t safi)
+{
+  struct bgp_adj_out *adj;
+  struct bgp_node *rn = adv->rn;
+
+  adj = bgp_adj_out_peer (rn, peer);
 
-      bgp_unlock_node (rn);
+  if (! adj || adj->attr != adv->baa->attr)
+    {
+      bgp_adj_out_join (rn, peer, adv->baa->attr);
+
+      if (adj)
+	bgp_adj_out_leave (rn, adj, peer);
+      else
+	peer->scount[afi][safi]++;
     }
+
+  return bgp_advertise_clean (peer, adv, afi, safi);
 }
 
+/* Drop everything sent or pending to peer for this prefix.  */
 void
-bgp_adj_out_remove (struct bgp_node *rn, struct bgp_adj_out *adj, 
-		    struct peer *peer, afi_t afi, safi_t safi)
+bgp_adj_out_remove (struct bgp_node *rn, struct peer *peer,
+		    afi_t afi, safi_t safi)
 {
-  if (adj->attr)
-    bgp_attr_unintern (adj->attr);
+  struct bgp_advertise *adv;
+  struct bgp_adj_out *adj;
 
-  if (adj->adv)
-    bgp_advertise_clean (peer, adj, afi, safi);
+  bgp_lock_node (rn);
+
+  if ((adv = bgp_adj_out_adv (rn, peer)) != NULL)
+    bgp_advertise_clean (peer, adv, afi, safi);
+
+  if ((adj = bgp_adj_out_peer (rn, peer)) != NULL)
+    bgp_adj_out_leave (rn, adj, peer);
 
-  BGP_ADJ_OUT_DEL (rn, adj);
-  bgp_adj_out_free (adj);
+  bgp_unlock_node (rn);
 }
-
+
+/* Add each peer's share of the Adj-RIB-Out of table to memory, which is
+   indexed by peer->adj_index.  */
+void
+bgp_adj_out_memory (struct bgp_table *table, unsigned long *memory, int size)
+{
+  struct bgp_node *rn;
+  struct bgp_adj_out *adj;
+  struct bgp_advertise *adv;
+  unsigned long share;
+  int i;
+  int w;
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    {
+      for (adj = rn->adj_out; adj; adj = adj->next)
+	{
+	  share = BGP_ADJ_OUT_SIZE (adj->size) / adj->count;
+
+	  for (w = 0; w < adj->size; w++)
+	    if (adj->peers[w])
+	      for (i = w * 32; i < (w + 1) * 32 && i < size; i++)
+		if (adj->peers[w] & BGP_ADJ_INDEX_BIT (i))
+		  memory[i] += share;
+	}
+
+      for (adv = rn->adv; adv; adv = adv->rn_next)
+	if (adv->peer->adj_index < size)
+	  memory[adv->peer->adj_index] += sizeof (struct bgp_advertise);
+    }
+}
+
+/* Allocate an Adj-RIB-Out index for a new peer.  */
+int
+bgp_adj_index_get (struct bgp *bgp)
+{
+  int w;
+  int i;
+
+  for (w = 0; w < bgp->adj_index_size; w++)
+    if (bgp->adj_index[w] != 0xffffffff)
+      for (i = w * 32; i < (w + 1) * 32; i++)
+	if (! (bgp->adj_index[w] & BGP_ADJ_INDEX_BIT (i)))
+	  {
+	    bgp->adj_index[w] |= BGP_ADJ_INDEX_BIT (i);
+	    return i;
+	  }
+
+  bgp->adj_index = XREALLOC (MTYPE_BGP_ADJ_INDEX, bgp->adj_index,
+			     (w + 1) * sizeof (u_int32_t));
+  bgp->adj_index[w] = BGP_ADJ_INDEX_BIT (0);
+  bgp->adj_index_size = w + 1;
+
+  return w * 32;
+}
+
+void
+bgp_adj_index_release (struct bgp *bgp, int index)
+{
+  if (BGP_ADJ_INDEX_WORD (index) < bgp->adj_index_size)
+    bgp->adj_index[BGP_ADJ_INDEX_WORD (index)] &= ~BGP_ADJ_INDEX_BIT (index);
+}
+
 void
 bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
 {
   struct bgp_adj_in *adj;
+  struct bgp_adj_in **head;
 
   for (adj = rn->adj_in; adj; adj = adj->next)
     {
@@ -348,16 +550,33 @@ bgp_adj_in_set (struct bgp_node *rn, struct peer *peer, struct attr *attr)
   adj = XCALLOC (MTYPE_BGP_ADJ_IN, sizeof (struct bgp_adj_in));
   adj->peer = peer_lock (peer); /* adj_in peer reference */
   adj->attr = bgp_attr_intern (attr);
+  adj->rn = rn;
   BGP_ADJ_IN_ADD (rn, adj);
   bgp_lock_node (rn);
+
+  /* Index it in the peer's Adj-RIB-In.  */
+  head = &peer->adj_in[rn->table->afi][rn->table->safi];
+  adj->peer_next = *head;
+  if (*head)
+    (*head)->peer_prev = adj;
+  *head = adj;
 }
 
 void
 bgp_adj_in_remove (struct bgp_node *rn, struct bgp_adj_in *bai)
 {
+  struct peer *peer = bai->peer;
+
+  if (bai->peer_next)
+    bai->peer_next->peer_prev = bai->peer_prev;
+  if (bai->peer_prev)
+    bai->peer_prev->peer_next = bai->peer_next;
+  else
+    peer->adj_in[rn->table->afi][rn->table->safi] = bai->peer_next;
+
   bgp_attr_unintern (bai->attr);
   BGP_ADJ_IN_DEL (rn, bai);
-  peer_unlock (bai->peer); /* adj_in peer reference */
+  peer_unlock (peer); /* adj_in peer reference */
   XFREE (MTYPE_BGP_ADJ_IN, bai);
 }
 
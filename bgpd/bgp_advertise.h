@@ -50,11 +50,15 @@ struct bgp_advertise
   struct bgp_advertise *next;
   struct bgp_advertise *prev;
 
+  /* Link list of advertisements pending for the same prefix.  */
+  struct bgp_advertise *rn_next;
+  struct bgp_advertise *rn_prev;
+
   /* Prefix information.  */
   struct bgp_node *rn;
 
-  /* Reference pointer.  */
-  struct bgp_adj_out *adj;
+  /* Peer to be advertised to.  */
+  struct peer *peer;
 
   /* Advertisement attribute.  */
   struct bgp_advertise_attr *baa;
@@ -63,23 +67,36 @@ struct bgp_advertise
   struct bgp_info *binfo;
 };
 
-/* BGP adjacency out.  */
+/* BGP adjacency out.  Peers which were sent the same attribute for a
+   prefix share one entry, they are kept in a bitmap indexed by
+   peer->adj_index.  */
 struct bgp_adj_out
 {
   /* Lined list pointer.  */
   struct bgp_adj_out *next;
   struct bgp_adj_out *prev;
 
-  /* Advertised peer.  */
-  struct peer *peer;
-
   /* Advertised attribute.  */
   struct attr *attr;
 
-  /* Advertisement information.  */
-  struct bgp_advertise *adv;
+  /* Number of peers, and size of the bitmap in words.  */
+  u_int16_t count;
+  u_int16_t size;
+
+  /* Advertised peers.  */
+  u_int32_t peers[];
 };
 
+#define BGP_ADJ_OUT_SIZE(W) \
+  (sizeof (struct bgp_adj_out) + (W) * sizeof (u_int32_t))
+
+#define BGP_ADJ_INDEX_WORD(I)  ((I) / 32)
+#define BGP_ADJ_INDEX_BIT(I)   (1U << ((I) % 32))
+
+#define BGP_ADJ_OUT_CHECK(A,I) \
+  (BGP_ADJ_INDEX_WORD (I) < (A)->size \
+   && ((A)->peers[BGP_ADJ_INDEX_WORD (I)] & BGP_ADJ_INDEX_BIT (I)))
+
 /* BGP adjacency in. */
 struct bgp_adj_in
 {
@@ -87,6 +104,13 @@ struct bgp_adj_in
   struct bgp_adj_in *next;
   struct bgp_adj_in *prev;
 
+  /* Linked list of the received peer's Adj-RIB-In.  */
+  struct bgp_adj_in *peer_next;
+  struct bgp_adj_in *peer_prev;
+
+  /* Prefix information.  */
+  struct bgp_node *rn;
+
   /* Received peer.  */
   struct peer *peer;
 
@@ -132,17 +156,25 @@ extern void bgp_adj_out_set (struct bgp_node *, struct peer *, struct prefix *,
 		      struct attr *, afi_t, safi_t, struct bgp_info *);
 extern void bgp_adj_out_unset (struct bgp_node *, struct peer *, struct prefix *,
 			afi_t, safi_t);
-extern void bgp_adj_out_remove (struct bgp_node *, struct bgp_adj_out *, 
-			 struct peer *, afi_t, safi_t);
+extern void bgp_adj_out_remove (struct bgp_node *, struct peer *,
+				afi_t, safi_t);
 extern int bgp_adj_out_lookup (struct peer *, struct prefix *, afi_t, safi_t,
 			struct bgp_node *);
+extern struct bgp_adj_out *bgp_adj_out_peer (struct bgp_node *, struct peer *);
+extern struct bgp_advertise *bgp_adj_out_sent (struct peer *,
+					       struct bgp_advertise *,
+					       afi_t, safi_t);
+extern void bgp_adj_out_memory (struct bgp_table *, unsigned long *, int);
+
+extern int bgp_adj_index_get (struct bgp *);
+extern void bgp_adj_index_release (struct bgp *, int);
 
 extern void bgp_adj_in_set (struct bgp_node *, struct peer *, struct attr *);
 extern void bgp_adj_in_unset (struct bgp_node *, struct peer *);
 extern void bgp_adj_in_remove (struct bgp_node *, struct bgp_adj_in *);
 
 extern struct bgp_advertise *
-bgp_advertise_clean (struct peer *, struct bgp_adj_out *, afi_t, safi_t);
+bgp_advertise_clean (struct peer *, struct bgp_advertise *, afi_t, safi_t);
 
 extern void bgp_sync_init (struct peer *);
 extern void bgp_sync_delete (struct peer *);
@@ -1498,6 +1498,42 @@ aspath_cmp_left_confed (const struct aspath *aspath1, const struct aspath *aspat
   return 0;
 }
 
+/* Leftmost AS used to group paths for the MED check: the first AS of
+   the first AS_SEQUENCE past the confederation segments, as by
+   aspath_cmp_left, so that "(65001) 100", "(65002) 100" and "100" are
+   all grouped by 100.  Only a path without such an AS_SEQUENCE is
+   grouped by the first AS of its leading AS_CONFED_SEQUENCE, as by
+   aspath_cmp_left_confed.  Returns the type of the segment the AS was
+   taken from, AS_SEQUENCE or AS_CONFED_SEQUENCE, or 0 if the path has
+   no such AS. */
+int
+aspath_left_as (const struct aspath *aspath, as_t *as)
+{
+  const struct assegment *seg;
+
+  if (! (aspath && aspath->segments))
+    return 0;
+
+  for (seg = aspath->segments; seg; seg = seg->next)
+    if (seg->type != AS_CONFED_SEQUENCE && seg->type != AS_CONFED_SET)
+      break;
+
+  if (seg && seg->type == AS_SEQUENCE && seg->length)
+    {
+      *as = seg->as[0];
+      return AS_SEQUENCE;
+    }
+
+  seg = aspath->segments;
+  if (seg->type == AS_CONFED_SEQUENCE && seg->length)
+    {
+      *as = seg->as[0];
+      return AS_CONFED_SEQUENCE;
+    }
+
+  return 0;
+}
+
 /* Delete all leading AS_CONFED_SEQUENCE/SET segments from aspath.
  * See RFC3065, 6.1 c1 */
 struct aspath *
@@ -321,6 +321,44 @@ bgp_attr_dup (struct attr *new, struct attr *orig)
     }
 }
 
+void
+bgp_attr_scratch_init (struct bgp_attr_scratch *scratch)
+{
+  scratch->used = 0;
+}
+
+/* As bgp_attr_dup, but take the copy of the extra attributes from the
+ * scratch slots, falling back to the heap once they are exhausted.
+ */
+void
+bgp_attr_scratch_dup (struct bgp_attr_scratch *scratch,
+                      struct attr *new, struct attr *orig)
+{
+  *new = *orig;
+  if (orig->extra)
+    {
+      if (scratch->used < BGP_ATTR_SCRATCH_SLOTS)
+        new->extra = &scratch->extra[scratch->used++];
+      else
+        new->extra = bgp_attr_extra_new();
+      *new->extra = *orig->extra;
+    }
+}
+
+/* Release the extra attributes of a temporary copy.  Slots are only
+ * reclaimed by bgp_attr_scratch_init, anything else (an overflow copy, or
+ * an extra allocated by a route-map setter) goes back to the heap.
+ */
+void
+bgp_attr_scratch_free (struct bgp_attr_scratch *scratch, struct attr *attr)
+{
+  if (attr->extra >= &scratch->extra[0]
+      && attr->extra < &scratch->extra[BGP_ATTR_SCRATCH_SLOTS])
+    attr->extra = NULL;
+  else
+    bgp_attr_extra_free (attr);
+}
+
 unsigned long int
 attr_count (void)
 {
@@ -2450,3 +2488,216 @@ bgp_dump_routes_attr (struct stream *s, struct attr *attr,
   len = stream_get_endp (s) - cp - 2;
   stream_putw_at (s, cp, len);
 }
+
+/* Write attr to s in the form kept by the RIB checkpoint.  Unlike the
+   UPDATE encoding this is a plain copy of the stored attribute,
+   including what only exists locally such as the weight, so that
+   bgp_attr_checkpoint_get gives back an attribute which interns to
+   the same one.  The stream is grown as needed. */
+void
+bgp_attr_checkpoint_put (struct stream *s, struct attr *attr)
+{
+  struct attr_extra *attre = attr->extra;
+  size_t need;
+  size_t lenp;
+  u_char present = 0;
+
+  need = 64;
+  if (attr->aspath)
+    {
+      SET_FLAG (present, BGP_CHECKPOINT_ATTR_ASPATH);
+      need += aspath_size (attr->aspath) * 2;	/* only an estimate */
+    }
+  if (attr->community)
+    {
+      SET_FLAG (present, BGP_CHECKPOINT_ATTR_COMMUNITY);
+      need += attr->community->size * 4;
+    }
+  if (attre)
+    {
+      SET_FLAG (present, BGP_CHECKPOINT_ATTR_EXTRA);
+      need += 64;
+      if (attre->ecommunity)
+	{
+	  SET_FLAG (present, BGP_CHECKPOINT_ATTR_ECOMMUNITY);
+	  need += attre->ecommunity->size * ECOMMUNITY_SIZE;
+	}
+      if (attre->cluster)
+	{
+	  SET_FLAG (present, BGP_CHECKPOINT_ATTR_CLUSTER);
+	  need += attre->cluster->length;
+	}
+      if (attre->transit)
+	{
+	  SET_FLAG (present, BGP_CHECKPOINT_ATTR_TRANSIT);
+	  need += attre->transit->length;
+	}
+    }
+  if (STREAM_WRITEABLE (s) < need)
+    stream_resize (s, stream_get_endp (s) + need);
+
+  stream_putc (s, present);
+  stream_putl (s, attr->flag);
+  stream_putc (s, attr->origin);
+  stream_put_in_addr (s, &attr->nexthop);
+  stream_putl (s, attr->med);
+  stream_putl (s, attr->local_pref);
+  stream_putc (s, attr->pathlimit.ttl);
+  stream_putl (s, attr->pathlimit.as);
+
+  if (attr->aspath)
+    {
+      lenp = stream_get_endp (s);
+      stream_putw (s, 0);
+      stream_putw_at (s, lenp, aspath_put (s, attr->aspath, 1));
+    }
+  if (attr->community)
+    {
+      stream_putw (s, attr->community->size * 4);
+      stream_put (s, attr->community->val, attr->community->size * 4);
+    }
+
+  if (! attre)
+    return;
+
+  stream_putl (s, attre->aggregator_as);
+  stream_put_in_addr (s, &attre->aggregator_addr);
+  stream_put_in_addr (s, &attre->originator_id);
+  stream_putl (s, attre->weight);
+  stream_putc (s, attre->mp_nexthop_len);
+  stream_put_in_addr (s, &attre->mp_nexthop_global_in);
+  stream_put_in_addr (s, &attre->mp_nexthop_local_in);
+#ifdef HAVE_IPV6
+  stream_put (s, &attre->mp_nexthop_global, IPV6_MAX_BYTELEN);
+  stream_put (s, &attre->mp_nexthop_local, IPV6_MAX_BYTELEN);
+#else
+  stream_put (s, NULL, IPV6_MAX_BYTELEN * 2);
+#endif /* HAVE_IPV6 */
+
+  if (attre->ecommunity)
+    {
+      stream_putw (s, attre->ecommunity->size * ECOMMUNITY_SIZE);
+      stream_put (s, attre->ecommunity->val,
+		  attre->ecommunity->size * ECOMMUNITY_SIZE);
+    }
+  if (attre->cluster)
+    {
+      stream_putw (s, attre->cluster->length);
+      stream_put (s, attre->cluster->list, attre->cluster->length);
+    }
+  if (attre->transit)
+    {
+      stream_putw (s, attre->transit->length);
+      stream_put (s, attre->transit->val, attre->transit->length);
+    }
+}
+
+/* Length prefixed part of a checkpointed attribute.  Returns the
+   length, or -1 if the data is truncated. */
+static int
+bgp_attr_checkpoint_getw (struct stream *s)
+{
+  u_int16_t length;
+
+  if (STREAM_READABLE (s) < 2)
+    return -1;
+  length = stream_getw (s);
+  if (STREAM_READABLE (s) < length)
+    return -1;
+  return length;
+}
+
+/* Read an attribute written by bgp_attr_checkpoint_put into attr.  As
+   with bgp_attr_parse the parts are returned interned, the caller
+   releases them once the attribute itself has been interned.  Returns
+   -1 if the data is malformed. */
+int
+bgp_attr_checkpoint_get (struct stream *s, struct attr *attr)
+{
+  struct attr_extra *attre;
+  struct transit *transit;
+  u_char present;
+  int length;
+
+  memset (attr, 0, sizeof (struct attr));
+
+  if (STREAM_READABLE (s) < 23)
+    return -1;
+  present = stream_getc (s);
+  attr->flag = stream_getl (s);
+  attr->origin = stream_getc (s);
+  attr->nexthop.s_addr = stream_get_ipv4 (s);
+  attr->med = stream_getl (s);
+  attr->local_pref = stream_getl (s);
+  attr->pathlimit.ttl = stream_getc (s);
+  attr->pathlimit.as = stream_getl (s);
+
+  if (CHECK_FLAG (present, BGP_CHECKPOINT_ATTR_ASPATH))
+    {
+      if ((length = bgp_attr_checkpoint_getw (s)) < 0)
+	return -1;
+      attr->aspath = aspath_parse (s, length, 1);
+      if (! attr->aspath)
+	return -1;
+    }
+  if (CHECK_FLAG (present, BGP_CHECKPOINT_ATTR_COMMUNITY))
+    {
+      if ((length = bgp_attr_checkpoint_getw (s)) < 0)
+	return -1;
+      attr->community = community_parse ((u_int32_t *) stream_pnt (s),
+					 length);
+      if (! attr->community)
+	return -1;
+      stream_forward_getp (s, length);
+    }
+
+  if (! CHECK_FLAG (present, BGP_CHECKPOINT_ATTR_EXTRA))
+    return 0;
+
+  attre = bgp_attr_extra_get (attr);
+  if (STREAM_READABLE (s) < 25 + IPV6_MAX_BYTELEN * 2)
+    return -1;
+  attre->aggregator_as = stream_getl (s);
+  attre->aggregator_addr.s_addr = stream_get_ipv4 (s);
+  attre->originator_id.s_addr = stream_get_ipv4 (s);
+  attre->weight = stream_getl (s);
+  attre->mp_nexthop_len = stream_getc (s);
+  attre->mp_nexthop_global_in.s_addr = stream_get_ipv4 (s);
+  attre->mp_nexthop_local_in.s_addr = stream_get_ipv4 (s);
+#ifdef HAVE_IPV6
+  stream_get (&attre->mp_nexthop_global, s, IPV6_MAX_BYTELEN);
+  stream_get (&attre->mp_nexthop_local, s, IPV6_MAX_BYTELEN);
+#else
+  stream_forward_getp (s, IPV6_MAX_BYTELEN * 2);
+#endif /* HAVE_IPV6 */
+
+  if (CHECK_FLAG (present, BGP_CHECKPOINT_ATTR_ECOMMUNITY))
+    {
+      if ((length = bgp_attr_checkpoint_getw (s)) < 0)
+	return -1;
+      attre->ecommunity = ecommunity_parse (stream_pnt (s), length);
+      if (! attre->ecommunity)
+	return -1;
+      stream_forward_getp (s, length);
+    }
+  if (CHECK_FLAG (present, BGP_CHECKPOINT_ATTR_CLUSTER))
+    {
+      if ((length = bgp_attr_checkpoint_getw (s)) < 0 || length % 4)
+	return -1;
+      attre->cluster = cluster_parse ((struct in_addr *) stream_pnt (s),
+				      length);
+      stream_forward_getp (s, length);
+    }
+  if (CHECK_FLAG (present, BGP_CHECKPOINT_ATTR_TRANSIT))
+    {
+      if ((length = bgp_attr_checkpoint_getw (s)) <= 0)
+	return -1;
+      transit = XCALLOC (MTYPE_TRANSIT, sizeof (struct transit));
+      transit->val = XMALLOC (MTYPE_TRANSIT_VAL, length);
+      transit->length = length;
+      stream_get (transit->val, s, length);
+      attre->transit = transit_intern (transit);
+    }
+
+  return 0;
+}
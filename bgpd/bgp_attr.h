@@ -120,6 +120,27 @@ struct attr
   u_char origin;
 };
 
+/* Parts present in a checkpointed attribute. */
+#define BGP_CHECKPOINT_ATTR_ASPATH       (1 << 0)
+#define BGP_CHECKPOINT_ATTR_COMMUNITY    (1 << 1)
+#define BGP_CHECKPOINT_ATTR_EXTRA        (1 << 2)
+#define BGP_CHECKPOINT_ATTR_ECOMMUNITY   (1 << 3)
+#define BGP_CHECKPOINT_ATTR_CLUSTER      (1 << 4)
+#define BGP_CHECKPOINT_ATTR_TRANSIT      (1 << 5)
+
+/* Scratch storage for the temporary attribute copies made while running
+ * outbound policy on an announcement.  Extras are handed out from a fixed
+ * set of slots, normally on the caller's stack, so evaluating a route for
+ * a peer does not touch the heap unless policy needs more than that.
+ */
+#define BGP_ATTR_SCRATCH_SLOTS 2
+
+struct bgp_attr_scratch
+{
+  struct attr_extra extra[BGP_ATTR_SCRATCH_SLOTS];
+  int used;
+};
+
 /* Router Reflector related structure. */
 struct cluster_list
 {
@@ -146,6 +167,10 @@ extern int bgp_attr_check (struct peer *, struct attr *);
 extern struct attr_extra *bgp_attr_extra_get (struct attr *);
 extern void bgp_attr_extra_free (struct attr *);
 extern void bgp_attr_dup (struct attr *, struct attr *);
+extern void bgp_attr_scratch_init (struct bgp_attr_scratch *);
+extern void bgp_attr_scratch_dup (struct bgp_attr_scratch *,
+                                  struct attr *, struct attr *);
+extern void bgp_attr_scratch_free (struct bgp_attr_scratch *, struct attr *);
 extern struct attr *bgp_attr_intern (struct attr *attr);
 extern void bgp_attr_unintern (struct attr *);
 extern void bgp_attr_flush (struct attr *);
@@ -163,6 +188,8 @@ extern bgp_size_t bgp_packet_withdraw (struct peer *peer, struct stream *s,
                                 struct prefix_rd *, u_char *);
 extern void bgp_dump_routes_attr (struct stream *, struct attr *,
 				  struct prefix *);
+extern void bgp_attr_checkpoint_put (struct stream *, struct attr *);
+extern int bgp_attr_checkpoint_get (struct stream *, struct attr *);
 extern int attrhash_cmp (const void *, const void *);
 extern unsigned int attrhash_key_make (void *);
 extern void attr_show_all (struct vty *);
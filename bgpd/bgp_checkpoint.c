@@ -0,0 +1,881 @@
+/* BGP RIB checkpoint and warm restart
+   Copyright (C) 2026 The Quagga project
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#include <zebra.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "stream.h"
+#include "sockunion.h"
+#include "command.h"
+#include "prefix.h"
+#include "thread.h"
+#include "linklist.h"
+#include "vector.h"
+#include "memory.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_community.h"
+#include "bgpd/bgp_ecommunity.h"
+#include "bgpd/bgp_fsm.h"
+#include "bgpd/bgp_checkpoint.h"
+
+/* The tables kept in a checkpoint, in the order they are written. */
+static const struct
+{
+  afi_t afi;
+  safi_t safi;
+} bgp_checkpoint_tables[] =
+{
+  { AFI_IP,  SAFI_UNICAST   },
+  { AFI_IP,  SAFI_MULTICAST },
+  { AFI_IP6, SAFI_UNICAST   },
+  { AFI_IP6, SAFI_MULTICAST },
+};
+#define BGP_CHECKPOINT_TABLES \
+  (sizeof (bgp_checkpoint_tables) / sizeof (bgp_checkpoint_tables[0]))
+
+struct bgp_checkpoint
+{
+  char *filename;
+  char *tmpname;
+  unsigned int interval;
+  struct thread *t_interval;
+
+  /* Checkpoint being written.  Like a routes-mrt dump the RIB is
+     walked in slices from a background thread, 'rn' is the locked node
+     to resume from.  Peers are numbered as they are first met, those
+     with checkpoint_gen equal to 'gen' have their PEER record in the
+     file already. */
+  FILE *fp;
+  struct bgp *bgp;
+  unsigned int table;
+  struct bgp_node *rn;
+  u_int32_t gen;
+  u_int16_t peers;
+  struct stream *obuf;
+  struct thread *t_walk;
+  struct timeval start;
+  unsigned long routes;
+  unsigned long paths;
+  unsigned long bytes;
+
+  /* Last completed checkpoint. */
+  time_t last_time;
+  struct timeval last_duration;
+  unsigned long last_routes;
+  unsigned long last_paths;
+  unsigned long last_bytes;
+
+  /* Paths preloaded at startup. */
+  time_t restore_time;
+  struct timeval restore_duration;
+  unsigned long restore_paths;
+  unsigned long restore_skipped;
+  unsigned int restore_peers;
+};
+
+static struct bgp_checkpoint bgp_checkpoint;
+
+static int bgp_checkpoint_walk (struct thread *);
+
+static void
+bgp_checkpoint_elapsed (struct timeval *start, struct timeval *elapsed)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  elapsed->tv_sec = now.tv_sec - start->tv_sec;
+  elapsed->tv_usec = now.tv_usec - start->tv_usec;
+  if (elapsed->tv_usec < 0)
+    {
+      elapsed->tv_sec--;
+      elapsed->tv_usec += 1000000;
+    }
+}
+
+/* Only paths learned from peers are kept, the rest is originated again
+   from the configuration. */
+static int
+bgp_checkpoint_path (struct bgp *bgp, struct bgp_info *ri)
+{
+  return (ri->type == ZEBRA_ROUTE_BGP
+	  && ri->sub_type == BGP_ROUTE_NORMAL
+	  && ri->peer != bgp->peer_self
+	  && ! CHECK_FLAG (ri->flags, BGP_INFO_HISTORY | BGP_INFO_DAMPED
+			   | BGP_INFO_REMOVED));
+}
+
+static void
+bgp_checkpoint_put (struct bgp_checkpoint *ckpt, struct stream *s)
+{
+  stream_putl_at (s, 1, stream_get_endp (s) - BGP_CHECKPOINT_RECORD_HEADER);
+  fwrite (STREAM_DATA (s), stream_get_endp (s), 1, ckpt->fp);
+  ckpt->bytes += stream_get_endp (s);
+}
+
+static void
+bgp_checkpoint_peer (struct bgp_checkpoint *ckpt, struct peer *peer)
+{
+  struct stream *s = ckpt->obuf;
+
+  peer->checkpoint_gen = ckpt->gen;
+  peer->checkpoint_index = ckpt->peers++;
+
+  stream_reset (s);
+  stream_putc (s, BGP_CHECKPOINT_PEER);
+  stream_putl (s, 0);
+  stream_putw (s, peer->checkpoint_index);
+  stream_putl (s, peer->as);
+  if (sockunion_family (&peer->su) == AF_INET)
+    {
+      stream_putw (s, AFI_IP);
+      stream_put_in_addr (s, &peer->su.sin.sin_addr);
+    }
+#ifdef HAVE_IPV6
+  else if (sockunion_family (&peer->su) == AF_INET6)
+    {
+      stream_putw (s, AFI_IP6);
+      stream_put (s, &peer->su.sin6.sin6_addr, IPV6_MAX_BYTELEN);
+    }
+#endif /* HAVE_IPV6 */
+  else
+    return;
+
+  bgp_checkpoint_put (ckpt, s);
+}
+
+/* Write the ROUTE record of one table node. */
+static void
+bgp_checkpoint_node (struct bgp_checkpoint *ckpt, struct bgp_node *rn)
+{
+  struct stream *s = ckpt->obuf;
+  struct bgp_info *ri;
+  size_t countp;
+  u_int16_t count = 0;
+
+  /* The peers met for the first time go ahead of the record. */
+  for (ri = rn->info; ri; ri = ri->next)
+    if (bgp_checkpoint_path (ckpt->bgp, ri)
+	&& ri->peer->checkpoint_gen != ckpt->gen)
+      bgp_checkpoint_peer (ckpt, ri->peer);
+
+  stream_reset (s);
+  stream_putc (s, BGP_CHECKPOINT_ROUTE);
+  stream_putl (s, 0);
+  stream_putw (s, bgp_checkpoint_tables[ckpt->table].afi);
+  stream_putc (s, bgp_checkpoint_tables[ckpt->table].safi);
+  stream_putc (s, rn->p.prefixlen);
+  stream_put (s, &rn->p.u.prefix, PSIZE (rn->p.prefixlen));
+  countp = stream_get_endp (s);
+  stream_putw (s, 0);
+
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      if (! bgp_checkpoint_path (ckpt->bgp, ri))
+	continue;
+
+      if (STREAM_WRITEABLE (s) < 16)
+	stream_resize (s, stream_get_size (s) * 2);
+      stream_putw (s, ri->peer->checkpoint_index);
+      stream_putc (s, CHECK_FLAG (ri->flags, BGP_INFO_VALID)
+		   ? BGP_CHECKPOINT_PATH_VALID : 0);
+      stream_putl (s, ri->uptime);
+      bgp_attr_checkpoint_put (s, ri->attr);
+      count++;
+    }
+
+  if (! count)
+    return;
+
+  stream_putw_at (s, countp, count);
+  bgp_checkpoint_put (ckpt, s);
+  ckpt->routes++;
+  ckpt->paths += count;
+}
+
+/* Release the walk state.  A completed checkpoint replaces the
+   previous one, an abandoned one is removed. */
+static void
+bgp_checkpoint_stop (struct bgp_checkpoint *ckpt, int completed)
+{
+  int error = 0;
+
+  THREAD_OFF (ckpt->t_walk);
+
+  if (ckpt->rn)
+    {
+      bgp_unlock_node (ckpt->rn);
+      ckpt->rn = NULL;
+    }
+  if (ckpt->bgp)
+    {
+      bgp_unlock (ckpt->bgp);
+      ckpt->bgp = NULL;
+    }
+  if (! ckpt->fp)
+    return;
+
+  if (fflush (ckpt->fp) != 0 || ferror (ckpt->fp)
+      || fsync (fileno (ckpt->fp)) < 0)
+    error = errno ? errno : EIO;
+  fclose (ckpt->fp);
+  ckpt->fp = NULL;
+
+  if (completed && ! error && rename (ckpt->tmpname, ckpt->filename) < 0)
+    error = errno;
+  if (! completed || error)
+    {
+      if (error)
+	zlog_warn ("BGP checkpoint %s: %s", ckpt->filename,
+		   safe_strerror (error));
+      unlink (ckpt->tmpname);
+      return;
+    }
+
+  bgp_checkpoint_elapsed (&ckpt->start, &ckpt->last_duration);
+  ckpt->last_time = time (NULL);
+  ckpt->last_routes = ckpt->routes;
+  ckpt->last_paths = ckpt->paths;
+  ckpt->last_bytes = ckpt->bytes;
+
+  zlog_info ("BGP checkpoint %s: %lu routes, %lu paths, %lu bytes "
+	     "in %ld.%03ld seconds", ckpt->filename,
+	     ckpt->routes, ckpt->paths, ckpt->bytes,
+	     (long) ckpt->last_duration.tv_sec,
+	     (long) ckpt->last_duration.tv_usec / 1000);
+}
+
+/* Open the temporary file and write the file header.  The walk itself
+   is left to the caller. */
+static int
+bgp_checkpoint_start (struct bgp_checkpoint *ckpt)
+{
+  struct bgp *bgp;
+  struct stream *s = ckpt->obuf;
+  mode_t oldumask;
+
+  bgp = bgp_get_default ();
+  if (! bgp)
+    return -1;
+
+  oldumask = umask (0777 & ~LOGFILE_MASK);
+  ckpt->fp = fopen (ckpt->tmpname, "w");
+  umask (oldumask);
+  if (! ckpt->fp)
+    {
+      zlog_warn ("BGP checkpoint %s: %s", ckpt->tmpname,
+		 safe_strerror (errno));
+      return -1;
+    }
+
+  bgp_lock (bgp);
+  ckpt->bgp = bgp;
+  ckpt->gen++;
+  ckpt->peers = 0;
+  ckpt->routes = 0;
+  ckpt->paths = 0;
+  ckpt->bytes = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &ckpt->start);
+
+  stream_reset (s);
+  stream_putl (s, BGP_CHECKPOINT_MAGIC);
+  stream_putw (s, BGP_CHECKPOINT_VERSION);
+  stream_putw (s, 0);
+  stream_putl (s, time (NULL));
+  stream_putl (s, bgp->as);
+  fwrite (STREAM_DATA (s), stream_get_endp (s), 1, ckpt->fp);
+  ckpt->bytes += stream_get_endp (s);
+
+  for (ckpt->table = 0; ckpt->table < BGP_CHECKPOINT_TABLES; ckpt->table++)
+    {
+      ckpt->rn = bgp_table_top (bgp->rib[bgp_checkpoint_tables[ckpt->table].afi]
+				        [bgp_checkpoint_tables[ckpt->table].safi]);
+      if (ckpt->rn)
+	break;
+    }
+
+  return 0;
+}
+
+/* Write the node the walk is at and move on, to the next table once
+   one is done.  Returns 0 when the walk is finished. */
+static int
+bgp_checkpoint_step (struct bgp_checkpoint *ckpt)
+{
+  struct bgp_table *table;
+
+  if (ckpt->rn->info)
+    bgp_checkpoint_node (ckpt, ckpt->rn);
+
+  ckpt->rn = bgp_route_next (ckpt->rn);
+  while (! ckpt->rn && ++ckpt->table < BGP_CHECKPOINT_TABLES)
+    {
+      table = ckpt->bgp->rib[bgp_checkpoint_tables[ckpt->table].afi]
+			    [bgp_checkpoint_tables[ckpt->table].safi];
+      ckpt->rn = bgp_table_top (table);
+    }
+
+  return ckpt->rn != NULL;
+}
+
+/* Close the file with the END record, which tells the restore the
+   checkpoint is complete. */
+static void
+bgp_checkpoint_end (struct bgp_checkpoint *ckpt)
+{
+  struct stream *s = ckpt->obuf;
+
+  stream_reset (s);
+  stream_putc (s, BGP_CHECKPOINT_END);
+  stream_putl (s, 0);
+  stream_putl (s, ckpt->routes);
+  stream_putl (s, ckpt->paths);
+  bgp_checkpoint_put (ckpt, s);
+
+  bgp_checkpoint_stop (ckpt, 1);
+}
+
+static int
+bgp_checkpoint_walk (struct thread *t)
+{
+  struct bgp_checkpoint *ckpt;
+
+  ckpt = THREAD_ARG (t);
+  ckpt->t_walk = NULL;
+
+  while (ckpt->rn)
+    if (! bgp_checkpoint_step (ckpt) || thread_should_yield (t))
+      break;
+
+  if (ckpt->rn)
+    ckpt->t_walk = thread_add_background (master, bgp_checkpoint_walk,
+					  ckpt, 0);
+  else
+    bgp_checkpoint_end (ckpt);
+
+  return 0;
+}
+
+static int
+bgp_checkpoint_timer (struct thread *t)
+{
+  struct bgp_checkpoint *ckpt;
+
+  ckpt = THREAD_ARG (t);
+  ckpt->t_interval = thread_add_timer (master, bgp_checkpoint_timer,
+				       ckpt, ckpt->interval);
+
+  if (ckpt->fp)
+    {
+      zlog_warn ("BGP checkpoint %s: previous checkpoint still in "
+		 "progress, skipping", ckpt->filename);
+      return 0;
+    }
+
+  if (bgp_checkpoint_start (ckpt) == 0)
+    ckpt->t_walk = thread_add_background (master, bgp_checkpoint_walk,
+					  ckpt, 0);
+  return 0;
+}
+
+/* Write a complete checkpoint now, without yielding, for bgpd going
+   down.  A checkpoint in progress is started over. */
+void
+bgp_checkpoint_write (void)
+{
+  struct bgp_checkpoint *ckpt = &bgp_checkpoint;
+
+  if (! ckpt->filename)
+    return;
+
+  bgp_checkpoint_stop (ckpt, 0);
+  if (bgp_checkpoint_start (ckpt) < 0)
+    return;
+
+  while (ckpt->rn)
+    if (! bgp_checkpoint_step (ckpt))
+      break;
+
+  bgp_checkpoint_end (ckpt);
+}
+
+/* Copy the next record of the mapped file at *pnt into s, its type
+   and length already read.  Returns the record type, 0 at the end of
+   the file and -1 if the record is truncated. */
+static int
+bgp_checkpoint_record (struct stream *s, u_char **pnt, u_char *end)
+{
+  u_char type;
+  u_int32_t length;
+
+  if (*pnt == end)
+    return 0;
+  if (end - *pnt < BGP_CHECKPOINT_RECORD_HEADER)
+    return -1;
+
+  stream_reset (s);
+  stream_put (s, *pnt, BGP_CHECKPOINT_RECORD_HEADER);
+  type = stream_getc (s);
+  length = stream_getl (s);
+  *pnt += BGP_CHECKPOINT_RECORD_HEADER;
+
+  if (length > (size_t) (end - *pnt))
+    return -1;
+  if (STREAM_WRITEABLE (s) < length)
+    stream_resize (s, stream_get_endp (s) + length);
+  stream_put (s, *pnt, length);
+  *pnt += length;
+
+  return type;
+}
+
+/* Map a PEER record to the configured peer with that address and AS,
+   if any, setting it in peers at the record's index. */
+static int
+bgp_checkpoint_restore_peer (struct bgp *bgp, struct stream *s,
+			     vector peers)
+{
+  union sockunion su;
+  struct peer *peer;
+  u_int16_t index;
+  as_t as;
+  afi_t afi;
+
+  if (STREAM_READABLE (s) < 8)
+    return -1;
+  index = stream_getw (s);
+  as = stream_getl (s);
+  afi = stream_getw (s);
+
+  memset (&su, 0, sizeof (union sockunion));
+  if (afi == AFI_IP && STREAM_READABLE (s) == 4)
+    {
+      su.sin.sin_family = AF_INET;
+      su.sin.sin_addr.s_addr = stream_get_ipv4 (s);
+    }
+#ifdef HAVE_IPV6
+  else if (afi == AFI_IP6 && STREAM_READABLE (s) == IPV6_MAX_BYTELEN)
+    {
+      su.sin6.sin6_family = AF_INET6;
+      stream_get (&su.sin6.sin6_addr, s, IPV6_MAX_BYTELEN);
+    }
+#endif /* HAVE_IPV6 */
+  else
+    return 0;
+
+  peer = peer_lookup (bgp, &su);
+  if (peer && peer->as == as)
+    vector_set_index (peers, index, peer);
+
+  return 0;
+}
+
+/* Preload the paths of a ROUTE record.  Paths of peers which are no
+   longer configured, or of address families no longer activated for
+   them, are skipped. */
+static int
+bgp_checkpoint_restore_route (struct bgp_checkpoint *ckpt, struct stream *s,
+			      vector peers)
+{
+  struct prefix p;
+  struct attr attr;
+  struct peer *peer;
+  u_int16_t count;
+  u_int16_t index;
+  u_char flags;
+  time_t uptime;
+  afi_t afi;
+  safi_t safi;
+  int ret;
+
+  if (STREAM_READABLE (s) < 4)
+    return -1;
+  afi = stream_getw (s);
+  safi = stream_getc (s);
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.prefixlen = stream_getc (s);
+  if (afi == AFI_IP && p.prefixlen <= IPV4_MAX_BITLEN)
+    p.family = AF_INET;
+#ifdef HAVE_IPV6
+  else if (afi == AFI_IP6 && p.prefixlen <= IPV6_MAX_BITLEN)
+    p.family = AF_INET6;
+#endif /* HAVE_IPV6 */
+  else
+    return 0;
+  if (safi != SAFI_UNICAST && safi != SAFI_MULTICAST)
+    return 0;
+  if (STREAM_READABLE (s) < (size_t) PSIZE (p.prefixlen) + 2)
+    return -1;
+  stream_get (&p.u.prefix, s, PSIZE (p.prefixlen));
+  count = stream_getw (s);
+
+  while (count--)
+    {
+      if (STREAM_READABLE (s) < 7)
+	return -1;
+      index = stream_getw (s);
+      flags = stream_getc (s);
+      uptime = stream_getl (s);
+
+      if (bgp_attr_checkpoint_get (s, &attr) < 0)
+	ret = -1;
+      else
+	{
+	  peer = vector_lookup (peers, index);
+	  if (peer && peer->afc[afi][safi]
+	      && bgp_update_stale (peer, &p, &attr, afi, safi,
+				   CHECK_FLAG (flags, BGP_CHECKPOINT_PATH_VALID),
+				   uptime) == 0)
+	    {
+	      peer->nsf[afi][safi] = 1;
+	      ckpt->restore_paths++;
+	    }
+	  else
+	    ckpt->restore_skipped++;
+	  ret = 0;
+	}
+
+      /* The parts were interned for us, as bgp_attr_parse does. */
+      if (attr.aspath)
+	aspath_unintern (attr.aspath);
+      if (attr.community)
+	community_unintern (attr.community);
+      if (attr.extra)
+	{
+	  if (attr.extra->ecommunity)
+	    ecommunity_unintern (attr.extra->ecommunity);
+	  if (attr.extra->cluster)
+	    cluster_unintern (attr.extra->cluster);
+	  if (attr.extra->transit)
+	    transit_unintern (attr.extra->transit);
+	  bgp_attr_extra_free (&attr);
+	}
+
+      if (ret < 0)
+	return -1;
+    }
+
+  return 0;
+}
+
+/* Whether paths of peer have been preloaded. */
+static int
+bgp_checkpoint_restored (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_UNICAST_MULTICAST; safi++)
+      if (peer->nsf[afi][safi])
+	return 1;
+  return 0;
+}
+
+/* Preload the paths of the last checkpoint into the RIB as stale,
+   once the configuration has been read.  Only done when bgpd starts,
+   not when the configuration is read again. */
+void
+bgp_checkpoint_restore (void)
+{
+  struct bgp_checkpoint *ckpt = &bgp_checkpoint;
+  static int restored = 0;
+  struct timeval start;
+  struct stream *s;
+  struct stat st;
+  struct bgp *bgp;
+  struct peer *peer;
+  struct listnode *node;
+  vector peers;
+  u_char *data;
+  u_char *pnt;
+  int type;
+  int fd;
+
+  if (restored || ! ckpt->filename)
+    return;
+  restored = 1;
+
+  bgp = bgp_get_default ();
+  if (! bgp)
+    return;
+
+  fd = open (ckpt->filename, O_RDONLY);
+  if (fd < 0)
+    {
+      if (errno != ENOENT)
+	zlog_warn ("BGP checkpoint %s: %s", ckpt->filename,
+		   safe_strerror (errno));
+      return;
+    }
+  if (fstat (fd, &st) < 0 || st.st_size < BGP_CHECKPOINT_HEADER_SIZE)
+    {
+      zlog_warn ("BGP checkpoint %s: no checkpoint in file", ckpt->filename);
+      close (fd);
+      return;
+    }
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      zlog_warn ("BGP checkpoint %s: %s", ckpt->filename,
+		 safe_strerror (errno));
+      return;
+    }
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+  s = ckpt->obuf;
+  peers = vector_init (VECTOR_MIN_SIZE);
+
+  stream_reset (s);
+  stream_put (s, data, BGP_CHECKPOINT_HEADER_SIZE);
+  if (stream_getl (s) != BGP_CHECKPOINT_MAGIC
+      || stream_getw (s) != BGP_CHECKPOINT_VERSION)
+    type = -1;
+  else
+    {
+      stream_getw (s);
+      stream_getl (s);
+      if (stream_getl (s) != bgp->as)
+	{
+	  zlog_warn ("BGP checkpoint %s: written for another AS, ignored",
+		     ckpt->filename);
+	  type = 0;
+	}
+      else
+	type = BGP_CHECKPOINT_PEER;
+    }
+
+  /* A file cut short still preloads what it has, the stale paths
+     are refreshed or removed just the same. */
+  pnt = data + BGP_CHECKPOINT_HEADER_SIZE;
+  while (type > 0 && type != BGP_CHECKPOINT_END)
+    {
+      type = bgp_checkpoint_record (s, &pnt, data + st.st_size);
+      if (type == BGP_CHECKPOINT_PEER)
+	{
+	  if (bgp_checkpoint_restore_peer (bgp, s, peers) < 0)
+	    type = -1;
+	}
+      else if (type == BGP_CHECKPOINT_ROUTE)
+	{
+	  if (bgp_checkpoint_restore_route (ckpt, s, peers) < 0)
+	    type = -1;
+	}
+      else if (type == 0)
+	type = -1;
+    }
+  if (type < 0)
+    zlog_warn ("BGP checkpoint %s: malformed or incomplete checkpoint",
+	       ckpt->filename);
+
+  munmap (data, st.st_size);
+  vector_free (peers);
+
+  for (ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
+    if (bgp_checkpoint_restored (peer))
+      {
+	bgp_graceful_stale_start (peer);
+	ckpt->restore_peers++;
+      }
+
+  bgp_checkpoint_elapsed (&start, &ckpt->restore_duration);
+  ckpt->restore_time = time (NULL);
+
+  zlog_info ("BGP checkpoint %s: preloaded %lu paths from %u peers, "
+	     "%lu skipped, in %ld.%03ld seconds", ckpt->filename,
+	     ckpt->restore_paths, ckpt->restore_peers, ckpt->restore_skipped,
+	     (long) ckpt->restore_duration.tv_sec,
+	     (long) ckpt->restore_duration.tv_usec / 1000);
+}
+
+DEFUN (bgp_checkpoint_file,
+       bgp_checkpoint_file_cmd,
+       "bgp checkpoint PATH",
+       BGP_STR
+       "Checkpoint the RIB for a warm restart\n"
+       "Checkpoint filename\n")
+{
+  struct bgp_checkpoint *ckpt = &bgp_checkpoint;
+  char path[MAXPATHLEN];
+  unsigned int interval = BGP_CHECKPOINT_INTERVAL_DEFAULT;
+
+  if (argc > 1)
+    VTY_GET_INTEGER_RANGE ("checkpoint interval", interval, argv[1],
+			   10, 86400);
+
+  if (argv[0][0] != DIRECTORY_SEP)
+    snprintf (path, sizeof (path), "%s/%s", vty_get_cwd (), argv[0]);
+  else
+    snprintf (path, sizeof (path), "%s", argv[0]);
+
+  /* Abandon a checkpoint still being written to the old file. */
+  bgp_checkpoint_stop (ckpt, 0);
+
+  if (ckpt->filename)
+    free (ckpt->filename);
+  if (ckpt->tmpname)
+    free (ckpt->tmpname);
+  ckpt->filename = strdup (path);
+  strncat (path, ".tmp", sizeof (path) - strlen (path) - 1);
+  ckpt->tmpname = strdup (path);
+
+  ckpt->interval = interval;
+  THREAD_OFF (ckpt->t_interval);
+  ckpt->t_interval = thread_add_timer (master, bgp_checkpoint_timer,
+				       ckpt, ckpt->interval);
+
+  return CMD_SUCCESS;
+}
+
+ALIAS (bgp_checkpoint_file,
+       bgp_checkpoint_file_interval_cmd,
+       "bgp checkpoint PATH <10-86400>",
+       BGP_STR
+       "Checkpoint the RIB for a warm restart\n"
+       "Checkpoint filename\n"
+       "Interval between checkpoints in seconds\n")
+
+DEFUN (no_bgp_checkpoint_file,
+       no_bgp_checkpoint_file_cmd,
+       "no bgp checkpoint",
+       NO_STR
+       BGP_STR
+       "Checkpoint the RIB for a warm restart\n")
+{
+  struct bgp_checkpoint *ckpt = &bgp_checkpoint;
+
+  bgp_checkpoint_stop (ckpt, 0);
+  THREAD_OFF (ckpt->t_interval);
+
+  if (ckpt->filename)
+    free (ckpt->filename);
+  if (ckpt->tmpname)
+    free (ckpt->tmpname);
+  ckpt->filename = NULL;
+  ckpt->tmpname = NULL;
+  ckpt->interval = 0;
+
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_bgp_checkpoint_file,
+       no_bgp_checkpoint_file_val_cmd,
+       "no bgp checkpoint PATH",
+       NO_STR
+       BGP_STR
+       "Checkpoint the RIB for a warm restart\n"
+       "Checkpoint filename\n")
+
+ALIAS (no_bgp_checkpoint_file,
+       no_bgp_checkpoint_file_interval_cmd,
+       "no bgp checkpoint PATH <10-86400>",
+       NO_STR
+       BGP_STR
+       "Checkpoint the RIB for a warm restart\n"
+       "Checkpoint filename\n"
+       "Interval between checkpoints in seconds\n")
+
+DEFUN (show_bgp_checkpoint,
+       show_bgp_checkpoint_cmd,
+       "show bgp checkpoint",
+       SHOW_STR
+       BGP_STR
+       "RIB checkpoint\n")
+{
+  struct bgp_checkpoint *ckpt = &bgp_checkpoint;
+  char timebuf[30];
+
+  if (! ckpt->filename)
+    {
+      vty_out (vty, "No checkpoint configured%s", VTY_NEWLINE);
+      return CMD_SUCCESS;
+    }
+
+  vty_out (vty, "Checkpoint %s, every %u seconds%s", ckpt->filename,
+	   ckpt->interval, VTY_NEWLINE);
+
+  if (ckpt->fp)
+    vty_out (vty, "  In progress: %lu routes, %lu paths, %lu bytes%s",
+	     ckpt->routes, ckpt->paths, ckpt->bytes, VTY_NEWLINE);
+
+  if (ckpt->last_time)
+    {
+      strftime (timebuf, sizeof (timebuf), "%Y/%m/%d %H:%M:%S",
+		localtime (&ckpt->last_time));
+      vty_out (vty, "  Last written %s: %lu routes, %lu paths, %lu bytes "
+	       "in %ld.%03ld seconds%s", timebuf,
+	       ckpt->last_routes, ckpt->last_paths, ckpt->last_bytes,
+	       (long) ckpt->last_duration.tv_sec,
+	       (long) ckpt->last_duration.tv_usec / 1000, VTY_NEWLINE);
+    }
+
+  if (ckpt->restore_time)
+    {
+      strftime (timebuf, sizeof (timebuf), "%Y/%m/%d %H:%M:%S",
+		localtime (&ckpt->restore_time));
+      vty_out (vty, "  Preloaded %s: %lu paths from %u peers, %lu skipped, "
+	       "in %ld.%03ld seconds%s", timebuf,
+	       ckpt->restore_paths, ckpt->restore_peers, ckpt->restore_skipped,
+	       (long) ckpt->restore_duration.tv_sec,
+	       (long) ckpt->restore_duration.tv_usec / 1000, VTY_NEWLINE);
+    }
+
+  return CMD_SUCCESS;
+}
+
+int
+bgp_checkpoint_config_write (struct vty *vty)
+{
+  struct bgp_checkpoint *ckpt = &bgp_checkpoint;
+
+  if (! ckpt->filename)
+    return 0;
+
+  if (ckpt->interval != BGP_CHECKPOINT_INTERVAL_DEFAULT)
+    vty_out (vty, "bgp checkpoint %s %u%s", ckpt->filename, ckpt->interval,
+	     VTY_NEWLINE);
+  else
+    vty_out (vty, "bgp checkpoint %s%s", ckpt->filename, VTY_NEWLINE);
+
+  return 1;
+}
+
+void
+bgp_checkpoint_init (void)
+{
+  memset (&bgp_checkpoint, 0, sizeof (struct bgp_checkpoint));
+  bgp_checkpoint.obuf = stream_new (BGP_MAX_PACKET_SIZE * 4);
+
+  install_element (CONFIG_NODE, &bgp_checkpoint_file_cmd);
+  install_element (CONFIG_NODE, &bgp_checkpoint_file_interval_cmd);
+  install_element (CONFIG_NODE, &no_bgp_checkpoint_file_cmd);
+  install_element (CONFIG_NODE, &no_bgp_checkpoint_file_val_cmd);
+  install_element (CONFIG_NODE, &no_bgp_checkpoint_file_interval_cmd);
+
+  install_element (VIEW_NODE, &show_bgp_checkpoint_cmd);
+  install_element (ENABLE_NODE, &show_bgp_checkpoint_cmd);
+}
@@ -0,0 +1,49 @@
+/* BGP RIB checkpoint and warm restart
+   Copyright (C) 2026 The Quagga project
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#ifndef _QUAGGA_BGP_CHECKPOINT_H
+#define _QUAGGA_BGP_CHECKPOINT_H
+
+/* Checkpoint file format.  After the file header come records of a
+   type octet and a four octet length of the data which follows, all
+   in network byte order.  PEER records name the peers the ROUTE
+   records after them refer to by index, the END record closes a
+   complete checkpoint. */
+#define BGP_CHECKPOINT_MAGIC         0x42475043 /* "BGPC" */
+#define BGP_CHECKPOINT_VERSION       1
+#define BGP_CHECKPOINT_HEADER_SIZE   16
+#define BGP_CHECKPOINT_RECORD_HEADER 5
+
+#define BGP_CHECKPOINT_PEER          1
+#define BGP_CHECKPOINT_ROUTE         2
+#define BGP_CHECKPOINT_END           3
+
+/* Path flags in a ROUTE record. */
+#define BGP_CHECKPOINT_PATH_VALID    (1 << 0)
+
+/* Default interval between checkpoints, in seconds. */
+#define BGP_CHECKPOINT_INTERVAL_DEFAULT 300
+
+extern void bgp_checkpoint_init (void);
+extern void bgp_checkpoint_restore (void);
+extern void bgp_checkpoint_write (void);
+extern int bgp_checkpoint_config_write (struct vty *);
+
+#endif /* _QUAGGA_BGP_CHECKPOINT_H */
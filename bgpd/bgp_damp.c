@@ -34,18 +34,11 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_attr.h" 
 #include "bgpd/bgp_advertise.h"
 
-/* Global variable to access damping configuration */
-struct bgp_damp_config bgp_damp_cfg;
-static struct bgp_damp_config *damp = &bgp_damp_cfg;
-
-/* Utility macro to add and delete BGP dampening information to no
-   used list.  */
-#define BGP_DAMP_LIST_ADD(N,A)  BGP_INFO_ADD(N,A,no_reuse_list)
-#define BGP_DAMP_LIST_DEL(N,A)  BGP_INFO_DEL(N,A,no_reuse_list)
+static int bgp_reuse_timer (struct thread *);
 
 /* Calculate reuse list index by penalty value.  */
 static int
-bgp_reuse_index (int penalty)
+bgp_reuse_index (struct bgp_damp_config *damp, int penalty)
 {
   unsigned int i;
   int index;
@@ -60,36 +53,66 @@ bgp_reuse_index (int penalty)
   return (damp->reuse_offset + index) % damp->reuse_list_size;  
 }
 
-/* Add BGP dampening information to reuse list.  */
+/* Add BGP dampening information to reuse list.  A suppressed route is
+   filed under the time its penalty decays to the reuse limit, or the
+   end of its max-suppress-time if that comes first.  Any other route
+   is filed under the time its history may be forgotten, which is when
+   twice its penalty would decay to the reuse limit.  */
 static void 
-bgp_reuse_list_add (struct bgp_damp_info *bdi)
+bgp_reuse_list_add (struct bgp_damp_config *damp, struct bgp_damp_info *bdi)
 {
   int index;
+  time_t remain;
+  unsigned int slots;
 
-  index = bdi->index = bgp_reuse_index (bdi->penalty);
+  if (CHECK_FLAG (bdi->binfo->flags, BGP_INFO_DAMPED))
+    {
+      index = bgp_reuse_index (damp, bdi->penalty);
+
+      remain = bdi->suppress_time + damp->max_suppress_time - time (NULL);
+      slots = remain > 0 ? remain / DELTA_REUSE : 0;
+      if (slots < (index + damp->reuse_list_size - damp->reuse_offset)
+		  % damp->reuse_list_size)
+	index = (damp->reuse_offset + slots) % damp->reuse_list_size;
+    }
+  else
+    index = bgp_reuse_index (damp, bdi->penalty * 2);
+  bdi->index = index;
 
   bdi->prev = NULL;
   bdi->next = damp->reuse_list[index];
   if (damp->reuse_list[index])
     damp->reuse_list[index]->prev = bdi;
   damp->reuse_list[index] = bdi;
+  damp->count++;
+
+  /* The reuse timer only runs while there is some history.  */
+  if (! damp->t_reuse)
+    damp->t_reuse =
+      thread_add_timer (master, bgp_reuse_timer, damp, DELTA_REUSE);
 }
 
 /* Delete BGP dampening information from reuse list.  */
 static void
-bgp_reuse_list_delete (struct bgp_damp_info *bdi)
+bgp_reuse_list_delete (struct bgp_damp_config *damp,
+		       struct bgp_damp_info *bdi)
 {
+  if (bdi->index < 0)
+    return;
+
   if (bdi->next)
     bdi->next->prev = bdi->prev;
   if (bdi->prev)
     bdi->prev->next = bdi->next;
   else
     damp->reuse_list[bdi->index] = bdi->next;
+  bdi->index = -1;
+  damp->count--;
 }   
 
 /* Return decayed penalty value.  */
-int 
-bgp_damp_decay (time_t tdiff, int penalty)
+static int 
+bgp_damp_decay (struct bgp_damp_config *damp, time_t tdiff, int penalty)
 {
   unsigned int i;
 
@@ -105,17 +128,21 @@ bgp_damp_decay (time_t tdiff, int penalty)
 }
 
 /* Handler of reuse timer event.  Each route in the current reuse-list
-   is evaluated.  RFC2439 Section 4.8.7.  */
+   is evaluated.  RFC2439 Section 4.8.7.  This is the only periodic
+   work dampening does, penalties are otherwise decayed when a route
+   is updated, withdrawn or displayed.  */
 static int
 bgp_reuse_timer (struct thread *t)
 {
+  struct bgp_damp_config *damp;
+  struct bgp *bgp;
   struct bgp_damp_info *bdi;
   struct bgp_damp_info *next;
   time_t t_now, t_diff;
     
+  damp = THREAD_ARG (t);
   damp->t_reuse = NULL;
-  damp->t_reuse =
-    thread_add_timer (master, bgp_reuse_timer, NULL, DELTA_REUSE);
+  bgp = damp->bgp;
 
   t_now = time (NULL);
 
@@ -131,23 +158,34 @@ bgp_reuse_timer (struct thread *t)
   /* 3. if ( the saved list head pointer is non-empty ) */
   for (; bdi; bdi = next)
     {
-      struct bgp *bgp = bdi->binfo->peer->bgp;
-      
       next = bdi->next;
+      bdi->index = -1;
+      damp->count--;
 
       /* Set t-diff = t-now - t-updated.  */
       t_diff = t_now - bdi->t_updated;
 
       /* Set figure-of-merit = figure-of-merit * decay-array-ok [t-diff] */
-      bdi->penalty = bgp_damp_decay (t_diff, bdi->penalty);   
+      bdi->penalty = bgp_damp_decay (damp, t_diff, bdi->penalty);   
 
       /* Set t-updated = t-now.  */
       bdi->t_updated = t_now;
 
-      /* if (figure-of-merit < reuse).  */
-      if (bdi->penalty < damp->reuse_limit)
+      if (CHECK_FLAG (bdi->binfo->flags, BGP_INFO_DAMPED))
 	{
+	  /* Re-insert into another list (See RFC2439 Section 4.8.6),
+	     unless figure-of-merit < reuse or the route has been
+	     suppressed for the maximum time.  */
+	  if (bdi->penalty >= damp->reuse_limit
+	      && t_now - bdi->suppress_time < damp->max_suppress_time)
+	    {
+	      bgp_reuse_list_add (damp, bdi);
+	      continue;
+	    }
+
 	  /* Reuse the route.  */
+	  if (bdi->penalty > damp->reuse_limit)
+	    bdi->penalty = damp->reuse_limit;
 	  bgp_info_unset_flag (bdi->rn, bdi->binfo, BGP_INFO_DAMPED);
 	  bdi->suppress_time = 0;
 
@@ -158,17 +196,19 @@ bgp_reuse_timer (struct thread *t)
 				       bdi->afi, bdi->safi);   
 	      bgp_process (bgp, bdi->rn, bdi->afi, bdi->safi);
 	    }
-
-	  if (bdi->penalty <= damp->reuse_limit / 2.0)
-	    bgp_damp_info_free (bdi, 1);
-	  else
-	    BGP_DAMP_LIST_ADD (damp, bdi);
 	}
+
+      /* Release the history once the penalty has decayed.  */
+      if (bdi->penalty <= damp->reuse_limit / 2.0)
+	bgp_damp_info_free (bdi, 1);
       else
-	/* Re-insert into another list (See RFC2439 Section 4.8.6).  */
-	bgp_reuse_list_add (bdi);
+	bgp_reuse_list_add (damp, bdi);
     }
 
+  if (damp->count && ! damp->t_reuse)
+    damp->t_reuse =
+      thread_add_timer (master, bgp_reuse_timer, damp, DELTA_REUSE);
+
   return 0;
 }
 
@@ -179,9 +219,10 @@ bgp_damp_withdraw (struct bgp_info *binfo, struct bgp_node *rn,
 {
   time_t t_now;
   struct bgp_damp_info *bdi = NULL;
-  double last_penalty = 0;
+  struct bgp_damp_config *damp;
   
   t_now = time (NULL);
+  damp = binfo->peer->bgp->damp[afi][safi];
 
   /* Processing Unreachable Messages.  */
   if (binfo->extra)
@@ -206,16 +247,14 @@ bgp_damp_withdraw (struct bgp_info *binfo, struct bgp_node *rn,
       bdi->index = -1;
       bdi->afi = afi;
       bdi->safi = safi;
+      bdi->damp = damp;
       (bgp_info_extra_get (binfo))->damp_info = bdi;
-      BGP_DAMP_LIST_ADD (damp, bdi);
     }
   else
     {
-      last_penalty = bdi->penalty;
-
       /* 1. Set t-diff = t-now - t-updated.  */
       bdi->penalty = 
-	(bgp_damp_decay (t_now - bdi->t_updated, bdi->penalty) 
+	(bgp_damp_decay (damp, t_now - bdi->t_updated, bdi->penalty) 
 	 + (attr_change ? DEFAULT_PENALTY / 2 : DEFAULT_PENALTY));
 
       if (bdi->penalty > damp->ceiling)
@@ -232,15 +271,13 @@ bgp_damp_withdraw (struct bgp_info *binfo, struct bgp_node *rn,
   /* Make this route as historical status.  */
   bgp_info_set_flag (rn, binfo, BGP_INFO_HISTORY);
 
-  /* Remove the route from a reuse list if it is on one.  */
+  /* The penalty has changed, file the route under its new reuse
+     time.  */
+  bgp_reuse_list_delete (damp, bdi);
+
   if (CHECK_FLAG (bdi->binfo->flags, BGP_INFO_DAMPED))
     {
-      /* If decay rate isn't equal to 0, reinsert brn. */  
-      if (bdi->penalty != last_penalty)
-	{
-	  bgp_reuse_list_delete (bdi);
-	  bgp_reuse_list_add (bdi);  
-	}
+      bgp_reuse_list_add (damp, bdi);
       return BGP_DAMP_SUPPRESSED; 
     }
 
@@ -250,9 +287,8 @@ bgp_damp_withdraw (struct bgp_info *binfo, struct bgp_node *rn,
     {
       bgp_info_set_flag (rn, binfo, BGP_INFO_DAMPED);
       bdi->suppress_time = t_now;
-      BGP_DAMP_LIST_DEL (damp, bdi);
-      bgp_reuse_list_add (bdi);
     }
+  bgp_reuse_list_add (damp, bdi);
 
   return BGP_DAMP_USED;
 }
@@ -263,16 +299,18 @@ bgp_damp_update (struct bgp_info *binfo, struct bgp_node *rn,
 {
   time_t t_now;
   struct bgp_damp_info *bdi;
+  struct bgp_damp_config *damp;
   int status;
 
   if (!binfo->extra || !((bdi = binfo->extra->damp_info)))
     return BGP_DAMP_USED;
 
   t_now = time (NULL);
+  damp = bdi->damp;
   bgp_info_unset_flag (rn, binfo, BGP_INFO_HISTORY);
 
   bdi->lastrecord = BGP_RECORD_UPDATE;
-  bdi->penalty = bgp_damp_decay (t_now - bdi->t_updated, bdi->penalty);
+  bdi->penalty = bgp_damp_decay (damp, t_now - bdi->t_updated, bdi->penalty);
 
   if (! CHECK_FLAG (bdi->binfo->flags, BGP_INFO_DAMPED)
       && (bdi->penalty < damp->suppress_value))
@@ -281,8 +319,7 @@ bgp_damp_update (struct bgp_info *binfo, struct bgp_node *rn,
 	   && (bdi->penalty < damp->reuse_limit) )
     {
       bgp_info_unset_flag (rn, binfo, BGP_INFO_DAMPED);
-      bgp_reuse_list_delete (bdi);
-      BGP_DAMP_LIST_ADD (damp, bdi);
+      bgp_reuse_list_delete (damp, bdi);
       bdi->suppress_time = 0;
       status = BGP_DAMP_USED;
     }
@@ -290,88 +327,47 @@ bgp_damp_update (struct bgp_info *binfo, struct bgp_node *rn,
     status = BGP_DAMP_SUPPRESSED;  
 
   if (bdi->penalty > damp->reuse_limit / 2.0)
-    bdi->t_updated = t_now;
+    {
+      bdi->t_updated = t_now;
+      if (bdi->index < 0)
+	bgp_reuse_list_add (damp, bdi);
+    }
   else
     bgp_damp_info_free (bdi, 0);
 	
   return status;
 }
 
-/* Remove dampening information and history route.  */
-int 
-bgp_damp_scan (struct bgp_info *binfo, afi_t afi, safi_t safi)
-{
-  time_t t_now, t_diff;
-  struct bgp_damp_info *bdi;
-  
-  assert (binfo->extra && binfo->extra->damp_info);
-  
-  t_now = time (NULL);
-  bdi = binfo->extra->damp_info;
- 
-  if (CHECK_FLAG (binfo->flags, BGP_INFO_DAMPED))
-    {
-      t_diff = t_now - bdi->suppress_time;
-
-      if (t_diff >= damp->max_suppress_time)
-        {
-          bgp_info_unset_flag (bdi->rn, binfo, BGP_INFO_DAMPED);
-          bgp_reuse_list_delete (bdi);
-	  BGP_DAMP_LIST_ADD (damp, bdi);
-          bdi->penalty = damp->reuse_limit;
-          bdi->suppress_time = 0;
-          bdi->t_updated = t_now;
-          
-          /* Need to announce UPDATE once this binfo is usable again. */
-          if (bdi->lastrecord == BGP_RECORD_UPDATE)
-            return 1;
-          else
-            return 0;
-        }
-    }
-  else
-    {
-      t_diff = t_now - bdi->t_updated;
-      bdi->penalty = bgp_damp_decay (t_diff, bdi->penalty);
-
-      if (bdi->penalty <= damp->reuse_limit / 2.0)
-        {
-          /* release the bdi, bdi->binfo. */  
-          bgp_damp_info_free (bdi, 1);
-          return 0;
-        }            
-      else
-        bdi->t_updated = t_now;
-    }       
-  return 0;
-}
-
 void
 bgp_damp_info_free (struct bgp_damp_info *bdi, int withdraw)
 {
   struct bgp_info *binfo;
+  struct bgp_node *rn;
 
   if (! bdi)
     return;
 
   binfo = bdi->binfo;
+  rn = bdi->rn;
   binfo->extra->damp_info = NULL;
 
-  if (CHECK_FLAG (binfo->flags, BGP_INFO_DAMPED))
-    bgp_reuse_list_delete (bdi);
-  else
-    BGP_DAMP_LIST_DEL (damp, bdi);
+  bgp_reuse_list_delete (bdi->damp, bdi);
 
-  bgp_info_unset_flag (bdi->rn, binfo, BGP_INFO_HISTORY|BGP_INFO_DAMPED);
+  bgp_info_unset_flag (rn, binfo, BGP_INFO_HISTORY|BGP_INFO_DAMPED);
 
-  if (bdi->lastrecord == BGP_RECORD_WITHDRAW && withdraw)
-    bgp_info_delete (bdi->rn, binfo);
+  if (withdraw)
+    {
+      if (bdi->lastrecord == BGP_RECORD_WITHDRAW)
+	bgp_info_delete (rn, binfo);
+      bgp_process (bdi->damp->bgp, rn, bdi->afi, bdi->safi);
+    }
   
   XFREE (MTYPE_BGP_DAMP_INFO, bdi);
 }
 
 static void
-bgp_damp_parameter_set (int hlife, int reuse, int sup, int maxsup)
+bgp_damp_parameter_set (struct bgp_damp_config *damp, int hlife, int reuse,
+			int sup, int maxsup)
 {
   double reuse_max_ratio;
   unsigned int i;
@@ -435,8 +431,11 @@ int
 bgp_damp_enable (struct bgp *bgp, afi_t afi, safi_t safi, time_t half,
 		 unsigned int reuse, unsigned int suppress, time_t max)
 {
+  struct bgp_damp_config *damp;
+
   if (CHECK_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING))
     {
+      damp = bgp->damp[afi][safi];
       if (damp->half_life == half
 	  && damp->reuse_limit == reuse
 	  && damp->suppress_value == suppress
@@ -445,14 +444,14 @@ bgp_damp_enable (struct bgp *bgp, afi_t afi, safi_t safi, time_t half,
       bgp_damp_disable (bgp, afi, safi);
     }
 
-  SET_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING);
-  bgp_damp_parameter_set (half, reuse, suppress, max);
+  damp = XCALLOC (MTYPE_BGP_DAMP_CONFIG, sizeof (struct bgp_damp_config));
+  damp->bgp = bgp;
+  bgp->damp[afi][safi] = damp;
 
-  /* Register reuse timer.  */
-  if (! damp->t_reuse)
-    damp->t_reuse = 
-      thread_add_timer (master, bgp_reuse_timer, NULL, DELTA_REUSE);
+  SET_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING);
+  bgp_damp_parameter_set (damp, half, reuse, suppress, max);
 
+  /* The reuse timer is registered when a route first flaps.  */
   return 0;
 }
 
@@ -471,12 +470,14 @@ bgp_damp_config_clean (struct bgp_damp_config *damp)
 
 /* Clean all the bgp_damp_info stored in reuse_list. */
 void
-bgp_damp_info_clean (void)
+bgp_damp_info_clean (struct bgp *bgp, afi_t afi, safi_t safi)
 {
+  struct bgp_damp_config *damp;
   unsigned int i;
   struct bgp_damp_info *bdi, *next;
 
-  damp->reuse_offset = 0;
+  if (! (damp = bgp->damp[afi][safi]))
+    return;
 
   for (i = 0; i < damp->reuse_list_size; i++)
     {
@@ -488,61 +489,66 @@ bgp_damp_info_clean (void)
 	  next = bdi->next;
 	  bgp_damp_info_free (bdi, 1);
 	}
-      damp->reuse_list[i] = NULL;
     }
 
-  for (bdi = damp->no_reuse_list; bdi; bdi = next)
-    {
-      next = bdi->next;
-      bgp_damp_info_free (bdi, 1);
-    }
-  damp->no_reuse_list = NULL;
+  damp->reuse_offset = 0;
 }
 
 int
 bgp_damp_disable (struct bgp *bgp, afi_t afi, safi_t safi)
 {
+  struct bgp_damp_config *damp;
+
+  if (! (damp = bgp->damp[afi][safi]))
+    return 0;
+
+  /* Clean BGP dampening information.  */
+  bgp_damp_info_clean (bgp, afi, safi);
+
   /* Cancel reuse thread. */
   if (damp->t_reuse )
     thread_cancel (damp->t_reuse);
   damp->t_reuse = NULL;
 
-  /* Clean BGP dampening information.  */
-  bgp_damp_info_clean ();
-
   /* Clear configuration */
-  bgp_damp_config_clean (&bgp_damp_cfg);
+  bgp_damp_config_clean (damp);
+  XFREE (MTYPE_BGP_DAMP_CONFIG, damp);
+  bgp->damp[afi][safi] = NULL;
 
   UNSET_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING);
   return 0;
 }
 
 void
-bgp_config_write_damp (struct vty *vty)
+bgp_config_write_damp (struct vty *vty, struct bgp *bgp, afi_t afi,
+		       safi_t safi)
 {
-  if (bgp_damp_cfg.half_life == DEFAULT_HALF_LIFE*60
-      && bgp_damp_cfg.reuse_limit == DEFAULT_REUSE
-      && bgp_damp_cfg.suppress_value == DEFAULT_SUPPRESS
-      && bgp_damp_cfg.max_suppress_time == bgp_damp_cfg.half_life*4)
+  struct bgp_damp_config *damp = bgp->damp[afi][safi];
+
+  if (damp->half_life == DEFAULT_HALF_LIFE*60
+      && damp->reuse_limit == DEFAULT_REUSE
+      && damp->suppress_value == DEFAULT_SUPPRESS
+      && damp->max_suppress_time == damp->half_life*4)
     vty_out (vty, " bgp dampening%s", VTY_NEWLINE);
-  else if (bgp_damp_cfg.half_life != DEFAULT_HALF_LIFE*60
-	   && bgp_damp_cfg.reuse_limit == DEFAULT_REUSE
-	   && bgp_damp_cfg.suppress_value == DEFAULT_SUPPRESS
-	   && bgp_damp_cfg.max_suppress_time == bgp_damp_cfg.half_life*4)
+  else if (damp->half_life != DEFAULT_HALF_LIFE*60
+	   && damp->reuse_limit == DEFAULT_REUSE
+	   && damp->suppress_value == DEFAULT_SUPPRESS
+	   && damp->max_suppress_time == damp->half_life*4)
     vty_out (vty, " bgp dampening %ld%s",
-	     bgp_damp_cfg.half_life/60,
+	     damp->half_life/60,
 	     VTY_NEWLINE);
   else
     vty_out (vty, " bgp dampening %ld %d %d %ld%s",
-	     bgp_damp_cfg.half_life/60,
-	     bgp_damp_cfg.reuse_limit,
-	     bgp_damp_cfg.suppress_value,
-	     bgp_damp_cfg.max_suppress_time/60,
+	     damp->half_life/60,
+	     damp->reuse_limit,
+	     damp->suppress_value,
+	     damp->max_suppress_time/60,
 	     VTY_NEWLINE);
 }
 
 static const char *
-bgp_get_reuse_time (unsigned int penalty, char *buf, size_t len)
+bgp_get_reuse_time (struct bgp_damp_config *damp, unsigned int penalty,
+		    char *buf, size_t len)
 {
   time_t reuse_time = 0;
   struct tm *tm = NULL;
@@ -593,13 +599,13 @@ bgp_damp_info_vty (struct vty *vty, struct bgp_info *binfo)
 
   /* If dampening is not enabled or there is no dampening information,
      return immediately.  */
-  if (! damp || ! bdi)
+  if (! bdi)
     return;
 
   /* Calculate new penalty.  */
   t_now = time (NULL);
   t_diff = t_now - bdi->t_updated;
-  penalty = bgp_damp_decay (t_diff, bdi->penalty);
+  penalty = bgp_damp_decay (bdi->damp, t_diff, bdi->penalty);
 
   vty_out (vty, "      Dampinfo: penalty %d, flapped %d times in %s",
            penalty, bdi->flap,
@@ -608,7 +614,7 @@ bgp_damp_info_vty (struct vty *vty, struct bgp_info *binfo)
   if (CHECK_FLAG (binfo->flags, BGP_INFO_DAMPED)
       && ! CHECK_FLAG (binfo->flags, BGP_INFO_HISTORY))
     vty_out (vty, ", reuse in %s",
-	     bgp_get_reuse_time (penalty, timebuf, BGP_UPTIME_LEN));
+	     bgp_get_reuse_time (bdi->damp, penalty, timebuf, BGP_UPTIME_LEN));
 
   vty_out (vty, "%s", VTY_NEWLINE);
 }
@@ -629,13 +635,13 @@ bgp_damp_reuse_time_vty (struct vty *vty, struct bgp_info *binfo,
 
   /* If dampening is not enabled or there is no dampening information,
      return immediately.  */
-  if (! damp || ! bdi)
+  if (! bdi)
     return NULL;
 
   /* Calculate new penalty.  */
   t_now = time (NULL);
   t_diff = t_now - bdi->t_updated;
-  penalty = bgp_damp_decay (t_diff, bdi->penalty);
+  penalty = bgp_damp_decay (bdi->damp, t_diff, bdi->penalty);
 
-  return  bgp_get_reuse_time (penalty, timebuf, len);
+  return  bgp_get_reuse_time (bdi->damp, penalty, timebuf, len);
 }
@@ -50,7 +50,10 @@ struct bgp_damp_info
   /* Back reference to bgp_node. */
   struct bgp_node *rn;
 
-  /* Current index in the reuse_list. */
+  /* Dampening configuration of the route's address family. */
+  struct bgp_damp_config *damp;
+
+  /* Current index in the reuse_list, -1 if on none. */
   int index;
 
   /* Last time message type. */
@@ -99,15 +102,20 @@ struct bgp_damp_config
   /* Reuse index array per-set based. */ 
   int *reuse_index;
 
-  /* Reuse list array per-set based. */  
+  /* Reuse list array per-set based.  Every route with dampening
+     information is on one of the lists.  */
   struct bgp_damp_info **reuse_list;
   int reuse_offset;
-        
-  /* All dampening information which is not on reuse list.  */
-  struct bgp_damp_info *no_reuse_list;
 
-  /* Reuse timer thread per-set base. */
+  /* Number of routes on the reuse lists.  */
+  unsigned long count;
+
+  /* Reuse timer thread per-set base, only running while count is
+     non-zero. */
   struct thread* t_reuse;
+
+  /* Back reference to the instance. */
+  struct bgp *bgp;
 };
 
 #define BGP_DAMP_NONE           0
@@ -135,11 +143,9 @@ extern int bgp_damp_disable (struct bgp *, afi_t, safi_t);
 extern int bgp_damp_withdraw (struct bgp_info *, struct bgp_node *,
 		       afi_t, safi_t, int);
 extern int bgp_damp_update (struct bgp_info *, struct bgp_node *, afi_t, safi_t);
-extern int bgp_damp_scan (struct bgp_info *, afi_t, safi_t);
 extern void bgp_damp_info_free (struct bgp_damp_info *, int);
-extern void bgp_damp_info_clean (void);
-extern int bgp_damp_decay (time_t, int);
-extern void bgp_config_write_damp (struct vty *);
+extern void bgp_damp_info_clean (struct bgp *, afi_t, safi_t);
+extern void bgp_config_write_damp (struct vty *, struct bgp *, afi_t, safi_t);
 extern void bgp_damp_info_vty (struct vty *, struct bgp_info *);
 extern const char * bgp_damp_reuse_time_vty (struct vty *, struct bgp_info *,
                                              char *, size_t);
@@ -27,6 +27,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "prefix.h"
 #include "thread.h"
 #include "linklist.h"
+#include "buffer.h"
+#include "memory.h"
 #include "bgpd/bgp_table.h"
 
 #include "bgpd/bgpd.h"
@@ -59,6 +61,8 @@ enum MRT_MSG_TYPES {
 };
 
 static int bgp_dump_interval_func (struct thread *);
+static int bgp_dump_routes_walk (struct thread *);
+static int bgp_dump_routes_write (struct thread *);
 
 struct bgp_dump
 {
@@ -73,6 +77,31 @@ struct bgp_dump
   char *interval_str;
 
   struct thread *t_interval;
+
+  /* State of a routes-mrt dump in progress.  The table is walked in
+     slices from a background thread; the node to resume from is kept
+     locked in 'rn' and each slice is queued in 'wb' until the write
+     thread has handed it to the file.  The peers in the index table
+     are kept locked in 'peers', the records only refer to them. */
+  struct bgp *bgp;
+  struct peer **peers;
+  unsigned int peer_count;
+  afi_t afi;
+  struct bgp_node *rn;
+  unsigned int seq;
+  struct buffer *wb;
+  struct thread *t_walk;
+  struct thread *t_write;
+
+  /* Statistics of the dump in progress and of the last completed one. */
+  struct timeval start;
+  unsigned long records;
+  unsigned long bytes;
+
+  time_t last_time;
+  struct timeval last_duration;
+  unsigned long last_records;
+  unsigned long last_bytes;
 };
 
 /* BGP packet dump output buffer. */
@@ -192,13 +221,56 @@ bgp_dump_set_size (struct stream *s, int type)
   stream_putl_at (s, 8, stream_get_endp (s) - BGP_DUMP_HEADER_SIZE);
 }
 
+/* Write the index table entry of peer, with the given BGP ID, address
+   and AS, and add it to the snapshot. */
 static void
-bgp_dump_routes_index_table(struct bgp *bgp)
+bgp_dump_routes_index_peer (struct bgp_dump *bgp_dump, struct stream *obuf,
+                            struct peer *peer, struct in_addr *id,
+                            union sockunion *su, as_t as)
+{
+  uint16_t peerno = bgp_dump->peer_count;
+
+  /* Peer's type */
+#ifdef HAVE_IPV6
+  if (sockunion_family (su) == AF_INET6)
+    stream_putc (obuf, TABLE_DUMP_V2_PEER_INDEX_TABLE_AS4+TABLE_DUMP_V2_PEER_INDEX_TABLE_IP6);
+  else
+#endif /* HAVE_IPV6 */
+    stream_putc (obuf, TABLE_DUMP_V2_PEER_INDEX_TABLE_AS4+TABLE_DUMP_V2_PEER_INDEX_TABLE_IP);
+
+  /* Peer's BGP ID */
+  stream_put_in_addr (obuf, id);
+
+  /* Peer's IP address */
+#ifdef HAVE_IPV6
+  if (sockunion_family (su) == AF_INET6)
+    stream_write (obuf, (u_char *)&su->sin6.sin6_addr, IPV6_MAX_BYTELEN);
+  else
+#endif /* HAVE_IPV6 */
+    stream_put_in_addr (obuf, &su->sin.sin_addr);
+
+  /* Peer's AS number. */
+  /* Note that, as this is an AS4 compliant quagga, the RIB is always AS4 */
+  stream_putl (obuf, as);
+
+  /* Store the peer number for this peer */
+  peer->table_dump_index = peerno;
+  bgp_dump->peers[peerno] = peer_lock (peer);
+  bgp_dump->peer_count++;
+}
+
+/* Write the peer index table and take the snapshot of the peers it
+   lists, which the records of the whole dump are written against.  The
+   routes originated here, by network statements and redistribution,
+   are listed under the last peer, with our router ID and address
+   0.0.0.0. */
+static void
+bgp_dump_routes_index_table(struct bgp_dump *bgp_dump, struct bgp *bgp)
 {
   struct peer *peer;
   struct listnode *node;
-  uint16_t peerno = 0;
   struct stream *obuf;
+  union sockunion self;
 
   obuf = bgp_dump_obuf;
   stream_reset (obuf);
@@ -221,161 +293,302 @@ bgp_dump_routes_index_table(struct bgp *bgp)
     }
 
   /* Peer count */
-  stream_putw (obuf, listcount(bgp->peer));
+  stream_putw (obuf, listcount(bgp->peer) + 1);
+
+  bgp_dump->peers = XCALLOC (MTYPE_BGP_DUMP_PEERS,
+                             (listcount (bgp->peer) + 1) * sizeof (struct peer *));
+  bgp_dump->peer_count = 0;
 
   /* Walk down all peers */
   for(ALL_LIST_ELEMENTS_RO (bgp->peer, node, peer))
-    {
+    bgp_dump_routes_index_peer (bgp_dump, obuf, peer, &peer->remote_id,
+                                &peer->su, peer->as);
+
+  memset (&self, 0, sizeof (union sockunion));
+  self.sin.sin_family = AF_INET;
+  bgp_dump_routes_index_peer (bgp_dump, obuf, bgp->peer_self,
+                              &bgp->router_id, &self, bgp->as);
+
+  bgp_dump_set_size(obuf, MSG_TABLE_DUMP_V2);
+
+  buffer_put (bgp_dump->wb, STREAM_DATA (obuf), stream_get_endp (obuf));
+  bgp_dump->bytes += stream_get_endp (obuf);
+}
+
+/* Whether peer is in the index table of the dump in progress.  Peers
+   configured since it was written are left out of the records. */
+static int
+bgp_dump_routes_peer_indexed (struct bgp_dump *bgp_dump, struct peer *peer)
+{
+  return peer->table_dump_index < bgp_dump->peer_count
+         && bgp_dump->peers[peer->table_dump_index] == peer;
+}
+
+/* Queue the RIB entry record of one table node. */
+static void
+bgp_dump_routes_node (struct bgp_dump *bgp_dump, struct bgp_node *rn)
+{
+  struct stream *obuf;
+  struct bgp_info *info;
+  afi_t afi = bgp_dump->afi;
+
+  obuf = bgp_dump_obuf;
+  stream_reset(obuf);
 
-      /* Peer's type */
-      if (sockunion_family(&peer->su) == AF_INET)
-        {
-          stream_putc (obuf, TABLE_DUMP_V2_PEER_INDEX_TABLE_AS4+TABLE_DUMP_V2_PEER_INDEX_TABLE_IP);
-        }
+  /* MRT header */
+  if (afi == AFI_IP)
+    {
+      bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV4_UNICAST);
+    }
 #ifdef HAVE_IPV6
-      else if (sockunion_family(&peer->su) == AF_INET6)
-        {
-          stream_putc (obuf, TABLE_DUMP_V2_PEER_INDEX_TABLE_AS4+TABLE_DUMP_V2_PEER_INDEX_TABLE_IP6);
-        }
+  else if (afi == AFI_IP6)
+    {
+      bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV6_UNICAST);
+    }
 #endif /* HAVE_IPV6 */
 
-      /* Peer's BGP ID */
-      stream_put_in_addr (obuf, &peer->remote_id);
+  /* Sequence number */
+  stream_putl(obuf, bgp_dump->seq);
 
-      /* Peer's IP address */
-      if (sockunion_family(&peer->su) == AF_INET)
-        {
-          stream_put_in_addr (obuf, &peer->su.sin.sin_addr);
-        }
+  /* Prefix length */
+  stream_putc (obuf, rn->p.prefixlen);
+
+  /* Prefix */
+  if (afi == AFI_IP)
+    {
+      /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
+      stream_write(obuf, (u_char *)&rn->p.u.prefix4, (rn->p.prefixlen+7)/8);
+    }
 #ifdef HAVE_IPV6
-      else if (sockunion_family(&peer->su) == AF_INET6)
-        {
-          stream_write (obuf, (u_char *)&peer->su.sin6.sin6_addr,
-                        IPV6_MAX_BYTELEN);
-        }
+  else if (afi == AFI_IP6)
+    {
+      /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
+      stream_write (obuf, (u_char *)&rn->p.u.prefix6, (rn->p.prefixlen+7)/8);
+    }
 #endif /* HAVE_IPV6 */
 
-      /* Peer's AS number. */
-      /* Note that, as this is an AS4 compliant quagga, the RIB is always AS4 */
-      stream_putl (obuf, peer->as);
+  /* Save where we are now, so we can overwride the entry count later */
+  int sizep = stream_get_endp(obuf);
+
+  /* Entry count */
+  uint16_t entry_count = 0;
+
+  /* Entry count, note that this is overwritten later */
+  stream_putw(obuf, 0);
+
+  for (info = rn->info; info; info = info->next)
+    {
+      if (! bgp_dump_routes_peer_indexed (bgp_dump, info->peer))
+        continue;
+
+      entry_count++;
+
+      /* Peer index */
+      stream_putw(obuf, info->peer->table_dump_index);
+
+      /* Originated */
+      stream_putl (obuf, info->uptime);
 
-      /* Store the peer number for this peer */
-      peer->table_dump_index = peerno;
-      peerno++;
+      /* Dump attribute. */
+      /* Skip prefix & AFI/SAFI for MP_NLRI */
+      bgp_dump_routes_attr (obuf, info->attr, &rn->p);
     }
 
+  /* None of the paths is from a peer in the index table. */
+  if (entry_count == 0)
+    return;
+
+  /* Overwrite the entry count, now that we know the right number */
+  stream_putw_at (obuf, sizep, entry_count);
+
+  bgp_dump->seq++;
+
   bgp_dump_set_size(obuf, MSG_TABLE_DUMP_V2);
 
-  fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump_routes.fp);
-  fflush (bgp_dump_routes.fp);
+  buffer_put (bgp_dump->wb, STREAM_DATA (obuf), stream_get_endp (obuf));
+  bgp_dump->records++;
+  bgp_dump->bytes += stream_get_endp (obuf);
 }
 
-
-/* Runs under child process. */
-static unsigned int
-bgp_dump_routes_func (int afi, int first_run, unsigned int seq)
+/* Release the walk state of a routes dump and close its file.  The
+   statistics are only kept when the dump ran to completion. */
+static void
+bgp_dump_routes_stop (struct bgp_dump *bgp_dump, int completed)
 {
-  struct stream *obuf;
-  struct bgp_info *info;
-  struct bgp_node *rn;
-  struct bgp *bgp;
-  struct bgp_table *table;
+  struct timeval now;
 
-  bgp = bgp_get_default ();
-  if (!bgp)
-    return seq;
+  THREAD_OFF (bgp_dump->t_walk);
+  THREAD_OFF (bgp_dump->t_write);
 
-  if (bgp_dump_routes.fp == NULL)
-    return seq;
+  if (bgp_dump->rn)
+    {
+      bgp_unlock_node (bgp_dump->rn);
+      bgp_dump->rn = NULL;
+    }
+  if (bgp_dump->peers)
+    {
+      while (bgp_dump->peer_count)
+        peer_unlock (bgp_dump->peers[--bgp_dump->peer_count]);
+      XFREE (MTYPE_BGP_DUMP_PEERS, bgp_dump->peers);
+    }
+  if (bgp_dump->bgp)
+    {
+      bgp_unlock (bgp_dump->bgp);
+      bgp_dump->bgp = NULL;
+    }
+  if (bgp_dump->wb)
+    {
+      buffer_free (bgp_dump->wb);
+      bgp_dump->wb = NULL;
+    }
+  if (bgp_dump->fp)
+    {
+      fclose (bgp_dump->fp);
+      bgp_dump->fp = NULL;
+    }
 
-  /* Note that bgp_dump_routes_index_table will do ipv4 and ipv6 peers,
-     so this should only be done on the first call to bgp_dump_routes_func.
-     ( this function will be called once for ipv4 and once for ipv6 ) */
-  if(first_run)
-    bgp_dump_routes_index_table(bgp);
+  if (! completed)
+    return;
 
-  obuf = bgp_dump_obuf;
-  stream_reset(obuf);
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  bgp_dump->last_duration.tv_sec = now.tv_sec - bgp_dump->start.tv_sec;
+  bgp_dump->last_duration.tv_usec = now.tv_usec - bgp_dump->start.tv_usec;
+  if (bgp_dump->last_duration.tv_usec < 0)
+    {
+      bgp_dump->last_duration.tv_sec--;
+      bgp_dump->last_duration.tv_usec += 1000000;
+    }
+  bgp_dump->last_time = time (NULL);
+  bgp_dump->last_records = bgp_dump->records;
+  bgp_dump->last_bytes = bgp_dump->bytes;
+
+  zlog_info ("MRT routes dump %s: %lu records, %lu bytes in %ld.%03ld seconds",
+             bgp_dump->filename ? bgp_dump->filename : "",
+             bgp_dump->records, bgp_dump->bytes,
+             (long) bgp_dump->last_duration.tv_sec,
+             (long) bgp_dump->last_duration.tv_usec / 1000);
+}
 
-  /* Walk down each BGP route. */
-  table = bgp->rib[afi][SAFI_UNICAST];
+/* Start a routes dump into the freshly opened file.  Only the peer
+   index table is produced here, the RIB itself is walked in slices by
+   bgp_dump_routes_walk. */
+static void
+bgp_dump_routes_start (struct bgp_dump *bgp_dump)
+{
+  struct bgp *bgp;
 
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+  bgp = bgp_get_default ();
+  if (!bgp)
     {
-      if(!rn->info)
-        continue;
+      bgp_dump_routes_stop (bgp_dump, 0);
+      return;
+    }
+
+  bgp_dump->wb = buffer_new (0);
+  bgp_lock (bgp);
+  bgp_dump->bgp = bgp;
+  bgp_dump->afi = AFI_IP;
+  bgp_dump->seq = 0;
+  bgp_dump->records = 0;
+  bgp_dump->bytes = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &bgp_dump->start);
 
-      stream_reset(obuf);
+  /* Note that bgp_dump_routes_index_table will do ipv4 and ipv6 peers. */
+  bgp_dump_routes_index_table (bgp_dump, bgp);
 
-      /* MRT header */
-      if (afi == AFI_IP)
-        {
-          bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV4_UNICAST);
-        }
+  bgp_dump->rn = bgp_table_top (bgp->rib[AFI_IP][SAFI_UNICAST]);
 #ifdef HAVE_IPV6
-      else if (afi == AFI_IP6)
-        {
-          bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV6_UNICAST);
-        }
+  if (! bgp_dump->rn)
+    {
+      bgp_dump->afi = AFI_IP6;
+      bgp_dump->rn = bgp_table_top (bgp->rib[AFI_IP6][SAFI_UNICAST]);
+    }
 #endif /* HAVE_IPV6 */
+  bgp_dump->t_write = thread_add_write (master, bgp_dump_routes_write,
+                                        bgp_dump, fileno (bgp_dump->fp));
+}
 
-      /* Sequence number */
-      stream_putl(obuf, seq);
-
-      /* Prefix length */
-      stream_putc (obuf, rn->p.prefixlen);
+/* Move the walk on to the next node, continuing with the IPv6 table
+   once the IPv4 one is done.  Returns 0 when the walk is finished. */
+static int
+bgp_dump_routes_next (struct bgp_dump *bgp_dump)
+{
+  bgp_dump->rn = bgp_route_next (bgp_dump->rn);
+  if (bgp_dump->rn)
+    return 1;
 
-      /* Prefix */
-      if (afi == AFI_IP)
-        {
-          /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
-          stream_write(obuf, (u_char *)&rn->p.u.prefix4, (rn->p.prefixlen+7)/8);
-        }
 #ifdef HAVE_IPV6
-      else if (afi == AFI_IP6)
-        {
-          /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
-          stream_write (obuf, (u_char *)&rn->p.u.prefix6, (rn->p.prefixlen+7)/8);
-        }
+  if (bgp_dump->afi == AFI_IP)
+    {
+      bgp_dump->afi = AFI_IP6;
+      bgp_dump->rn = bgp_table_top (bgp_dump->bgp->rib[AFI_IP6][SAFI_UNICAST]);
+      return bgp_dump->rn != NULL;
+    }
 #endif /* HAVE_IPV6 */
 
-      /* Save where we are now, so we can overwride the entry count later */
-      int sizep = stream_get_endp(obuf);
-
-      /* Entry count */
-      uint16_t entry_count = 0;
+  return 0;
+}
 
-      /* Entry count, note that this is overwritten later */
-      stream_putw(obuf, 0);
+/* Background thread producing one slice of a routes dump.  Records are
+   queued until the thread has used up its time slot, then the write
+   thread takes over and restarts the walk once the slice is on disk,
+   so neither the table walk nor the file I/O hold up the peers for
+   long. */
+static int
+bgp_dump_routes_walk (struct thread *t)
+{
+  struct bgp_dump *bgp_dump;
 
-      for (info = rn->info; info; info = info->next)
-        {
-          entry_count++;
+  bgp_dump = THREAD_ARG (t);
+  bgp_dump->t_walk = NULL;
 
-          /* Peer index */
-          stream_putw(obuf, info->peer->table_dump_index);
+  while (bgp_dump->rn)
+    {
+      if (bgp_dump->rn->info)
+        bgp_dump_routes_node (bgp_dump, bgp_dump->rn);
 
-          /* Originated */
-          stream_putl (obuf, info->uptime);
+      if (! bgp_dump_routes_next (bgp_dump))
+        break;
 
-          /* Dump attribute. */
-          /* Skip prefix & AFI/SAFI for MP_NLRI */
-          bgp_dump_routes_attr (obuf, info->attr, &rn->p);
-        }
+      if (thread_should_yield (t))
+        break;
+    }
 
-      /* Overwrite the entry count, now that we know the right number */
-      stream_putw_at (obuf, sizep, entry_count);
+  bgp_dump->t_write = thread_add_write (master, bgp_dump_routes_write,
+                                        bgp_dump, fileno (bgp_dump->fp));
+  return 0;
+}
 
-      seq++;
+static int
+bgp_dump_routes_write (struct thread *t)
+{
+  struct bgp_dump *bgp_dump;
 
-      bgp_dump_set_size(obuf, MSG_TABLE_DUMP_V2);
-      fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump_routes.fp);
+  bgp_dump = THREAD_ARG (t);
+  bgp_dump->t_write = NULL;
 
+  switch (buffer_flush_available (bgp_dump->wb, THREAD_FD (t)))
+    {
+    case BUFFER_ERROR:
+      zlog_warn ("bgp_dump_routes_write: %s: %s", bgp_dump->filename,
+                 safe_strerror (errno));
+      bgp_dump_routes_stop (bgp_dump, 0);
+      return 0;
+    case BUFFER_PENDING:
+      bgp_dump->t_write = thread_add_write (master, bgp_dump_routes_write,
+                                            bgp_dump, THREAD_FD (t));
+      return 0;
+    case BUFFER_EMPTY:
+      break;
     }
 
-  fflush (bgp_dump_routes.fp);
+  if (bgp_dump->rn)
+    bgp_dump->t_walk = thread_add_background (master, bgp_dump_routes_walk,
+                                              bgp_dump, 0);
+  else
+    bgp_dump_routes_stop (bgp_dump, 1);
 
-  return seq;
+  return 0;
 }
 
 static int
@@ -385,20 +598,20 @@ bgp_dump_interval_func (struct thread *t)
   bgp_dump = THREAD_ARG (t);
   bgp_dump->t_interval = NULL;
 
+  /* A routes dump that is still being written is left to finish, this
+     round is skipped. */
+  if (bgp_dump->type == BGP_DUMP_ROUTES && bgp_dump->wb)
+    zlog_warn ("MRT routes dump %s: previous dump still in progress, "
+               "skipping", bgp_dump->filename);
   /* Reschedule dump even if file couldn't be opened this time... */
-  if (bgp_dump_open_file (bgp_dump) != NULL)
+  else if (bgp_dump_open_file (bgp_dump) != NULL)
     {
-      /* In case of bgp_dump_routes, we need special route dump function. */
+      /* In case of bgp_dump_routes, we need special route dump function.
+         The file is closed once the dump is done, for a RIB dump
+         there's no point in leaving it open until the next scheduled
+         dump starts. */
       if (bgp_dump->type == BGP_DUMP_ROUTES)
-	{
-	  unsigned int seq = bgp_dump_routes_func (AFI_IP, 1, 0);
-#ifdef HAVE_IPV6
-	  bgp_dump_routes_func (AFI_IP6, 0, seq);
-#endif /* HAVE_IPV6 */
-	  /* Close the file now. For a RIB dump there's no point in leaving
-	   * it open until the next scheduled dump starts. */
-	  fclose(bgp_dump->fp); bgp_dump->fp = NULL;
-	}
+	bgp_dump_routes_start (bgp_dump);
     }
 
   /* if interval is set reschedule */
@@ -623,6 +836,10 @@ bgp_dump_set (struct vty *vty, struct bgp_dump *bgp_dump,
   /* Set type. */
   bgp_dump->type = type;
 
+  /* Abandon a routes dump still being written to the old file. */
+  if (bgp_dump->wb)
+    bgp_dump_routes_stop (bgp_dump, 0);
+
   /* Set file name. */
   if (bgp_dump->filename)
     free (bgp_dump->filename);
@@ -637,6 +854,9 @@ bgp_dump_set (struct vty *vty, struct bgp_dump *bgp_dump,
 static int
 bgp_dump_unset (struct vty *vty, struct bgp_dump *bgp_dump)
 {
+  if (bgp_dump->wb)
+    bgp_dump_routes_stop (bgp_dump, 0);
+
   /* Set file name. */
   if (bgp_dump->filename)
     {
@@ -772,6 +992,50 @@ DEFUN (no_dump_bgp_routes,
   return bgp_dump_unset (vty, &bgp_dump_routes);
 }
 
+static void
+bgp_dump_show (struct vty *vty, struct bgp_dump *bgp_dump, const char *name)
+{
+  char timebuf[30];
+
+  if (! bgp_dump->filename)
+    return;
+
+  vty_out (vty, "dump bgp %s %s%s%s%s", name, bgp_dump->filename,
+           bgp_dump->interval_str ? " " : "",
+           bgp_dump->interval_str ? bgp_dump->interval_str : "", VTY_NEWLINE);
+
+  if (bgp_dump->type != BGP_DUMP_ROUTES)
+    return;
+
+  if (bgp_dump->wb)
+    vty_out (vty, "  In progress: %lu records, %lu bytes%s",
+             bgp_dump->records, bgp_dump->bytes, VTY_NEWLINE);
+
+  if (bgp_dump->last_time)
+    {
+      strftime (timebuf, sizeof (timebuf), "%Y/%m/%d %H:%M:%S",
+                localtime (&bgp_dump->last_time));
+      vty_out (vty, "  Last dump finished %s: %lu records, %lu bytes "
+               "in %ld.%03ld seconds%s", timebuf,
+               bgp_dump->last_records, bgp_dump->last_bytes,
+               (long) bgp_dump->last_duration.tv_sec,
+               (long) bgp_dump->last_duration.tv_usec / 1000, VTY_NEWLINE);
+    }
+}
+
+DEFUN (show_dump_bgp,
+       show_dump_bgp_cmd,
+       "show dump bgp",
+       SHOW_STR
+       "Packet dump\n"
+       "BGP packet dump\n")
+{
+  bgp_dump_show (vty, &bgp_dump_all, "all");
+  bgp_dump_show (vty, &bgp_dump_updates, "updates");
+  bgp_dump_show (vty, &bgp_dump_routes, "routes-mrt");
+  return CMD_SUCCESS;
+}
+
 /* BGP node structure. */
 static struct cmd_node bgp_dump_node =
 {
@@ -864,4 +1128,7 @@ bgp_dump_init (void)
   install_element (CONFIG_NODE, &dump_bgp_routes_cmd);
   install_element (CONFIG_NODE, &dump_bgp_routes_interval_cmd);
   install_element (CONFIG_NODE, &no_dump_bgp_routes_cmd);
+
+  install_element (VIEW_NODE, &show_dump_bgp_cmd);
+  install_element (ENABLE_NODE, &show_dump_bgp_cmd);
 }
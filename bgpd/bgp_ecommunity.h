@@ -66,7 +66,9 @@ struct ecommunity_val
 #define ecom_length(X)    ((X)->size * ECOMMUNITY_SIZE)
 
 extern void ecommunity_init (void);
+extern struct ecommunity *ecommunity_new (void);
 extern void ecommunity_free (struct ecommunity *);
+extern int ecommunity_add_val (struct ecommunity *, struct ecommunity_val *);
 extern struct ecommunity *ecommunity_parse (u_int8_t *, u_short);
 extern struct ecommunity *ecommunity_dup (struct ecommunity *);
 extern struct ecommunity *ecommunity_merge (struct ecommunity *, struct ecommunity *);
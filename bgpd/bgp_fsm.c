@@ -30,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "stream.h"
 #include "memory.h"
 #include "plist.h"
+#include "sockopt.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_attr.h"
@@ -38,8 +39,10 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_packet.h"
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_route.h"
+#include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_zebra.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -292,6 +295,26 @@ bgp_keepalive_timer (struct thread *thread)
   return 0;
 }
 
+/* Is any update still queued for peer?  */
+static int
+bgp_routeadv_pending (struct peer *peer)
+{
+  struct bgp_advertise_fifo *fifo;
+  afi_t afi;
+  safi_t safi;
+
+  /* An empty fifo points back to itself. */
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      {
+	fifo = &peer->sync[afi][safi]->update;
+	if (fifo->next != (struct bgp_advertise *) fifo)
+	  return 1;
+      }
+
+  return 0;
+}
+
 static int
 bgp_routeadv_timer (struct thread *thread)
 {
@@ -309,12 +332,42 @@ bgp_routeadv_timer (struct thread *thread)
 
   BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 
+  /* Adapt the interval to the churn: it doubles, up to the configured
+     advertisement-interval, while each run finds new changes queued,
+     so that repeated changes to a prefix are coalesced into a single
+     UPDATE.  An idle peer stops the timer and drops back to the short
+     interval; bgp_routeadv_update () restarts it on the next change.  */
+  if (peer->routeadv_churn)
+    {
+      peer->v_routeadv_cur = MIN (peer->v_routeadv_cur * 2,
+				  peer->v_routeadv);
+      if (peer->v_routeadv_cur == 0 && peer->v_routeadv)
+	peer->v_routeadv_cur = BGP_ROUTEADV_IDLE;
+    }
+  else if (! bgp_routeadv_pending (peer))
+    {
+      peer->v_routeadv_cur = MIN (BGP_ROUTEADV_IDLE, peer->v_routeadv);
+      return 0;
+    }
+  peer->routeadv_churn = 0;
+
   BGP_TIMER_ON (peer->t_routeadv, bgp_routeadv_timer,
-		peer->v_routeadv);
+		peer->v_routeadv_cur);
 
   return 0;
 }
 
+/* A new advertisement has been queued for peer.  */
+void
+bgp_routeadv_update (struct peer *peer)
+{
+  peer->routeadv_churn++;
+
+  if (peer->status == Established)
+    BGP_TIMER_ON (peer->t_routeadv, bgp_routeadv_timer,
+		  peer->v_routeadv_cur);
+}
+
 /* Reset bgp update timer */
 static void
 bgp_uptime_reset (struct peer *peer)
@@ -396,12 +449,33 @@ bgp_graceful_stale_timer_expire (struct thread *thread)
   /* NSF delete stale route */
   for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
     for (safi = SAFI_UNICAST ; safi < SAFI_UNICAST_MULTICAST ; safi++)
-      if (peer->nsf[afi][safi])
+      if (peer->nsf[afi][safi]
+	  || CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_PRELOAD_STALE))
 	bgp_clear_stale_route (peer, afi, safi);
 
+  UNSET_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT);
+
   return 0;
 }
 
+/* Paths of peer have been preloaded from a checkpoint for each
+   address family with nsf set.  They are kept as though the peer was
+   restarting: until its End-of-RIB, or until the stalepath timer
+   expires for a peer which has no End-of-RIB to send. */
+void
+bgp_graceful_stale_start (struct peer *peer)
+{
+  SET_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT);
+
+  if (BGP_DEBUG (events, EVENTS))
+    zlog_debug ("%s graceful restart stalepath timer started for %d sec",
+		peer->host, peer->bgp->stalepath_time);
+
+  BGP_TIMER_OFF (peer->t_gr_stale);
+  BGP_TIMER_ON (peer->t_gr_stale, bgp_graceful_stale_timer_expire,
+		peer->bgp->stalepath_time);
+}
+
 /* Called after event occured, this function change status and reset
    read/write and timer thread. */
 void
@@ -471,6 +545,7 @@ bgp_stop (struct peer *peer)
       else
 	{
 	  UNSET_FLAG (peer->sflags, PEER_STATUS_NSF_MODE);
+	  UNSET_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT);
 
 	  for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
 	    for (safi = SAFI_UNICAST ; safi < SAFI_UNICAST_MULTICAST ; safi++)
@@ -515,6 +590,8 @@ bgp_stop (struct peer *peer)
     stream_reset (peer->work);
   if (peer->obuf)
     stream_fifo_clean (peer->obuf);
+  if (peer->obuf_ctrl)
+    stream_fifo_clean (peer->obuf_ctrl);
 
   /* Close of file descriptor. */
   if (peer->fd >= 0)
@@ -522,6 +599,7 @@ bgp_stop (struct peer *peer)
       close (peer->fd);
       peer->fd = -1;
     }
+  UNSET_FLAG (peer->sflags, PEER_STATUS_WRITE_LOWAT);
 
   for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
     for (safi = SAFI_UNICAST ; safi < SAFI_MAX ; safi++)
@@ -768,6 +846,7 @@ bgp_establish (struct peer *peer)
   afi_t afi;
   safi_t safi;
   int nsf_af_count = 0;
+  int stale_af_count = 0;
 
   /* Reset capability open status flag. */
   if (! CHECK_FLAG (peer->sflags, PEER_STATUS_CAPABILITY_OPEN))
@@ -786,6 +865,11 @@ bgp_establish (struct peer *peer)
   peer->established++;
   bgp_fsm_change_status (peer, Established);
 
+  /* Have the socket only report writable once its backlog of unsent
+     data has drained, so that bgp_write can hold back UPDATEs. */
+  if (sockopt_tcp_notsent_lowat (peer->fd, BGP_WRITE_UNSENT_MAX) == 0)
+    SET_FLAG (peer->sflags, PEER_STATUS_WRITE_LOWAT);
+
   /* bgp log-neighbor-changes of neighbor Up */
   if (bgp_flag_check (peer->bgp, BGP_FLAG_LOG_NEIGHBOR_CHANGES))
     zlog_info ("%%ADJCHANGE: neighbor %s Up", peer->host);
@@ -800,6 +884,7 @@ bgp_establish (struct peer *peer)
 	    && CHECK_FLAG (peer->af_cap[afi][safi], PEER_CAP_RESTART_AF_RCV))
 	  {
 	    if (peer->nsf[afi][safi]
+		&& ! CHECK_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT)
 		&& ! CHECK_FLAG (peer->af_cap[afi][safi], PEER_CAP_RESTART_AF_PRESERVE_RCV))
 	      bgp_clear_stale_route (peer, afi, safi);
 
@@ -808,18 +893,38 @@ bgp_establish (struct peer *peer)
 	  }
 	else
 	  {
-	    if (peer->nsf[afi][safi])
+	    if (peer->nsf[afi][safi]
+		&& CHECK_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT))
+	      {
+		SET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_PRELOAD_STALE);
+		stale_af_count++;
+	      }
+	    else if (peer->nsf[afi][safi])
 	      bgp_clear_stale_route (peer, afi, safi);
 	    peer->nsf[afi][safi] = 0;
 	  }
       }
 
+  /* Paths preloaded from a checkpoint stay stale until the End-of-RIB
+     of their address family, or until the stalepath timer expires,
+     whether or not the peer negotiated graceful restart for it, so
+     that zebra does not see them withdrawn and added back.  Those held
+     back from zebra for want of the interface to the peer can be sent
+     now. */
+  if (CHECK_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT))
+    {
+      if (nsf_af_count || stale_af_count)
+	bgp_zebra_announce_stale (peer);
+      else
+	UNSET_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT);
+    }
+
   if (nsf_af_count)
     SET_FLAG (peer->sflags, PEER_STATUS_NSF_MODE);
   else
     {
       UNSET_FLAG (peer->sflags, PEER_STATUS_NSF_MODE);
-      if (peer->t_gr_stale)
+      if (peer->t_gr_stale && ! CHECK_FLAG (peer->sflags, PEER_STATUS_CHECKPOINT))
 	{
 	  BGP_TIMER_OFF (peer->t_gr_stale);
 	  if (BGP_DEBUG (events, EVENTS))
@@ -865,8 +970,11 @@ bgp_establish (struct peer *peer)
 	    || CHECK_FLAG (peer->af_cap[afi][safi], PEER_CAP_ORF_PREFIX_SM_OLD_RCV))
 	  SET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_ORF_WAIT_REFRESH);
 
+  peer->v_routeadv_cur = MIN (BGP_ROUTEADV_IDLE, peer->v_routeadv);
   bgp_announce_route_all (peer);
 
+  /* The initial table is not churn.  */
+  peer->routeadv_churn = 0;
   BGP_TIMER_ON (peer->t_routeadv, bgp_routeadv_timer, 1);
 
   return 0;
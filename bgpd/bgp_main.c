@@ -35,6 +35,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_attr.h"
 #include "bgpd/bgp_mplsvpn.h"
+#include "bgpd/bgp_checkpoint.h"
 
 /* bgpd options, we use GNU getopt library. */
 static const struct option longopts[] = 
@@ -179,6 +180,8 @@ sigint (void)
 {
   zlog_notice ("Terminating on signal");
 
+  bgp_checkpoint_write ();
+
   if (! retain_mode)
     bgp_terminate ();
 
@@ -314,6 +317,9 @@ main (int argc, char **argv)
   /* Start execution only if not in dry-run mode */
   if(dryrun)
     return(0);
+
+  /* Preload the RIB kept by the last checkpoint. */
+  bgp_checkpoint_restore ();
   
   /* Turn into daemon if daemon_mode is set. */
   if (daemon_mode && daemon (0, 0) < 0)
@@ -25,11 +25,14 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "log.h"
 #include "memory.h"
 #include "stream.h"
+#include "hash.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_ecommunity.h"
 #include "bgpd/bgp_mplsvpn.h"
 
 static u_int16_t
@@ -235,7 +238,7 @@ str2tag (const char *str, u_char *tag)
 
   l = strtoul (str, &endptr, 10);
   
-  if (*endptr == '\0' || l == ULONG_MAX || l > UINT32_MAX)
+  if (*endptr != '\0' || l == ULONG_MAX || l > UINT32_MAX)
     return 0;
 
   t = (u_int32_t) l;
@@ -278,6 +281,499 @@ prefix_rd2str (struct prefix_rd *prd, char *buf, size_t size)
   return NULL;
 }
 
+/* Route target index.  Every VPNv4 path in the RIB is indexed under
+   each route target it carries, so that work concerning a route
+   target only has to look at the paths carrying it.  */
+struct bgp_rt_index
+{
+  struct ecommunity_val rt;
+
+  /* struct bgp_rt_path of the paths carrying the route target. */
+  struct hash *paths;
+};
+
+struct bgp_rt_path
+{
+  struct bgp_info *ri;
+  struct bgp_node *rn;
+};
+
+static int
+ecommunity_val_is_rt (const u_int8_t *pnt)
+{
+  return ((pnt[0] == ECOMMUNITY_ENCODE_AS
+	   || pnt[0] == ECOMMUNITY_ENCODE_IP
+	   || pnt[0] == ECOMMUNITY_ENCODE_AS4)
+	  && pnt[1] == ECOMMUNITY_ROUTE_TARGET);
+}
+
+static unsigned int
+bgp_rt_path_hash_key (void *arg)
+{
+  const struct bgp_rt_path *path = arg;
+
+  return jhash_1word ((u_int32_t) (uintptr_t) path->ri, 0);
+}
+
+static int
+bgp_rt_path_hash_cmp (const void *arg1, const void *arg2)
+{
+  const struct bgp_rt_path *path1 = arg1;
+  const struct bgp_rt_path *path2 = arg2;
+
+  return path1->ri == path2->ri;
+}
+
+static void *
+bgp_rt_path_hash_alloc (void *arg)
+{
+  struct bgp_rt_path *path;
+
+  path = XMALLOC (MTYPE_BGP_RT_INDEX_PATH, sizeof (struct bgp_rt_path));
+  *path = *(struct bgp_rt_path *) arg;
+  return path;
+}
+
+static unsigned int
+bgp_rt_index_hash_key (void *arg)
+{
+  const struct bgp_rt_index *index = arg;
+  struct ecommunity_val rt = index->rt;
+
+  return jhash (rt.val, ECOMMUNITY_SIZE, 0);
+}
+
+static int
+bgp_rt_index_hash_cmp (const void *arg1, const void *arg2)
+{
+  const struct bgp_rt_index *index1 = arg1;
+  const struct bgp_rt_index *index2 = arg2;
+
+  return memcmp (index1->rt.val, index2->rt.val, ECOMMUNITY_SIZE) == 0;
+}
+
+static void *
+bgp_rt_index_hash_alloc (void *arg)
+{
+  struct bgp_rt_index *index;
+
+  index = XCALLOC (MTYPE_BGP_RT_INDEX, sizeof (struct bgp_rt_index));
+  index->rt = ((struct bgp_rt_index *) arg)->rt;
+  index->paths = hash_create (bgp_rt_path_hash_key, bgp_rt_path_hash_cmp);
+  return index;
+}
+
+static struct bgp_rt_index *
+bgp_rt_index_lookup (struct bgp *bgp, const u_int8_t *rt)
+{
+  struct bgp_rt_index key;
+
+  if (! bgp->rt_index)
+    return NULL;
+
+  memcpy (key.rt.val, rt, ECOMMUNITY_SIZE);
+  return hash_lookup (bgp->rt_index, &key);
+}
+
+/* Index a VPNv4 path which has been added to the RIB, or has had its
+   attributes replaced.  */
+void
+bgp_rt_index_add (struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp *bgp = ri->peer->bgp;
+  struct ecommunity *ecom;
+  struct bgp_rt_index key;
+  struct bgp_rt_index *index;
+  struct bgp_rt_path path;
+  int i;
+
+  if (! ri->attr->extra || ! (ecom = ri->attr->extra->ecommunity))
+    return;
+
+  if (! bgp->rt_index)
+    bgp->rt_index = hash_create (bgp_rt_index_hash_key,
+				 bgp_rt_index_hash_cmp);
+
+  path.ri = ri;
+  path.rn = rn;
+
+  for (i = 0; i < ecom->size; i++)
+    {
+      if (! ecommunity_val_is_rt (ecom->val + i * ECOMMUNITY_SIZE))
+	continue;
+
+      memcpy (key.rt.val, ecom->val + i * ECOMMUNITY_SIZE, ECOMMUNITY_SIZE);
+      index = hash_get (bgp->rt_index, &key, bgp_rt_index_hash_alloc);
+      hash_get (index->paths, &path, bgp_rt_path_hash_alloc);
+    }
+
+  /* Hold on to the communities the path was indexed under, its
+     attributes may be replaced before it is taken out again.  */
+  ecom->refcnt++;
+  bgp_info_extra_get (ri)->rt_ecom = ecom;
+}
+
+/* Take a VPNv4 path out of the index.  */
+void
+bgp_rt_index_del (struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp *bgp = ri->peer->bgp;
+  struct ecommunity *ecom;
+  struct bgp_rt_index *index;
+  struct bgp_rt_path key;
+  struct bgp_rt_path *path;
+  int i;
+
+  if (! ri->extra || ! (ecom = ri->extra->rt_ecom))
+    return;
+
+  key.ri = ri;
+
+  for (i = 0; i < ecom->size; i++)
+    {
+      index = bgp_rt_index_lookup (bgp, ecom->val + i * ECOMMUNITY_SIZE);
+      if (! index)
+	continue;
+
+      if ((path = hash_release (index->paths, &key)) != NULL)
+	XFREE (MTYPE_BGP_RT_INDEX_PATH, path);
+
+      if (index->paths->count == 0)
+	{
+	  hash_release (bgp->rt_index, index);
+	  hash_free (index->paths);
+	  XFREE (MTYPE_BGP_RT_INDEX, index);
+	}
+    }
+
+  ri->extra->rt_ecom = NULL;
+  ecommunity_unintern (ecom);
+}
+
+static void
+bgp_rt_path_free (void *arg)
+{
+  XFREE (MTYPE_BGP_RT_INDEX_PATH, arg);
+}
+
+static void
+bgp_rt_index_entry_free (void *arg)
+{
+  struct bgp_rt_index *index = arg;
+
+  hash_clean (index->paths, bgp_rt_path_free);
+  hash_free (index->paths);
+  XFREE (MTYPE_BGP_RT_INDEX, index);
+}
+
+void
+bgp_rt_index_free (struct bgp *bgp)
+{
+  if (! bgp->rt_index)
+    return;
+
+  hash_clean (bgp->rt_index, bgp_rt_index_entry_free);
+  hash_free (bgp->rt_index);
+  bgp->rt_index = NULL;
+}
+
+/* Whether the route target filter of peer lets a VPNv4 route with
+   attr through: it must carry one of the route targets.  */
+int
+bgp_rt_filter_permit (struct peer *peer, struct attr *attr)
+{
+  struct ecommunity *ecom;
+  int i, j;
+
+  if (! peer->rt_filter)
+    return 1;
+
+  if (! attr->extra || ! (ecom = attr->extra->ecommunity))
+    return 0;
+
+  for (i = 0; i < ecom->size; i++)
+    for (j = 0; j < peer->rt_filter->size; j++)
+      if (memcmp (ecom->val + i * ECOMMUNITY_SIZE,
+		  peer->rt_filter->val + j * ECOMMUNITY_SIZE,
+		  ECOMMUNITY_SIZE) == 0)
+	return 1;
+
+  return 0;
+}
+
+static void
+bgp_rt_filter_announce_path (struct hash_backet *backet, void *arg)
+{
+  struct bgp_rt_path *path = backet->data;
+  struct peer *peer = arg;
+
+  if (CHECK_FLAG (path->ri->flags, BGP_INFO_SELECTED))
+    bgp_announce_node (peer, AFI_IP, SAFI_MPLS_VPN, path->rn);
+}
+
+/* The route targets in ecom have been added to or removed from the
+   route target filter of peer, announce or withdraw the routes
+   carrying them.  */
+static void
+bgp_rt_filter_update (struct peer *peer, struct ecommunity *ecom)
+{
+  struct bgp_rt_index *index;
+  int i;
+
+  if (peer->status != Established
+      || ! peer->afc_nego[AFI_IP][SAFI_MPLS_VPN])
+    return;
+
+  for (i = 0; i < ecom->size; i++)
+    if ((index = bgp_rt_index_lookup (peer->bgp,
+				      ecom->val + i * ECOMMUNITY_SIZE)))
+      hash_iterate (index->paths, bgp_rt_filter_announce_path, peer);
+}
+
+static struct peer *
+bgp_rt_filter_peer_vty (struct vty *vty, const char *ip_str)
+{
+  union sockunion su;
+  struct peer *peer;
+
+  if (str2sockunion (ip_str, &su) < 0)
+    {
+      vty_out (vty, "%% Malformed address: %s%s", ip_str, VTY_NEWLINE);
+      return NULL;
+    }
+
+  peer = peer_lookup (vty->index, &su);
+  if (! peer || ! peer->afc[AFI_IP][SAFI_MPLS_VPN])
+    {
+      vty_out (vty, "%% No such neighbor or address family%s", VTY_NEWLINE);
+      return NULL;
+    }
+  return peer;
+}
+
+static struct ecommunity *
+bgp_rt_filter_str2com (struct vty *vty, int argc, const char **argv)
+{
+  struct ecommunity *ecom;
+  char *str;
+
+  str = argv_concat (argv, argc, 1);
+  ecom = ecommunity_str2com (str, ECOMMUNITY_ROUTE_TARGET, 0);
+  XFREE (MTYPE_TMP, str);
+
+  if (! ecom)
+    vty_out (vty, "%% Malformed route target%s", VTY_NEWLINE);
+  return ecom;
+}
+
+DEFUN (neighbor_route_target,
+       neighbor_route_target_cmd,
+       NEIGHBOR_CMD "route-target .ASN:nn_or_IP-address:nn",
+       NEIGHBOR_STR
+       NEIGHBOR_ADDR_STR
+       "Only advertise routes carrying one of the route targets\n"
+       "Route target, in the form ASN:nn or IP-address:nn\n")
+{
+  struct peer *peer;
+  struct ecommunity *ecom;
+  int i;
+
+  if (! (peer = bgp_rt_filter_peer_vty (vty, argv[0])))
+    return CMD_WARNING;
+  if (! (ecom = bgp_rt_filter_str2com (vty, argc, argv)))
+    return CMD_WARNING;
+
+  /* A new filter may withdraw any route, so has to be applied to the
+     whole table.  */
+  if (! peer->rt_filter)
+    {
+      peer->rt_filter = ecom;
+      if (peer->status == Established)
+	bgp_announce_route (peer, AFI_IP, SAFI_MPLS_VPN);
+      return CMD_SUCCESS;
+    }
+
+  for (i = 0; i < ecom->size; i++)
+    ecommunity_add_val (peer->rt_filter,
+			(struct ecommunity_val *)
+			(ecom->val + i * ECOMMUNITY_SIZE));
+
+  bgp_rt_filter_update (peer, ecom);
+  ecommunity_free (ecom);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_neighbor_route_target,
+       no_neighbor_route_target_cmd,
+       NO_NEIGHBOR_CMD "route-target .ASN:nn_or_IP-address:nn",
+       NO_STR
+       NEIGHBOR_STR
+       NEIGHBOR_ADDR_STR
+       "Only advertise routes carrying one of the route targets\n"
+       "Route target, in the form ASN:nn or IP-address:nn\n")
+{
+  struct peer *peer;
+  struct ecommunity *ecom;
+  struct ecommunity *rest;
+  u_int8_t *pnt;
+  int i, j;
+
+  if (! (peer = bgp_rt_filter_peer_vty (vty, argv[0])))
+    return CMD_WARNING;
+
+  if (argc == 1)
+    ecom = NULL;
+  else if (! (ecom = bgp_rt_filter_str2com (vty, argc, argv)))
+    return CMD_WARNING;
+
+  if (! peer->rt_filter)
+    {
+      if (ecom)
+	ecommunity_free (ecom);
+      return CMD_SUCCESS;
+    }
+
+  /* Keep those route targets not being removed.  */
+  rest = ecommunity_new ();
+  for (i = 0; ecom && i < peer->rt_filter->size; i++)
+    {
+      pnt = peer->rt_filter->val + i * ECOMMUNITY_SIZE;
+      for (j = 0; j < ecom->size; j++)
+	if (memcmp (pnt, ecom->val + j * ECOMMUNITY_SIZE,
+		    ECOMMUNITY_SIZE) == 0)
+	  break;
+      if (j == ecom->size)
+	ecommunity_add_val (rest, (struct ecommunity_val *) pnt);
+    }
+
+  ecommunity_free (peer->rt_filter);
+
+  /* Without a filter any route may be advertised again.  */
+  if (rest->size == 0)
+    {
+      ecommunity_free (rest);
+      peer->rt_filter = NULL;
+      if (peer->status == Established)
+	bgp_announce_route (peer, AFI_IP, SAFI_MPLS_VPN);
+    }
+  else
+    {
+      peer->rt_filter = rest;
+      bgp_rt_filter_update (peer, ecom);
+    }
+
+  if (ecom)
+    ecommunity_free (ecom);
+  return CMD_SUCCESS;
+}
+
+ALIAS (no_neighbor_route_target,
+       no_neighbor_route_target_all_cmd,
+       NO_NEIGHBOR_CMD "route-target",
+       NO_STR
+       NEIGHBOR_STR
+       NEIGHBOR_ADDR_STR
+       "Only advertise routes carrying one of the route targets\n")
+
+static int
+bgp_rt_path_cmp (const void *arg1, const void *arg2)
+{
+  const struct bgp_rt_path *path1 = *(const struct bgp_rt_path * const *) arg1;
+  const struct bgp_rt_path *path2 = *(const struct bgp_rt_path * const *) arg2;
+  int ret;
+
+  ret = memcmp (path1->rn->prn->p.u.val, path2->rn->prn->p.u.val, 8);
+  if (ret)
+    return ret;
+  ret = memcmp (&path1->rn->p.u.prefix4, &path2->rn->p.u.prefix4,
+		sizeof (struct in_addr));
+  if (ret)
+    return ret;
+  return path1->rn->p.prefixlen - path2->rn->p.prefixlen;
+}
+
+static void
+bgp_rt_path_collect (struct hash_backet *backet, void *arg)
+{
+  struct bgp_rt_path ***next = arg;
+
+  *(*next)++ = backet->data;
+}
+
+DEFUN (show_ip_bgp_vpnv4_all_route_target,
+       show_ip_bgp_vpnv4_all_route_target_cmd,
+       "show ip bgp vpnv4 all route-target ASN:nn_or_IP-address:nn",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Display VPNv4 NLRI specific information\n"
+       "Display information about all VPNv4 NLRIs\n"
+       "Display routes carrying a route target\n"
+       "Route target, in the form ASN:nn or IP-address:nn\n")
+{
+  struct bgp *bgp;
+  struct ecommunity *ecom;
+  struct bgp_rt_index *index;
+  struct bgp_rt_path **paths, **next;
+  struct bgp_node *prn = NULL;
+  char buf[RD_ADDRSTRLEN];
+  unsigned long i, count;
+
+  bgp = bgp_get_default ();
+  if (bgp == NULL)
+    {
+      vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  ecom = ecommunity_str2com (argv[0], ECOMMUNITY_ROUTE_TARGET, 0);
+  if (! ecom || ecom->size != 1)
+    {
+      vty_out (vty, "%% Malformed route target%s", VTY_NEWLINE);
+      if (ecom)
+	ecommunity_free (ecom);
+      return CMD_WARNING;
+    }
+  index = bgp_rt_index_lookup (bgp, ecom->val);
+  ecommunity_free (ecom);
+
+  if (! index)
+    return CMD_SUCCESS;
+
+  /* Only the paths carrying the route target are looked at, sorted
+     into the order of the table.  */
+  count = index->paths->count;
+  paths = next = XMALLOC (MTYPE_TMP, count * sizeof (struct bgp_rt_path *));
+  hash_iterate (index->paths, bgp_rt_path_collect, &next);
+  qsort (paths, count, sizeof (struct bgp_rt_path *), bgp_rt_path_cmp);
+
+  vty_out (vty, "BGP table version is 0, local router ID is %s%s",
+	   inet_ntoa (bgp->router_id), VTY_NEWLINE);
+  vty_out (vty, "Status codes: s suppressed, d damped, h history, * valid, > best, i - internal%s",
+	   VTY_NEWLINE);
+  vty_out (vty, "Origin codes: i - IGP, e - EGP, ? - incomplete%s%s",
+	   VTY_NEWLINE, VTY_NEWLINE);
+  vty_out (vty, "   Network          Next Hop            Metric LocPrf Weight Path%s",
+	   VTY_NEWLINE);
+
+  for (i = 0; i < count; i++)
+    {
+      if (paths[i]->rn->prn != prn)
+	{
+	  prn = paths[i]->rn->prn;
+	  vty_out (vty, "Route Distinguisher: %s%s",
+		   prefix_rd2str ((struct prefix_rd *) &prn->p, buf,
+				  sizeof (buf)), VTY_NEWLINE);
+	}
+      route_vty_out (vty, &paths[i]->rn->p, paths[i]->ri, 0, SAFI_MPLS_VPN);
+    }
+
+  vty_out (vty, "%sTotal number of paths %lu%s", VTY_NEWLINE, count,
+	   VTY_NEWLINE);
+  XFREE (MTYPE_TMP, paths);
+  return CMD_SUCCESS;
+}
+
 /* For testing purpose, static route of MPLS-VPN. */
 DEFUN (vpnv4_network,
        vpnv4_network_cmd,
@@ -717,6 +1213,9 @@ bgp_mplsvpn_init (void)
 {
   install_element (BGP_VPNV4_NODE, &vpnv4_network_cmd);
   install_element (BGP_VPNV4_NODE, &no_vpnv4_network_cmd);
+  install_element (BGP_VPNV4_NODE, &neighbor_route_target_cmd);
+  install_element (BGP_VPNV4_NODE, &no_neighbor_route_target_cmd);
+  install_element (BGP_VPNV4_NODE, &no_neighbor_route_target_all_cmd);
 
 
   install_element (VIEW_NODE, &show_ip_bgp_vpnv4_all_cmd);
@@ -727,6 +1226,7 @@ bgp_mplsvpn_init (void)
   install_element (VIEW_NODE, &show_ip_bgp_vpnv4_rd_neighbor_routes_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_vpnv4_all_neighbor_advertised_routes_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_vpnv4_rd_neighbor_advertised_routes_cmd);
+  install_element (VIEW_NODE, &show_ip_bgp_vpnv4_all_route_target_cmd);
 
   install_element (ENABLE_NODE, &show_ip_bgp_vpnv4_all_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_vpnv4_rd_cmd);
@@ -736,4 +1236,5 @@ bgp_mplsvpn_init (void)
   install_element (ENABLE_NODE, &show_ip_bgp_vpnv4_rd_neighbor_routes_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_vpnv4_all_neighbor_advertised_routes_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_vpnv4_rd_neighbor_advertised_routes_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_vpnv4_all_route_target_cmd);
 }
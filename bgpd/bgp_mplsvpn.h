@@ -47,4 +47,11 @@ extern int str2prefix_rd (const char *, struct prefix_rd *);
 extern int str2tag (const char *, u_char *);
 extern char *prefix_rd2str (struct prefix_rd *, char *, size_t);
 
+struct bgp_node;
+struct bgp_info;
+extern void bgp_rt_index_add (struct bgp_node *, struct bgp_info *);
+extern void bgp_rt_index_del (struct bgp_node *, struct bgp_info *);
+extern void bgp_rt_index_free (struct bgp *);
+extern int bgp_rt_filter_permit (struct peer *, struct attr *);
+
 #endif /* _QUAGGA_BGP_MPLSVPN_H */
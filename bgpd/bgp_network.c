@@ -179,9 +179,7 @@ bgp_accept (struct thread *thread)
   {
     char buf[SU_ADDRSTRLEN + 1];
 
-    peer = peer_create_accept (bgp);
-    SET_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER);
-    peer->su = su;
+    peer = peer_create_accept (bgp, &su);
     peer->fd = bgp_sock;
     peer->status = Active;
     peer->local_id = peer1->local_id;
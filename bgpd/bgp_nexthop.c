@@ -470,6 +470,9 @@ bgp_scan (afi_t afi, safi_t safi)
 	      else
 		UNSET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
 
+	      if (changed || metricchanged)
+		bgp_info_changed (rn, bi);
+
 	      if (valid != current)
 		{
 		  if (CHECK_FLAG (bi->flags, BGP_INFO_VALID))
@@ -485,13 +488,6 @@ bgp_scan (afi_t afi, safi_t safi)
 					       afi, SAFI_UNICAST);
 		    }
 		}
-
-              if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST],
-		  BGP_CONFIG_DAMPENING)
-                  &&  bi->extra && bi->extra->damp_info )
-                if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
-		  bgp_aggregate_increment (bgp, &rn->p, bi,
-					   afi, SAFI_UNICAST);
 	    }
 	}
       bgp_process (bgp, rn, afi, SAFI_UNICAST);
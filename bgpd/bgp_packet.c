@@ -30,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "sockunion.h"		/* for inet_ntop () */
 #include "linklist.h"
 #include "plist.h"
+#include "sockopt.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -84,19 +85,38 @@ bgp_packet_set_size (struct stream *s)
   return cp;
 }
 
-/* Add new packet to the peer. */
+/* Add new packet to the peer.  UPDATEs are queued on obuf, all other
+   messages on obuf_ctrl so that they can go ahead of the UPDATEs. */
 static void
 bgp_packet_add (struct peer *peer, struct stream *s)
 {
   /* Add packet to the end of list. */
-  stream_fifo_push (peer->obuf, s);
+  if (stream_getc_from (s, BGP_MARKER_SIZE + 2) == BGP_MSG_UPDATE)
+    stream_fifo_push (peer->obuf, s);
+  else
+    stream_fifo_push (peer->obuf_ctrl, s);
 }
 
-/* Free first packet. */
+/* Free the packet just written, which heads one of the queues. */
 static void
-bgp_packet_delete (struct peer *peer)
+bgp_packet_delete (struct peer *peer, struct stream *s)
+{
+  if (s == stream_fifo_head (peer->obuf_ctrl))
+    stream_free (stream_fifo_pop (peer->obuf_ctrl));
+  else
+    stream_free (stream_fifo_pop (peer->obuf));
+}
+
+/* Whether so much is still waiting to be sent on the socket that no
+   more UPDATEs should be produced for now.  Only done when the socket
+   wakes bgp_write up again once it has drained. */
+static int
+bgp_write_backlog (struct peer *peer)
 {
-  stream_free (stream_fifo_pop (peer->obuf));
+  if (! CHECK_FLAG (peer->sflags, PEER_STATUS_WRITE_LOWAT))
+    return 0;
+
+  return sockopt_tcp_unsent (peer->fd) >= (int) BGP_WRITE_UNSENT_MAX;
 }
 
 /* Check file descriptor whether connect is established. */
@@ -142,7 +162,6 @@ static struct stream *
 bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct stream *packet;
   struct bgp_node *rn = NULL;
@@ -160,7 +179,6 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
     {
       assert (adv->rn);
       rn = adv->rn;
-      adj = adv->adj;
       if (adv->binfo)
         binfo = adv->binfo;
 
@@ -204,14 +222,7 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	      rn->p.prefixlen);
 
       /* Synchnorize attribute.  */
-      if (adj->attr)
-	bgp_attr_unintern (adj->attr);
-      else
-	peer->scount[afi][safi]++;
-
-      adj->attr = bgp_attr_intern (adv->baa->attr);
-
-      adv = bgp_advertise_clean (peer, adj, afi, safi);
+      adv = bgp_adj_out_sent (peer, adv, afi, safi);
 
       if (! (afi == AFI_IP && safi == SAFI_UNICAST))
 	break;
@@ -278,7 +289,6 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 {
   struct stream *s;
   struct stream *packet;
-  struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct bgp_node *rn;
   unsigned long pos;
@@ -292,7 +302,6 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
   while ((adv = FIFO_HEAD (&peer->sync[afi][safi]->withdraw)) != NULL)
     {
       assert (adv->rn);
-      adj = adv->adj;
       rn = adv->rn;
 
       if (STREAM_REMAIN (s) 
@@ -330,8 +339,7 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 
       peer->scount[afi][safi]--;
 
-      bgp_adj_out_remove (rn, adj, peer, afi, safi);
-      bgp_unlock_node (rn);
+      bgp_adj_out_remove (rn, peer, afi, safi);
 
       if (! (afi == AFI_IP && safi == SAFI_UNICAST))
 	break;
@@ -504,12 +512,25 @@ bgp_write_packet (struct peer *peer)
   afi_t afi;
   safi_t safi;
   struct stream *s = NULL;
+  struct stream *ctrl;
   struct bgp_advertise *adv;
 
+  /* A partly written UPDATE has to be finished first, otherwise other
+     messages are sent ahead of the UPDATEs. */
   s = stream_fifo_head (peer->obuf);
+  if (s && stream_get_getp (s) > 0)
+    return s;
+
+  ctrl = stream_fifo_head (peer->obuf_ctrl);
+  if (ctrl)
+    return ctrl;
+
   if (s)
     return s;
 
+  if (bgp_write_backlog (peer))
+    return NULL;
+
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       {
@@ -571,7 +592,7 @@ bgp_write_proceed (struct peer *peer)
   safi_t safi;
   struct bgp_advertise *adv;
 
-  if (stream_fifo_head (peer->obuf))
+  if (stream_fifo_head (peer->obuf) || stream_fifo_head (peer->obuf_ctrl))
     return 1;
 
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
@@ -618,7 +639,13 @@ bgp_write (struct thread *thread)
 
       s = bgp_write_packet (peer);
       if (! s)
-	return 0;
+	{
+	  /* UPDATEs held back while the socket is backed up are produced
+	     once it has drained. */
+	  if (bgp_write_backlog (peer) && bgp_write_proceed (peer))
+	    BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+	  return 0;
+	}
       
       /* XXX: FIXME, the socket should be NONBLOCK from the start
        * status shouldnt need to be toggled on each write
@@ -689,7 +716,7 @@ bgp_write (struct thread *thread)
 	}
 
       /* OK we send packet so delete it. */
-      bgp_packet_delete (peer);
+      bgp_packet_delete (peer, s);
 
       if (++count >= BGP_WRITE_PACKET_MAX)
 	break;
@@ -710,7 +737,7 @@ bgp_write_notify (struct peer *peer)
   struct stream *s; 
 
   /* There should be at least one packet. */
-  s = stream_fifo_head (peer->obuf);
+  s = stream_fifo_head (peer->obuf_ctrl);
   if (!s)
     return 0;
   assert (stream_get_endp (s) >= BGP_HEADER_SIZE);
@@ -857,6 +884,7 @@ bgp_notify_send_with_data (struct peer *peer, u_char code, u_char sub_code,
   
   /* Add packet to the peer. */
   stream_fifo_clean (peer->obuf);
+  stream_fifo_clean (peer->obuf_ctrl);
   bgp_packet_add (peer, s);
 
   /* For debug */
@@ -1097,7 +1125,6 @@ static int
 bgp_collision_detect (struct peer *new, struct in_addr remote_id)
 {
   struct peer *peer;
-  struct listnode *node, *nnode;
   struct bgp *bgp;
 
   bgp = bgp_get_default ();
@@ -1113,14 +1140,13 @@ bgp_collision_detect (struct peer *new, struct in_addr remote_id)
      OPEN message, then the local system performs the following
      collision resolution procedure: */
 
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+  for (peer = peer_addr_lookup (bgp, &new->su); peer; peer = peer->addr_next)
     {
       /* Under OpenConfirm status, local peer structure already hold
          remote router ID. */
 
       if (peer != new
-	  && (peer->status == OpenConfirm || peer->status == OpenSent)
-	  && sockunion_same (&peer->su, &new->su))
+	  && (peer->status == OpenConfirm || peer->status == OpenSent))
 	{
 	  /* 1. The BGP Identifier of the local system is compared to
 	     the BGP Identifier of the remote system (as specified in
@@ -1685,7 +1711,9 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
 		    PEER_STATUS_EOR_RECEIVED);
 
 	  /* NSF delete stale route */
-	  if (peer->nsf[AFI_IP][SAFI_UNICAST])
+	  if (peer->nsf[AFI_IP][SAFI_UNICAST]
+	      || CHECK_FLAG (peer->af_sflags[AFI_IP][SAFI_UNICAST],
+			     PEER_STATUS_PRELOAD_STALE))
 	    bgp_clear_stale_route (peer, AFI_IP, SAFI_UNICAST);
 
 	  if (BGP_DEBUG (normal, NORMAL))
@@ -1715,7 +1743,9 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
 		    PEER_STATUS_EOR_RECEIVED);
 
 	  /* NSF delete stale route */
-	  if (peer->nsf[AFI_IP][SAFI_MULTICAST])
+	  if (peer->nsf[AFI_IP][SAFI_MULTICAST]
+	      || CHECK_FLAG (peer->af_sflags[AFI_IP][SAFI_MULTICAST],
+			     PEER_STATUS_PRELOAD_STALE))
 	    bgp_clear_stale_route (peer, AFI_IP, SAFI_MULTICAST);
 
 	  if (BGP_DEBUG (normal, NORMAL))
@@ -1744,7 +1774,9 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
 	  SET_FLAG (peer->af_sflags[AFI_IP6][SAFI_UNICAST], PEER_STATUS_EOR_RECEIVED);
 
 	  /* NSF delete stale route */
-	  if (peer->nsf[AFI_IP6][SAFI_UNICAST])
+	  if (peer->nsf[AFI_IP6][SAFI_UNICAST]
+	      || CHECK_FLAG (peer->af_sflags[AFI_IP6][SAFI_UNICAST],
+			     PEER_STATUS_PRELOAD_STALE))
 	    bgp_clear_stale_route (peer, AFI_IP6, SAFI_UNICAST);
 
 	  if (BGP_DEBUG (normal, NORMAL))
@@ -1772,7 +1804,9 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
 	  /* End-of-RIB received */
 
 	  /* NSF delete stale route */
-	  if (peer->nsf[AFI_IP6][SAFI_MULTICAST])
+	  if (peer->nsf[AFI_IP6][SAFI_MULTICAST]
+	      || CHECK_FLAG (peer->af_sflags[AFI_IP6][SAFI_MULTICAST],
+			     PEER_STATUS_PRELOAD_STALE))
 	    bgp_clear_stale_route (peer, AFI_IP6, SAFI_MULTICAST);
 
 	  if (BGP_DEBUG (update, UPDATE_IN))
@@ -2458,7 +2492,10 @@ bgp_read (struct thread *thread)
       break;
     case BGP_MSG_UPDATE:
       peer->readtime = time(NULL);    /* Last read timer reset */
+      if (bgp_option_check (BGP_OPT_CONVERGENCE_STATS))
+	quagga_gettime (QUAGGA_CLK_MONOTONIC, &bm->update_recv);
       bgp_update_receive (peer, size);
+      timerclear (&bm->update_recv);
       break;
     case BGP_MSG_NOTIFY:
       bgp_notify_receive (peer, size);
@@ -26,6 +26,10 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #define BGP_UNFEASIBLE_LEN    2U
 #define BGP_WRITE_PACKET_MAX 10U
 
+/* No more UPDATEs are produced while this much is waiting unsent in the
+   socket, so that a KEEPALIVE doesn't queue behind a long backlog. */
+#define BGP_WRITE_UNSENT_MAX (16 * BGP_MAX_PACKET_SIZE)
+
 /* When to refresh */
 #define REFRESH_IMMEDIATE 1
 #define REFRESH_DEFER     2 
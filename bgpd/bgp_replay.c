@@ -0,0 +1,1202 @@
+/* BGP MRT replay load generator
+   Copyright (C) 2026 The Quagga project
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+/* bgp_replay feeds the routes of MRT files into a running bgpd over
+   real TCP sessions, to benchmark bgpd against Internet sized tables.
+
+   TABLE_DUMP_V2 RIB entries are turned into UPDATEs, BGP4MP UPDATE
+   messages (4-octet AS variant) are sent as they were recorded.  The
+   original peers of the file are spread over the emulated peers, which
+   connect from consecutive local addresses and announce AS4 and the
+   IPv4 and IPv6 unicast capabilities.  An optional monitor peer only
+   receives what bgpd advertises; the time until it has been quiet for
+   a while is taken as the convergence time.
+
+   bgpd needs a neighbor for each emulated peer, with ebgp-multihop when
+   the peers are eBGP since the recorded next hops are not connected,
+   and activated for IPv6 unicast if IPv6 routes are replayed. */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "getopt.h"
+#include "thread.h"
+#include <lib/version.h>
+#include "stream.h"
+#include "buffer.h"
+#include "memory.h"
+#include "network.h"
+#include "prefix.h"
+#include "log.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_aspath.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_open.h"
+#include "bgpd/bgp_dump.h"
+
+/* MRT type of TABLE_DUMP_V2 records, see bgp_dump.c. */
+#define MSG_TABLE_DUMP_V2            13
+
+/* MRT common header and the largest record that is accepted. */
+#define REPLAY_MRT_HEADER_SIZE       12
+#define REPLAY_MRT_MAX_SIZE          (1024 * 1024)
+
+#define REPLAY_HOLDTIME              180
+#define REPLAY_QUIET_DEFAULT         5
+
+/* An emulated peer. */
+struct replay_peer
+{
+  as_t as;
+  struct in_addr local;
+  int fd;
+  int monitor;
+  int established;
+  int keepalive;
+
+  /* Messages from bgpd that have not been completely read yet. */
+  u_char ibuf[BGP_MAX_PACKET_SIZE * 2];
+  size_t ilen;
+
+  struct buffer *obuf;
+
+  struct thread *t_read;
+  struct thread *t_write;
+  struct thread *t_keepalive;
+
+  /* IPv4 UPDATE being filled with prefixes sharing its attributes. */
+  struct stream *upd;
+  int upd_pending;
+  size_t upd_attr_len;
+
+  /* Counters. */
+  unsigned long updates;
+  unsigned long prefixes;
+};
+
+/* Original peer of a BGP4MP file, and the emulated peer it maps to. */
+struct replay_source
+{
+  u_int16_t afi;
+  u_char addr[IPV6_MAX_BYTELEN];
+};
+
+struct thread_master *master;
+
+/* Options. */
+static as_t replay_as = 65000;
+static struct in_addr replay_remote;
+static int replay_port = BGP_PORT_DEFAULT;
+static struct in_addr replay_local;
+static int replay_npeers = 1;
+static struct in_addr replay_monitor_addr;
+static as_t replay_monitor_as = 65001;
+static double replay_speed = 0;
+static int replay_quiet = REPLAY_QUIET_DEFAULT;
+static const char *replay_pid_file;
+
+static struct replay_peer *replay_peers;
+static struct replay_peer *replay_monitor;
+static int replay_established;
+
+/* Input files and the MRT record being replayed. */
+static char **replay_files;
+static int replay_nfiles;
+static int replay_fileno;
+static FILE *replay_fp;
+static struct stream *replay_rec;
+static u_int32_t replay_rec_time;
+static u_int16_t replay_rec_type;
+static u_int16_t replay_rec_subtype;
+static int replay_rec_held;
+
+/* Emulated peers already sent a path for the prefix of the current
+   TABLE_DUMP_V2 record. */
+static u_char *replay_sent;
+
+static struct replay_source *replay_sources;
+static int replay_nsources;
+static int replay_sources_size;
+
+static struct stream *replay_obuf;
+static struct thread *t_replay;
+static struct thread *t_tick;
+static int replay_waiting;
+static int replay_finished;
+static int replay_injected;
+
+/* Original timing. */
+static int replay_clock_set;
+static u_int32_t replay_mrt_start;
+static struct timeval replay_wall_start;
+
+/* Statistics. */
+static unsigned long replay_records;
+static unsigned long replay_skipped;
+static struct timeval replay_first_sent;
+static struct timeval replay_inject_end;
+static struct timeval replay_monitor_last;
+static unsigned long replay_rss_start;
+static unsigned long replay_rss_peak;
+
+static int replay_run (struct thread *);
+
+static const struct option longopts[] =
+{
+  { "as",          required_argument, NULL, 'a'},
+  { "remote",      required_argument, NULL, 'r'},
+  { "port",        required_argument, NULL, 'p'},
+  { "local",       required_argument, NULL, 'l'},
+  { "peers",       required_argument, NULL, 'n'},
+  { "monitor",     required_argument, NULL, 'm'},
+  { "monitor_as",  required_argument, NULL, 'M'},
+  { "speed",       required_argument, NULL, 's'},
+  { "quiet",       required_argument, NULL, 'q'},
+  { "pid_file",    required_argument, NULL, 'i'},
+  { "help",        no_argument,       NULL, 'h'},
+  { 0 }
+};
+
+static void
+usage (char *progname, int status)
+{
+  if (status != 0)
+    fprintf (stderr, "Try `%s --help' for more information.\n", progname);
+  else
+    {
+      printf ("Usage : %s [OPTION...] FILE...\n\n\
+Replay the routes of MRT TABLE_DUMP_V2 and BGP4MP files into bgpd \
+and measure how it copes.\n\n\
+-a, --as           AS number of the emulated peers (default 65000)\n\
+-r, --remote       Address of bgpd (default 127.0.0.1)\n\
+-p, --port         Port of bgpd (default 179)\n\
+-l, --local        Address of the first emulated peer, the others use\n\
+                   the following addresses (default 127.0.1.1)\n\
+-n, --peers        Number of emulated peers (default 1)\n\
+-m, --monitor      Address of a monitor peer measuring convergence\n\
+-M, --monitor_as   AS number of the monitor peer (default 65001)\n\
+-s, --speed        0 to replay as fast as possible (default), 1 for the\n\
+                   original timing, N for N times faster\n\
+-q, --quiet        Seconds the monitor must be quiet to have converged\n\
+                   (default %d)\n\
+-i, --pid_file     pid file of bgpd, to report its resident size\n\
+-h, --help         Display this help and exit\n\
+\n\
+Report bugs to %s\n", progname, REPLAY_QUIET_DEFAULT, ZEBRA_BUG_ADDRESS);
+    }
+
+  exit (status);
+}
+
+static double
+replay_elapsed (struct timeval *start, struct timeval *end)
+{
+  return (end->tv_sec - start->tv_sec)
+    + (end->tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Resident size of bgpd in kB, 0 if it can't be told. */
+static unsigned long
+replay_rss (void)
+{
+  FILE *fp;
+  char buf[128];
+  long pid = 0;
+  unsigned long rss = 0;
+
+  if (! replay_pid_file)
+    return 0;
+
+  fp = fopen (replay_pid_file, "r");
+  if (! fp)
+    return 0;
+  if (fscanf (fp, "%ld", &pid) != 1)
+    pid = 0;
+  fclose (fp);
+  if (pid <= 0)
+    return 0;
+
+  snprintf (buf, sizeof (buf), "/proc/%ld/status", pid);
+  fp = fopen (buf, "r");
+  if (! fp)
+    return 0;
+  while (fgets (buf, sizeof (buf), fp))
+    if (sscanf (buf, "VmRSS: %lu", &rss) == 1)
+      break;
+  fclose (fp);
+
+  return rss;
+}
+
+/* Count the prefixes announced in an UPDATE, in its NLRI and in
+   MP_REACH_NLRI attributes. */
+static unsigned long
+replay_update_prefixes (const u_char *data, size_t size)
+{
+  size_t withdraw_len, attr_len, end, pos;
+  unsigned long count = 0;
+  u_char flag, type;
+  size_t len;
+
+  if (size < 4)
+    return 0;
+  withdraw_len = (data[0] << 8) | data[1];
+  if (2 + withdraw_len + 2 > size)
+    return 0;
+  attr_len = (data[2 + withdraw_len] << 8) | data[3 + withdraw_len];
+  pos = 4 + withdraw_len;
+  end = pos + attr_len;
+  if (end > size)
+    return 0;
+
+  while (pos + 3 <= end)
+    {
+      flag = data[pos];
+      type = data[pos + 1];
+      if (CHECK_FLAG (flag, BGP_ATTR_FLAG_EXTLEN))
+	{
+	  if (pos + 4 > end)
+	    break;
+	  len = (data[pos + 2] << 8) | data[pos + 3];
+	  pos += 4;
+	}
+      else
+	{
+	  len = data[pos + 2];
+	  pos += 3;
+	}
+      if (pos + len > end)
+	break;
+
+      /* AFI, SAFI, next hop and reserved octet precede the NLRI. */
+      if (type == BGP_ATTR_MP_REACH_NLRI && len >= 5
+	  && (size_t) 5 + data[pos + 3] <= len)
+	{
+	  size_t p = pos + 5 + data[pos + 3];
+
+	  while (p < pos + len)
+	    {
+	      p += 1 + PSIZE (data[p]);
+	      count++;
+	    }
+	}
+      pos += len;
+    }
+
+  for (pos = end; pos < size; pos += 1 + PSIZE (data[pos]))
+    count++;
+
+  return count;
+}
+
+/* Start a BGP message of the given type in the stream. */
+static void
+replay_msg_new (struct stream *s, u_char type)
+{
+  int i;
+
+  stream_reset (s);
+  for (i = 0; i < BGP_MARKER_SIZE; i++)
+    stream_putc (s, 0xff);
+  stream_putw (s, 0);
+  stream_putc (s, type);
+}
+
+static int
+replay_write (struct thread *t)
+{
+  struct replay_peer *peer;
+
+  peer = THREAD_ARG (t);
+  peer->t_write = NULL;
+
+  switch (buffer_flush_available (peer->obuf, peer->fd))
+    {
+    case BUFFER_ERROR:
+      fprintf (stderr, "%s: write error: %s\n", inet_ntoa (peer->local),
+	       safe_strerror (errno));
+      exit (1);
+    case BUFFER_PENDING:
+      peer->t_write = thread_add_write (master, replay_write, peer, peer->fd);
+      break;
+    case BUFFER_EMPTY:
+      break;
+    }
+
+  /* The replay waits for the output of the emulated peers to drain
+     before producing more. */
+  if (replay_waiting && buffer_empty (peer->obuf))
+    {
+      int i;
+
+      for (i = 0; i < replay_npeers; i++)
+	if (! buffer_empty (replay_peers[i].obuf))
+	  return 0;
+
+      replay_waiting = 0;
+      if (replay_finished)
+	{
+	  quagga_gettime (QUAGGA_CLK_MONOTONIC, &replay_inject_end);
+	  replay_injected = 1;
+	}
+      else
+	t_replay = thread_add_event (master, replay_run, NULL, 0);
+    }
+
+  return 0;
+}
+
+/* Send a message prepared with replay_msg_new. */
+static void
+replay_send (struct replay_peer *peer, struct stream *s)
+{
+  stream_putw_at (s, BGP_MARKER_SIZE, stream_get_endp (s));
+
+  if (STREAM_DATA (s)[BGP_MARKER_SIZE + 2] == BGP_MSG_UPDATE)
+    {
+      if (! replay_first_sent.tv_sec && ! replay_first_sent.tv_usec)
+	quagga_gettime (QUAGGA_CLK_MONOTONIC, &replay_first_sent);
+      peer->updates++;
+    }
+
+  switch (buffer_write (peer->obuf, peer->fd, STREAM_DATA (s),
+			stream_get_endp (s)))
+    {
+    case BUFFER_ERROR:
+      fprintf (stderr, "%s: write error: %s\n", inet_ntoa (peer->local),
+	       safe_strerror (errno));
+      exit (1);
+    case BUFFER_PENDING:
+      if (! peer->t_write)
+	peer->t_write = thread_add_write (master, replay_write, peer,
+					  peer->fd);
+      break;
+    case BUFFER_EMPTY:
+      break;
+    }
+}
+
+/* Send the IPv4 UPDATE being filled, if any. */
+static void
+replay_flush (struct replay_peer *peer)
+{
+  if (! peer->upd_pending)
+    return;
+
+  replay_send (peer, peer->upd);
+  peer->upd_pending = 0;
+}
+
+static void
+replay_flush_all (void)
+{
+  int i;
+
+  for (i = 0; i < replay_npeers; i++)
+    replay_flush (&replay_peers[i]);
+}
+
+static int
+replay_keepalive (struct thread *t)
+{
+  struct replay_peer *peer;
+
+  peer = THREAD_ARG (t);
+  peer->t_keepalive = thread_add_timer (master, replay_keepalive, peer,
+					peer->keepalive);
+
+  replay_msg_new (replay_obuf, BGP_MSG_KEEPALIVE);
+  replay_send (peer, replay_obuf);
+  return 0;
+}
+
+static void
+replay_send_open (struct replay_peer *peer)
+{
+  struct stream *s = replay_obuf;
+  size_t optp;
+  afi_t afi;
+
+  replay_msg_new (s, BGP_MSG_OPEN);
+  stream_putc (s, BGP_VERSION_4);
+  stream_putw (s, peer->as > BGP_AS_MAX ? BGP_AS_TRANS : peer->as);
+  stream_putw (s, REPLAY_HOLDTIME);
+  stream_put_in_addr (s, &peer->local);
+
+  optp = stream_get_endp (s);
+  stream_putc (s, 0);
+
+  for (afi = AFI_IP; afi <= AFI_IP6; afi++)
+    {
+      stream_putc (s, BGP_OPEN_OPT_CAP);
+      stream_putc (s, CAPABILITY_CODE_MP_LEN + 2);
+      stream_putc (s, CAPABILITY_CODE_MP);
+      stream_putc (s, CAPABILITY_CODE_MP_LEN);
+      stream_putw (s, afi);
+      stream_putc (s, 0);
+      stream_putc (s, SAFI_UNICAST);
+    }
+
+  stream_putc (s, BGP_OPEN_OPT_CAP);
+  stream_putc (s, CAPABILITY_CODE_AS4_LEN + 2);
+  stream_putc (s, CAPABILITY_CODE_AS4);
+  stream_putc (s, CAPABILITY_CODE_AS4_LEN);
+  stream_putl (s, peer->as);
+
+  stream_putc_at (s, optp, stream_get_endp (s) - optp - 1);
+
+  replay_send (peer, s);
+}
+
+/* Handle a message from bgpd. */
+static void
+replay_message (struct replay_peer *peer, u_char type, u_char *data,
+		size_t size)
+{
+  u_int16_t holdtime;
+
+  switch (type)
+    {
+    case BGP_MSG_OPEN:
+      if (size < 10)
+	break;
+      holdtime = (data[3] << 8) | data[4];
+      if (holdtime > REPLAY_HOLDTIME)
+	holdtime = REPLAY_HOLDTIME;
+      replay_msg_new (replay_obuf, BGP_MSG_KEEPALIVE);
+      replay_send (peer, replay_obuf);
+      if (holdtime)
+	{
+	  peer->keepalive = holdtime / 3;
+	  peer->t_keepalive = thread_add_timer (master, replay_keepalive,
+						peer, peer->keepalive);
+	}
+      break;
+    case BGP_MSG_KEEPALIVE:
+      if (peer->established)
+	break;
+      peer->established = 1;
+      replay_established++;
+      if (replay_established == replay_npeers + (replay_monitor ? 1 : 0))
+	{
+	  printf ("All %d sessions established, replaying\n",
+		  replay_established);
+	  t_replay = thread_add_event (master, replay_run, NULL, 0);
+	}
+      break;
+    case BGP_MSG_UPDATE:
+      if (! peer->monitor)
+	break;
+      peer->updates++;
+      peer->prefixes += replay_update_prefixes (data, size);
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &replay_monitor_last);
+      break;
+    case BGP_MSG_NOTIFY:
+      fprintf (stderr, "%s: NOTIFICATION from bgpd, code %d subcode %d\n",
+	       inet_ntoa (peer->local), size > 0 ? data[0] : 0,
+	       size > 1 ? data[1] : 0);
+      exit (1);
+    default:
+      break;
+    }
+}
+
+static int
+replay_read (struct thread *t)
+{
+  struct replay_peer *peer;
+  ssize_t nbytes;
+  size_t off, len;
+
+  peer = THREAD_ARG (t);
+  peer->t_read = NULL;
+
+  nbytes = read (peer->fd, peer->ibuf + peer->ilen,
+		 sizeof (peer->ibuf) - peer->ilen);
+  if (nbytes == 0)
+    {
+      fprintf (stderr, "%s: connection closed by bgpd\n",
+	       inet_ntoa (peer->local));
+      exit (1);
+    }
+  if (nbytes < 0)
+    {
+      if (! ERRNO_IO_RETRY (errno))
+	{
+	  fprintf (stderr, "%s: read error: %s\n", inet_ntoa (peer->local),
+		   safe_strerror (errno));
+	  exit (1);
+	}
+      nbytes = 0;
+    }
+  peer->ilen += nbytes;
+
+  for (off = 0; peer->ilen - off >= BGP_HEADER_SIZE; off += len)
+    {
+      len = (peer->ibuf[off + BGP_MARKER_SIZE] << 8)
+	| peer->ibuf[off + BGP_MARKER_SIZE + 1];
+      if (len < BGP_HEADER_SIZE || len > BGP_MAX_PACKET_SIZE)
+	{
+	  fprintf (stderr, "%s: bad message length %lu from bgpd\n",
+		   inet_ntoa (peer->local), (unsigned long) len);
+	  exit (1);
+	}
+      if (peer->ilen - off < len)
+	break;
+
+      replay_message (peer, peer->ibuf[off + BGP_MARKER_SIZE + 2],
+		      peer->ibuf + off + BGP_HEADER_SIZE,
+		      len - BGP_HEADER_SIZE);
+    }
+  memmove (peer->ibuf, peer->ibuf + off, peer->ilen - off);
+  peer->ilen -= off;
+
+  peer->t_read = thread_add_read (master, replay_read, peer, peer->fd);
+  return 0;
+}
+
+static void
+replay_connect (struct replay_peer *peer)
+{
+  struct sockaddr_in sin;
+
+  peer->fd = socket (AF_INET, SOCK_STREAM, 0);
+  if (peer->fd < 0)
+    {
+      perror ("socket");
+      exit (1);
+    }
+
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr = peer->local;
+  if (bind (peer->fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+    {
+      fprintf (stderr, "bind %s: %s\n", inet_ntoa (peer->local),
+	       safe_strerror (errno));
+      exit (1);
+    }
+
+  sin.sin_addr = replay_remote;
+  sin.sin_port = htons (replay_port);
+  if (connect (peer->fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+    {
+      fprintf (stderr, "connect from %s: %s\n", inet_ntoa (peer->local),
+	       safe_strerror (errno));
+      exit (1);
+    }
+  set_nonblocking (peer->fd);
+
+  peer->obuf = buffer_new (0);
+  peer->upd = stream_new (BGP_MAX_PACKET_SIZE);
+
+  replay_send_open (peer);
+  peer->t_read = thread_add_read (master, replay_read, peer, peer->fd);
+}
+
+/* Read the next MRT record, moving on to the next file at the end of
+   one.  Returns 0 once all files are done. */
+static int
+replay_next_record (void)
+{
+  u_char hdr[REPLAY_MRT_HEADER_SIZE];
+  u_int32_t len;
+
+  for (;;)
+    {
+      if (! replay_fp)
+	{
+	  if (replay_fileno >= replay_nfiles)
+	    return 0;
+	  replay_fp = fopen (replay_files[replay_fileno], "r");
+	  if (! replay_fp)
+	    {
+	      fprintf (stderr, "%s: %s\n", replay_files[replay_fileno],
+		       safe_strerror (errno));
+	      exit (1);
+	    }
+	}
+
+      if (fread (hdr, sizeof (hdr), 1, replay_fp) == 1)
+	break;
+
+      fclose (replay_fp);
+      replay_fp = NULL;
+      replay_fileno++;
+    }
+
+  replay_rec_time = (hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+  replay_rec_type = (hdr[4] << 8) | hdr[5];
+  replay_rec_subtype = (hdr[6] << 8) | hdr[7];
+  len = (hdr[8] << 24) | (hdr[9] << 16) | (hdr[10] << 8) | hdr[11];
+
+  if (len > REPLAY_MRT_MAX_SIZE)
+    {
+      fprintf (stderr, "%s: MRT record of %lu bytes, giving up\n",
+	       replay_files[replay_fileno], (unsigned long) len);
+      exit (1);
+    }
+  if (len > stream_get_size (replay_rec))
+    stream_resize (replay_rec, len);
+
+  stream_reset (replay_rec);
+  if (len && fread (STREAM_DATA (replay_rec), len, 1, replay_fp) != 1)
+    {
+      fprintf (stderr, "%s: truncated MRT record\n",
+	       replay_files[replay_fileno]);
+      exit (1);
+    }
+  stream_forward_endp (replay_rec, len);
+
+  replay_records++;
+  return 1;
+}
+
+/* Add an IPv4 prefix to the UPDATE being filled for the peer, starting
+   a new one if its attributes differ or it is full. */
+static void
+replay_announce_ipv4 (struct replay_peer *peer, u_char *attr,
+		      size_t attr_len, u_char plen, u_char *prefix)
+{
+  struct stream *s = peer->upd;
+  size_t psize = PSIZE (plen);
+
+  if (BGP_HEADER_SIZE + 4 + attr_len + 1 + psize > BGP_MAX_PACKET_SIZE)
+    {
+      replay_skipped++;
+      return;
+    }
+
+  if (peer->upd_pending
+      && (peer->upd_attr_len != attr_len
+	  || memcmp (STREAM_DATA (s) + BGP_HEADER_SIZE + 4, attr, attr_len)
+	  || stream_get_endp (s) + 1 + psize > BGP_MAX_PACKET_SIZE))
+    replay_flush (peer);
+
+  if (! peer->upd_pending)
+    {
+      replay_msg_new (s, BGP_MSG_UPDATE);
+      stream_putw (s, 0);
+      stream_putw (s, attr_len);
+      stream_put (s, attr, attr_len);
+      peer->upd_attr_len = attr_len;
+      peer->upd_pending = 1;
+    }
+
+  stream_putc (s, plen);
+  stream_put (s, prefix, psize);
+  peer->prefixes++;
+}
+
+/* Send an IPv6 prefix in an UPDATE of its own.  TABLE_DUMP_V2 may
+   abbreviate MP_REACH_NLRI to just the next hop, in which case the
+   attribute is rebuilt around it. */
+static void
+replay_announce_ipv6 (struct replay_peer *peer, u_char *attr,
+		      size_t attr_len, u_char plen, u_char *prefix)
+{
+  struct stream *s = replay_obuf;
+  size_t attrp, pos, len, hdr;
+  size_t psize = PSIZE (plen);
+  int reach = 0;
+
+  if (BGP_HEADER_SIZE + 4 + attr_len + 8 + psize > BGP_MAX_PACKET_SIZE)
+    {
+      replay_skipped++;
+      return;
+    }
+
+  replay_msg_new (s, BGP_MSG_UPDATE);
+  stream_putw (s, 0);
+  attrp = stream_get_endp (s);
+  stream_putw (s, 0);
+
+  for (pos = 0; pos + 3 <= attr_len; pos += hdr + len)
+    {
+      if (CHECK_FLAG (attr[pos], BGP_ATTR_FLAG_EXTLEN))
+	{
+	  if (pos + 4 > attr_len)
+	    break;
+	  hdr = 4;
+	  len = (attr[pos + 2] << 8) | attr[pos + 3];
+	}
+      else
+	{
+	  hdr = 3;
+	  len = attr[pos + 2];
+	}
+      if (pos + hdr + len > attr_len)
+	break;
+
+      if (attr[pos + 1] != BGP_ATTR_MP_REACH_NLRI)
+	{
+	  stream_put (s, attr + pos, hdr + len);
+	  continue;
+	}
+
+      reach = 1;
+      if (len == 0 || len != (size_t) 1 + attr[pos + hdr])
+	{
+	  stream_put (s, attr + pos, hdr + len);
+	  continue;
+	}
+
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL);
+      stream_putc (s, BGP_ATTR_MP_REACH_NLRI);
+      stream_putc (s, 2 + 1 + len + 1 + 1 + psize);
+      stream_putw (s, AFI_IP6);
+      stream_putc (s, SAFI_UNICAST);
+      stream_put (s, attr + pos + hdr, len);
+      stream_putc (s, 0);
+      stream_putc (s, plen);
+      stream_put (s, prefix, psize);
+    }
+
+  if (! reach)
+    {
+      replay_skipped++;
+      return;
+    }
+
+  stream_putw_at (s, attrp, stream_get_endp (s) - attrp - 2);
+  replay_send (peer, s);
+  peer->prefixes++;
+}
+
+/* Replay a TABLE_DUMP_V2 RIB record: each emulated peer announces the
+   first path of the prefix learnt from one of the original peers it
+   stands for. */
+static void
+replay_rib (afi_t afi)
+{
+  struct stream *s = replay_rec;
+  struct replay_peer *peer;
+  u_char prefix[IPV6_MAX_BYTELEN];
+  u_char plen;
+  u_int16_t count, index, attr_len;
+  u_char *attr;
+  int i;
+
+  if (STREAM_READABLE (s) < 5)
+    goto malformed;
+  stream_getl (s);
+  plen = stream_getc (s);
+  if (plen > (afi == AFI_IP ? IPV4_MAX_BITLEN : IPV6_MAX_BITLEN)
+      || STREAM_READABLE (s) < (size_t) PSIZE (plen) + 2)
+    goto malformed;
+  stream_get (prefix, s, PSIZE (plen));
+  count = stream_getw (s);
+
+  memset (replay_sent, 0, replay_npeers);
+  for (i = 0; i < count; i++)
+    {
+      if (STREAM_READABLE (s) < 8)
+	goto malformed;
+      index = stream_getw (s);
+      stream_getl (s);
+      attr_len = stream_getw (s);
+      if (STREAM_READABLE (s) < attr_len)
+	goto malformed;
+      attr = stream_pnt (s);
+      stream_forward_getp (s, attr_len);
+
+      if (replay_sent[index % replay_npeers])
+	continue;
+      replay_sent[index % replay_npeers] = 1;
+
+      peer = &replay_peers[index % replay_npeers];
+      if (afi == AFI_IP)
+	replay_announce_ipv4 (peer, attr, attr_len, plen, prefix);
+      else
+	replay_announce_ipv6 (peer, attr, attr_len, plen, prefix);
+    }
+  return;
+
+ malformed:
+  fprintf (stderr, "%s: malformed RIB record\n", replay_files[replay_fileno]);
+  replay_skipped++;
+}
+
+/* Emulated peer standing for the original peer with this address. */
+static struct replay_peer *
+replay_source_peer (u_int16_t afi, u_char *addr, size_t addr_len)
+{
+  int i;
+
+  for (i = 0; i < replay_nsources; i++)
+    if (replay_sources[i].afi == afi
+	&& ! memcmp (replay_sources[i].addr, addr, addr_len))
+      break;
+
+  if (i == replay_nsources)
+    {
+      if (replay_nsources == replay_sources_size)
+	{
+	  replay_sources_size = replay_sources_size ? replay_sources_size * 2
+						    : 16;
+	  replay_sources = XREALLOC (MTYPE_TMP, replay_sources,
+				     replay_sources_size
+				     * sizeof (struct replay_source));
+	}
+      memset (&replay_sources[i], 0, sizeof (struct replay_source));
+      replay_sources[i].afi = afi;
+      memcpy (replay_sources[i].addr, addr, addr_len);
+      replay_nsources++;
+    }
+
+  return &replay_peers[i % replay_npeers];
+}
+
+/* Replay the UPDATE of a BGP4MP_MESSAGE_AS4 record as it was. */
+static void
+replay_bgp4mp (void)
+{
+  struct stream *s = replay_rec;
+  struct replay_peer *peer;
+  u_char addr[IPV6_MAX_BYTELEN];
+  size_t addr_len;
+  u_int16_t afi;
+  u_char *msg;
+  size_t len;
+
+  if (STREAM_READABLE (s) < 12)
+    goto malformed;
+  stream_getl (s);
+  stream_getl (s);
+  stream_getw (s);
+  afi = stream_getw (s);
+  addr_len = (afi == AFI_IP6) ? IPV6_MAX_BYTELEN : IPV4_MAX_BYTELEN;
+  if (STREAM_READABLE (s) < 2 * addr_len + BGP_HEADER_SIZE)
+    goto malformed;
+  stream_get (addr, s, addr_len);
+  stream_forward_getp (s, addr_len);
+
+  msg = stream_pnt (s);
+  len = (msg[BGP_MARKER_SIZE] << 8) | msg[BGP_MARKER_SIZE + 1];
+  if (len < BGP_HEADER_SIZE || len > STREAM_READABLE (s)
+      || len > BGP_MAX_PACKET_SIZE)
+    goto malformed;
+  if (msg[BGP_MARKER_SIZE + 2] != BGP_MSG_UPDATE)
+    {
+      replay_skipped++;
+      return;
+    }
+
+  peer = replay_source_peer (afi, addr, addr_len);
+  replay_flush (peer);
+
+  stream_reset (replay_obuf);
+  stream_put (replay_obuf, msg, len);
+  replay_send (peer, replay_obuf);
+  peer->prefixes += replay_update_prefixes (msg + BGP_HEADER_SIZE,
+					    len - BGP_HEADER_SIZE);
+  return;
+
+ malformed:
+  fprintf (stderr, "%s: malformed BGP4MP record\n",
+	   replay_files[replay_fileno]);
+  replay_skipped++;
+}
+
+static void
+replay_record (void)
+{
+  switch (replay_rec_type)
+    {
+    case MSG_TABLE_DUMP_V2:
+      if (replay_rec_subtype == TABLE_DUMP_V2_RIB_IPV4_UNICAST)
+	replay_rib (AFI_IP);
+      else if (replay_rec_subtype == TABLE_DUMP_V2_RIB_IPV6_UNICAST)
+	replay_rib (AFI_IP6);
+      else if (replay_rec_subtype != TABLE_DUMP_V2_PEER_INDEX_TABLE)
+	replay_skipped++;
+      break;
+    case MSG_PROTOCOL_BGP4MP:
+      /* Plain BGP4MP_MESSAGE carries 2-octet AS paths, which don't
+         fit the AS4 sessions. */
+      if (replay_rec_subtype == BGP4MP_MESSAGE_AS4)
+	replay_bgp4mp ();
+      else if (replay_rec_subtype != BGP4MP_STATE_CHANGE
+	       && replay_rec_subtype != BGP4MP_STATE_CHANGE_AS4)
+	replay_skipped++;
+      break;
+    default:
+      replay_skipped++;
+      break;
+    }
+}
+
+/* Milliseconds until the current record is due with the original
+   timing. */
+static long
+replay_delay (void)
+{
+  struct timeval now;
+  double due;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  if (! replay_clock_set)
+    {
+      replay_clock_set = 1;
+      replay_mrt_start = replay_rec_time;
+      replay_wall_start = now;
+    }
+
+  due = (double) (replay_rec_time - replay_mrt_start) / replay_speed;
+  return (long) ((due - replay_elapsed (&replay_wall_start, &now)) * 1000);
+}
+
+/* Produce UPDATEs from the MRT records until the time slot is used up
+   or the output of an emulated peer backs up, in which case
+   replay_write restarts it once everything is written. */
+static int
+replay_run (struct thread *t)
+{
+  long delay;
+  int i;
+
+  t_replay = NULL;
+
+  for (;;)
+    {
+      if (! replay_rec_held)
+	{
+	  if (! replay_next_record ())
+	    break;
+	  replay_rec_held = 1;
+	}
+
+      if (replay_speed > 0 && (delay = replay_delay ()) > 0)
+	{
+	  replay_flush_all ();
+	  t_replay = thread_add_timer_msec (master, replay_run, NULL, delay);
+	  return 0;
+	}
+
+      replay_record ();
+      replay_rec_held = 0;
+
+      for (i = 0; i < replay_npeers; i++)
+	if (! buffer_empty (replay_peers[i].obuf))
+	  {
+	    replay_waiting = 1;
+	    return 0;
+	  }
+
+      if (thread_should_yield (t))
+	{
+	  t_replay = thread_add_event (master, replay_run, NULL, 0);
+	  return 0;
+	}
+    }
+
+  /* All files are replayed. */
+  replay_flush_all ();
+  replay_finished = 1;
+  replay_waiting = 1;
+  for (i = 0; i < replay_npeers; i++)
+    if (! buffer_empty (replay_peers[i].obuf))
+      return 0;
+  replay_waiting = 0;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &replay_inject_end);
+  replay_injected = 1;
+
+  return 0;
+}
+
+static void
+replay_report (void)
+{
+  struct timeval *end;
+  unsigned long updates = 0, prefixes = 0;
+  double secs;
+  int i;
+
+  for (i = 0; i < replay_npeers; i++)
+    {
+      updates += replay_peers[i].updates;
+      prefixes += replay_peers[i].prefixes;
+    }
+
+  printf ("Replayed %lu MRT records, %lu skipped\n",
+	  replay_records, replay_skipped);
+
+  secs = replay_elapsed (&replay_first_sent, &replay_inject_end);
+  printf ("Sent %lu UPDATEs, %lu prefixes in %.3f seconds",
+	  updates, prefixes, secs);
+  if (secs > 0)
+    printf (": %.0f UPDATEs/s, %.0f prefixes/s",
+	    updates / secs, prefixes / secs);
+  printf ("\n");
+
+  if (replay_monitor)
+    {
+      end = &replay_inject_end;
+      if (replay_elapsed (&replay_inject_end, &replay_monitor_last) > 0)
+	end = &replay_monitor_last;
+      printf ("Monitor received %lu UPDATEs, %lu prefixes, converged "
+	      "%.3f seconds after the first UPDATE\n",
+	      replay_monitor->updates, replay_monitor->prefixes,
+	      replay_elapsed (&replay_first_sent, end));
+    }
+
+  if (replay_rss_peak)
+    printf ("bgpd resident size: %lu kB before, %lu kB peak, %lu kB after\n",
+	    replay_rss_start, replay_rss_peak, replay_rss ());
+}
+
+/* Once a second: sample the size of bgpd and see whether the replay
+   is over. */
+static int
+replay_tick (struct thread *t)
+{
+  struct timeval now;
+  unsigned long rss;
+
+  t_tick = thread_add_timer (master, replay_tick, NULL, 1);
+
+  rss = replay_rss ();
+  if (rss > replay_rss_peak)
+    replay_rss_peak = rss;
+
+  if (! replay_injected)
+    return 0;
+
+  if (replay_monitor)
+    {
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+      if (replay_elapsed (&replay_inject_end, &now) < replay_quiet
+	  || replay_elapsed (&replay_monitor_last, &now) < replay_quiet)
+	return 0;
+    }
+
+  replay_report ();
+  exit (0);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *p;
+  char *progname;
+  struct thread thread;
+  int opt;
+  int i;
+
+  progname = ((p = strrchr (argv[0], '/')) ? ++p : argv[0]);
+
+  inet_aton ("127.0.0.1", &replay_remote);
+  inet_aton ("127.0.1.1", &replay_local);
+
+  while (1)
+    {
+      opt = getopt_long (argc, argv, "a:r:p:l:n:m:M:s:q:i:h", longopts, 0);
+
+      if (opt == EOF)
+	break;
+
+      switch (opt)
+	{
+	case 0:
+	  break;
+	case 'a':
+	  replay_as = strtoul (optarg, NULL, 10);
+	  break;
+	case 'r':
+	  if (! inet_aton (optarg, &replay_remote))
+	    usage (progname, 1);
+	  break;
+	case 'p':
+	  replay_port = atoi (optarg);
+	  break;
+	case 'l':
+	  if (! inet_aton (optarg, &replay_local))
+	    usage (progname, 1);
+	  break;
+	case 'n':
+	  replay_npeers = atoi (optarg);
+	  if (replay_npeers < 1)
+	    usage (progname, 1);
+	  break;
+	case 'm':
+	  if (! inet_aton (optarg, &replay_monitor_addr))
+	    usage (progname, 1);
+	  break;
+	case 'M':
+	  replay_monitor_as = strtoul (optarg, NULL, 10);
+	  break;
+	case 's':
+	  replay_speed = atof (optarg);
+	  if (replay_speed < 0)
+	    usage (progname, 1);
+	  break;
+	case 'q':
+	  replay_quiet = atoi (optarg);
+	  break;
+	case 'i':
+	  replay_pid_file = optarg;
+	  break;
+	case 'h':
+	  usage (progname, 0);
+	  break;
+	default:
+	  usage (progname, 1);
+	  break;
+	}
+    }
+
+  if (optind >= argc)
+    usage (progname, 1);
+  replay_files = argv + optind;
+  replay_nfiles = argc - optind;
+
+  signal (SIGPIPE, SIG_IGN);
+
+  master = thread_master_create ();
+  replay_obuf = stream_new (BGP_MAX_PACKET_SIZE);
+  replay_rec = stream_new (BGP_MAX_PACKET_SIZE);
+  replay_sent = XCALLOC (MTYPE_TMP, replay_npeers);
+  replay_rss_start = replay_rss_peak = replay_rss ();
+
+  if (replay_monitor_addr.s_addr)
+    {
+      replay_monitor = XCALLOC (MTYPE_TMP, sizeof (struct replay_peer));
+      replay_monitor->as = replay_monitor_as;
+      replay_monitor->local = replay_monitor_addr;
+      replay_monitor->monitor = 1;
+      replay_connect (replay_monitor);
+    }
+
+  replay_peers = XCALLOC (MTYPE_TMP, replay_npeers * sizeof (struct replay_peer));
+  for (i = 0; i < replay_npeers; i++)
+    {
+      replay_peers[i].as = replay_as;
+      replay_peers[i].local.s_addr = htonl (ntohl (replay_local.s_addr) + i);
+      replay_connect (&replay_peers[i]);
+    }
+
+  t_tick = thread_add_timer (master, replay_tick, NULL, 1);
+
+  while (thread_fetch (master, &thread))
+    thread_call (&thread);
+
+  return 0;
+}
@@ -34,6 +34,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "thread.h"
 #include "workqueue.h"
+#include "latency.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -180,18 +181,116 @@ bgp_info_unlock (struct bgp_info *binfo)
   return binfo;
 }
 
+/* Whether two paths are from the same neighbouring AS, as far as the
+   deterministic MED check is concerned. */
+static int
+bgp_info_dmed_same (struct bgp_info *ri1, struct bgp_info *ri2)
+{
+  as_t as1, as2;
+  int type1, type2;
+
+  type1 = aspath_left_as (ri1->attr->aspath, &as1);
+  if (! type1)
+    return 0;
+  type2 = aspath_left_as (ri2->attr->aspath, &as2);
+
+  return (type1 == type2 && as1 == as2);
+}
+
+/* Link info into the node's list.  Paths from the same neighbouring
+   AS are kept next to each other, so that bgp_best_selection can do
+   the deterministic MED check in a single pass over the list. */
+static void
+bgp_info_link (struct bgp_node *rn, struct bgp_info *ri)
+{
+  struct bgp_info *next;
+
+  for (next = rn->info; next; next = next->next)
+    if (bgp_info_dmed_same (ri, next))
+      break;
+
+  if (! next)
+    next = rn->info;
+
+  ri->next = next;
+  ri->prev = next ? next->prev : NULL;
+  if (ri->prev)
+    ri->prev->next = ri;
+  else
+    rn->info = ri;
+  if (next)
+    next->prev = ri;
+}
+
+static void
+bgp_info_unlink (struct bgp_node *rn, struct bgp_info *ri)
+{
+  if (ri->next)
+    ri->next->prev = ri->prev;
+  if (ri->prev)
+    ri->prev->next = ri->next;
+  else
+    rn->info = ri->next;
+}
+
+/* The attributes of info have been replaced, move it to the group of
+   its neighbouring AS if that has changed. */
+static void
+bgp_info_regroup (struct bgp_node *rn, struct bgp_info *ri)
+{
+  as_t as;
+
+  if (rn->table->safi == SAFI_MPLS_VPN && rn->table->type == BGP_TABLE_MAIN)
+    {
+      bgp_rt_index_del (rn, ri);
+      bgp_rt_index_add (rn, ri);
+    }
+
+  if (! aspath_left_as (ri->attr->aspath, &as))
+    {
+      /* Only has to move if it now splits a group. */
+      if (! (ri->prev && ri->next
+             && bgp_info_dmed_same (ri->prev, ri->next)))
+        return;
+    }
+  else if ((ri->prev && bgp_info_dmed_same (ri, ri->prev))
+           || (ri->next && bgp_info_dmed_same (ri, ri->next)))
+    return;
+
+  bgp_info_unlink (rn, ri);
+  bgp_info_link (rn, ri);
+}
+
+/* Note that a path of the node changed in a way that matters to best
+   path selection.  While it is the only path changed when the node is
+   processed, bgp_best_selection need only look at that path. */
+void
+bgp_info_changed (struct bgp_node *rn, struct bgp_info *ri)
+{
+  if (CHECK_FLAG (rn->flags, BGP_NODE_CHANGED_MANY))
+    return;
+
+  if (! rn->changed)
+    rn->changed = ri;
+  else if (rn->changed != ri)
+    {
+      rn->changed = NULL;
+      UNSET_FLAG (rn->flags, BGP_NODE_CHANGED_ADD);
+      SET_FLAG (rn->flags, BGP_NODE_CHANGED_MANY);
+    }
+}
+
 void
 bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
 {
-  struct bgp_info *top;
+  bgp_info_link (rn, ri);
 
-  top = rn->info;
-  
-  ri->next = rn->info;
-  ri->prev = NULL;
-  if (top)
-    top->prev = ri;
-  rn->info = ri;
+  if (rn->table->safi == SAFI_MPLS_VPN && rn->table->type == BGP_TABLE_MAIN)
+    bgp_rt_index_add (rn, ri);
+
+  bgp_info_changed (rn, ri);
+  if (rn->changed == ri)
+    SET_FLAG (rn->flags, BGP_NODE_CHANGED_ADD);
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
@@ -203,12 +302,17 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
 static void
 bgp_info_reap (struct bgp_node *rn, struct bgp_info *ri)
 {
-  if (ri->next)
-    ri->next->prev = ri->prev;
-  if (ri->prev)
-    ri->prev->next = ri->next;
-  else
-    rn->info = ri->next;
+  bgp_info_unlink (rn, ri);
+
+  if (rn->table->safi == SAFI_MPLS_VPN && rn->table->type == BGP_TABLE_MAIN)
+    bgp_rt_index_del (rn, ri);
+
+  if (rn->changed == ri)
+    {
+      rn->changed = NULL;
+      UNSET_FLAG (rn->flags, BGP_NODE_CHANGED_ADD);
+      SET_FLAG (rn->flags, BGP_NODE_CHANGED_MANY);
+    }
   
   bgp_info_unlock (ri);
   bgp_unlock_node (rn);
@@ -279,6 +383,10 @@ bgp_info_set_flag (struct bgp_node *rn, struct bgp_info *ri, u_int32_t flag)
 {
   SET_FLAG (ri->flags, flag);
   
+  if (CHECK_FLAG (flag, BGP_INFO_VALID|BGP_INFO_UNUSEABLE|BGP_INFO_STALE
+                        |BGP_INFO_ATTR_CHANGED|BGP_INFO_IGP_CHANGED))
+    bgp_info_changed (rn, ri);
+
   /* early bath if we know it's not a flag that changes useability state */
   if (!CHECK_FLAG (flag, BGP_INFO_VALID|BGP_INFO_UNUSEABLE))
     return;
@@ -291,6 +399,9 @@ bgp_info_unset_flag (struct bgp_node *rn, struct bgp_info *ri, u_int32_t flag)
 {
   UNSET_FLAG (ri->flags, flag);
   
+  if (CHECK_FLAG (flag, BGP_INFO_VALID|BGP_INFO_UNUSEABLE|BGP_INFO_STALE))
+    bgp_info_changed (rn, ri);
+
   /* early bath if we know it's not a flag that changes useability state */
   if (!CHECK_FLAG (flag, BGP_INFO_VALID|BGP_INFO_UNUSEABLE))
     return;
@@ -316,7 +427,8 @@ bgp_med_value (struct attr *attr, struct bgp *bgp)
 
 /* Compare two bgp route entity.  br is preferable then return 1. */
 static int
-bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist)
+bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist,
+	      int *paths_eq)
 {
   u_int32_t new_pref;
   u_int32_t exist_pref;
@@ -332,6 +444,9 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist)
   int confed_as_route = 0;
   int ret;
 
+  if (paths_eq)
+    *paths_eq = 0;
+
   /* 0. Null check. */
   if (new == NULL)
     return 0;
@@ -465,7 +580,10 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist)
         return 0;
     }
 
-  /* 9. Maximum path check. */
+  /* 9. Maximum path check.  Only the tie-breakers are left, the paths
+     are equal for multipath. */
+  if (paths_eq)
+    *paths_eq = 1;
 
   /* 10. If both paths are external, prefer the path that was received
      first (the oldest one).  This step minimizes route-flap, since a
@@ -511,8 +629,12 @@ bgp_info_cmp (struct bgp *bgp, struct bgp_info *new, struct bgp_info *exist)
   if (new_cluster > exist_cluster)
     return 0;
 
-  /* 13. Neighbor address comparision. */
-  ret = sockunion_cmp (new->peer->su_remote, exist->peer->su_remote);
+  /* 13. Neighbor address comparision.  Stale paths may belong to a
+     peer with no session, fall back to its configured address. */
+  ret = sockunion_cmp (new->peer->su_remote ? new->peer->su_remote
+                                            : &new->peer->su,
+                       exist->peer->su_remote ? exist->peer->su_remote
+                                              : &exist->peer->su);
 
   if (ret == 1)
     return 0;
@@ -755,7 +877,8 @@ bgp_import_modifier (struct peer *rsclient, struct peer *peer,
 
 static int
 bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
-		    struct attr *attr, afi_t afi, safi_t safi)
+		    struct attr *attr, afi_t afi, safi_t safi,
+		    struct bgp_attr_scratch *scratch)
 {
   int ret;
   char buf[SU_ADDRSTRLEN];
@@ -795,6 +918,10 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
     if (! UNSUPPRESS_MAP_NAME (filter))
       return 0;
 
+  /* Route target filter.  */
+  if (safi == SAFI_MPLS_VPN && ! bgp_rt_filter_permit (peer, ri->attr))
+    return 0;
+
   /* Default route check.  */
   if (CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_DEFAULT_ORIGINATE))
     {
@@ -924,7 +1051,7 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
       }
   
   /* For modify attribute, copy it to temporary structure. */
-  bgp_attr_dup (attr, ri->attr);
+  bgp_attr_scratch_dup (scratch, attr, ri->attr);
   
   /* If local-preference is not set. */
   if ((peer_sort (peer) == BGP_PEER_IBGP 
@@ -1081,7 +1208,7 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
       if (peer_sort (from) == BGP_PEER_IBGP 
 	  && peer_sort (peer) == BGP_PEER_IBGP)
 	{
-	  bgp_attr_dup (&dummy_attr, attr);
+	  bgp_attr_scratch_dup (scratch, &dummy_attr, attr);
 	  info.attr = &dummy_attr;
 	}
 
@@ -1095,7 +1222,7 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
       peer->rmap_type = 0;
       
       if (dummy_attr.extra)
-        bgp_attr_extra_free (&dummy_attr);
+        bgp_attr_scratch_free (scratch, &dummy_attr);
       
       if (ret == RMAP_DENYMATCH)
 	{
@@ -1108,7 +1235,8 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 
 static int
 bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
-        struct prefix *p, struct attr *attr, afi_t afi, safi_t safi)
+        struct prefix *p, struct attr *attr, afi_t afi, safi_t safi,
+        struct bgp_attr_scratch *scratch)
 {
   int ret;
   char buf[SU_ADDRSTRLEN];
@@ -1197,7 +1325,7 @@ bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
 #endif /* BGP_SEND_ASPATH_CHECK */
 
   /* For modify attribute, copy it to temporary structure. */
-  bgp_attr_dup (attr, ri->attr);
+  bgp_attr_scratch_dup (scratch, attr, ri->attr);
 
   /* next-hop-set */
   if ((p->family == AF_INET && attr->nexthop.s_addr == 0)
@@ -1312,51 +1440,104 @@ struct bgp_info_pair
   struct bgp_info *new;
 };
 
+/* Best path selection when ri is the only path changed since the last
+   selection: the selected path stays unless ri beats it.  Returns 0 if
+   a full selection is needed instead. */
+static int
+bgp_best_selection_fast (struct bgp *bgp, struct bgp_node *rn,
+                         struct bgp_info *ri, int added,
+                         struct bgp_info_pair *result)
+{
+  struct bgp_info *old_select;
+
+  for (old_select = rn->info; old_select; old_select = old_select->next)
+    if (CHECK_FLAG (old_select->flags, BGP_INFO_SELECTED))
+      break;
+
+  if (! old_select || old_select == ri || BGP_INFO_HOLDDOWN (old_select))
+    return 0;
+
+  /* With deterministic-med only the best path of each neighbouring AS
+     competes, so ri must be the only path of its AS and either new or
+     gone; otherwise the winner of its group may have changed. */
+  if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+    {
+      if (! added && ! CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+        return 0;
+      if ((ri->prev && bgp_info_dmed_same (ri, ri->prev))
+          || (ri->next && bgp_info_dmed_same (ri, ri->next)))
+        return 0;
+    }
+
+  if (BGP_INFO_HOLDDOWN (ri))
+    {
+      if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+        bgp_info_reap (rn, ri);
+    }
+  else
+    {
+      rn->table->selection_cmps++;
+      if (bgp_info_cmp (bgp, ri, old_select, NULL))
+        return 0;
+    }
+
+  result->old = old_select;
+  result->new = old_select;
+  return 1;
+}
+
 static void
 bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *result)
 {
   struct bgp_info *new_select;
   struct bgp_info *old_select;
   struct bgp_info *ri;
-  struct bgp_info *ri1;
-  struct bgp_info *ri2;
+  struct bgp_info *group;
   struct bgp_info *nextri = NULL;
+  struct bgp_info *changed;
+  int added;
+  unsigned long cmps = 0;
   
-  /* bgp deterministic-med */
+  changed = rn->changed;
+  added = CHECK_FLAG (rn->flags, BGP_NODE_CHANGED_ADD);
+  rn->changed = NULL;
+  UNSET_FLAG (rn->flags, BGP_NODE_CHANGED_ADD|BGP_NODE_CHANGED_MANY);
+
+  rn->table->selections++;
+  if (changed
+      && bgp_best_selection_fast (bgp, rn, changed, added, result))
+    {
+      rn->table->selections_fast++;
+      return;
+    }
+
+  /* bgp deterministic-med.  Paths from the same neighbouring AS are
+     adjacent in the list (see bgp_info_link), so the best of each
+     group can be found in one pass. */
   new_select = NULL;
+  group = NULL;
   if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
-    for (ri1 = rn->info; ri1; ri1 = ri1->next)
-      {
-	if (CHECK_FLAG (ri1->flags, BGP_INFO_DMED_CHECK))
-	  continue;
-	if (BGP_INFO_HOLDDOWN (ri1))
-	  continue;
-
-	new_select = ri1;
-	if (ri1->next)
-	  for (ri2 = ri1->next; ri2; ri2 = ri2->next)
-	    {
-	      if (CHECK_FLAG (ri2->flags, BGP_INFO_DMED_CHECK))
-		continue;
-	      if (BGP_INFO_HOLDDOWN (ri2))
-		continue;
-
-	      if (aspath_cmp_left (ri1->attr->aspath, ri2->attr->aspath)
-		  || aspath_cmp_left_confed (ri1->attr->aspath,
-					     ri2->attr->aspath))
-		{
-		  if (bgp_info_cmp (bgp, ri2, new_select))
-		    {
-		      bgp_info_unset_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
-		      new_select = ri2;
-		    }
+    {
+      for (ri = rn->info; ri; ri = ri->next)
+	{
+	  if (BGP_INFO_HOLDDOWN (ri))
+	    continue;
 
-		  bgp_info_set_flag (rn, ri2, BGP_INFO_DMED_CHECK);
-		}
+	  if (group && bgp_info_dmed_same (group, ri))
+	    {
+	      cmps++;
+	      if (bgp_info_cmp (bgp, ri, new_select, NULL))
+		new_select = ri;
+	      continue;
 	    }
-	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_CHECK);
+
+	  if (new_select)
+	    bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
+	  group = new_select = ri;
+	}
+      if (new_select)
 	bgp_info_set_flag (rn, new_select, BGP_INFO_DMED_SELECTED);
-      }
+    }
 
   /* Check old selected route and new selected route. */
   old_select = NULL;
@@ -1380,31 +1561,146 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *
 
       if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED)
           && (! CHECK_FLAG (ri->flags, BGP_INFO_DMED_SELECTED)))
-	{
-	  bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
-	  continue;
-        }
-      bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_CHECK);
+	continue;
       bgp_info_unset_flag (rn, ri, BGP_INFO_DMED_SELECTED);
 
-      if (bgp_info_cmp (bgp, ri, new_select))
+      if (new_select)
+	cmps++;
+      if (bgp_info_cmp (bgp, ri, new_select, NULL))
 	new_select = ri;
     }
-    
+
+    rn->table->selection_cmps += cmps;
+
     result->old = old_select;
     result->new = new_select;
 
     return;
 }
 
+/* Whether ri may be installed alongside the selected path: a BGP path
+   of the same kind and AS path, equal to it up to the tie-breakers of
+   bgp_info_cmp. */
+static int
+bgp_mpath_candidate (struct bgp *bgp, struct bgp_info *best,
+                     struct bgp_info *ri)
+{
+  int paths_eq;
+
+  if (BGP_INFO_HOLDDOWN (ri))
+    return 0;
+  if (ri->type != ZEBRA_ROUTE_BGP || ri->sub_type != BGP_ROUTE_NORMAL)
+    return 0;
+  if ((peer_sort (ri->peer) == BGP_PEER_EBGP)
+      != (peer_sort (best->peer) == BGP_PEER_EBGP))
+    return 0;
+  if (ri->attr->aspath != best->attr->aspath)
+    return 0;
+
+  bgp_info_cmp (bgp, ri, best, &paths_eq);
+  return paths_eq;
+}
+
+/* Flag the paths to be installed in the FIB together with the selected
+   path, up to maximum-paths.  Returns 1 if the set, or the attributes
+   of one of its paths, changed since it was last installed. */
+static int
+bgp_mpath_update (struct bgp *bgp, struct bgp_node *rn,
+                  struct bgp_info *new_select, afi_t afi, safi_t safi)
+{
+  struct bgp_info *ri;
+  int maxpaths = 1;
+  int count = 1;
+  int changed = 0;
+  int mpath;
+
+  if (new_select && new_select->type == ZEBRA_ROUTE_BGP
+      && new_select->sub_type == BGP_ROUTE_NORMAL)
+    maxpaths = (peer_sort (new_select->peer) == BGP_PEER_EBGP
+                ? bgp->maxpaths[afi][safi].maxpaths_ebgp
+                : bgp->maxpaths[afi][safi].maxpaths_ibgp);
+
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      mpath = (ri != new_select && count < maxpaths
+               && bgp_mpath_candidate (bgp, new_select, ri));
+      if (mpath)
+        {
+          count++;
+          if (CHECK_FLAG (ri->flags, BGP_INFO_ATTR_CHANGED))
+            {
+              UNSET_FLAG (ri->flags, BGP_INFO_ATTR_CHANGED);
+              changed = 1;
+            }
+        }
+
+      if (mpath != (CHECK_FLAG (ri->flags, BGP_INFO_MULTIPATH) ? 1 : 0))
+        {
+          if (mpath)
+            SET_FLAG (ri->flags, BGP_INFO_MULTIPATH);
+          else
+            UNSET_FLAG (ri->flags, BGP_INFO_MULTIPATH);
+          changed = 1;
+        }
+    }
+
+  return changed;
+}
+
+/* A shared RS-client table holds the paths of all its clients, a
+   client must not be given back its own paths. */
+static int
+bgp_rsclient_excluded (struct peer *rsclient, struct bgp_info *ri)
+{
+  if (ri->peer == rsclient)
+    return 1;
+
+  if (ri->attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
+      && IPV4_ADDR_SAME (&rsclient->remote_id, &ri->attr->extra->originator_id))
+    return 1;
+
+  return 0;
+}
+
+/* Path to announce to rsclient, given the path selected for its
+   table.  When the selected path is excluded for this client, the
+   best of the remaining paths is used instead. */
+static struct bgp_info *
+bgp_rsclient_select (struct peer *rsclient, struct bgp_node *rn,
+                     struct bgp_info *selected)
+{
+  struct bgp_info *ri;
+  struct bgp_info *new_select;
+
+  if (! rn->table->share)
+    return selected;
+
+  if (selected && ! bgp_rsclient_excluded (rsclient, selected))
+    return selected;
+
+  new_select = NULL;
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      if (BGP_INFO_HOLDDOWN (ri) || bgp_rsclient_excluded (rsclient, ri))
+        continue;
+
+      if (bgp_info_cmp (rsclient->bgp, ri, new_select, NULL))
+        new_select = ri;
+    }
+
+  return new_select;
+}
+
 static int
 bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
                                struct bgp_node *rn, afi_t afi, safi_t safi)
 {
   struct prefix *p;
   struct attr attr = { 0 };
+  struct bgp_attr_scratch scratch;
 
   p = &rn->p;
+  bgp_attr_scratch_init (&scratch);
 
   /* Announce route to Established peer. */
   if (peer->status != Established)
@@ -1424,7 +1720,8 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
       case BGP_TABLE_MAIN:
       /* Announcement to peer->conf.  If the route is filtered,
          withdraw it. */
-        if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
+        if (selected && bgp_announce_check (selected, peer, p, &attr,
+                                            afi, safi, &scratch))
           bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
         else
           bgp_adj_out_unset (rn, peer, p, afi, safi);
@@ -1433,14 +1730,15 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
         /* Announcement to peer->conf.  If the route is filtered, 
            withdraw it. */
         if (selected && 
-            bgp_announce_check_rsclient (selected, peer, p, &attr, afi, safi))
+            bgp_announce_check_rsclient (selected, peer, p, &attr, afi, safi,
+                                         &scratch))
           bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
         else
 	  bgp_adj_out_unset (rn, peer, p, afi, safi);
         break;
     }
   
-  bgp_attr_extra_free (&attr);
+  bgp_attr_scratch_free (&scratch, &attr);
   
   return 0;
 }
@@ -1451,8 +1749,46 @@ struct bgp_process_queue
   struct bgp_node *rn;
   afi_t afi;
   safi_t safi;
+
+  /* For convergence statistics, the time the UPDATE which scheduled
+     the node was read and the time it was scheduled.  */
+  struct timeval recv;
+  struct timeval queued;
+};
+
+/* Convergence statistics, from the receipt of an UPDATE until its
+   routes are sent to zebra.  */
+enum
+{
+  BGP_LATENCY_UPDATE,
+  BGP_LATENCY_QUEUE,
+  BGP_LATENCY_ZEBRA,
+  BGP_LATENCY_TOTAL,
+  BGP_LATENCY_MAX
+};
+
+static struct latency bgp_latency[BGP_LATENCY_MAX] =
+{
+  { "update" },
+  { "queue" },
+  { "zebra" },
+  { "total" },
 };
 
+/* A route of the node dequeued at deq has been sent to zebra.  */
+static void
+bgp_latency_announce (struct timeval *recv, struct timeval *deq)
+{
+  struct timeval now;
+
+  if (! recv)
+    return;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  latency_add (&bgp_latency[BGP_LATENCY_ZEBRA], deq, &now);
+  latency_add (&bgp_latency[BGP_LATENCY_TOTAL], recv, &now);
+}
+
 static wq_item_status
 bgp_process_rsclient (struct work_queue *wq, void *data)
 {
@@ -1503,7 +1839,18 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
 	  bgp_info_set_flag (rn, new_select, BGP_INFO_SELECTED);
 	  bgp_info_unset_flag (rn, new_select, BGP_INFO_ATTR_CHANGED);
 	}
-      bgp_process_announce_selected (rsclient, new_select, rn, afi, safi);
+      bgp_process_announce_selected (rsclient,
+                                     bgp_rsclient_select (rsclient, rn,
+                                                          new_select),
+                                     rn, afi, safi);
+
+      /* Clients sharing this table. */
+      if (rn->table->share)
+        for (ALL_LIST_ELEMENTS (rn->table->share, node, nnode, rsclient))
+          bgp_process_announce_selected (rsclient,
+                                         bgp_rsclient_select (rsclient, rn,
+                                                              new_select),
+                                         rn, afi, safi);
     }
 
   if (old_select && CHECK_FLAG (old_select->flags, BGP_INFO_REMOVED))
@@ -1529,19 +1876,43 @@ bgp_process_main (struct work_queue *wq, void *data)
   struct bgp_info_pair old_and_new;
   struct listnode *node, *nnode;
   struct peer *peer;
+  int mpath_changed;
+  struct timeval *recv = NULL;
+  struct timeval deq;
+
+  if (timerisset (&pq->recv))
+    {
+      recv = &pq->recv;
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &deq);
+      latency_add (&bgp_latency[BGP_LATENCY_QUEUE], &pq->queued, &deq);
+    }
   
   /* Best path selection. */
   bgp_best_selection (bgp, rn, &old_and_new);
   old_select = old_and_new.old;
   new_select = old_and_new.new;
 
+  mpath_changed = bgp_mpath_update (bgp, rn, new_select, afi, safi);
+
   /* Nothing to do. */
   if (old_select && old_select == new_select)
     {
       if (! CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED))
         {
           if (CHECK_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED))
-            bgp_zebra_announce (p, old_select, bgp);
+            {
+              bgp_zebra_announce (p, old_select, bgp, recv);
+              bgp_latency_announce (recv, &deq);
+            }
+          else if (mpath_changed
+                   && safi == SAFI_UNICAST && ! bgp->name
+                   && ! bgp_option_check (BGP_OPT_NO_FIB)
+                   && old_select->type == ZEBRA_ROUTE_BGP
+                   && old_select->sub_type == BGP_ROUTE_NORMAL)
+            {
+              bgp_zebra_announce (p, old_select, bgp, recv);
+              bgp_latency_announce (recv, &deq);
+            }
           
           UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
           return WQ_SUCCESS;
@@ -1570,7 +1941,10 @@ bgp_process_main (struct work_queue *wq, void *data)
       if (new_select 
 	  && new_select->type == ZEBRA_ROUTE_BGP 
 	  && new_select->sub_type == BGP_ROUTE_NORMAL)
-	bgp_zebra_announce (p, new_select, bgp);
+	{
+	  bgp_zebra_announce (p, new_select, bgp, recv);
+	  bgp_latency_announce (recv, &deq);
+	}
       else
 	{
 	  /* Withdraw the route from the kernel. */
@@ -1647,6 +2021,12 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
   bgp_lock(bgp);
   pqnode->afi = afi;
   pqnode->safi = safi;
+
+  if (timerisset (&bm->update_recv))
+    {
+      pqnode->recv = bm->update_recv;
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &pqnode->queued);
+    }
   
   switch (rn->table->type)
     {
@@ -1807,8 +2187,9 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
 
   //memset (new_attr, 0, sizeof (struct attr));
   
-  /* Do not insert announces from a rsclient into its own 'bgp_table'. */
-  if (peer == rsclient)
+  /* Do not insert announces from a rsclient into its own 'bgp_table'.
+     Shared tables keep them, they are skipped on announcement. */
+  if (peer == rsclient && ! rsclient->rib[afi][safi]->share)
     return;
 
   bgp = peer->bgp;
@@ -1828,6 +2209,7 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
 
   /* Route reflector originator ID check.  */
   if (attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID)
+      && ! rsclient->rib[afi][safi]->share
       && IPV4_ADDR_SAME (&rsclient->remote_id, &attr->extra->originator_id))
     {
       reason = "originator is us;";
@@ -1917,6 +2299,7 @@ bgp_update_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
       /* Update to new attribute.  */
       bgp_attr_unintern (ri->attr);
       ri->attr = attr_new;
+      bgp_info_regroup (rn, ri);
 
       /* Update MPLS tag.  */
       if (safi == SAFI_MPLS_VPN)
@@ -1997,7 +2380,7 @@ bgp_withdraw_rsclient (struct peer *rsclient, afi_t afi, safi_t safi,
   struct bgp_info *ri;
   char buf[SU_ADDRSTRLEN];
 
-  if (rsclient == peer)
+  if (rsclient == peer && ! rsclient->rib[afi][safi]->share)
        return;
 
   rn = bgp_afi_node_get (rsclient->rib[afi][safi], afi, safi, p, prd);
@@ -2036,6 +2419,14 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
   const char *reason;
   char buf[SU_ADDRSTRLEN];
 
+  if (timerisset (&bm->update_recv))
+    {
+      struct timeval now;
+
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+      latency_add (&bgp_latency[BGP_LATENCY_UPDATE], &bm->update_recv, &now);
+    }
+
   bgp = peer->bgp;
   rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, prd);
   
@@ -2224,6 +2615,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
       /* Update to new attribute.  */
       bgp_attr_unintern (ri->attr);
       ri->attr = attr_new;
+      bgp_info_regroup (rn, ri);
 
       /* Update MPLS tag.  */
       if (safi == SAFI_MPLS_VPN)
@@ -2363,7 +2755,7 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
   /* Process the update for each RS-client. */
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (BGP_RSCLIENT_TABLE_OWNER (rsclient, afi, safi))
         bgp_update_rsclient (rsclient, afi, safi, attr, peer, p, type,
                 sub_type, prd, tag);
     }
@@ -2371,6 +2763,53 @@ bgp_update (struct peer *peer, struct prefix *p, struct attr *attr,
   return ret;
 }
 
+/* Preload a path of peer kept in a checkpoint before bgpd restarted.
+   attr is as it was stored in the RIB, inbound policy has already
+   been applied to it.  The path is marked stale, if the peer sends it
+   again unchanged it is simply refreshed without being processed. */
+int
+bgp_update_stale (struct peer *peer, struct prefix *p, struct attr *attr,
+		  afi_t afi, safi_t safi, int valid, time_t uptime)
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+  struct bgp_info *new;
+
+  bgp = peer->bgp;
+  rn = bgp_afi_node_get (bgp->rib[afi][safi], afi, safi, p, NULL);
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (ri->peer == peer && ri->type == ZEBRA_ROUTE_BGP
+	&& ri->sub_type == BGP_ROUTE_NORMAL)
+      break;
+
+  if (ri)
+    {
+      bgp_unlock_node (rn);
+      return -1;
+    }
+
+  new = bgp_info_new ();
+  new->type = ZEBRA_ROUTE_BGP;
+  new->sub_type = BGP_ROUTE_NORMAL;
+  new->peer = peer;
+  new->attr = bgp_attr_intern (attr);
+  new->uptime = uptime;
+
+  if (valid)
+    bgp_info_set_flag (rn, new, BGP_INFO_VALID);
+  bgp_info_set_flag (rn, new, BGP_INFO_STALE);
+
+  bgp_aggregate_increment (bgp, p, new, afi, safi);
+  bgp_info_add (rn, new);
+  bgp_unlock_node (rn);
+
+  bgp_process (bgp, rn, afi, safi);
+
+  return 0;
+}
+
 int
 bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr, 
 	     afi_t afi, safi_t safi, int type, int sub_type, 
@@ -2388,7 +2827,7 @@ bgp_withdraw (struct peer *peer, struct prefix *p, struct attr *attr,
   /* Process the withdraw for each RS-client. */
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (BGP_RSCLIENT_TABLE_OWNER (rsclient, afi, safi))
         bgp_withdraw_rsclient (rsclient, afi, safi, peer, p, type, sub_type, prd, tag);
     }
 
@@ -2521,7 +2960,9 @@ bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
 {
   struct bgp_node *rn;
   struct bgp_info *ri;
+  struct bgp_info *selected;
   struct attr attr;
+  struct bgp_attr_scratch scratch;
   
   memset (&attr, 0, sizeof (struct attr));
   
@@ -2534,19 +2975,51 @@ bgp_announce_table (struct peer *peer, afi_t afi, safi_t safi,
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next(rn))
     for (ri = rn->info; ri; ri = ri->next)
-      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
+      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED)
+          && (selected = (rsclient) ? bgp_rsclient_select (peer, rn, ri) : ri)
+          && selected->peer != peer)
 	{
+          bgp_attr_scratch_init (&scratch);
+
          if ( (rsclient) ?
-              (bgp_announce_check_rsclient (ri, peer, &rn->p, &attr, afi, safi))
-              : (bgp_announce_check (ri, peer, &rn->p, &attr, afi, safi)))
-	    bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
+              (bgp_announce_check_rsclient (selected, peer, &rn->p, &attr,
+                                            afi, safi, &scratch))
+              : (bgp_announce_check (selected, peer, &rn->p, &attr, afi, safi,
+                                     &scratch)))
+	    bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, selected);
 	  else
 	    bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
           
-          bgp_attr_extra_free (&attr);
+          bgp_attr_scratch_free (&scratch, &attr);
 	}
 }
 
+/* Announce, or withdraw, the selected path of a single node to a
+   peer, after something only affecting that node changed for it.  */
+void
+bgp_announce_node (struct peer *peer, afi_t afi, safi_t safi,
+		   struct bgp_node *rn)
+{
+  struct bgp_info *ri;
+  struct attr attr;
+  struct bgp_attr_scratch scratch;
+
+  memset (&attr, 0, sizeof (struct attr));
+
+  for (ri = rn->info; ri; ri = ri->next)
+    if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED) && ri->peer != peer)
+      {
+	bgp_attr_scratch_init (&scratch);
+
+	if (bgp_announce_check (ri, peer, &rn->p, &attr, afi, safi, &scratch))
+	  bgp_adj_out_set (rn, peer, &rn->p, &attr, afi, safi, ri);
+	else
+	  bgp_adj_out_unset (rn, peer, &rn->p, afi, safi);
+
+	bgp_attr_scratch_free (&scratch, &attr);
+      }
+}
+
 void
 bgp_announce_route (struct peer *peer, afi_t afi, safi_t safi)
 {
@@ -2620,51 +3093,131 @@ bgp_soft_reconfig_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
         bgp_soft_reconfig_table_rsclient (rsclient, afi, safi, table);
 }
 
+/* Whether peer leaves its paths in the main RIB as it sent them, with
+   no inbound policy applied. */
+static int
+bgp_rsclient_input_plain (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_filter *filter = &peer->filter[afi][safi];
+
+  return ! peer->weight
+         && ! DISTRIBUTE_IN_NAME (filter)
+         && ! PREFIX_LIST_IN_NAME (filter)
+         && ! FILTER_LIST_IN_NAME (filter)
+         && ! ROUTE_MAP_IN_NAME (filter);
+}
+
 static void
-bgp_soft_reconfig_table (struct peer *peer, afi_t afi, safi_t safi,
-			 struct bgp_table *table)
+bgp_rsclient_table_fill_table (struct peer *rsclient, afi_t afi,
+        safi_t safi, struct bgp_table *table, struct prefix_rd *prd)
 {
-  int ret;
   struct bgp_node *rn;
-  struct bgp_adj_in *ain;
-
-  if (! table)
-    table = peer->bgp->rib[afi][safi];
+  struct bgp_info *ri;
 
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain; ain = ain->next)
+    for (ri = rn->info; ri; ri = ri->next)
       {
-	if (ain->peer == peer)
-	  {
-	    ret = bgp_update (peer, &rn->p, ain->attr, afi, safi,
-			      ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL,
-			      NULL, NULL, 1);
-	    if (ret < 0)
-	      {
-		bgp_unlock_node (rn);
-		return;
-	      }
-	    continue;
-	  }
+        if (ri->peer == rsclient->bgp->peer_self
+            || ri->type != ZEBRA_ROUTE_BGP
+            || ri->sub_type != BGP_ROUTE_NORMAL
+            || CHECK_FLAG (ri->flags, BGP_INFO_REMOVED | BGP_INFO_HISTORY))
+          continue;
+
+        /* Their Adj-RIB-In was used instead. */
+        if (CHECK_FLAG (ri->peer->af_flags[afi][safi],
+                        PEER_FLAG_SOFT_RECONFIG))
+          continue;
+
+        if (! bgp_rsclient_input_plain (ri->peer, afi, safi))
+          {
+            SET_FLAG (ri->peer->af_sflags[afi][safi],
+                      PEER_STATUS_RSCLIENT_REFRESH);
+            continue;
+          }
+
+        bgp_update_rsclient (rsclient, afi, safi, ri->attr, ri->peer,
+                &rn->p, ri->type, ri->sub_type, prd,
+                (ri->extra ? ri->extra->tag : NULL));
       }
 }
 
+/* Fill a table an RS-client moved to with the paths of the peers
+   without soft-reconfiguration inbound, which bgp_soft_reconfig_rsclient
+   cannot give it.  A path is taken from the main RIB only when no
+   inbound policy was applied to it; peers with inbound policy are
+   marked to be asked for their paths again, see
+   bgp_rsclient_table_refresh. */
 void
-bgp_soft_reconfig_in (struct peer *peer, afi_t afi, safi_t safi)
+bgp_rsclient_table_fill (struct peer *rsclient, afi_t afi, safi_t safi)
 {
-  struct bgp_node *rn;
   struct bgp_table *table;
-
-  if (peer->status != Established)
-    return;
+  struct bgp_node *rn;
 
   if (safi != SAFI_MPLS_VPN)
-    bgp_soft_reconfig_table (peer, afi, safi, NULL);
+    bgp_rsclient_table_fill_table (rsclient, afi, safi,
+                                   rsclient->bgp->rib[afi][safi], NULL);
+
   else
-    for (rn = bgp_table_top (peer->bgp->rib[afi][safi]); rn;
-	 rn = bgp_route_next (rn))
+    for (rn = bgp_table_top (rsclient->bgp->rib[afi][safi]); rn;
+            rn = bgp_route_next (rn))
       if ((table = rn->info) != NULL)
-	bgp_soft_reconfig_table (peer, afi, safi, table);
+        bgp_rsclient_table_fill_table (rsclient, afi, safi, table,
+                                       (struct prefix_rd *) &rn->p);
+}
+
+/* Send a ROUTE-REFRESH to the peers marked by bgp_rsclient_table_fill,
+   once however many tables were filled.  The paths they send again go
+   through bgp_update_rsclient as received.  A peer which cannot be
+   asked fills the tables as it sends updates. */
+static void
+bgp_rsclient_table_refresh (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct peer *peer;
+  struct listnode *node, *nnode;
+
+  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+    {
+      if (! CHECK_FLAG (peer->af_sflags[afi][safi],
+                        PEER_STATUS_RSCLIENT_REFRESH))
+        continue;
+
+      UNSET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_RSCLIENT_REFRESH);
+
+      if (peer->status != Established)
+        continue;
+
+      if (CHECK_FLAG (peer->cap, PEER_CAP_REFRESH_OLD_RCV)
+          || CHECK_FLAG (peer->cap, PEER_CAP_REFRESH_NEW_RCV))
+        bgp_route_refresh_send (peer, afi, safi, 0, 0, 0);
+      else
+        zlog_warn ("%s does not support route refresh, RS-client tables"
+                   " get its paths with its next updates", peer->host);
+    }
+}
+
+/* Re-run inbound policy over the Adj-RIB-In of peer.  Only the peer's
+   own entries are visited, not the whole table.  */
+void
+bgp_soft_reconfig_in (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_adj_in *ain;
+  struct bgp_adj_in *next;
+  struct prefix_rd *prd;
+  int ret;
+
+  if (peer->status != Established)
+    return;
+
+  for (ain = peer->adj_in[afi][safi]; ain; ain = next)
+    {
+      next = ain->peer_next;
+      prd = ain->rn->prn ? (struct prefix_rd *) &ain->rn->prn->p : NULL;
+
+      ret = bgp_update (peer, &ain->rn->p, ain->attr, afi, safi,
+			ZEBRA_ROUTE_BGP, BGP_ROUTE_NORMAL, prd, NULL, 1);
+      if (ret < 0)
+	return;
+    }
 }
 
 static wq_item_status
@@ -2754,8 +3307,6 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
   for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
     {
       struct bgp_info *ri;
-      struct bgp_adj_in *ain;
-      struct bgp_adj_out *aout;
       
       if (rn->info == NULL)
         continue;
@@ -2798,20 +3349,7 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
             work_queue_add (peer->clear_node_queue, rn);
           }
 
-      for (ain = rn->adj_in; ain; ain = ain->next)
-        if (ain->peer == peer)
-          {
-            bgp_adj_in_remove (rn, ain);
-            bgp_unlock_node (rn);
-            break;
-          }
-      for (aout = rn->adj_out; aout; aout = aout->next)
-        if (aout->peer == peer)
-          {
-            bgp_adj_out_remove (rn, aout, peer, afi, safi);
-            bgp_unlock_node (rn);
-            break;
-          }
+      bgp_adj_out_remove (rn, peer, afi, safi);
     }
   return;
 }
@@ -2842,6 +3380,8 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi)
   if (!peer->clear_node_queue->thread)
     peer_lock (peer); /* bgp_clear_node_complete */
   
+  bgp_clear_adj_in (peer, afi, safi);
+
   if (safi != SAFI_MPLS_VPN)
     bgp_clear_route_table (peer, afi, safi, NULL, NULL);
   else
@@ -2852,7 +3392,7 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi)
 
   for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG(rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (BGP_RSCLIENT_TABLE_OWNER (rsclient, afi, safi))
         bgp_clear_route_table (peer, afi, safi, NULL, rsclient);
     }
   
@@ -2893,20 +3433,15 @@ bgp_clear_route_all (struct peer *peer)
 void
 bgp_clear_adj_in (struct peer *peer, afi_t afi, safi_t safi)
 {
-  struct bgp_table *table;
-  struct bgp_node *rn;
   struct bgp_adj_in *ain;
+  struct bgp_node *rn;
 
-  table = peer->bgp->rib[afi][safi];
-
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    for (ain = rn->adj_in; ain ; ain = ain->next)
-      if (ain->peer == peer)
-	{
-          bgp_adj_in_remove (rn, ain);
-          bgp_unlock_node (rn);
-          break;
-	}
+  while ((ain = peer->adj_in[afi][safi]) != NULL)
+    {
+      rn = ain->rn;
+      bgp_adj_in_remove (rn, ain);
+      bgp_unlock_node (rn);
+    }
 }
 
 void
@@ -2928,6 +3463,8 @@ bgp_clear_stale_route (struct peer *peer, afi_t afi, safi_t safi)
 	    break;
 	  }
     }
+
+  UNSET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_PRELOAD_STALE);
 }
 
 /* Delete all kernel routes. */
@@ -3303,6 +3840,7 @@ bgp_static_update_rsclient (struct peer *rsclient, struct prefix *p,
 	    bgp_info_restore(rn, ri);
           bgp_attr_unintern (ri->attr);
           ri->attr = attr_new;
+          bgp_info_regroup (rn, ri);
           ri->uptime = time (NULL);
 
           /* Process change. */
@@ -3429,6 +3967,7 @@ bgp_static_update_main (struct bgp *bgp, struct prefix *p,
 	    bgp_aggregate_decrement (bgp, p, ri, afi, safi);
 	  bgp_attr_unintern (ri->attr);
 	  ri->attr = attr_new;
+	  bgp_info_regroup (rn, ri);
 	  ri->uptime = time (NULL);
 
 	  /* Process change. */
@@ -3478,7 +4017,7 @@ bgp_static_update (struct bgp *bgp, struct prefix *p,
 
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
     {
-      if (CHECK_FLAG (rsclient->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+      if (BGP_RSCLIENT_TABLE_OWNER (rsclient, afi, safi))
         bgp_static_update_rsclient (rsclient, p, bgp_static, afi, safi);
     }
 }
@@ -3540,28 +4079,303 @@ bgp_static_withdraw (struct bgp *bgp, struct prefix *p, afi_t afi,
       bgp_process (bgp, rn, afi, safi);
     }
 
-  /* Unlock bgp_node_lookup. */
-  bgp_unlock_node (rn);
+  /* Unlock bgp_node_lookup. */
+  bgp_unlock_node (rn);
+}
+
+void
+bgp_check_local_routes_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
+{
+  struct bgp_static *bgp_static;
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct prefix *p;
+
+  bgp = rsclient->bgp;
+
+  for (rn = bgp_table_top (bgp->route[afi][safi]); rn; rn = bgp_route_next (rn))
+    if ((bgp_static = rn->info) != NULL)
+      {
+        p = &rn->p;
+
+        bgp_static_update_rsclient (rsclient, p, bgp_static,
+                afi, safi);
+      }
+}
+
+/* Export route-maps and network route-maps are applied with the
+   RS-client as the peer to match, so while any is configured each
+   client gets a table of its own. */
+static int
+bgp_rsclient_share_compute (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct peer *peer;
+  struct bgp_static *bgp_static;
+  struct bgp_node *rn;
+  struct listnode *node, *nnode;
+
+  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
+    if (ROUTE_MAP_EXPORT_NAME (&peer->filter[afi][safi]))
+      return 0;
+
+  for (rn = bgp_table_top (bgp->route[afi][safi]); rn; rn = bgp_route_next (rn))
+    if ((bgp_static = rn->info) != NULL && bgp_static->rmap.name)
+      {
+        bgp_unlock_node (rn);
+        return 0;
+      }
+
+  return 1;
+}
+
+/* The result is kept until the export and network route-map
+   configuration changes, see bgp->rsclient_policy_gen. */
+static int
+bgp_rsclient_share_allowed (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  if (bgp->rsclient_share_gen[afi][safi] != bgp->rsclient_policy_gen)
+    {
+      bgp->rsclient_share[afi][safi] = bgp_rsclient_share_compute (bgp, afi,
+                                                                   safi);
+      bgp->rsclient_share_gen[afi][safi] = bgp->rsclient_policy_gen;
+    }
+
+  return bgp->rsclient_share[afi][safi];
+}
+
+/* Clients may share a table when everything applied to the paths
+   stored in it is the same for both: the AS path loop check and the
+   import policy, with no export or network route-map. */
+static int
+bgp_rsclient_share_match (struct peer *p1, struct peer *p2,
+                          afi_t afi, safi_t safi)
+{
+  const char *name1 = ROUTE_MAP_IMPORT_NAME (&p1->filter[afi][safi]);
+  const char *name2 = ROUTE_MAP_IMPORT_NAME (&p2->filter[afi][safi]);
+
+  if (p1->as != p2->as)
+    return 0;
+
+  if (! bgp_rsclient_share_allowed (p1->bgp, afi, safi))
+    return 0;
+
+  if (! name1 || ! name2)
+    return name1 == name2;
+
+  return strcmp (name1, name2) == 0;
+}
+
+/* Get the table for a new RS-client.  With 'bgp route-server
+   shared-rib' the table of a client with the same import policy is
+   used, if there is one. */
+struct bgp_table *
+bgp_rsclient_table_get (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_table *table;
+  struct peer *owner;
+  struct listnode *node, *nnode;
+  int share;
+
+  share = bgp_flag_check (peer->bgp, BGP_FLAG_RSCLIENT_SHARED_RIB)
+          && ! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP);
+
+  if (share)
+    for (ALL_LIST_ELEMENTS (peer->bgp->rsclient, node, nnode, owner))
+      {
+        if (owner == peer || ! BGP_RSCLIENT_TABLE_OWNER (owner, afi, safi))
+          continue;
+
+        table = owner->rib[afi][safi];
+        if (table->share && bgp_rsclient_share_match (owner, peer, afi, safi))
+          {
+            listnode_add (table->share, peer);
+            return table;
+          }
+      }
+
+  table = bgp_table_init (afi, safi);
+  table->type = BGP_TABLE_RSCLIENT;
+  table->owner = peer;
+  if (share)
+    table->share = list_new ();
+
+  return table;
+}
+
+/* Drop peer's reference to its RS-client table.  The table is freed
+   with its last client. */
+void
+bgp_rsclient_table_release (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_table *table = peer->rib[afi][safi];
+  struct listnode *node;
+
+  if (! table)
+    return;
+
+  if (table->share && table->owner != peer)
+    listnode_delete (table->share, peer);
+  else if (table->share && (node = listhead (table->share)))
+    {
+      table->owner = listgetdata (node);
+      list_delete_node (table->share, node);
+    }
+  else
+    {
+      bgp_table_finish (&peer->rib[afi][safi]);
+      return;
+    }
+
+  peer->rib[afi][safi] = NULL;
+}
+
+/* Move peer to another table when its import policy no longer matches
+   the clients it shares its table with.  Returns 1 when an Established
+   peer was moved; its Adj-RIB-Out refers to the old table, so the
+   caller has to reset the session. */
+static int
+bgp_rsclient_table_move (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct bgp_table *table = peer->rib[afi][safi];
+  struct peer *other;
+
+  if (! table || ! table->share)
+    return 0;
+
+  if (table->owner != peer)
+    other = table->owner;
+  else if (listhead (table->share))
+    other = listgetdata (listhead (table->share));
+  else
+    other = NULL;
+
+  if (other && bgp_rsclient_share_match (peer, other, afi, safi))
+    return 0;
+
+  /* A client with a table of its own only changes tables while down. */
+  if (! other && peer->status == Established)
+    return 0;
+
+  bgp_rsclient_table_release (peer, afi, safi);
+  peer->rib[afi][safi] = bgp_rsclient_table_get (peer, afi, safi);
+
+  if (BGP_RSCLIENT_TABLE_OWNER (peer, afi, safi))
+    {
+      bgp_check_local_routes_rsclient (peer, afi, safi);
+      bgp_soft_reconfig_rsclient (peer, afi, safi);
+      bgp_rsclient_table_fill (peer, afi, safi);
+    }
+
+  return peer->status == Established;
+}
+
+/* As bgp_rsclient_table_move, for a single client. */
+int
+bgp_rsclient_table_check (struct peer *peer, afi_t afi, safi_t safi)
+{
+  int ret;
+
+  ret = bgp_rsclient_table_move (peer, afi, safi);
+  bgp_rsclient_table_refresh (peer->bgp, afi, safi);
+
+  return ret;
+}
+
+/* Check the tables of all clients, after a change to what decides
+   whether they may share.  A running client moved to another table has
+   its session reset, as on 'clear ip bgp rsclient'. */
+void
+bgp_rsclient_table_recheck (struct bgp *bgp, afi_t afi, safi_t safi)
+{
+  struct peer *peer;
+  struct listnode *node, *nnode;
+
+  bgp->rsclient_policy_gen++;
+
+  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, peer))
+    if (! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP)
+        && bgp_rsclient_table_move (peer, afi, safi))
+      bgp_notify_send (peer, BGP_NOTIFY_CEASE,
+                       BGP_NOTIFY_CEASE_CONFIG_CHANGE);
+
+  bgp_rsclient_table_refresh (bgp, afi, safi);
+}
+
+static void
+bgp_rsclient_table_show_peer (struct vty *vty, struct peer *peer,
+                              struct peer *owner, unsigned long paths,
+                              unsigned long memory)
+{
+  int len;
+
+  len = vty_out (vty, "%s", peer->host);
+  len = 16 - len;
+  if (len < 1)
+    vty_out (vty, "%s%*s", VTY_NEWLINE, 16, " ");
+  else
+    vty_out (vty, "%*s", len, " ");
+
+  len = vty_out (vty, "%s", owner->host);
+  len = 16 - len;
+  if (len < 1)
+    vty_out (vty, "%s%*s", VTY_NEWLINE, 32, " ");
+  else
+    vty_out (vty, "%*s", len, " ");
+
+  vty_out (vty, "%10lu %10lu%s", paths, memory, VTY_NEWLINE);
 }
 
+/* Per client view of the RS-client tables.  The memory of a shared
+   table is split evenly between its clients. */
 void
-bgp_check_local_routes_rsclient (struct peer *rsclient, afi_t afi, safi_t safi)
+bgp_rsclient_table_show (struct vty *vty, struct bgp *bgp,
+                         afi_t afi, safi_t safi)
 {
-  struct bgp_static *bgp_static;
-  struct bgp *bgp;
+  struct peer *owner;
+  struct peer *peer;
+  struct listnode *node, *nnode;
+  struct listnode *snode, *snnode;
+  struct bgp_table *table;
   struct bgp_node *rn;
-  struct prefix *p;
+  struct bgp_info *ri;
+  unsigned long nodes;
+  unsigned long paths;
+  unsigned long memory;
+  int header = 1;
 
-  bgp = rsclient->bgp;
+  for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, owner))
+    {
+      if (! BGP_RSCLIENT_TABLE_OWNER (owner, afi, safi)
+          || CHECK_FLAG (owner->sflags, PEER_STATUS_GROUP))
+        continue;
 
-  for (rn = bgp_table_top (bgp->route[afi][safi]); rn; rn = bgp_route_next (rn))
-    if ((bgp_static = rn->info) != NULL)
-      {
-        p = &rn->p;
+      table = owner->rib[afi][safi];
 
-        bgp_static_update_rsclient (rsclient, p, bgp_static,
-                afi, safi);
-      }
+      nodes = paths = 0;
+      for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+        {
+          nodes++;
+          for (ri = rn->info; ri; ri = ri->next)
+            paths++;
+        }
+
+      memory = nodes * sizeof (struct bgp_node)
+               + paths * sizeof (struct bgp_info);
+      if (table->share)
+        memory /= listcount (table->share) + 1;
+
+      if (header)
+        {
+          vty_out (vty, "%sNeighbor        RIB owner            Paths     Memory%s",
+                   VTY_NEWLINE, VTY_NEWLINE);
+          header = 0;
+        }
+
+      bgp_rsclient_table_show_peer (vty, owner, owner, paths, memory);
+      if (table->share)
+        for (ALL_LIST_ELEMENTS (table->share, snode, snnode, peer))
+          bgp_rsclient_table_show_peer (vty, peer, owner, paths, memory);
+    }
 }
 
 static void
@@ -3684,7 +4498,10 @@ bgp_static_set (struct vty *vty, struct bgp *bgp, const char *ip_str,
       else
 	{
 	  if (bgp_static->rmap.name)
-	    free (bgp_static->rmap.name);
+	    {
+	      free (bgp_static->rmap.name);
+	      bgp->rsclient_policy_gen++;
+	    }
 	  bgp_static->rmap.name = NULL;
 	  bgp_static->rmap.map = NULL;
 	  bgp_static->valid = 0;
@@ -3758,6 +4575,10 @@ bgp_static_set (struct vty *vty, struct bgp *bgp, const char *ip_str,
 	bgp_static_update (bgp, &p, bgp_static, afi, safi);
     }
 
+  /* Network route-maps keep RS-clients from sharing tables. */
+  if (rmap)
+    bgp_rsclient_table_recheck (bgp, afi, safi);
+
   return CMD_SUCCESS;
 }
 
@@ -3770,6 +4591,7 @@ bgp_static_unset (struct vty *vty, struct bgp *bgp, const char *ip_str,
   struct prefix p;
   struct bgp_static *bgp_static;
   struct bgp_node *rn;
+  int rmap;
 
   /* Convert IP prefix string to struct prefix. */
   ret = str2prefix (ip_str, &p);
@@ -3807,11 +4629,15 @@ bgp_static_unset (struct vty *vty, struct bgp *bgp, const char *ip_str,
     bgp_static_withdraw (bgp, &p, afi, safi);
 
   /* Clear configuration. */
+  rmap = (bgp_static->rmap.name != NULL);
   bgp_static_free (bgp_static);
   rn->info = NULL;
   bgp_unlock_node (rn);
   bgp_unlock_node (rn);
 
+  if (rmap)
+    bgp_rsclient_table_recheck (bgp, afi, safi);
+
   return CMD_SUCCESS;
 }
 
@@ -5480,6 +6306,7 @@ bgp_redistribute_add (struct prefix *p, struct in_addr *nexthop,
 		    bgp_aggregate_decrement (bgp, p, bi, afi, SAFI_UNICAST);
  		  bgp_attr_unintern (bi->attr);
  		  bi->attr = new_attr;
+ 		  bgp_info_regroup (bn, bi);
  		  bi->uptime = time (NULL);
  
  		  /* Process change. */
@@ -6061,6 +6888,9 @@ route_vty_out_detail (struct vty *vty, struct bgp *bgp, struct prefix *p,
       if (attr->flag & ATTR_FLAG_BIT(BGP_ATTR_ATOMIC_AGGREGATE))
 	vty_out (vty, ", atomic-aggregate");
 	  
+      if (CHECK_FLAG (binfo->flags, BGP_INFO_MULTIPATH))
+	vty_out (vty, ", multipath");
+
       if (CHECK_FLAG (binfo->flags, BGP_INFO_SELECTED))
 	vty_out (vty, ", best");
 
@@ -6151,230 +6981,342 @@ enum bgp_show_type
   bgp_show_type_damp_neighbor
 };
 
-static int
-bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
-	  enum bgp_show_type type, void *output_arg)
+/* State of a show command walking a table.  The walk is resumed by
+   the vty each time its output has drained, so a large table neither
+   blocks the daemon nor gets buffered whole.  */
+struct bgp_show_walk
 {
-  struct bgp_info *ri;
+  /* Owner of table, locked while the walk is resumable.  */
+  struct bgp *bgp;
+  struct bgp_table *table;
+
+  /* Next node to show, locked.  */
   struct bgp_node *rn;
-  int header = 1;
-  int display;
+
+  struct in_addr router_id;
+  enum bgp_show_type type;
+  void *output_arg;
+
+  /* Copy of an output_arg the caller does not keep.  */
+  union
+  {
+    union sockunion su;
+    struct prefix p;
+  } arg;
+
+  int header;
   unsigned long output_count;
+};
 
-  /* This is first entry point, so reset total line. */
-  output_count = 0;
+/* Nodes shown by each part of a walk.  */
+#define BGP_SHOW_WALK_NODES 1000
 
-  /* Start processing of routes. */
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn)) 
-    if (rn->info != NULL)
-      {
-	display = 0;
+/* Show the paths of rn selected by the walk, returns their count.  */
+static int
+bgp_show_node (struct vty *vty, struct bgp_show_walk *walk,
+	       struct bgp_node *rn)
+{
+  struct bgp_info *ri;
+  int display = 0;
 
-	for (ri = rn->info; ri; ri = ri->next)
-	  {
-	    if (type == bgp_show_type_flap_statistics
-		|| type == bgp_show_type_flap_address
-		|| type == bgp_show_type_flap_prefix
-		|| type == bgp_show_type_flap_cidr_only
-		|| type == bgp_show_type_flap_regexp
-		|| type == bgp_show_type_flap_filter_list
-		|| type == bgp_show_type_flap_prefix_list
-		|| type == bgp_show_type_flap_prefix_longer
-		|| type == bgp_show_type_flap_route_map
-		|| type == bgp_show_type_flap_neighbor
-		|| type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		if (!(ri->extra && ri->extra->damp_info))
-		  continue;
-	      }
-	    if (type == bgp_show_type_regexp
-		|| type == bgp_show_type_flap_regexp)
-	      {
-		regex_t *regex = output_arg;
-		    
-		if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
-		  continue;
-	      }
-	    if (type == bgp_show_type_prefix_list
-		|| type == bgp_show_type_flap_prefix_list)
-	      {
-		struct prefix_list *plist = output_arg;
-		    
-		if (prefix_list_apply (plist, &rn->p) != PREFIX_PERMIT)
-		  continue;
-	      }
-	    if (type == bgp_show_type_filter_list
-		|| type == bgp_show_type_flap_filter_list)
-	      {
-		struct as_list *as_list = output_arg;
+  for (ri = rn->info; ri; ri = ri->next)
+    {
+      if (walk->type == bgp_show_type_flap_statistics
+	  || walk->type == bgp_show_type_flap_address
+	  || walk->type == bgp_show_type_flap_prefix
+	  || walk->type == bgp_show_type_flap_cidr_only
+	  || walk->type == bgp_show_type_flap_regexp
+	  || walk->type == bgp_show_type_flap_filter_list
+	  || walk->type == bgp_show_type_flap_prefix_list
+	  || walk->type == bgp_show_type_flap_prefix_longer
+	  || walk->type == bgp_show_type_flap_route_map
+	  || walk->type == bgp_show_type_flap_neighbor
+	  || walk->type == bgp_show_type_dampend_paths
+	  || walk->type == bgp_show_type_damp_neighbor)
+	{
+	  if (!(ri->extra && ri->extra->damp_info))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_regexp
+	  || walk->type == bgp_show_type_flap_regexp)
+	{
+	  regex_t *regex = walk->output_arg;
 
-		if (as_list_apply (as_list, ri->attr->aspath) != AS_FILTER_PERMIT)
-		  continue;
-	      }
-	    if (type == bgp_show_type_route_map
-		|| type == bgp_show_type_flap_route_map)
-	      {
-		struct route_map *rmap = output_arg;
-		struct bgp_info binfo;
-		struct attr dummy_attr = { 0 }; 
-		int ret;
-
-		bgp_attr_dup (&dummy_attr, ri->attr);
-		binfo.peer = ri->peer;
-		binfo.attr = &dummy_attr;
-
-		ret = route_map_apply (rmap, &rn->p, RMAP_BGP, &binfo);
-		
-		bgp_attr_extra_free (&dummy_attr);
-		
-		if (ret == RMAP_DENYMATCH)
-		  continue;
-	      }
-	    if (type == bgp_show_type_neighbor
-		|| type == bgp_show_type_flap_neighbor
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		union sockunion *su = output_arg;
+	  if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
+	    continue;
+	}
+      if (walk->type == bgp_show_type_prefix_list
+	  || walk->type == bgp_show_type_flap_prefix_list)
+	{
+	  struct prefix_list *plist = walk->output_arg;
 
-		if (ri->peer->su_remote == NULL || ! sockunion_same(ri->peer->su_remote, su))
-		  continue;
-	      }
-	    if (type == bgp_show_type_cidr_only
-		|| type == bgp_show_type_flap_cidr_only)
-	      {
-		u_int32_t destination;
-
-		destination = ntohl (rn->p.u.prefix4.s_addr);
-		if (IN_CLASSC (destination) && rn->p.prefixlen == 24)
-		  continue;
-		if (IN_CLASSB (destination) && rn->p.prefixlen == 16)
-		  continue;
-		if (IN_CLASSA (destination) && rn->p.prefixlen == 8)
-		  continue;
-	      }
-	    if (type == bgp_show_type_prefix_longer
-		|| type == bgp_show_type_flap_prefix_longer)
-	      {
-		struct prefix *p = output_arg;
+	  if (prefix_list_apply (plist, &rn->p) != PREFIX_PERMIT)
+	    continue;
+	}
+      if (walk->type == bgp_show_type_filter_list
+	  || walk->type == bgp_show_type_flap_filter_list)
+	{
+	  struct as_list *as_list = walk->output_arg;
 
-		if (! prefix_match (p, &rn->p))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_all)
-	      {
-		if (! ri->attr->community)
-		  continue;
-	      }
-	    if (type == bgp_show_type_community)
-	      {
-		struct community *com = output_arg;
+	  if (as_list_apply (as_list, ri->attr->aspath) != AS_FILTER_PERMIT)
+	    continue;
+	}
+      if (walk->type == bgp_show_type_route_map
+	  || walk->type == bgp_show_type_flap_route_map)
+	{
+	  struct route_map *rmap = walk->output_arg;
+	  struct bgp_info binfo;
+	  struct attr dummy_attr = { 0 }; 
+	  int ret;
 
-		if (! ri->attr->community ||
-		    ! community_match (ri->attr->community, com))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_exact)
-	      {
-		struct community *com = output_arg;
+	  bgp_attr_dup (&dummy_attr, ri->attr);
+	  binfo.peer = ri->peer;
+	  binfo.attr = &dummy_attr;
 
-		if (! ri->attr->community ||
-		    ! community_cmp (ri->attr->community, com))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_list)
-	      {
-		struct community_list *list = output_arg;
+	  ret = route_map_apply (rmap, &rn->p, RMAP_BGP, &binfo);
 
-		if (! community_list_match (ri->attr->community, list))
-		  continue;
-	      }
-	    if (type == bgp_show_type_community_list_exact)
-	      {
-		struct community_list *list = output_arg;
+	  bgp_attr_extra_free (&dummy_attr);
 
-		if (! community_list_exact_match (ri->attr->community, list))
-		  continue;
-	      }
-	    if (type == bgp_show_type_flap_address
-		|| type == bgp_show_type_flap_prefix)
-	      {
-		struct prefix *p = output_arg;
+	  if (ret == RMAP_DENYMATCH)
+	    continue;
+	}
+      if (walk->type == bgp_show_type_neighbor
+	  || walk->type == bgp_show_type_flap_neighbor
+	  || walk->type == bgp_show_type_damp_neighbor)
+	{
+	  union sockunion *su = walk->output_arg;
 
-		if (! prefix_match (&rn->p, p))
-		  continue;
+	  if (ri->peer->su_remote == NULL || ! sockunion_same(ri->peer->su_remote, su))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_cidr_only
+	  || walk->type == bgp_show_type_flap_cidr_only)
+	{
+	  u_int32_t destination;
 
-		if (type == bgp_show_type_flap_prefix)
-		  if (p->prefixlen != rn->p.prefixlen)
-		    continue;
-	      }
-	    if (type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      {
-		if (! CHECK_FLAG (ri->flags, BGP_INFO_DAMPED)
-		    || CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
-		  continue;
-	      }
+	  destination = ntohl (rn->p.u.prefix4.s_addr);
+	  if (IN_CLASSC (destination) && rn->p.prefixlen == 24)
+	    continue;
+	  if (IN_CLASSB (destination) && rn->p.prefixlen == 16)
+	    continue;
+	  if (IN_CLASSA (destination) && rn->p.prefixlen == 8)
+	    continue;
+	}
+      if (walk->type == bgp_show_type_prefix_longer
+	  || walk->type == bgp_show_type_flap_prefix_longer)
+	{
+	  struct prefix *p = walk->output_arg;
 
-	    if (header)
-	      {
-		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (*router_id), VTY_NEWLINE);
-		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		if (type == bgp_show_type_dampend_paths
-		    || type == bgp_show_type_damp_neighbor)
-		  vty_out (vty, BGP_SHOW_DAMP_HEADER, VTY_NEWLINE);
-		else if (type == bgp_show_type_flap_statistics
-			 || type == bgp_show_type_flap_address
-			 || type == bgp_show_type_flap_prefix
-			 || type == bgp_show_type_flap_cidr_only
-			 || type == bgp_show_type_flap_regexp
-			 || type == bgp_show_type_flap_filter_list
-			 || type == bgp_show_type_flap_prefix_list
-			 || type == bgp_show_type_flap_prefix_longer
-			 || type == bgp_show_type_flap_route_map
-			 || type == bgp_show_type_flap_neighbor)
-		  vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
-		else
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		header = 0;
-	      }
+	  if (! prefix_match (p, &rn->p))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_community_all)
+	{
+	  if (! ri->attr->community)
+	    continue;
+	}
+      if (walk->type == bgp_show_type_community)
+	{
+	  struct community *com = walk->output_arg;
 
-	    if (type == bgp_show_type_dampend_paths
-		|| type == bgp_show_type_damp_neighbor)
-	      damp_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    else if (type == bgp_show_type_flap_statistics
-		     || type == bgp_show_type_flap_address
-		     || type == bgp_show_type_flap_prefix
-		     || type == bgp_show_type_flap_cidr_only
-		     || type == bgp_show_type_flap_regexp
-		     || type == bgp_show_type_flap_filter_list
-		     || type == bgp_show_type_flap_prefix_list
-		     || type == bgp_show_type_flap_prefix_longer
-		     || type == bgp_show_type_flap_route_map
-		     || type == bgp_show_type_flap_neighbor)
-	      flap_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    else
-	      route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
-	    display++;
-	  }
-	if (display)
-	  output_count++;
-      }
+	  if (! ri->attr->community ||
+	      ! community_match (ri->attr->community, com))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_community_exact)
+	{
+	  struct community *com = walk->output_arg;
+
+	  if (! ri->attr->community ||
+	      ! community_cmp (ri->attr->community, com))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_community_list)
+	{
+	  struct community_list *list = walk->output_arg;
+
+	  if (! community_list_match (ri->attr->community, list))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_community_list_exact)
+	{
+	  struct community_list *list = walk->output_arg;
+
+	  if (! community_list_exact_match (ri->attr->community, list))
+	    continue;
+	}
+      if (walk->type == bgp_show_type_flap_address
+	  || walk->type == bgp_show_type_flap_prefix)
+	{
+	  struct prefix *p = walk->output_arg;
+
+	  if (! prefix_match (&rn->p, p))
+	    continue;
+
+	  if (walk->type == bgp_show_type_flap_prefix)
+	    if (p->prefixlen != rn->p.prefixlen)
+	      continue;
+	}
+      if (walk->type == bgp_show_type_dampend_paths
+	  || walk->type == bgp_show_type_damp_neighbor)
+	{
+	  if (! CHECK_FLAG (ri->flags, BGP_INFO_DAMPED)
+	      || CHECK_FLAG (ri->flags, BGP_INFO_HISTORY))
+	    continue;
+	}
+
+      if (walk->header)
+	{
+	  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (walk->router_id), VTY_NEWLINE);
+	  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+	  if (walk->type == bgp_show_type_dampend_paths
+	      || walk->type == bgp_show_type_damp_neighbor)
+	    vty_out (vty, BGP_SHOW_DAMP_HEADER, VTY_NEWLINE);
+	  else if (walk->type == bgp_show_type_flap_statistics
+		   || walk->type == bgp_show_type_flap_address
+		   || walk->type == bgp_show_type_flap_prefix
+		   || walk->type == bgp_show_type_flap_cidr_only
+		   || walk->type == bgp_show_type_flap_regexp
+		   || walk->type == bgp_show_type_flap_filter_list
+		   || walk->type == bgp_show_type_flap_prefix_list
+		   || walk->type == bgp_show_type_flap_prefix_longer
+		   || walk->type == bgp_show_type_flap_route_map
+		   || walk->type == bgp_show_type_flap_neighbor)
+	    vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
+	  else
+	    vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+	  walk->header = 0;
+	}
+
+      if (walk->type == bgp_show_type_dampend_paths
+	  || walk->type == bgp_show_type_damp_neighbor)
+	damp_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+      else if (walk->type == bgp_show_type_flap_statistics
+	       || walk->type == bgp_show_type_flap_address
+	       || walk->type == bgp_show_type_flap_prefix
+	       || walk->type == bgp_show_type_flap_cidr_only
+	       || walk->type == bgp_show_type_flap_regexp
+	       || walk->type == bgp_show_type_flap_filter_list
+	       || walk->type == bgp_show_type_flap_prefix_list
+	       || walk->type == bgp_show_type_flap_prefix_longer
+	       || walk->type == bgp_show_type_flap_route_map
+	       || walk->type == bgp_show_type_flap_neighbor)
+	flap_route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+      else
+	route_vty_out (vty, &rn->p, ri, display, SAFI_UNICAST);
+      display++;
+    }
+
+  return display;
+}
+
+static void
+bgp_show_walk_free (struct vty *vty, void *arg)
+{
+  struct bgp_show_walk *walk = arg;
+
+  if (walk->rn)
+    bgp_unlock_node (walk->rn);
+  if (walk->bgp)
+    bgp_unlock (walk->bgp);
+
+  XFREE (MTYPE_BGP_SHOW_WALK, walk);
+}
+
+/* Show the next part of the walk, returns 0 once it has finished.  */
+static int
+bgp_show_walk_run (struct vty *vty, void *arg)
+{
+  struct bgp_show_walk *walk = arg;
+  int count;
+
+  for (count = 0; walk->rn && count < BGP_SHOW_WALK_NODES; count++)
+    {
+      if (walk->rn->info != NULL && bgp_show_node (vty, walk, walk->rn))
+	walk->output_count++;
+      walk->rn = bgp_route_next (walk->rn);
+    }
+
+  if (walk->rn)
+    return 1;
 
   /* No route is displayed */
-  if (output_count == 0)
+  if (walk->output_count == 0)
     {
-      if (type == bgp_show_type_normal)
+      if (walk->type == bgp_show_type_normal)
 	vty_out (vty, "No BGP network exists%s", VTY_NEWLINE);
     }
   else
     vty_out (vty, "%sTotal number of prefixes %ld%s",
-	     VTY_NEWLINE, output_count, VTY_NEWLINE);
+	     VTY_NEWLINE, walk->output_count, VTY_NEWLINE);
+
+  bgp_show_walk_free (vty, walk);
+  return 0;
+}
+
+/* Show table.  When bgp, the owner of table, is given the walk is
+   left to the vty to resume, unless output_arg is something the
+   caller frees or which may be deleted meanwhile.  */
+static int
+bgp_show_walk (struct vty *vty, struct bgp *bgp, struct bgp_table *table,
+	       struct in_addr *router_id, enum bgp_show_type type,
+	       void *output_arg)
+{
+  struct bgp_show_walk *walk;
+  int resume;
+
+  walk = XCALLOC (MTYPE_BGP_SHOW_WALK, sizeof (struct bgp_show_walk));
+  walk->table = table;
+  walk->router_id = *router_id;
+  walk->type = type;
+  walk->header = 1;
+
+  switch (type)
+    {
+    case bgp_show_type_neighbor:
+    case bgp_show_type_flap_neighbor:
+    case bgp_show_type_damp_neighbor:
+      walk->arg.su = *(union sockunion *) output_arg;
+      walk->output_arg = &walk->arg.su;
+      resume = 1;
+      break;
+    case bgp_show_type_prefix_longer:
+    case bgp_show_type_flap_prefix_longer:
+    case bgp_show_type_flap_address:
+    case bgp_show_type_flap_prefix:
+      prefix_copy (&walk->arg.p, output_arg);
+      walk->output_arg = &walk->arg.p;
+      resume = 1;
+      break;
+    default:
+      walk->output_arg = output_arg;
+      resume = (output_arg == NULL);
+      break;
+    }
+
+  walk->rn = bgp_table_top (table);
+
+  if (bgp && resume)
+    {
+      bgp_lock (bgp);
+      walk->bgp = bgp;
+      vty_output_continue (vty, bgp_show_walk_run, bgp_show_walk_free, walk);
+    }
+  else
+    while (bgp_show_walk_run (vty, walk))
+      ;
 
   return CMD_SUCCESS;
 }
 
+static int
+bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
+	  enum bgp_show_type type, void *output_arg)
+{
+  return bgp_show_walk (vty, NULL, table, router_id, type, output_arg);
+}
+
 static int
 bgp_show (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi,
          enum bgp_show_type type, void *output_arg)
@@ -6394,7 +7336,7 @@ bgp_show (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi,
 
   table = bgp->rib[afi][safi];
 
-  return bgp_show_table (vty, table, &bgp->router_id, type, output_arg);
+  return bgp_show_walk (vty, bgp, table, &bgp->router_id, type, output_arg);
 }
 
 /* Header of detailed BGP route information */
@@ -8981,6 +9923,9 @@ enum bgp_stats
   BGP_STATS_ASPATH_MAXSIZE,
   BGP_STATS_ASPATH_TOTSIZE,
   BGP_STATS_ASN_HIGHEST,
+  BGP_STATS_SELECTIONS,
+  BGP_STATS_SELECTIONS_FAST,
+  BGP_STATS_SELECTION_CMPS,
   BGP_STATS_MAX,
 };
 
@@ -8999,6 +9944,9 @@ static const char *table_stats_strs[] =
   [BGP_STATS_ASPATH_TOTHOPS]      = "Average AS-Path length (hops)",
   [BGP_STATS_ASPATH_TOTSIZE]      = "Average AS-Path size (bytes)",
   [BGP_STATS_ASN_HIGHEST]         = "Highest public ASN",
+  [BGP_STATS_SELECTIONS]          = "Best-path selections",
+  [BGP_STATS_SELECTIONS_FAST]     = "Incremental selections",
+  [BGP_STATS_SELECTION_CMPS]      = "Average comparisons/selection",
   [BGP_STATS_MAX] = NULL,
 };
 
@@ -9143,6 +10091,9 @@ bgp_table_stats (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi)
   memset (&ts, 0, sizeof (ts));
   ts.table = bgp->rib[afi][safi];
   thread_execute (bm->master, bgp_table_stats_walker, &ts, 0);
+  ts.counts[BGP_STATS_SELECTIONS] = ts.table->selections;
+  ts.counts[BGP_STATS_SELECTIONS_FAST] = ts.table->selections_fast;
+  ts.counts[BGP_STATS_SELECTION_CMPS] = ts.table->selection_cmps;
 
   vty_out (vty, "BGP %s RIB statistics%s%s",
            afi_safi_print (afi, safi), VTY_NEWLINE, VTY_NEWLINE);
@@ -9172,6 +10123,14 @@ bgp_table_stats (struct vty *vty, struct bgp *bgp, afi_t afi, safi_t safi)
                       (float)ts.counts[BGP_STATS_ASPATH_COUNT]
                      : 0);
             break;
+          case BGP_STATS_SELECTION_CMPS:
+            vty_out (vty, "%-30s: ", table_stats_strs[i]);
+            vty_out (vty, "%12.2f",
+                     ts.counts[i] ?
+                     (float)ts.counts[i] / 
+                      (float)ts.counts[BGP_STATS_SELECTIONS]
+                     : 0);
+            break;
           case BGP_STATS_TOTPLEN:
             vty_out (vty, "%-30s: ", table_stats_strs[i]);
             vty_out (vty, "%12.2f",
@@ -9618,27 +10577,26 @@ show_adj_route (struct vty *vty, struct peer *peer, afi_t afi, safi_t safi,
       }
     else
       {
-	for (adj = rn->adj_out; adj; adj = adj->next)
-	  if (adj->peer == peer)
-	    {
-	      if (header1)
-		{
-		  vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
-		  header1 = 0;
-		}
-	      if (header2)
-		{
-		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		  header2 = 0;
-		}
-	      if (adj->attr)
-		{	
-		  route_vty_out_tmp (vty, &rn->p, adj->attr, safi);
-		  output_count++;
-		}
-	    }
+	if ((adj = bgp_adj_out_peer (rn, peer)) != NULL)
+	  {
+	    if (header1)
+	      {
+		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (bgp->router_id), VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
+		header1 = 0;
+	      }
+	    if (header2)
+	      {
+		vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
+		header2 = 0;
+	      }
+	    if (adj->attr)
+	      {       
+		route_vty_out_tmp (vty, &rn->p, adj->attr, safi);
+		output_count++;
+	      }
+	  }
       }
   
   if (output_count != 0)
@@ -11379,7 +12337,15 @@ DEFUN (clear_ip_bgp_dampening,
        BGP_STR
        "Clear route flap dampening information\n")
 {
-  bgp_damp_info_clean ();
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  bgp = bgp_get_default ();
+  if (bgp)
+    for (afi = AFI_IP; afi < AFI_MAX; afi++)
+      for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	bgp_damp_info_clean (bgp, afi, safi);
   return CMD_SUCCESS;
 }
 
@@ -11604,6 +12570,34 @@ bgp_config_write_distance (struct vty *vty, struct bgp *bgp)
 }
 
 /* Allocate routing table structure and install commands. */
+DEFUN (show_bgp_convergence_statistics,
+       show_bgp_convergence_statistics_cmd,
+       "show bgp convergence-statistics",
+       SHOW_STR
+       BGP_STR
+       "Latency of the stages from UPDATE receipt to zebra\n")
+{
+  if (! bgp_option_check (BGP_OPT_CONVERGENCE_STATS))
+    vty_out (vty, "Convergence statistics are not enabled%s", VTY_NEWLINE);
+
+  latency_vty (vty, bgp_latency, BGP_LATENCY_MAX);
+  return CMD_SUCCESS;
+}
+
+DEFUN (clear_bgp_convergence_statistics,
+       clear_bgp_convergence_statistics_cmd,
+       "clear bgp convergence-statistics",
+       CLEAR_STR
+       BGP_STR
+       "Latency of the stages from UPDATE receipt to zebra\n")
+{
+  int i;
+
+  for (i = 0; i < BGP_LATENCY_MAX; i++)
+    latency_reset (&bgp_latency[i]);
+  return CMD_SUCCESS;
+}
+
 void
 bgp_route_init (void)
 {
@@ -11755,6 +12749,7 @@ bgp_route_init (void)
   install_element (BGP_IPV4M_NODE, &no_aggregate_address_mask_summary_as_set_cmd);
 
   install_element (VIEW_NODE, &show_ip_bgp_cmd);
+  install_element (VIEW_NODE, &show_bgp_convergence_statistics_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_ipv4_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_route_cmd);
   install_element (VIEW_NODE, &show_ip_bgp_ipv4_route_cmd);
@@ -11862,6 +12857,8 @@ bgp_route_init (void)
   install_element (RESTRICTED_NODE, &show_ip_bgp_view_rsclient_prefix_cmd);
 
   install_element (ENABLE_NODE, &show_ip_bgp_cmd);
+  install_element (ENABLE_NODE, &show_bgp_convergence_statistics_cmd);
+  install_element (ENABLE_NODE, &clear_bgp_convergence_statistics_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_ipv4_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_route_cmd);
   install_element (ENABLE_NODE, &show_ip_bgp_ipv4_route_cmd);
@@ -12275,4 +13272,26 @@ bgp_route_init (void)
   install_element (BGP_IPV4_NODE, &bgp_damp_set3_cmd);
   install_element (BGP_IPV4_NODE, &bgp_damp_unset_cmd);
   install_element (BGP_IPV4_NODE, &bgp_damp_unset2_cmd);
+  install_element (BGP_IPV4M_NODE, &bgp_damp_set_cmd);
+  install_element (BGP_IPV4M_NODE, &bgp_damp_set2_cmd);
+  install_element (BGP_IPV4M_NODE, &bgp_damp_set3_cmd);
+  install_element (BGP_IPV4M_NODE, &bgp_damp_unset_cmd);
+  install_element (BGP_IPV4M_NODE, &bgp_damp_unset2_cmd);
+  install_element (BGP_VPNV4_NODE, &bgp_damp_set_cmd);
+  install_element (BGP_VPNV4_NODE, &bgp_damp_set2_cmd);
+  install_element (BGP_VPNV4_NODE, &bgp_damp_set3_cmd);
+  install_element (BGP_VPNV4_NODE, &bgp_damp_unset_cmd);
+  install_element (BGP_VPNV4_NODE, &bgp_damp_unset2_cmd);
+#ifdef HAVE_IPV6
+  install_element (BGP_IPV6_NODE, &bgp_damp_set_cmd);
+  install_element (BGP_IPV6_NODE, &bgp_damp_set2_cmd);
+  install_element (BGP_IPV6_NODE, &bgp_damp_set3_cmd);
+  install_element (BGP_IPV6_NODE, &bgp_damp_unset_cmd);
+  install_element (BGP_IPV6_NODE, &bgp_damp_unset2_cmd);
+  install_element (BGP_IPV6M_NODE, &bgp_damp_set_cmd);
+  install_element (BGP_IPV6M_NODE, &bgp_damp_set2_cmd);
+  install_element (BGP_IPV6M_NODE, &bgp_damp_set3_cmd);
+  install_element (BGP_IPV6M_NODE, &bgp_damp_unset_cmd);
+  install_element (BGP_IPV6M_NODE, &bgp_damp_unset2_cmd);
+#endif /* HAVE_IPV6 */
 }
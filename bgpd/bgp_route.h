@@ -40,6 +40,10 @@ struct bgp_info_extra
 
   /* MPLS label.  */
   u_char tag[3];  
+
+  /* Extended communities the path is in the route target index
+     under.  */
+  struct ecommunity *rt_ecom;
 };
 
 struct bgp_info
@@ -76,6 +80,7 @@ struct bgp_info
 #define BGP_INFO_STALE          (1 << 8)
 #define BGP_INFO_REMOVED        (1 << 9)
 #define BGP_INFO_COUNTED	(1 << 10)
+#define BGP_INFO_MULTIPATH	(1 << 11)
 
   /* BGP route type.  This can be static, RIP, OSPF, BGP etc.  */
   u_char type;
@@ -157,18 +162,31 @@ struct bgp_static
 #define ROUTE_MAP_EXPORT_NAME(F)    ((F)->map[RMAP_EXPORT].name)
 #define ROUTE_MAP_EXPORT(F)    ((F)->map[RMAP_EXPORT].map)
 
+/* RS-client tables may be shared between clients, only the owner of
+   the table feeds it. */
+#define BGP_RSCLIENT_TABLE_OWNER(P,A,S) \
+  ((P)->rib[(A)][(S)] && (P)->rib[(A)][(S)]->owner == (P))
+
 #define UNSUPPRESS_MAP_NAME(F)  ((F)->usmap.name)
 #define UNSUPPRESS_MAP(F)       ((F)->usmap.map)
 
 /* Prototypes. */
 extern void bgp_route_init (void);
 extern void bgp_cleanup_routes (void);
+extern void bgp_announce_node (struct peer *, afi_t, safi_t,
+			       struct bgp_node *);
 extern void bgp_announce_route (struct peer *, afi_t, safi_t);
 extern void bgp_announce_route_all (struct peer *);
 extern void bgp_default_originate (struct peer *, afi_t, safi_t, int);
 extern void bgp_soft_reconfig_in (struct peer *, afi_t, safi_t);
 extern void bgp_soft_reconfig_rsclient (struct peer *, afi_t, safi_t);
+extern void bgp_rsclient_table_fill (struct peer *, afi_t, safi_t);
 extern void bgp_check_local_routes_rsclient (struct peer *rsclient, afi_t afi, safi_t safi);
+extern struct bgp_table *bgp_rsclient_table_get (struct peer *, afi_t, safi_t);
+extern void bgp_rsclient_table_release (struct peer *, afi_t, safi_t);
+extern int bgp_rsclient_table_check (struct peer *, afi_t, safi_t);
+extern void bgp_rsclient_table_recheck (struct bgp *, afi_t, safi_t);
+extern void bgp_rsclient_table_show (struct vty *, struct bgp *, afi_t, safi_t);
 extern void bgp_clear_route (struct peer *, afi_t, safi_t);
 extern void bgp_clear_route_all (struct peer *);
 extern void bgp_clear_adj_in (struct peer *, afi_t, safi_t);
@@ -178,6 +196,7 @@ extern struct bgp_info *bgp_info_lock (struct bgp_info *);
 extern struct bgp_info *bgp_info_unlock (struct bgp_info *);
 extern void bgp_info_add (struct bgp_node *rn, struct bgp_info *ri);
 extern void bgp_info_delete (struct bgp_node *rn, struct bgp_info *ri);
+extern void bgp_info_changed (struct bgp_node *rn, struct bgp_info *ri);
 extern struct bgp_info_extra *bgp_info_extra_get (struct bgp_info *);
 extern void bgp_info_set_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
 extern void bgp_info_unset_flag (struct bgp_node *, struct bgp_info *, u_int32_t);
@@ -208,6 +227,8 @@ extern int bgp_update (struct peer *, struct prefix *, struct attr *,
 		       u_char *, int);
 extern int bgp_withdraw (struct peer *, struct prefix *, struct attr *,
 			 afi_t, safi_t, int, int, struct prefix_rd *, u_char *);
+extern int bgp_update_stale (struct peer *, struct prefix *, struct attr *,
+			     afi_t, safi_t, int, time_t);
 
 /* for bgp_nexthop and bgp_damp */
 extern void bgp_process (struct bgp *, struct bgp_node *, afi_t, safi_t);
@@ -2407,6 +2407,13 @@ bgp_route_map_update (const char *unused)
 #endif /* HAVE_IPV6 */
 	}
     }
+
+  /* For RS-client shared tables. */
+  for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
+    if (bgp_flag_check (bgp, BGP_FLAG_RSCLIENT_SHARED_RIB))
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+	for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	  bgp_rsclient_table_recheck (bgp, afi, safi);
 }
 
 DEFUN (match_peer,
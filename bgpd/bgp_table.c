@@ -24,6 +24,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "memory.h"
 #include "sockunion.h"
 #include "vty.h"
+#include "linklist.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -124,6 +125,9 @@ bgp_table_free (struct bgp_table *rt)
 	}
     }
  
+  if (rt->share)
+    list_delete (rt->share);
+
   XFREE (MTYPE_BGP_TABLE, rt);
   return;
 }
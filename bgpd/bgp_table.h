@@ -38,9 +38,18 @@ struct bgp_table
   /* The owner of this 'bgp_table' structure. */
   void *owner;
 
+  /* RS-clients, other than the owner, sharing this table. */
+  struct list *share;
+
   struct bgp_node *top;
   
   unsigned long count;
+
+  /* Best path selection runs, those that only had to look at the
+     changed path, and the path comparisons they made. */
+  unsigned long selections;
+  unsigned long selections_fast;
+  unsigned long selection_cmps;
 };
 
 struct bgp_node
@@ -57,14 +66,21 @@ struct bgp_node
 
   struct bgp_adj_out *adj_out;
 
+  struct bgp_advertise *adv;
+
   struct bgp_adj_in *adj_in;
 
   struct bgp_node *prn;
 
+  /* Single path changed since the last best path selection. */
+  struct bgp_info *changed;
+
   unsigned int lock;
 
   u_char flags;
 #define BGP_NODE_PROCESS_SCHEDULED	(1 << 0)
+#define BGP_NODE_CHANGED_ADD		(1 << 1)
+#define BGP_NODE_CHANGED_MANY		(1 << 2)
 };
 
 extern struct bgp_table *bgp_table_init (afi_t, safi_t);
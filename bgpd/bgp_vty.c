@@ -252,6 +252,27 @@ DEFUN (no_bgp_multiple_instance,
   return CMD_SUCCESS;
 }
 
+DEFUN (bgp_convergence_statistics,
+       bgp_convergence_statistics_cmd,
+       "bgp convergence-statistics",
+       BGP_STR
+       "Measure the latency from UPDATE receipt to FIB installation\n")
+{
+  bgp_option_set (BGP_OPT_CONVERGENCE_STATS);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_convergence_statistics,
+       no_bgp_convergence_statistics_cmd,
+       "no bgp convergence-statistics",
+       NO_STR
+       BGP_STR
+       "Measure the latency from UPDATE receipt to FIB installation\n")
+{
+  bgp_option_unset (BGP_OPT_CONVERGENCE_STATS);
+  return CMD_SUCCESS;
+}
+
 DEFUN (bgp_config_type,
        bgp_config_type_cmd,
        "bgp config-type (cisco|zebra)",
@@ -785,6 +806,128 @@ DEFUN (no_bgp_deterministic_med,
   return CMD_SUCCESS;
 }
 
+/* "maximum-paths" configuration. */
+static int
+bgp_maxpaths_config_vty (struct vty *vty, int ibgp, const char *num_str)
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  afi_t afi;
+  safi_t safi;
+  u_int16_t maxpaths = BGP_DEFAULT_MAXPATHS;
+
+  bgp = vty->index;
+  afi = bgp_node_afi (vty);
+  safi = bgp_node_safi (vty);
+
+  if (num_str)
+    VTY_GET_INTEGER_RANGE ("maximum-paths", maxpaths, num_str,
+			   1, BGP_MAXIMUM_MAXPATHS);
+
+  if (ibgp)
+    {
+      if (bgp->maxpaths[afi][safi].maxpaths_ibgp == maxpaths)
+	return CMD_SUCCESS;
+      bgp->maxpaths[afi][safi].maxpaths_ibgp = maxpaths;
+    }
+  else
+    {
+      if (bgp->maxpaths[afi][safi].maxpaths_ebgp == maxpaths)
+	return CMD_SUCCESS;
+      bgp->maxpaths[afi][safi].maxpaths_ebgp = maxpaths;
+    }
+
+  /* Have the installed multipath sets follow. */
+  for (rn = bgp_table_top (bgp->rib[afi][safi]); rn; rn = bgp_route_next (rn))
+    if (rn->info)
+      bgp_process (bgp, rn, afi, safi);
+
+  return CMD_SUCCESS;
+}
+
+DEFUN (bgp_maxpaths,
+       bgp_maxpaths_cmd,
+       "maximum-paths <1-64>",
+       "Forward packets over multiple paths\n"
+       "Number of paths\n")
+{
+  return bgp_maxpaths_config_vty (vty, 0, argv[0]);
+}
+
+DEFUN (bgp_maxpaths_ibgp,
+       bgp_maxpaths_ibgp_cmd,
+       "maximum-paths ibgp <1-64>",
+       "Forward packets over multiple paths\n"
+       "iBGP-multipath\n"
+       "Number of paths\n")
+{
+  return bgp_maxpaths_config_vty (vty, 1, argv[0]);
+}
+
+DEFUN (no_bgp_maxpaths,
+       no_bgp_maxpaths_cmd,
+       "no maximum-paths",
+       NO_STR
+       "Forward packets over multiple paths\n")
+{
+  return bgp_maxpaths_config_vty (vty, 0, NULL);
+}
+
+ALIAS (no_bgp_maxpaths,
+       no_bgp_maxpaths_arg_cmd,
+       "no maximum-paths <1-64>",
+       NO_STR
+       "Forward packets over multiple paths\n"
+       "Number of paths\n")
+
+DEFUN (no_bgp_maxpaths_ibgp,
+       no_bgp_maxpaths_ibgp_cmd,
+       "no maximum-paths ibgp",
+       NO_STR
+       "Forward packets over multiple paths\n"
+       "iBGP-multipath\n")
+{
+  return bgp_maxpaths_config_vty (vty, 1, NULL);
+}
+
+ALIAS (no_bgp_maxpaths_ibgp,
+       no_bgp_maxpaths_ibgp_arg_cmd,
+       "no maximum-paths ibgp <1-64>",
+       NO_STR
+       "Forward packets over multiple paths\n"
+       "iBGP-multipath\n"
+       "Number of paths\n")
+
+/* "bgp route-server shared-rib" configuration. */
+DEFUN (bgp_rsclient_shared_rib,
+       bgp_rsclient_shared_rib_cmd,
+       "bgp route-server shared-rib",
+       "BGP specific commands\n"
+       "Route Server specific commands\n"
+       "Share RIBs between Route Server clients with the same import policy\n")
+{
+  struct bgp *bgp;
+
+  bgp = vty->index;
+  bgp_flag_set (bgp, BGP_FLAG_RSCLIENT_SHARED_RIB);
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_bgp_rsclient_shared_rib,
+       no_bgp_rsclient_shared_rib_cmd,
+       "no bgp route-server shared-rib",
+       NO_STR
+       "BGP specific commands\n"
+       "Route Server specific commands\n"
+       "Share RIBs between Route Server clients with the same import policy\n")
+{
+  struct bgp *bgp;
+
+  bgp = vty->index;
+  bgp_flag_unset (bgp, BGP_FLAG_RSCLIENT_SHARED_RIB);
+  return CMD_SUCCESS;
+}
+
 /* "bgp graceful-restart" configuration. */
 DEFUN (bgp_graceful_restart,
        bgp_graceful_restart_cmd,
@@ -2095,15 +2238,17 @@ peer_rsclient_set_vty (struct vty *vty, const char *peer_str,
   if (ret < 0)
     return bgp_vty_return (vty, ret);
 
-  peer->rib[afi][safi] = bgp_table_init (afi, safi);
-  peer->rib[afi][safi]->type = BGP_TABLE_RSCLIENT;
-  peer->rib[afi][safi]->owner = peer;
+  peer->rib[afi][safi] = bgp_rsclient_table_get (peer, afi, safi);
 
-  /* Check for existing 'network' and 'redistribute' routes. */
-  bgp_check_local_routes_rsclient (peer, afi, safi);
+  /* A shared table is already populated. */
+  if (BGP_RSCLIENT_TABLE_OWNER (peer, afi, safi))
+    {
+      /* Check for existing 'network' and 'redistribute' routes. */
+      bgp_check_local_routes_rsclient (peer, afi, safi);
 
-  /* Check for routes for peers configured with 'soft-reconfiguration'. */
-  bgp_soft_reconfig_rsclient (peer, afi, safi);
+      /* Check for routes for peers configured with 'soft-reconfiguration'. */
+      bgp_soft_reconfig_rsclient (peer, afi, safi);
+    }
 
   if (CHECK_FLAG(peer->sflags, PEER_STATUS_GROUP))
     {
@@ -2194,7 +2339,7 @@ peer_rsclient_unset_vty (struct vty *vty, const char *peer_str,
       listnode_delete (bgp->rsclient, peer);
     }
 
-  bgp_table_finish (&peer->rib[bgp_node_afi(vty)][bgp_node_safi(vty)]);
+  bgp_rsclient_table_release (peer, bgp_node_afi(vty), bgp_node_safi(vty));
 
   return CMD_SUCCESS;
 }
@@ -6671,6 +6816,94 @@ DEFUN (show_bgp_memory,
   return CMD_SUCCESS;
 }
 
+static void
+bgp_adj_out_memory_table (struct bgp_table *table, safi_t safi,
+                          unsigned long *memory, int size)
+{
+  struct bgp_node *rn;
+
+  if (safi != SAFI_MPLS_VPN)
+    bgp_adj_out_memory (table, memory, size);
+  else
+    for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+      if (rn->info)
+        bgp_adj_out_memory (rn->info, memory, size);
+}
+
+/* Adj-RIB-Out memory of each peer.  Adjacencies shared by several peers
+   are split evenly between them. */
+DEFUN (show_bgp_memory_adj_out,
+       show_bgp_memory_adj_out_cmd,
+       "show bgp memory adj-out",
+       SHOW_STR
+       BGP_STR
+       "Global BGP memory statistics\n"
+       "Adj-RIB-Out memory per neighbor\n")
+{
+  char memstrbuf[MTYPE_MEMSTR_LEN];
+  struct bgp *bgp;
+  struct peer *peer;
+  struct listnode *node, *nnode;
+  struct listnode *pnode, *pnnode;
+  unsigned long *memory;
+  unsigned long prefixes;
+  int size;
+  int len;
+  afi_t afi;
+  safi_t safi;
+
+  for (ALL_LIST_ELEMENTS (bm->bgp, node, nnode, bgp))
+    {
+      size = bgp->adj_index_size * 32;
+      if (! size)
+        continue;
+
+      memory = XCALLOC (MTYPE_TMP, size * sizeof (unsigned long));
+
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+        for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+          {
+            if (bgp->rib[afi][safi])
+              bgp_adj_out_memory_table (bgp->rib[afi][safi], safi,
+                                        memory, size);
+
+            for (ALL_LIST_ELEMENTS (bgp->rsclient, pnode, pnnode, peer))
+              if (BGP_RSCLIENT_TABLE_OWNER (peer, afi, safi))
+                bgp_adj_out_memory_table (peer->rib[afi][safi], safi,
+                                          memory, size);
+          }
+
+      if (bgp->name)
+        vty_out (vty, "BGP view %s%s", bgp->name, VTY_NEWLINE);
+      vty_out (vty, "Neighbor          Prefixes  Memory%s", VTY_NEWLINE);
+
+      for (ALL_LIST_ELEMENTS (bgp->peer, pnode, pnnode, peer))
+        {
+          prefixes = 0;
+          for (afi = AFI_IP; afi < AFI_MAX; afi++)
+            for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+              prefixes += peer->scount[afi][safi];
+
+          len = vty_out (vty, "%s", peer->host);
+          len = 16 - len;
+          if (len < 1)
+            vty_out (vty, "%s%*s", VTY_NEWLINE, 16, " ");
+          else
+            vty_out (vty, "%*s", len, " ");
+
+          vty_out (vty, "%10lu  %s%s", prefixes,
+                   mtype_memstr (memstrbuf, sizeof (memstrbuf),
+                                 memory[peer->adj_index]),
+                   VTY_NEWLINE);
+        }
+      vty_out (vty, "%s", VTY_NEWLINE);
+
+      XFREE (MTYPE_TMP, memory);
+    }
+
+  return CMD_SUCCESS;
+}
+
 /* Show BGP peer's summary information. */
 static int
 bgp_show_summary (struct vty *vty, struct bgp *bgp, int afi, int safi)
@@ -6749,7 +6982,8 @@ bgp_show_summary (struct vty *vty, struct bgp *bgp, int afi, int safi)
 		   peer->open_out + peer->update_out + peer->keepalive_out
 		   + peer->notify_out + peer->refresh_out
 		   + peer->dynamic_cap_out,
-		   0, 0, (unsigned long) peer->obuf->count);
+		   0, 0, (unsigned long) (peer->obuf->count
+					  + peer->obuf_ctrl->count));
 
 	  vty_out (vty, "%8s", 
 		   peer_uptime (peer->uptime, timebuf, BGP_UPTIME_LEN));
@@ -7473,7 +7707,8 @@ bgp_show_peer (struct vty *vty, struct peer *p)
   /* Packet counts. */
   vty_out (vty, "  Message statistics:%s", VTY_NEWLINE);
   vty_out (vty, "    Inq depth is 0%s", VTY_NEWLINE);
-  vty_out (vty, "    Outq depth is %lu%s", (unsigned long) p->obuf->count, VTY_NEWLINE);
+  vty_out (vty, "    Outq depth is %lu%s",
+	   (unsigned long) (p->obuf->count + p->obuf_ctrl->count), VTY_NEWLINE);
   vty_out (vty, "                         Sent       Rcvd%s", VTY_NEWLINE);
   vty_out (vty, "    Opens:         %10d %10d%s", p->open_out, p->open_in, VTY_NEWLINE);
   vty_out (vty, "    Notifications: %10d %10d%s", p->notify_out, p->notify_in, VTY_NEWLINE);
@@ -7485,10 +7720,15 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 	   p->update_out + p->keepalive_out + p->refresh_out + p->dynamic_cap_out,
 	   p->open_in + p->notify_in + p->update_in + p->keepalive_in + p->refresh_in +
 	   p->dynamic_cap_in, VTY_NEWLINE);
+  vty_out (vty, "    Updates superseded before being sent: %d%s",
+	   p->update_suppressed, VTY_NEWLINE);
 
   /* advertisement-interval */
   vty_out (vty, "  Minimum time between advertisement runs is %d seconds%s",
 	   p->v_routeadv, VTY_NEWLINE);
+  if (p->status == Established)
+    vty_out (vty, "  Current advertisement interval is %d seconds%s%s",
+	     p->v_routeadv_cur, p->t_routeadv ? "" : " (idle)", VTY_NEWLINE);
 
   /* Update-source. */
   if (p->update_if || p->update_source)
@@ -8047,8 +8287,12 @@ bgp_show_rsclient_summary (struct vty *vty, struct bgp *bgp,
     }
 
   if (count)
-    vty_out (vty, "%sTotal number of Route Server Clients %d%s", VTY_NEWLINE,
-            count, VTY_NEWLINE);
+    {
+      vty_out (vty, "%sTotal number of Route Server Clients %d%s", VTY_NEWLINE,
+              count, VTY_NEWLINE);
+      if (bgp_flag_check (bgp, BGP_FLAG_RSCLIENT_SHARED_RIB))
+        bgp_rsclient_table_show (vty, bgp, afi, safi);
+    }
   else
     vty_out (vty, "No %s Route Server Client is configured%s",
             afi == AFI_IP ? "IPv4" : "IPv6", VTY_NEWLINE);
@@ -8842,6 +9086,10 @@ bgp_vty_init (void)
   install_element (CONFIG_NODE, &bgp_multiple_instance_cmd);
   install_element (CONFIG_NODE, &no_bgp_multiple_instance_cmd);
 
+  /* "bgp convergence-statistics" commands. */
+  install_element (CONFIG_NODE, &bgp_convergence_statistics_cmd);
+  install_element (CONFIG_NODE, &no_bgp_convergence_statistics_cmd);
+
   /* "bgp config-type" commands. */
   install_element (CONFIG_NODE, &bgp_config_type_cmd);
   install_element (CONFIG_NODE, &no_bgp_config_type_cmd);
@@ -8895,6 +9143,30 @@ bgp_vty_init (void)
   install_element (BGP_NODE, &bgp_deterministic_med_cmd);
   install_element (BGP_NODE, &no_bgp_deterministic_med_cmd);
 
+  /* "maximum-paths" commands */
+  install_element (BGP_NODE, &bgp_maxpaths_cmd);
+  install_element (BGP_NODE, &bgp_maxpaths_ibgp_cmd);
+  install_element (BGP_NODE, &no_bgp_maxpaths_cmd);
+  install_element (BGP_NODE, &no_bgp_maxpaths_arg_cmd);
+  install_element (BGP_NODE, &no_bgp_maxpaths_ibgp_cmd);
+  install_element (BGP_NODE, &no_bgp_maxpaths_ibgp_arg_cmd);
+  install_element (BGP_IPV4_NODE, &bgp_maxpaths_cmd);
+  install_element (BGP_IPV4_NODE, &bgp_maxpaths_ibgp_cmd);
+  install_element (BGP_IPV4_NODE, &no_bgp_maxpaths_cmd);
+  install_element (BGP_IPV4_NODE, &no_bgp_maxpaths_arg_cmd);
+  install_element (BGP_IPV4_NODE, &no_bgp_maxpaths_ibgp_cmd);
+  install_element (BGP_IPV4_NODE, &no_bgp_maxpaths_ibgp_arg_cmd);
+  install_element (BGP_IPV6_NODE, &bgp_maxpaths_cmd);
+  install_element (BGP_IPV6_NODE, &bgp_maxpaths_ibgp_cmd);
+  install_element (BGP_IPV6_NODE, &no_bgp_maxpaths_cmd);
+  install_element (BGP_IPV6_NODE, &no_bgp_maxpaths_arg_cmd);
+  install_element (BGP_IPV6_NODE, &no_bgp_maxpaths_ibgp_cmd);
+  install_element (BGP_IPV6_NODE, &no_bgp_maxpaths_ibgp_arg_cmd);
+
+  /* "bgp route-server shared-rib" commands */
+  install_element (BGP_NODE, &bgp_rsclient_shared_rib_cmd);
+  install_element (BGP_NODE, &no_bgp_rsclient_shared_rib_cmd);
+
   /* "bgp graceful-restart" commands */
   install_element (BGP_NODE, &bgp_graceful_restart_cmd);
   install_element (BGP_NODE, &no_bgp_graceful_restart_cmd);
@@ -9900,6 +10172,9 @@ bgp_vty_init (void)
   install_element (VIEW_NODE, &show_bgp_memory_cmd);
   install_element (RESTRICTED_NODE, &show_bgp_memory_cmd);
   install_element (ENABLE_NODE, &show_bgp_memory_cmd);
+  install_element (VIEW_NODE, &show_bgp_memory_adj_out_cmd);
+  install_element (RESTRICTED_NODE, &show_bgp_memory_adj_out_cmd);
+  install_element (ENABLE_NODE, &show_bgp_memory_adj_out_cmd);
   
   /* "show bgp views" commands. */
   install_element (VIEW_NODE, &show_bgp_views_cmd);
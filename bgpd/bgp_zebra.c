@@ -672,12 +672,78 @@ bgp_ifindex_by_nexthop (struct in6_addr *addr)
 }
 #endif /* HAVE_IPV6 */
 
+#ifdef HAVE_IPV6
+/* IPv6 nexthop and interface to install a path with.  Returns 0 if
+   the path has no usable nexthop, which is also the case for a
+   link-local nexthop while the interface to the peer is not known, as
+   for a path preloaded from a checkpoint before its peer is up. */
+static int
+bgp_zebra_nexthop_ipv6 (struct bgp_info *info, struct in6_addr **nexthop,
+			unsigned int *ifindex)
+{
+  struct peer *peer = info->peer;
+
+  *ifindex = 0;
+  *nexthop = NULL;
+      
+  assert (info->attr->extra);
+      
+  /* Only global address nexthop exists. */
+  if (info->attr->extra->mp_nexthop_len == 16)
+    *nexthop = &info->attr->extra->mp_nexthop_global;
+      
+  /* If both global and link-local address present. */
+  if (info->attr->extra->mp_nexthop_len == 32)
+    {
+      /* Workaround for Cisco's nexthop bug.  */
+      if (IN6_IS_ADDR_UNSPECIFIED (&info->attr->extra->mp_nexthop_global)
+	  && peer->su_remote && peer->su_remote->sa.sa_family == AF_INET6)
+	*nexthop = &peer->su_remote->sin6.sin6_addr;
+      else
+	*nexthop = &info->attr->extra->mp_nexthop_local;
+
+      if (peer->nexthop.ifp)
+	*ifindex = peer->nexthop.ifp->ifindex;
+    }
+
+  if (*nexthop == NULL)
+    return 0;
+
+  if (IN6_IS_ADDR_LINKLOCAL (*nexthop) && ! *ifindex)
+    {
+      if (peer->ifname)
+	*ifindex = if_nametoindex (peer->ifname);
+      else if (peer->nexthop.ifp)
+	*ifindex = peer->nexthop.ifp->ifindex;
+      if (! *ifindex)
+	return 0;
+    }
+
+  return 1;
+}
+#endif /* HAVE_IPV6 */
+
+/* First path of the node info belongs to, the other paths flagged
+   BGP_INFO_MULTIPATH are installed together with info. */
+static struct bgp_info *
+bgp_zebra_mpath_first (struct bgp_info *info)
+{
+  while (info->prev)
+    info = info->prev;
+  return info;
+}
+
+/* Install the route in the FIB.  recv, when set, is the time the
+   UPDATE for it was read, passed on for zebra's statistics.  */
 void
-bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp)
+bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp,
+		    struct timeval *recv)
 {
   int flags;
   u_char distance;
   struct peer *peer;
+  struct bgp_info *mpinfo;
+  int i;
 
   if (zclient->sock < 0)
     return;
@@ -701,16 +767,31 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp)
   if (p->family == AF_INET)
     {
       struct zapi_ipv4 api;
-      struct in_addr *nexthop;
+      struct in_addr *nexthop[BGP_MAXIMUM_MAXPATHS];
 
       api.flags = flags;
-      nexthop = &info->attr->nexthop;
+      nexthop[0] = &info->attr->nexthop;
+      api.nexthop_num = 1;
+
+      /* Add the distinct nexthops of the multipath set. */
+      for (mpinfo = bgp_zebra_mpath_first (info);
+	   mpinfo && api.nexthop_num < BGP_MAXIMUM_MAXPATHS;
+	   mpinfo = mpinfo->next)
+	{
+	  if (! CHECK_FLAG (mpinfo->flags, BGP_INFO_MULTIPATH))
+	    continue;
+
+	  for (i = 0; i < api.nexthop_num; i++)
+	    if (IPV4_ADDR_SAME (nexthop[i], &mpinfo->attr->nexthop))
+	      break;
+	  if (i == api.nexthop_num)
+	    nexthop[api.nexthop_num++] = &mpinfo->attr->nexthop;
+	}
 
       api.type = ZEBRA_ROUTE_BGP;
       api.message = 0;
       SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
-      api.nexthop_num = 1;
-      api.nexthop = &nexthop;
+      api.nexthop = nexthop;
       api.ifindex_num = 0;
       SET_FLAG (api.message, ZAPI_MESSAGE_METRIC);
       api.metric = info->attr->med;
@@ -723,14 +804,20 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp)
 	  api.distance = distance;
 	}
 
+      if (recv)
+	{
+	  SET_FLAG (api.message, ZAPI_MESSAGE_TIMESTAMP);
+	  api.timestamp = *recv;
+	}
+
       if (BGP_DEBUG(zebra, ZEBRA))
 	{
 	  char buf[2][INET_ADDRSTRLEN];
-	  zlog_debug("Zebra send: IPv4 route add %s/%d nexthop %s metric %u",
+	  zlog_debug("Zebra send: IPv4 route add %s/%d nexthop %s (of %d) metric %u",
 		     inet_ntop(AF_INET, &p->u.prefix4, buf[0], sizeof(buf[0])),
 		     p->prefixlen,
-		     inet_ntop(AF_INET, nexthop, buf[1], sizeof(buf[1])),
-		     api.metric);
+		     inet_ntop(AF_INET, nexthop[0], buf[1], sizeof(buf[1])),
+		     api.nexthop_num, api.metric);
 	}
 
       zapi_ipv4_route (ZEBRA_IPV4_ROUTE_ADD, zclient, 
@@ -740,42 +827,32 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp)
   /* We have to think about a IPv6 link-local address curse. */
   if (p->family == AF_INET6)
     {
-      unsigned int ifindex;
-      struct in6_addr *nexthop;
+      struct in6_addr *nexthop[BGP_MAXIMUM_MAXPATHS];
+      unsigned int ifindex[BGP_MAXIMUM_MAXPATHS];
       struct zapi_ipv6 api;
 
-      ifindex = 0;
-      nexthop = NULL;
-      
-      assert (info->attr->extra);
-      
-      /* Only global address nexthop exists. */
-      if (info->attr->extra->mp_nexthop_len == 16)
-	nexthop = &info->attr->extra->mp_nexthop_global;
-      
-      /* If both global and link-local address present. */
-      if (info->attr->extra->mp_nexthop_len == 32)
-	{
-	  /* Workaround for Cisco's nexthop bug.  */
-	  if (IN6_IS_ADDR_UNSPECIFIED (&info->attr->extra->mp_nexthop_global)
-	      && peer->su_remote->sa.sa_family == AF_INET6)
-	    nexthop = &peer->su_remote->sin6.sin6_addr;
-	  else
-	    nexthop = &info->attr->extra->mp_nexthop_local;
-
-	  if (info->peer->nexthop.ifp)
-	    ifindex = info->peer->nexthop.ifp->ifindex;
-	}
-
-      if (nexthop == NULL)
+      if (! bgp_zebra_nexthop_ipv6 (info, &nexthop[0], &ifindex[0]))
 	return;
+      api.nexthop_num = 1;
 
-      if (IN6_IS_ADDR_LINKLOCAL (nexthop) && ! ifindex)
+      /* Add the distinct nexthops of the multipath set, each followed
+         by its interface index in the message. */
+      for (mpinfo = bgp_zebra_mpath_first (info);
+	   mpinfo && api.nexthop_num < BGP_MAXIMUM_MAXPATHS;
+	   mpinfo = mpinfo->next)
 	{
-	  if (info->peer->ifname)
-	    ifindex = if_nametoindex (info->peer->ifname);
-	  else if (info->peer->nexthop.ifp)
-	    ifindex = info->peer->nexthop.ifp->ifindex;
+	  if (! CHECK_FLAG (mpinfo->flags, BGP_INFO_MULTIPATH))
+	    continue;
+	  if (! bgp_zebra_nexthop_ipv6 (mpinfo, &nexthop[api.nexthop_num],
+					&ifindex[api.nexthop_num]))
+	    continue;
+
+	  for (i = 0; i < api.nexthop_num; i++)
+	    if (IPV6_ADDR_SAME (nexthop[i], nexthop[api.nexthop_num])
+		&& ifindex[i] == ifindex[api.nexthop_num])
+	      break;
+	  if (i == api.nexthop_num)
+	    api.nexthop_num++;
 	}
 
       /* Make Zebra API structure. */
@@ -783,22 +860,27 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp)
       api.type = ZEBRA_ROUTE_BGP;
       api.message = 0;
       SET_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP);
-      api.nexthop_num = 1;
-      api.nexthop = &nexthop;
+      api.nexthop = nexthop;
       SET_FLAG (api.message, ZAPI_MESSAGE_IFINDEX);
-      api.ifindex_num = 1;
-      api.ifindex = &ifindex;
+      api.ifindex_num = api.nexthop_num;
+      api.ifindex = ifindex;
       SET_FLAG (api.message, ZAPI_MESSAGE_METRIC);
       api.metric = info->attr->med;
 
+      if (recv)
+	{
+	  SET_FLAG (api.message, ZAPI_MESSAGE_TIMESTAMP);
+	  api.timestamp = *recv;
+	}
+
       if (BGP_DEBUG(zebra, ZEBRA))
 	{
 	  char buf[2][INET6_ADDRSTRLEN];
-	  zlog_debug("Zebra send: IPv6 route add %s/%d nexthop %s metric %u",
+	  zlog_debug("Zebra send: IPv6 route add %s/%d nexthop %s (of %d) metric %u",
 		     inet_ntop(AF_INET6, &p->u.prefix6, buf[0], sizeof(buf[0])),
 		     p->prefixlen,
-		     inet_ntop(AF_INET6, nexthop, buf[1], sizeof(buf[1])),
-		     api.metric);
+		     inet_ntop(AF_INET6, nexthop[0], buf[1], sizeof(buf[1])),
+		     api.nexthop_num, api.metric);
 	}
 
       zapi_ipv6_route (ZEBRA_IPV6_ROUTE_ADD, zclient, 
@@ -807,6 +889,37 @@ bgp_zebra_announce (struct prefix *p, struct bgp_info *info, struct bgp *bgp)
 #endif /* HAVE_IPV6 */
 }
 
+/* Send zebra the selected IPv6 paths of peer which were preloaded
+   from a checkpoint, now that the peer is up.  Those with a
+   link-local nexthop were held back by bgp_zebra_nexthop_ipv6 until
+   the interface to the peer was known. */
+void
+bgp_zebra_announce_stale (struct peer *peer)
+{
+#ifdef HAVE_IPV6
+  struct bgp *bgp = peer->bgp;
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  if (bgp->name || bgp_option_check (BGP_OPT_NO_FIB)
+      || ! bgp->rib[AFI_IP6][SAFI_UNICAST])
+    return;
+
+  for (rn = bgp_table_top (bgp->rib[AFI_IP6][SAFI_UNICAST]); rn;
+       rn = bgp_route_next (rn))
+    for (ri = rn->info; ri; ri = ri->next)
+      if (ri->peer == peer
+	  && CHECK_FLAG (ri->flags, BGP_INFO_SELECTED)
+	  && CHECK_FLAG (ri->flags, BGP_INFO_STALE)
+	  && ri->type == ZEBRA_ROUTE_BGP
+	  && ri->sub_type == BGP_ROUTE_NORMAL)
+	{
+	  bgp_zebra_announce (&rn->p, ri, bgp, NULL);
+	  break;
+	}
+#endif /* HAVE_IPV6 */
+}
+
 void
 bgp_zebra_withdraw (struct prefix *p, struct bgp_info *info)
 {
@@ -1060,6 +1173,8 @@ bgp_zebra_init (void)
   /* Set default values. */
   zclient = zclient_new ();
   zclient_init (zclient, ZEBRA_ROUTE_BGP);
+  /* Full tables go through zebra, worth rings in shared memory. */
+  zclient->ring_enable = 1;
   zclient->router_id_update = bgp_router_id_update;
   zclient->interface_add = bgp_interface_add;
   zclient->interface_delete = bgp_interface_delete;
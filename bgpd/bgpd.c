@@ -35,6 +35,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "plist.h"
 #include "linklist.h"
 #include "workqueue.h"
+#include "hash.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_table.h"
@@ -43,6 +45,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_community.h"
+#include "bgpd/bgp_ecommunity.h"
 #include "bgpd/bgp_attr.h"
 #include "bgpd/bgp_regex.h"
 #include "bgpd/bgp_clist.h"
@@ -57,6 +60,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_checkpoint.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -81,6 +85,7 @@ bgp_option_set (int flag)
     case BGP_OPT_NO_FIB:
     case BGP_OPT_MULTIPLE_INSTANCE:
     case BGP_OPT_CONFIG_CISCO:
+    case BGP_OPT_CONVERGENCE_STATS:
       SET_FLAG (bm->options, flag);
       break;
     default:
@@ -100,6 +105,7 @@ bgp_option_unset (int flag)
       /* Fall through.  */
     case BGP_OPT_NO_FIB:
     case BGP_OPT_CONFIG_CISCO:
+    case BGP_OPT_CONVERGENCE_STATS:
       UNSET_FLAG (bm->options, flag);
       break;
     default:
@@ -520,6 +526,107 @@ peer_cmp (struct peer *p1, struct peer *p2)
   return sockunion_cmp (&p1->su, &p2->su);
 }
 
+/* Peer address index.  Each entry heads the chain, through
+   peer->addr_next, of every peer in the instance connected to or
+   configured for that address: the configured peer first, then any
+   accept peers which have not yet received an OPEN.  */
+struct peer_addr
+{
+  union sockunion su;
+  struct peer *peer;
+};
+
+static unsigned int
+peer_addr_hash_key (void *p)
+{
+  struct peer_addr *pa = p;
+
+  if (pa->su.sa.sa_family == AF_INET)
+    return jhash_1word (pa->su.sin.sin_addr.s_addr, AF_INET);
+#ifdef HAVE_IPV6
+  if (pa->su.sa.sa_family == AF_INET6)
+    return jhash2 ((u_int32_t *) &pa->su.sin6.sin6_addr, 4, AF_INET6);
+#endif /* HAVE_IPV6 */
+  return 0;
+}
+
+static int
+peer_addr_hash_cmp (const void *p1, const void *p2)
+{
+  const struct peer_addr *pa1 = p1;
+  const struct peer_addr *pa2 = p2;
+
+  return sockunion_same (&pa1->su, &pa2->su);
+}
+
+static void *
+peer_addr_hash_alloc (void *p)
+{
+  struct peer_addr *ref = p;
+  struct peer_addr *pa;
+
+  pa = XCALLOC (MTYPE_BGP_PEER_ADDR, sizeof (struct peer_addr));
+  pa->su = ref->su;
+  return pa;
+}
+
+static void
+peer_addr_free (void *pa)
+{
+  XFREE (MTYPE_BGP_PEER_ADDR, pa);
+}
+
+static void
+peer_addr_add (struct peer *peer)
+{
+  struct peer_addr ref;
+  struct peer_addr *pa;
+
+  ref.su = peer->su;
+  pa = hash_get (peer->bgp->peerhash, &ref, peer_addr_hash_alloc);
+
+  if (pa->peer && CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
+    {
+      peer->addr_next = pa->peer->addr_next;
+      pa->peer->addr_next = peer;
+    }
+  else
+    {
+      peer->addr_next = pa->peer;
+      pa->peer = peer;
+    }
+}
+
+static void
+peer_addr_delete (struct peer *peer)
+{
+  struct peer_addr ref;
+  struct peer_addr *pa;
+  struct peer *prev;
+
+  ref.su = peer->su;
+  pa = hash_lookup (peer->bgp->peerhash, &ref);
+  if (! pa)
+    return;
+
+  if (pa->peer == peer)
+    pa->peer = peer->addr_next;
+  else
+    for (prev = pa->peer; prev; prev = prev->addr_next)
+      if (prev->addr_next == peer)
+        {
+          prev->addr_next = peer->addr_next;
+          break;
+        }
+  peer->addr_next = NULL;
+
+  if (! pa->peer)
+    {
+      hash_release (peer->bgp->peerhash, pa);
+      peer_addr_free (pa);
+    }
+}
+
 int
 peer_af_flag_check (struct peer *peer, afi_t afi, safi_t safi, u_int32_t flag)
 {
@@ -563,6 +670,7 @@ peer_af_flag_reset (struct peer *peer, afi_t afi, safi_t safi)
 	  filter->map[i].name = NULL;
 	}
     }
+  peer->bgp->rsclient_policy_gen++;
 
   /* Clear unsuppress map.  */
   if (filter->usmap.name)
@@ -689,6 +797,7 @@ peer_free (struct peer *peer)
 {
   assert (peer->status == Deleted);
 
+  bgp_adj_index_release (peer->bgp, peer->adj_index);
   bgp_unlock(peer->bgp);
 
   /* this /ought/ to have been done already through bgp_stop earlier,
@@ -712,6 +821,9 @@ peer_free (struct peer *peer)
   
   if (peer->update_if)
     XFREE (MTYPE_PEER_UPDATE_SOURCE, peer->update_if);
+
+  if (peer->rt_filter)
+    ecommunity_free (peer->rt_filter);
     
   if (peer->clear_node_queue)
     work_queue_free (peer->clear_node_queue);
@@ -792,6 +904,7 @@ peer_new (struct bgp *bgp)
   peer->weight = 0;
   peer->password = NULL;
   peer->bgp = bgp;
+  peer->adj_index = bgp_adj_index_get (bgp);
   peer = peer_lock (peer); /* initial reference */
   bgp_lock (bgp);
 
@@ -811,6 +924,7 @@ peer_new (struct bgp *bgp)
   /* Create buffers.  */
   peer->ibuf = stream_new (BGP_MAX_PACKET_SIZE);
   peer->obuf = stream_fifo_new ();
+  peer->obuf_ctrl = stream_fifo_new ();
   peer->work = stream_new (BGP_MAX_PACKET_SIZE);
 
   bgp_sync_init (peer);
@@ -845,6 +959,7 @@ peer_create (union sockunion *su, struct bgp *bgp, as_t local_as,
     
   peer = peer_lock (peer); /* bgp peer list reference */
   listnode_add_sort (bgp->peer, peer);
+  peer_addr_add (peer);
 
   active = peer_active (peer);
 
@@ -873,14 +988,17 @@ peer_create (union sockunion *su, struct bgp *bgp, as_t local_as,
 
 /* Make accept BGP peer.  Called from bgp_accept (). */
 struct peer *
-peer_create_accept (struct bgp *bgp)
+peer_create_accept (struct bgp *bgp, union sockunion *su)
 {
   struct peer *peer;
 
   peer = peer_new (bgp);
+  SET_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER);
+  peer->su = *su;
   
   peer = peer_lock (peer); /* bgp peer list reference */
   listnode_add_sort (bgp->peer, peer);
+  peer_addr_add (peer);
 
   return peer;
 }
@@ -1226,6 +1344,7 @@ peer_delete (struct peer *peer)
       
       if ((pn = listnode_lookup (bgp->peer, peer)))
         {
+          peer_addr_delete (peer);
           peer_unlock (peer); /* bgp peer list reference */
           list_delete_node (bgp->peer, pn);
         }
@@ -1243,16 +1362,18 @@ peer_delete (struct peer *peer)
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       if (peer->rib[afi][safi] && ! peer->af_group[afi][safi])
-        bgp_table_finish (&peer->rib[afi][safi]);
+        bgp_rsclient_table_release (peer, afi, safi);
 
   /* Buffers.  */
   if (peer->ibuf)
     stream_free (peer->ibuf);
   if (peer->obuf)
     stream_fifo_free (peer->obuf);
+  if (peer->obuf_ctrl)
+    stream_fifo_free (peer->obuf_ctrl);
   if (peer->work)
     stream_free (peer->work);
-  peer->obuf = NULL;
+  peer->obuf = peer->obuf_ctrl = NULL;
   peer->work = peer->ibuf = NULL;
 
   /* Local and remote addresses. */
@@ -1297,7 +1418,8 @@ peer_delete (struct peer *peer)
         filter->usmap.name = NULL;
         peer->default_rmap[afi][safi].name = NULL;
       }
-  
+  bgp->rsclient_policy_gen++;
+
   peer_unlock (peer); /* initial reference */
 
   return 0;
@@ -1637,7 +1759,11 @@ peer_group2peer_config_copy (struct peer_group *group, struct peer *peer,
       pfilter->usmap.name = NULL;
       pfilter->usmap.map = NULL;
     }
-} 
+
+  /* Export route-maps keep RS-clients from sharing tables. */
+  if (pfilter->map[RMAP_EXPORT].name)
+    bgp_rsclient_table_recheck (peer->bgp, afi, safi);
+}
 
 /* Peer group's remote AS configuration.  */
 int
@@ -1824,7 +1950,7 @@ peer_group_bind (struct bgp *bgp, union sockunion *su,
           list_delete_node (bgp->rsclient, pn);
         }
 
-      bgp_table_finish (&peer->rib[afi][safi]);
+      bgp_rsclient_table_release (peer, afi, safi);
 
       /* Import policy. */
       if (peer->filter[afi][safi].map[RMAP_IMPORT].name)
@@ -1918,12 +2044,14 @@ bgp_create (as_t *as, const char *name)
 
   bgp->peer = list_new ();
   bgp->peer->cmp = (int (*)(void *, void *)) peer_cmp;
+  bgp->peerhash = hash_create (peer_addr_hash_key, peer_addr_hash_cmp);
 
   bgp->group = list_new ();
   bgp->group->cmp = (int (*)(void *, void *)) peer_group_cmp;
 
   bgp->rsclient = list_new ();
   bgp->rsclient->cmp = (int (*)(void*, void*)) peer_cmp;
+  bgp->rsclient_policy_gen = 1;
 
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
@@ -1931,6 +2059,8 @@ bgp_create (as_t *as, const char *name)
 	bgp->route[afi][safi] = bgp_table_init (afi, safi);
 	bgp->aggregate[afi][safi] = bgp_table_init (afi, safi);
 	bgp->rib[afi][safi] = bgp_table_init (afi, safi);
+	bgp->maxpaths[afi][safi].maxpaths_ebgp = BGP_DEFAULT_MAXPATHS;
+	bgp->maxpaths[afi][safi].maxpaths_ibgp = BGP_DEFAULT_MAXPATHS;
       }
 
   bgp->default_local_pref = BGP_DEFAULT_LOCAL_PREF;
@@ -2049,11 +2179,17 @@ bgp_delete (struct bgp *bgp)
   struct listnode *node;
   struct listnode *next;
   afi_t afi;
+  safi_t safi;
   int i;
 
   /* Delete static route. */
   bgp_static_delete (bgp);
 
+  /* Stop dampening. */
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      bgp_damp_disable (bgp, afi, safi);
+
   /* Unset redistribution. */
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (i = 0; i < ZEBRA_ROUTE_MAX; i++) 
@@ -2104,6 +2240,14 @@ bgp_free (struct bgp *bgp)
   list_delete (bgp->peer);
   list_delete (bgp->rsclient);
 
+  hash_clean (bgp->peerhash, peer_addr_free);
+  hash_free (bgp->peerhash);
+
+  if (bgp->adj_index)
+    XFREE (MTYPE_BGP_ADJ_INDEX, bgp->adj_index);
+
+  bgp_rt_index_free (bgp);
+
   listnode_delete (bm->bgp, bgp);
   
   if (bgp->name)
@@ -2122,11 +2266,24 @@ bgp_free (struct bgp *bgp)
   XFREE (MTYPE_BGP, bgp);
 }
 
+/* Return the first of the peers in BGP instance using address su,
+   including accept peers.  The rest follow through peer->addr_next.  */
+struct peer *
+peer_addr_lookup (struct bgp *bgp, union sockunion *su)
+{
+  struct peer_addr ref;
+  struct peer_addr *pa;
+
+  ref.su = *su;
+  pa = hash_lookup (bgp->peerhash, &ref);
+
+  return pa ? pa->peer : NULL;
+}
+
 struct peer *
 peer_lookup (struct bgp *bgp, union sockunion *su)
 {
   struct peer *peer;
-  struct listnode *node, *nnode;
 
   if (! bgp)
     bgp = bgp_get_default ();
@@ -2134,12 +2291,10 @@ peer_lookup (struct bgp *bgp, union sockunion *su)
   if (! bgp)
     return NULL;
   
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-    {
-      if (sockunion_same (&peer->su, su)
-	  && ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-	return peer;
-    }
+  for (peer = peer_addr_lookup (bgp, su); peer; peer = peer->addr_next)
+    if (! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
+      return peer;
+
   return NULL;
 }
 
@@ -2148,37 +2303,16 @@ peer_lookup_with_open (union sockunion *su, as_t remote_as,
 		       struct in_addr *remote_id, int *as)
 {
   struct peer *peer;
-  struct listnode *node, *nnode;
-  struct bgp *bgp;
 
-  bgp = bgp_get_default ();
-  if (! bgp)
+  peer = peer_lookup (NULL, su);
+  if (! peer || peer->as != remote_as)
     return NULL;
 
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-    {
-      if (sockunion_same (&peer->su, su)
-	  && ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-	{
-	  if (peer->as == remote_as
-	      && peer->remote_id.s_addr == remote_id->s_addr)
-	    return peer;
-	  if (peer->as == remote_as)
-	    *as = 1;
-	}
-    }
-  for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
-    {
-      if (sockunion_same (&peer->su, su)
-	  &&  ! CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
-	{
-	  if (peer->as == remote_as
-	      && peer->remote_id.s_addr == 0)
-	    return peer;
-	  if (peer->as == remote_as)
-	    *as = 1;
-	}
-    }
+  *as = 1;
+  if (peer->remote_id.s_addr == remote_id->s_addr
+      || peer->remote_id.s_addr == 0)
+    return peer;
+
   return NULL;
 }
 
@@ -4041,22 +4175,28 @@ peer_route_map_set (struct peer *peer, afi_t afi, safi_t safi, int direct,
   filter->map[direct].name = strdup (name);
   filter->map[direct].map = route_map_lookup_by_name (name);
 
-  if (! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP))
-    return 0;
-
-  group = peer->group;
-  for (ALL_LIST_ELEMENTS (group->peer, node, nnode, peer))
+  if (CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP))
     {
-      filter = &peer->filter[afi][safi];
+      group = peer->group;
+      for (ALL_LIST_ELEMENTS (group->peer, node, nnode, peer))
+	{
+	  filter = &peer->filter[afi][safi];
 
-      if (! peer->af_group[afi][safi])
-	continue;
+	  if (! peer->af_group[afi][safi])
+	    continue;
 
-      if (filter->map[direct].name)
-	free (filter->map[direct].name);
-      filter->map[direct].name = strdup (name);
-      filter->map[direct].map = route_map_lookup_by_name (name);
+	  if (filter->map[direct].name)
+	    free (filter->map[direct].name);
+	  filter->map[direct].name = strdup (name);
+	  filter->map[direct].map = route_map_lookup_by_name (name);
+	}
     }
+
+  /* Import and export route-maps decide which RS-clients share a
+     table. */
+  if (direct == RMAP_IMPORT || direct == RMAP_EXPORT)
+    bgp_rsclient_table_recheck (peer->bgp, afi, safi);
+
   return 0;
 }
 
@@ -4102,22 +4242,26 @@ peer_route_map_unset (struct peer *peer, afi_t afi, safi_t safi, int direct)
   filter->map[direct].name = NULL;
   filter->map[direct].map = NULL;
 
-  if (! CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP))
-    return 0;
-
-  group = peer->group;
-  for (ALL_LIST_ELEMENTS (group->peer, node, nnode, peer))
+  if (CHECK_FLAG (peer->sflags, PEER_STATUS_GROUP))
     {
-      filter = &peer->filter[afi][safi];
+      group = peer->group;
+      for (ALL_LIST_ELEMENTS (group->peer, node, nnode, peer))
+	{
+	  filter = &peer->filter[afi][safi];
 
-      if (! peer->af_group[afi][safi])
-	continue;
+	  if (! peer->af_group[afi][safi])
+	    continue;
 
-      if (filter->map[direct].name)
-	free (filter->map[direct].name);
-      filter->map[direct].name = NULL;
-      filter->map[direct].map = NULL;
+	  if (filter->map[direct].name)
+	    free (filter->map[direct].name);
+	  filter->map[direct].name = NULL;
+	  filter->map[direct].map = NULL;
+	}
     }
+
+  if (direct == RMAP_IMPORT || direct == RMAP_EXPORT)
+    bgp_rsclient_table_recheck (peer->bgp, afi, safi);
+
   return 0;
 }
 
@@ -4341,6 +4485,15 @@ peer_clear_soft (struct peer *peer, afi_t afi, safi_t safi,
     {
       if (! CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
         return 0;
+
+      /* Import policy changed, leave the shared table. */
+      if (bgp_rsclient_table_check (peer, afi, safi))
+        {
+          bgp_notify_send (peer, BGP_NOTIFY_CEASE,
+                           BGP_NOTIFY_CEASE_CONFIG_CHANGE);
+          return 0;
+        }
+
       bgp_check_local_routes_rsclient (peer, afi, safi);
       bgp_soft_reconfig_rsclient (peer, afi, safi);
     }
@@ -4826,6 +4979,16 @@ bgp_config_write_peer (struct vty *vty, struct bgp *bgp,
   /* Filter. */
   bgp_config_write_filter (vty, peer, afi, safi);
 
+  /* Route target filter.  */
+  if (afi == AFI_IP && safi == SAFI_MPLS_VPN && peer->rt_filter)
+    {
+      char *str;
+
+      str = ecommunity_ecom2str (peer->rt_filter, ECOMMUNITY_FORMAT_ROUTE_MAP);
+      vty_out (vty, " neighbor %s route-target %s%s", addr, str, VTY_NEWLINE);
+      XFREE (MTYPE_ECOMMUNITY_STR, str);
+    }
+
   /* atribute-unchanged. */
   if ((CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_AS_PATH_UNCHANGED)
       || CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_NEXTHOP_UNCHANGED)
@@ -4880,6 +5043,25 @@ bgp_config_write_family_header (struct vty *vty, afi_t afi, safi_t safi,
   *write = 1;
 }
 
+/* BGP maximum-paths configuration display.  */
+static void
+bgp_config_write_maxpaths (struct vty *vty, struct bgp *bgp, afi_t afi,
+			   safi_t safi, int *write)
+{
+  if (bgp->maxpaths[afi][safi].maxpaths_ebgp != BGP_DEFAULT_MAXPATHS)
+    {
+      bgp_config_write_family_header (vty, afi, safi, write);
+      vty_out (vty, " maximum-paths %d%s",
+	       bgp->maxpaths[afi][safi].maxpaths_ebgp, VTY_NEWLINE);
+    }
+  if (bgp->maxpaths[afi][safi].maxpaths_ibgp != BGP_DEFAULT_MAXPATHS)
+    {
+      bgp_config_write_family_header (vty, afi, safi, write);
+      vty_out (vty, " maximum-paths ibgp %d%s",
+	       bgp->maxpaths[afi][safi].maxpaths_ibgp, VTY_NEWLINE);
+    }
+}
+
 /* Address family based peer configuration display.  */
 static int
 bgp_config_write_family (struct vty *vty, struct bgp *bgp, afi_t afi,
@@ -4894,6 +5076,14 @@ bgp_config_write_family (struct vty *vty, struct bgp *bgp, afi_t afi,
 
   bgp_config_write_redistribute (vty, bgp, afi, safi, &write);
 
+  bgp_config_write_maxpaths (vty, bgp, afi, safi, &write);
+
+  if (CHECK_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING))
+    {
+      bgp_config_write_family_header (vty, afi, safi, &write);
+      bgp_config_write_damp (vty, bgp, afi, safi);
+    }
+
   for (ALL_LIST_ELEMENTS (bgp->group, node, nnode, group))
     {
       if (group->conf->afc[afi][safi])
@@ -4943,6 +5133,16 @@ bgp_config_write (struct vty *vty)
       write++;
     }
 
+  /* BGP convergence statistics. */
+  if (bgp_option_check (BGP_OPT_CONVERGENCE_STATS))
+    {
+      vty_out (vty, "bgp convergence-statistics%s", VTY_NEWLINE);
+      write++;
+    }
+
+  /* BGP RIB checkpoint. */
+  write += bgp_checkpoint_config_write (vty);
+
   /* BGP configuration. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
@@ -5024,6 +5224,10 @@ bgp_config_write (struct vty *vty)
       if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
 	vty_out (vty, " bgp deterministic-med%s", VTY_NEWLINE);
 
+      /* BGP route-server shared-rib. */
+      if (bgp_flag_check (bgp, BGP_FLAG_RSCLIENT_SHARED_RIB))
+	vty_out (vty, " bgp route-server shared-rib%s", VTY_NEWLINE);
+
       /* BGP graceful-restart. */
       if (bgp->stalepath_time != BGP_DEFAULT_STALEPATH_TIME)
 	vty_out (vty, " bgp graceful-restart stalepath-time %d%s",
@@ -5059,7 +5263,7 @@ bgp_config_write (struct vty *vty)
       /* BGP flag dampening. */
       if (CHECK_FLAG (bgp->af_flags[AFI_IP][SAFI_UNICAST],
 	  BGP_CONFIG_DAMPENING))
-	bgp_config_write_damp (vty);
+	bgp_config_write_damp (vty, bgp, AFI_IP, SAFI_UNICAST);
 
       /* BGP static route configuration. */
       bgp_config_write_network (vty, bgp, AFI_IP, SAFI_UNICAST, &write);
@@ -5067,6 +5271,9 @@ bgp_config_write (struct vty *vty)
       /* BGP redistribute configuration. */
       bgp_config_write_redistribute (vty, bgp, AFI_IP, SAFI_UNICAST, &write);
 
+      /* BGP maximum-paths configuration. */
+      bgp_config_write_maxpaths (vty, bgp, AFI_IP, SAFI_UNICAST, &write);
+
       /* BGP timers configuration. */
       if (bgp->default_keepalive != BGP_DEFAULT_KEEPALIVE
 	  && bgp->default_holdtime != BGP_DEFAULT_HOLDTIME)
@@ -5140,6 +5347,7 @@ bgp_init (void)
   bgp_attr_init ();
   bgp_debug_init ();
   bgp_dump_init ();
+  bgp_checkpoint_init ();
   bgp_route_init ();
   bgp_route_map_init ();
   bgp_scan_init ();
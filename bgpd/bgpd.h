@@ -59,6 +59,11 @@ struct bgp_master
 #define BGP_OPT_NO_FIB                   (1 << 0)
 #define BGP_OPT_MULTIPLE_INSTANCE        (1 << 1)
 #define BGP_OPT_CONFIG_CISCO             (1 << 2)
+#define BGP_OPT_CONVERGENCE_STATS        (1 << 3)
+
+  /* Monotonic time the UPDATE being handled was read, when convergence
+     statistics are enabled.  */
+  struct timeval update_recv;
 };
 
 /* BGP instance structure.  */
@@ -79,12 +84,28 @@ struct bgp
   /* BGP peer. */
   struct list *peer;
 
+  /* BGP peers indexed by remote address.  */
+  struct hash *peerhash;
+
+  /* Allocated peer->adj_index bitmap, and its size in words.  */
+  u_int32_t *adj_index;
+  int adj_index_size;
+
+  /* VPNv4 paths indexed by the route targets they carry.  */
+  struct hash *rt_index;
+
   /* BGP peer group.  */
   struct list *group;
 
   /* BGP route-server-clients. */
   struct list *rsclient;
 
+  /* Generation of the export and network route-map configuration, and
+     whether RS-clients may share tables as computed for it. */
+  u_int32_t rsclient_policy_gen;
+  u_int32_t rsclient_share_gen[AFI_MAX][SAFI_MAX];
+  u_char rsclient_share[AFI_MAX][SAFI_MAX];
+
   /* BGP configuration.  */
   u_int16_t config;
 #define BGP_CONFIG_ROUTER_ID              (1 << 0)
@@ -119,6 +140,7 @@ struct bgp
 #define BGP_FLAG_LOG_NEIGHBOR_CHANGES     (1 << 11)
 #define BGP_FLAG_GRACEFUL_RESTART         (1 << 12)
 #define BGP_FLAG_ASPATH_CONFED            (1 << 13)
+#define BGP_FLAG_RSCLIENT_SHARED_RIB      (1 << 14)
 
   /* BGP Per AF flags */
   u_int16_t af_flags[AFI_MAX][SAFI_MAX];
@@ -147,6 +169,16 @@ struct bgp
     struct route_map *map;
   } rmap[AFI_MAX][ZEBRA_ROUTE_MAX];
 
+  /* BGP maximum-paths configuration.  */
+  struct
+  {
+    u_int16_t maxpaths_ebgp;
+    u_int16_t maxpaths_ibgp;
+  } maxpaths[AFI_MAX][SAFI_MAX];
+
+  /* BGP route flap dampening, set with BGP_CONFIG_DAMPENING.  */
+  struct bgp_damp_config *damp[AFI_MAX][SAFI_MAX];
+
   /* BGP distance configuration.  */
   u_char distance_ebgp;
   u_char distance_ibgp;
@@ -270,6 +302,12 @@ struct peer
   struct peer_group *group;
   u_char af_group[AFI_MAX][SAFI_MAX];
 
+  /* Next peer of this instance with the same remote address. */
+  struct peer *addr_next;
+
+  /* Index of this peer in Adj-RIB-Out bitmaps. */
+  int adj_index;
+
   /* Peer's remote AS number. */
   as_t as;			
 
@@ -288,9 +326,11 @@ struct peer
   /* Peer specific RIB when configured as route-server-client. */
   struct bgp_table *rib[AFI_MAX][SAFI_MAX];
 
-  /* Packet receive and send buffer. */
+  /* Packet receive and send buffer.  Messages other than UPDATEs are
+     queued on obuf_ctrl, which is sent ahead of obuf. */
   struct stream *ibuf;
   struct stream_fifo *obuf;
+  struct stream_fifo *obuf_ctrl;
   struct stream *work;
 
   /* Status of the peer. */
@@ -300,6 +340,11 @@ struct peer
   /* Peer index, used for dumping TABLE_DUMP_V2 format */
   uint16_t table_dump_index;
 
+  /* Peer index in the RIB checkpoint being written, valid while
+     checkpoint_gen is that of the checkpoint. */
+  uint16_t checkpoint_index;
+  u_int32_t checkpoint_gen;
+
   /* Peer information */
   int fd;			/* File descriptor */
   int ttl;			/* TTL of TCP connection to the peer. */
@@ -404,6 +449,8 @@ struct peer
 #define PEER_STATUS_GROUP             (1 << 4) /* peer-group conf */
 #define PEER_STATUS_NSF_MODE          (1 << 5) /* NSF aware peer */
 #define PEER_STATUS_NSF_WAIT          (1 << 6) /* wait comeback peer */
+#define PEER_STATUS_WRITE_LOWAT       (1 << 7) /* socket has unsent low-water */
+#define PEER_STATUS_CHECKPOINT        (1 << 8) /* stale paths from checkpoint */
 
   /* Peer status af flags (reset in bgp_stop) */
   u_int16_t af_sflags[AFI_MAX][SAFI_MAX];
@@ -414,6 +461,8 @@ struct peer
 #define PEER_STATUS_PREFIX_LIMIT      (1 << 4) /* exceed prefix-limit */
 #define PEER_STATUS_EOR_SEND          (1 << 5) /* end-of-rib send to peer */
 #define PEER_STATUS_EOR_RECEIVED      (1 << 6) /* end-of-rib received from peer */
+#define PEER_STATUS_PRELOAD_STALE     (1 << 7) /* checkpoint paths kept stale */
+#define PEER_STATUS_RSCLIENT_REFRESH  (1 << 8) /* refresh for RS-client tables */
 
   /* Default attribute value for the peer. */
   u_int32_t config;
@@ -434,6 +483,7 @@ struct peer
   u_int32_t v_keepalive;
   u_int32_t v_asorig;
   u_int32_t v_routeadv;
+  u_int32_t v_routeadv_cur;	/* Adaptive, at most v_routeadv. */
   u_int32_t v_pmax_restart;
   u_int32_t v_gr_restart;
 
@@ -458,6 +508,7 @@ struct peer
   u_int32_t open_out;		/* Open message output count */
   u_int32_t update_in;		/* Update message input count */
   u_int32_t update_out;		/* Update message ouput count */
+  u_int32_t update_suppressed;	/* Pending updates superseded unsent */
   time_t update_time;		/* Update message received time. */
   u_int32_t keepalive_in;	/* Keepalive input count */
   u_int32_t keepalive_out;	/* Keepalive output count */
@@ -476,12 +527,18 @@ struct peer
   struct bgp_synchronize *sync[AFI_MAX][SAFI_MAX];
   time_t synctime;
 
+  /* Advertisements queued since the last advertisement run.  */
+  u_int32_t routeadv_churn;
+
   /* Send prefix count. */
   unsigned long scount[AFI_MAX][SAFI_MAX];
 
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
+  /* Adj-RIB-In kept for soft-reconfiguration inbound.  */
+  struct bgp_adj_in *adj_in[AFI_MAX][SAFI_MAX];
+
   /* Notify data. */
   struct bgp_notify notify;
 
@@ -491,6 +548,10 @@ struct peer
   /* Filter structure. */
   struct bgp_filter filter[AFI_MAX][SAFI_MAX];
 
+  /* Route targets, one of which VPNv4 routes must carry to be
+     advertised to the peer.  */
+  struct ecommunity *rt_filter;
+
   /* ORF Prefix-list */
   struct prefix_list *orf_plist[AFI_MAX][SAFI_MAX];
 
@@ -714,6 +775,7 @@ struct bgp_nlri
 #define BGP_DEFAULT_ASORIGINATE                 15
 #define BGP_DEFAULT_EBGP_ROUTEADV               30
 #define BGP_DEFAULT_IBGP_ROUTEADV                5
+#define BGP_ROUTEADV_IDLE                        1
 #define BGP_CLEAR_CONNECT_RETRY                 20
 #define BGP_DEFAULT_CONNECT_RETRY              120
 
@@ -724,6 +786,10 @@ struct bgp_nlri
 #define BGP_DEFAULT_RESTART_TIME               120
 #define BGP_DEFAULT_STALEPATH_TIME             360
 
+/* BGP multipath.  */
+#define BGP_DEFAULT_MAXPATHS                     1
+#define BGP_MAXIMUM_MAXPATHS                    64
+
 /* SAFI which used in open capability negotiation.  */
 #define BGP_SAFI_VPNV4                         128
 #define BGP_SAFI_VPNV6                         129
@@ -816,6 +882,7 @@ extern struct bgp *bgp_get_default (void);
 extern struct bgp *bgp_lookup (as_t, const char *);
 extern struct bgp *bgp_lookup_by_name (const char *);
 extern struct peer *peer_lookup (struct bgp *, union sockunion *);
+extern struct peer *peer_addr_lookup (struct bgp *, union sockunion *);
 extern struct peer_group *peer_group_lookup (struct bgp *, const char *);
 extern struct peer_group *peer_group_get (struct bgp *, const char *);
 extern struct peer *peer_lookup_with_open (union sockunion *, as_t, struct in_addr *,
@@ -825,7 +892,7 @@ extern struct peer *peer_unlock (struct peer *);
 extern int peer_sort (struct peer *peer);
 extern int peer_active (struct peer *);
 extern int peer_active_nego (struct peer *);
-extern struct peer *peer_create_accept (struct bgp *);
+extern struct peer *peer_create_accept (struct bgp *, union sockunion *);
 extern char *peer_uptime (time_t, char *, size_t);
 extern int bgp_config_write (struct vty *);
 extern void bgp_config_write_family_header (struct vty *, afi_t, safi_t, int *);
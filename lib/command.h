@@ -101,6 +101,7 @@ enum node_type
   DUMP_NODE,			/* Packet dump node. */
   FORWARDING_NODE,		/* IP forwarding node. */
   PROTOCOL_NODE,                /* protocol filtering node */
+  ZSERV_NODE,			/* Zebra client service node. */
   VTY_NODE,			/* Vty node. */
 };
 
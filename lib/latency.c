@@ -0,0 +1,130 @@
+/* Latency histograms.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "vty.h"
+#include "latency.h"
+
+/* Account for the time from start to end.  Stamps taken by different
+   daemons may be a little out of order, count those as no time.  */
+void
+latency_add (struct latency *lat, struct timeval *start, struct timeval *end)
+{
+  long usec;
+  int i;
+
+  usec = (end->tv_sec - start->tv_sec) * 1000000L
+    + (end->tv_usec - start->tv_usec);
+  if (usec < 0)
+    usec = 0;
+
+  for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+    if ((unsigned long) usec < (1UL << i))
+      break;
+  lat->bucket[i]++;
+
+  lat->count++;
+  lat->total += usec;
+  if ((unsigned long) usec > lat->max)
+    lat->max = usec;
+}
+
+void
+latency_reset (struct latency *lat)
+{
+  const char *name = lat->name;
+
+  memset (lat, 0, sizeof (struct latency));
+  lat->name = name;
+}
+
+/* Upper bound of the bucket holding the given percentile, at most the
+   longest sample.  */
+static unsigned long
+latency_percentile (struct latency *lat, int percent)
+{
+  unsigned long seen = 0;
+  int i;
+
+  for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+    {
+      seen += lat->bucket[i];
+      if (seen * 100 >= lat->count * percent)
+	break;
+    }
+
+  if (i < LATENCY_BUCKETS - 1 && (1UL << i) < lat->max)
+    return 1UL << i;
+  return lat->max;
+}
+
+/* Show num latencies, one line each, followed by their histograms.  */
+void
+latency_vty (struct vty *vty, struct latency *lat, int num)
+{
+  int i, j;
+  int first = LATENCY_BUCKETS;
+  int last = -1;
+
+  vty_out (vty, "%-24s %10s %10s %10s %10s %10s %10s%s", "Stage (usec)",
+	   "Count", "Average", "50%", "90%", "99%", "Max", VTY_NEWLINE);
+  for (i = 0; i < num; i++)
+    {
+      if (! lat[i].count)
+	{
+	  vty_out (vty, "%-24s %10lu%s", lat[i].name, 0UL, VTY_NEWLINE);
+	  continue;
+	}
+      vty_out (vty, "%-24s %10lu %10.0f %10lu %10lu %10lu %10lu%s",
+	       lat[i].name, lat[i].count, lat[i].total / lat[i].count,
+	       latency_percentile (&lat[i], 50),
+	       latency_percentile (&lat[i], 90),
+	       latency_percentile (&lat[i], 99), lat[i].max, VTY_NEWLINE);
+    }
+
+  /* Histograms, over the buckets in use by any of them.  */
+  for (i = 0; i < num; i++)
+    for (j = 0; j < LATENCY_BUCKETS; j++)
+      if (lat[i].bucket[j])
+	{
+	  if (j < first)
+	    first = j;
+	  if (j > last)
+	    last = j;
+	}
+  if (last < 0)
+    return;
+
+  vty_out (vty, "%s%-12s", VTY_NEWLINE, "< usec");
+  for (i = 0; i < num; i++)
+    vty_out (vty, " %10.10s", lat[i].name);
+  vty_out (vty, "%s", VTY_NEWLINE);
+  for (j = first; j <= last; j++)
+    {
+      if (j < LATENCY_BUCKETS - 1)
+	vty_out (vty, "%-12lu", 1UL << j);
+      else
+	vty_out (vty, "%-12s", "longer");
+      for (i = 0; i < num; i++)
+	vty_out (vty, " %10lu", lat[i].bucket[j]);
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
+}
@@ -0,0 +1,46 @@
+/* Latency histograms.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_LATENCY_H
+#define _QUAGGA_LATENCY_H
+
+#include "vty.h"
+
+/* Bucket 0 counts samples under 1 microsecond, bucket i those under
+   2^i microseconds, the last one everything longer.  */
+#define LATENCY_BUCKETS 26
+
+struct latency
+{
+  const char *name;
+
+  unsigned long count;
+  unsigned long max;		/* microseconds */
+  double total;			/* microseconds */
+
+  unsigned long bucket[LATENCY_BUCKETS];
+};
+
+extern void latency_add (struct latency *, struct timeval *start,
+			 struct timeval *end);
+extern void latency_reset (struct latency *);
+extern void latency_vty (struct vty *, struct latency *, int num);
+
+#endif /* _QUAGGA_LATENCY_H */
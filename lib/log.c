@@ -860,6 +860,10 @@ static const struct zebra_desc_table command_types[] = {
   DESC_ENTRY	(ZEBRA_ROUTER_ID_ADD),
   DESC_ENTRY	(ZEBRA_ROUTER_ID_DELETE),
   DESC_ENTRY	(ZEBRA_ROUTER_ID_UPDATE),
+  DESC_ENTRY	(ZEBRA_HELLO),
+  DESC_ENTRY	(ZEBRA_ROUTE_BATCH),
+  DESC_ENTRY	(ZEBRA_RING_SETUP),
+  DESC_ENTRY	(ZEBRA_RING_KICK),
 };
 #undef DESC_ENTRY
 
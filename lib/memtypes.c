@@ -66,6 +66,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_PRIVS,		"Privilege information"		},
   { MTYPE_ZLOG,			"Logging"			},
   { MTYPE_ZCLIENT,		"Zclient"			},
+  { MTYPE_ZRING,		"Zserv shared memory ring"	},
   { MTYPE_WORK_QUEUE,		"Work queue"			},
   { MTYPE_WORK_QUEUE_ITEM,	"Work queue item"		},
   { MTYPE_WORK_QUEUE_NAME,	"Work queue name string"	},
@@ -81,8 +82,16 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_VRF,			"VRF"				},
   { MTYPE_VRF_NAME,		"VRF name"			},
   { MTYPE_NEXTHOP,		"Nexthop"			},
+  { MTYPE_NEXTHOP_GROUP,	"Nexthop group"			},
+  { MTYPE_NEXTHOP_FLAGS,	"Nexthop flags"			},
   { MTYPE_RIB,			"RIB"				},
   { MTYPE_RIB_QUEUE,		"RIB process work queue"	},
+  { MTYPE_RIB_STAMP,		"RIB convergence timestamps"	},
+  { MTYPE_RIB_DEP,		"RIB nexthop dependency"	},
+  { MTYPE_RIB_DEP_KEY,		"RIB nexthop dependency key"	},
+  { MTYPE_NETLINK_BATCH,	"Netlink route message batch"	},
+  { MTYPE_ZSERV_MSG,		"Zserv output message"		},
+  { MTYPE_REDIST_HELD,		"Redistribution held back"	},
   { MTYPE_STATIC_IPV4,		"Static IPv4 route"		},
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
   { -1, NULL },
@@ -93,6 +102,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP,			"BGP instance"			},
   { MTYPE_BGP_PEER,		"BGP peer"			},
   { MTYPE_BGP_PEER_HOST,	"BGP peer hostname"		},
+  { MTYPE_BGP_PEER_ADDR,	"BGP peer address index"	},
   { MTYPE_PEER_GROUP,		"Peer group"			},
   { MTYPE_PEER_DESC,		"Peer description"		},
   { MTYPE_PEER_PASSWORD,	"Peer password string"		},
@@ -113,6 +123,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_SYNCHRONISE,	"BGP synchronise"		},
   { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
   { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
+  { MTYPE_BGP_ADJ_INDEX,	"BGP adj out peer index"	},
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
@@ -147,8 +158,13 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_PEER_UPDATE_SOURCE,	"BGP peer update interface"	},
   { MTYPE_BGP_DAMP_INFO,	"Dampening info"		},
   { MTYPE_BGP_DAMP_ARRAY,	"BGP Dampening array"		},
+  { MTYPE_BGP_DAMP_CONFIG,	"BGP Dampening config"		},
+  { MTYPE_BGP_RT_INDEX,		"BGP route target index"	},
+  { MTYPE_BGP_RT_INDEX_PATH,	"BGP route target index path"	},
   { MTYPE_BGP_REGEXP,		"BGP regexp"			},
   { MTYPE_BGP_AGGREGATE,	"BGP aggregate"			},
+  { MTYPE_BGP_SHOW_WALK,	"BGP show walk"			},
+  { MTYPE_BGP_DUMP_PEERS,	"BGP dump peer index"		},
   { -1, NULL }
 };
 
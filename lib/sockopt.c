@@ -24,6 +24,10 @@
 #include "sockopt.h"
 #include "sockunion.h"
 
+#ifdef GNU_LINUX
+#include <linux/sockios.h>
+#endif /* GNU_LINUX */
+
 int
 setsockopt_so_recvbuf (int sock, int size)
 {
@@ -595,3 +599,34 @@ sockopt_tcp_signature (int sock, union sockunion *su, const char *password)
   return -2;
 #endif /* !HAVE_TCP_MD5SIG */
 }
+
+/* Only report the socket writable while less than 'lowat' bytes are
+   waiting to be sent, rather than whenever there is room in the send
+   buffer. */
+int
+sockopt_tcp_notsent_lowat (int sock, int lowat)
+{
+#ifdef TCP_NOTSENT_LOWAT
+  return setsockopt (sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                     &lowat, sizeof (lowat));
+#else
+  errno = ENOPROTOOPT;
+  return -1;
+#endif /* TCP_NOTSENT_LOWAT */
+}
+
+/* Number of bytes in the send queue of the socket that have not been
+   sent yet, -1 if the system can't tell. */
+int
+sockopt_tcp_unsent (int sock)
+{
+#ifdef SIOCOUTQNSD
+  int unsent;
+
+  if (ioctl (sock, SIOCOUTQNSD, &unsent) < 0)
+    return -1;
+  return unsent;
+#else
+  return -1;
+#endif /* SIOCOUTQNSD */
+}
@@ -103,4 +103,7 @@ extern void sockopt_iphdrincl_swab_systoh (struct ip *iph);
 
 extern int sockopt_tcp_signature(int sock, union sockunion *su,
                                  const char *password);
+
+extern int sockopt_tcp_notsent_lowat (int sock, int lowat);
+extern int sockopt_tcp_unsent (int sock);
 #endif /*_ZEBRA_SOCKOPT_H */
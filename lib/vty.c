@@ -1288,7 +1288,7 @@ vty_execute (struct vty *vty)
   vty->cp = vty->length = 0;
   vty_clear_buf (vty);
 
-  if (vty->status != VTY_CLOSE )
+  if (vty->status != VTY_CLOSE && ! vty->output_func)
     vty_prompt (vty);
 
   return ret;
@@ -1325,10 +1325,60 @@ vty_escape_map (unsigned char c, struct vty *vty)
   vty->escape = VTY_NORMAL;
 }
 
+/* Register the rest of a command's output.  func is called each time
+   the output buffer has drained, appends the next part of the output
+   and returns non-zero while more is to come.  clean releases arg when
+   the output is abandoned before func has finished.  Output to files
+   and to stdout is produced at once.  */
+void
+vty_output_continue (struct vty *vty, int (*func) (struct vty *, void *),
+		     void (*clean) (struct vty *, void *), void *arg)
+{
+  if (vty->type != VTY_TERM && vty->type != VTY_SHELL_SERV)
+    {
+      while ((*func) (vty, arg))
+	;
+      return;
+    }
+
+  vty->output_func = func;
+  vty->output_clean = clean;
+  vty->output_arg = arg;
+}
+
+/* Produce the next part of the output, returns 0 when it is done.  */
+static int
+vty_output_run (struct vty *vty)
+{
+  if ((*vty->output_func) (vty, vty->output_arg))
+    return 1;
+
+  vty->output_func = NULL;
+  vty->output_clean = NULL;
+  vty->output_arg = NULL;
+  return 0;
+}
+
+/* Abandon the rest of the output.  */
+static void
+vty_output_stop (struct vty *vty)
+{
+  if (! vty->output_func)
+    return;
+
+  if (vty->output_clean)
+    (*vty->output_clean) (vty, vty->output_arg);
+
+  vty->output_func = NULL;
+  vty->output_clean = NULL;
+  vty->output_arg = NULL;
+}
+
 /* Quit print out to the buffer. */
 static void
 vty_buffer_reset (struct vty *vty)
 {
+  vty_output_stop (vty);
   buffer_reset (vty->obuf);
   vty_prompt (vty);
   vty_redraw_line (vty);
@@ -1398,7 +1448,7 @@ vty_read (struct thread *thread)
 	}
 	        
 
-      if (vty->status == VTY_MORE)
+      if (vty->status == VTY_MORE || vty->output_func)
 	{
 	  switch (buf[i])
 	    {
@@ -1588,6 +1638,13 @@ vty_flush (struct thread *thread)
     case BUFFER_EMPTY:
       if (vty->status == VTY_CLOSE)
 	vty_close (vty);
+      else if (vty->output_func)
+	{
+	  /* Only produce more once the previous part has been sent.  */
+	  if (! vty_output_run (vty))
+	    vty_prompt (vty);
+	  vty_event (VTY_WRITE, vty_sock, vty);
+	}
       else
 	{
 	  vty->status = VTY_NORMAL;
@@ -2036,6 +2093,17 @@ vtysh_flush(struct vty *vty)
       return -1;
       break;
     case BUFFER_EMPTY:
+      if (vty->output_func)
+	{
+	  if (! vty_output_run (vty))
+	    {
+	      u_char header[4] = {0, 0, 0, 0};
+
+	      header[3] = vty->output_ret;
+	      buffer_put (vty->obuf, header, 4);
+	    }
+	  vty_event (VTYSH_WRITE, vty->fd, vty);
+	}
       break;
     }
   return 0;
@@ -2098,8 +2166,14 @@ vtysh_read (struct thread *thread)
 	  printf ("vtysh node: %d\n", vty->node);
 #endif /* VTYSH_DEBUG */
 
-	  header[3] = ret;
-	  buffer_put(vty->obuf, header, 4);
+	  /* The result follows the rest of a resumable output.  */
+	  if (vty->output_func)
+	    vty->output_ret = ret;
+	  else
+	    {
+	      header[3] = ret;
+	      buffer_put(vty->obuf, header, 4);
+	    }
 
 	  if (!vty->t_write && (vtysh_flush(vty) < 0))
 	    /* Try to flush results; exit if a write error occurs. */
@@ -2166,6 +2240,8 @@ vty_close (struct vty *vty)
   if (vty->t_timeout)
     thread_cancel (vty->t_timeout);
 
+  vty_output_stop (vty);
+
   /* Flush buffer. */
   buffer_flush_all (vty->obuf, vty->fd);
 
@@ -118,6 +118,12 @@ struct vty
   /* Timeout seconds and thread. */
   unsigned long v_timeout;
   struct thread *t_timeout;
+
+  /* Resumable command output, see vty_output_continue ().  */
+  int (*output_func) (struct vty *, void *);
+  void (*output_clean) (struct vty *, void *);
+  void *output_arg;
+  int output_ret;
 };
 
 /* Integrated configuration file. */
@@ -210,6 +216,9 @@ extern void vty_read_config (char *, char *);
 extern void vty_time_print (struct vty *, int);
 extern void vty_serv_sock (const char *, unsigned short, const char *);
 extern void vty_close (struct vty *);
+extern void vty_output_continue (struct vty *,
+				 int (*) (struct vty *, void *),
+				 void (*) (struct vty *, void *), void *);
 extern char *vty_get_cwd (void);
 extern void vty_log (const char *level, const char *proto, 
                      const char *fmt, struct timestamp_control *, va_list);
@@ -309,6 +309,11 @@ work_queue_run (struct thread *thread)
 	{
 	  item->ran--;
 	  work_queue_item_requeue (wq, node);
+	  /* A queue of one requeued item, such as zebra's meta queue,
+	   * carries on with it rather than waiting for the next run.
+	   */
+	  if (nnode == NULL)
+	    nnode = node;
 	  break;
 	}
       case WQ_RETRY_NOW:
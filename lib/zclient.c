@@ -38,6 +38,8 @@ enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
 
 /* Prototype for event manager. */
 static void zclient_event (enum event, struct zclient *);
+static void zclient_ring_kick (struct zclient *);
+static int zclient_dispatch (struct zclient *, uint16_t, uint16_t);
 
 extern struct thread_master *master;
 
@@ -54,6 +56,7 @@ zclient_new ()
   zclient->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->wb = buffer_new(0);
+  zclient->batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
 
   return zclient;
 }
@@ -122,10 +125,30 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_batch);
+  THREAD_OFF(zclient->t_ring);
 
   /* Reset streams. */
   stream_reset(zclient->ibuf);
   stream_reset(zclient->obuf);
+  if (zclient->batch)
+    stream_reset(zclient->batch);
+
+  /* The next zebra may not take what this one did. */
+  zclient->capabilities = 0;
+
+  /* Drop the rings.  The streams stay, a ring message may be being
+     read from ring_ibuf. */
+  if (zclient->ring)
+    {
+      zring_unlink (zclient->ring);
+      zring_free (zclient->ring);
+      zclient->ring = NULL;
+    }
+  zclient->ring_up = 0;
+  zclient->ring_out = 0;
+  if (zclient->ring_backlog)
+    stream_reset (zclient->ring_backlog);
 
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
@@ -245,13 +268,64 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+/* Write as much of the backlog as fits in the ring. */
+static int
+zclient_ring_flush (struct zclient *zclient)
+{
+  struct stream *s = zclient->ring_backlog;
+  ssize_t nbytes;
+
+  if (! STREAM_READABLE (s))
+    return 0;
+  nbytes = zring_write (zclient->ring, STREAM_PNT (s), STREAM_READABLE (s));
+  if (nbytes < 0)
+    {
+      zlog_warn ("%s: ring to zebra is broken, closing", __func__);
+      return zclient_failed (zclient);
+    }
+  stream_forward_getp (s, nbytes);
+  if (! STREAM_READABLE (s))
+    stream_reset (s);
+  if (zring_kick_reader (zclient->ring))
+    zclient_ring_kick (zclient);
+  return 0;
+}
+
+/* Write a message to the ring, keeping what does not fit for when
+   zebra has made room. */
+static int
+zclient_ring_write (struct zclient *zclient, struct stream *s)
+{
+  struct stream *backlog = zclient->ring_backlog;
+  size_t len = stream_get_endp (s);
+
+  if (STREAM_WRITEABLE (backlog) < len)
+    stream_resize (backlog, MAX (2 * STREAM_SIZE (backlog),
+				 stream_get_endp (backlog) + len));
+  stream_put (backlog, STREAM_DATA (s), len);
+  return zclient_ring_flush (zclient);
+}
+
+/* Whether messages go in the ring, which they do once zebra has taken
+   it up and those before are off to it. */
+static int
+zclient_ring_ready (struct zclient *zclient)
+{
+  if (zclient->ring_up && ! zclient->ring_out && buffer_empty (zclient->wb))
+    zclient->ring_out = 1;
+  return zclient->ring_out;
+}
+
+static int
+zclient_write (struct zclient *zclient, struct stream *s)
 {
   if (zclient->sock < 0)
     return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+  if (zclient_ring_ready (zclient))
+    return zclient_ring_write (zclient, s);
+
+  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(s),
+		       stream_get_endp(s)))
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
@@ -269,6 +343,88 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+/* Tell zebra to look at the rings again.  Once messages go in the
+   ring, nothing else is written to the socket and the kick goes
+   straight to it; a kick which does not fit is not needed, zebra has
+   others to read. */
+static void
+zclient_ring_kick (struct zclient *zclient)
+{
+  static struct stream *s;
+
+  if (! s)
+    {
+      s = stream_new (ZEBRA_HEADER_SIZE);
+      zclient_create_header (s, ZEBRA_RING_KICK);
+    }
+
+  if (! zclient_ring_ready (zclient))
+    {
+      zclient_write (zclient, s);
+      return;
+    }
+  if (write (zclient->sock, STREAM_DATA (s), ZEBRA_HEADER_SIZE) < 0
+      && zclient_debug)
+    zlog_debug ("%s: %s", __func__, safe_strerror (errno));
+}
+
+/* Send the route messages batched so far, if any. */
+static int
+zclient_batch_flush (struct zclient *zclient)
+{
+  int ret;
+
+  THREAD_OFF (zclient->t_batch);
+  if (! zclient->batch || stream_get_endp (zclient->batch) == 0)
+    return 0;
+
+  ret = zclient_write (zclient, zclient->batch);
+  stream_reset (zclient->batch);
+  return ret;
+}
+
+static int
+zclient_batch_send (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_batch = NULL;
+  return zclient_batch_flush (zclient);
+}
+
+int
+zclient_send_message(struct zclient *zclient)
+{
+  /* Batched route messages were sent before this one. */
+  if (zclient_batch_flush (zclient) < 0)
+    return -1;
+  return zclient_write (zclient, zclient->obuf);
+}
+
+/* Send the route message in zclient->obuf.  If zebra takes batches,
+   the route is held back for the ones sent after it in the same
+   event, and the batch goes once the event is over or before a
+   message it cannot hold. */
+static int
+zclient_route_send (struct zclient *zclient)
+{
+  if (! CHECK_FLAG (zclient->capabilities, ZEBRA_CAPABILITY_ROUTE_BATCH))
+    return zclient_send_message (zclient);
+
+  if (! zapi_batch_add (zclient->batch, zclient->obuf))
+    {
+      if (zclient_batch_flush (zclient) < 0)
+	return -1;
+      if (! zapi_batch_add (zclient->batch, zclient->obuf))
+	return zclient_send_message (zclient);
+    }
+
+  if (! zclient->t_batch)
+    zclient->t_batch = thread_add_event (master, zclient_batch_send,
+					 zclient, 0);
+  return 0;
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command)
 {
@@ -295,6 +451,27 @@ zebra_message_send (struct zclient *zclient, int command)
   return zclient_send_message(zclient);
 }
 
+/* Offer zebra the capabilities of this client. */
+static int
+zclient_hello_send (struct zclient *zclient)
+{
+  struct stream *s;
+  u_int32_t capabilities;
+
+  capabilities = zclient->batch ? ZEBRA_CAPABILITIES : 0;
+  if (! zclient->ring_enable)
+    UNSET_FLAG (capabilities, ZEBRA_CAPABILITY_RING);
+
+  s = zclient->obuf;
+  stream_reset (s);
+
+  zclient_create_header (s, ZEBRA_HELLO);
+  stream_putl (s, capabilities);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zclient_send_message (zclient);
+}
+
 /* Make connection to zebra daemon. */
 int
 zclient_start (struct zclient *zclient)
@@ -342,6 +519,10 @@ zclient_start (struct zclient *zclient)
   /* Create read thread. */
   zclient_event (ZCLIENT_READ, zclient);
 
+  /* Zebra answers with what it takes up, zebras which do not know
+     about capabilities ignore the offer. */
+  zclient_hello_send (zclient);
+
   /* We need interface information. */
   zebra_message_send (zclient, ZEBRA_INTERFACE_ADD);
 
@@ -473,11 +654,16 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
     stream_putc (s, api->distance);
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_TIMESTAMP))
+    {
+      stream_putl (s, api->timestamp.tv_sec);
+      stream_putl (s, api->timestamp.tv_usec);
+    }
 
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zclient_send_message(zclient);
+  return zclient_route_send (zclient);
 }
 
 #ifdef HAVE_IPV6
@@ -526,14 +712,168 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
     stream_putc (s, api->distance);
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_TIMESTAMP))
+    {
+      stream_putl (s, api->timestamp.tv_sec);
+      stream_putl (s, api->timestamp.tv_usec);
+    }
 
   /* Put length at the first point of the stream. */
   stream_putw_at (s, 0, stream_get_endp (s));
 
-  return zclient_send_message(zclient);
+  return zclient_route_send (zclient);
 }
 #endif /* HAVE_IPV6 */
 
+/* Offsets in route and ZEBRA_ROUTE_BATCH messages. */
+#define ZAPI_ROUTE_TYPE     ZEBRA_HEADER_SIZE
+#define ZAPI_ROUTE_PREFIX   (ZAPI_ROUTE_TYPE + 3)
+#define ZAPI_BATCH_COMMAND  ZEBRA_HEADER_SIZE
+#define ZAPI_BATCH_TYPE     (ZAPI_BATCH_COMMAND + 2)
+#define ZAPI_BATCH_ATTRLEN  (ZAPI_BATCH_TYPE + 3)
+#define ZAPI_BATCH_ATTR     (ZAPI_BATCH_ATTRLEN + 2)
+
+/* Size of the timestamp following the prefix of a batch. */
+#define ZAPI_TIMESTAMP_SIZE(M) \
+  (CHECK_FLAG ((M), ZAPI_MESSAGE_TIMESTAMP) ? 8 : 0)
+
+/* Longest prefix of the routes of a command, 0 if no route command. */
+static u_char
+zapi_route_maxlen (u_int16_t command)
+{
+  switch (command)
+    {
+    case ZEBRA_IPV4_ROUTE_ADD:
+    case ZEBRA_IPV4_ROUTE_DELETE:
+      return IPV4_MAX_BITLEN;
+    case ZEBRA_IPV6_ROUTE_ADD:
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      return IPV6_MAX_BITLEN;
+    }
+  return 0;
+}
+
+int
+zapi_batch_add (struct stream *batch, struct stream *s)
+{
+  u_int16_t command;
+  u_int16_t count;
+  size_t length;
+  size_t attr;
+  size_t attrlen;
+  size_t entry;
+  size_t tslen;
+  size_t countp;
+
+  length = stream_get_endp (s);
+  if (length <= ZAPI_ROUTE_PREFIX)
+    return 0;
+  command = stream_getw_from (s, 4);
+  if (! zapi_route_maxlen (command))
+    return 0;
+
+  /* Split the message into prefix, attributes and timestamp. */
+  attr = ZAPI_ROUTE_PREFIX + 1
+    + PSIZE (stream_getc_from (s, ZAPI_ROUTE_PREFIX));
+  tslen = ZAPI_TIMESTAMP_SIZE (stream_getc_from (s, ZAPI_ROUTE_TYPE + 2));
+  if (attr + tslen > length)
+    return 0;
+  attrlen = length - attr - tslen;
+  entry = attr - ZAPI_ROUTE_PREFIX + tslen;
+
+  if (stream_get_endp (batch) == 0)
+    {
+      if (ZAPI_BATCH_ATTR + attrlen + 2 + entry > STREAM_SIZE (batch))
+	return 0;
+      zclient_create_header (batch, ZEBRA_ROUTE_BATCH);
+      stream_putw (batch, command);
+      stream_put (batch, STREAM_DATA (s) + ZAPI_ROUTE_TYPE, 3);
+      stream_putw (batch, attrlen);
+      stream_put (batch, STREAM_DATA (s) + attr, attrlen);
+      stream_putw (batch, 0);
+    }
+  else if (stream_getw_from (batch, ZAPI_BATCH_COMMAND) != command
+	   || memcmp (STREAM_DATA (batch) + ZAPI_BATCH_TYPE,
+		      STREAM_DATA (s) + ZAPI_ROUTE_TYPE, 3)
+	   || stream_getw_from (batch, ZAPI_BATCH_ATTRLEN) != attrlen
+	   || memcmp (STREAM_DATA (batch) + ZAPI_BATCH_ATTR,
+		      STREAM_DATA (s) + attr, attrlen)
+	   || STREAM_WRITEABLE (batch) < entry)
+    return 0;
+
+  countp = ZAPI_BATCH_ATTR + attrlen;
+  count = stream_getw_from (batch, countp);
+  if (count == UINT16_MAX)
+    return 0;
+
+  stream_put (batch, STREAM_DATA (s) + ZAPI_ROUTE_PREFIX,
+	      attr - ZAPI_ROUTE_PREFIX);
+  stream_put (batch, STREAM_DATA (s) + length - tslen, tslen);
+  stream_putw_at (batch, countp, count + 1);
+  stream_putw_at (batch, 0, stream_get_endp (batch));
+  return 1;
+}
+
+int
+zapi_batch_read (struct stream *s, struct zapi_batch *batch)
+{
+  if (STREAM_READABLE (s) < ZAPI_BATCH_ATTR - ZAPI_BATCH_COMMAND)
+    return -1;
+
+  batch->command = stream_getw (s);
+  batch->type = stream_getc (s);
+  batch->flags = stream_getc (s);
+  batch->message = stream_getc (s);
+  batch->attrlen = stream_getw (s);
+  if (! zapi_route_maxlen (batch->command)
+      || STREAM_READABLE (s) < (size_t) batch->attrlen + 2)
+    return -1;
+
+  batch->attr = stream_get_getp (s);
+  stream_forward_getp (s, batch->attrlen);
+  batch->count = stream_getw (s);
+  return 0;
+}
+
+int
+zapi_batch_route (struct stream *s, struct zapi_batch *batch,
+		  struct stream *route)
+{
+  u_char prefixlen;
+  size_t psize;
+  size_t tslen;
+
+  if (batch->count == 0 || STREAM_READABLE (s) < 1)
+    return -1;
+
+  prefixlen = stream_getc (s);
+  psize = PSIZE (prefixlen);
+  tslen = ZAPI_TIMESTAMP_SIZE (batch->message);
+  if (prefixlen > zapi_route_maxlen (batch->command)
+      || STREAM_READABLE (s) < psize + tslen
+      || ZAPI_ROUTE_PREFIX + 1 + psize + batch->attrlen + tslen
+         > STREAM_SIZE (route))
+    return -1;
+
+  stream_reset (route);
+  zclient_create_header (route, batch->command);
+  stream_putc (route, batch->type);
+  stream_putc (route, batch->flags);
+  stream_putc (route, batch->message);
+  stream_putc (route, prefixlen);
+  stream_put (route, STREAM_PNT (s), psize);
+  stream_forward_getp (s, psize);
+  stream_put (route, STREAM_DATA (s) + batch->attr, batch->attrlen);
+  stream_put (route, STREAM_PNT (s), tslen);
+  stream_forward_getp (s, tslen);
+  stream_putw_at (route, 0, stream_get_endp (route));
+
+  /* Leave the route to be read as if just received. */
+  stream_set_getp (route, ZEBRA_HEADER_SIZE);
+  batch->count--;
+  return 0;
+}
+
 /* 
  * send a ZEBRA_REDISTRIBUTE_ADD or ZEBRA_REDISTRIBUTE_DELETE
  * for the route type (ZEBRA_ROUTE_KERNEL etc.). The zebra server will
@@ -795,11 +1135,290 @@ zebra_interface_address_read (int type, struct stream *s)
 }
 
 
+/* Hand the routes of a ZEBRA_ROUTE_BATCH to the daemon one by one,
+   as the route messages they were batched from. */
+static int
+zclient_read_batch (struct zclient *zclient)
+{
+  static struct stream *route;
+  struct stream *s;
+  struct zapi_batch batch;
+  int (*func) (int, struct zclient *, uint16_t);
+
+  s = zclient->ibuf;
+  if (zapi_batch_read (s, &batch) < 0)
+    {
+      zlog_warn ("%s: malformed route batch on socket %d",
+		 __func__, zclient->sock);
+      return -1;
+    }
+
+  switch (batch.command)
+    {
+    case ZEBRA_IPV4_ROUTE_ADD:
+      func = zclient->ipv4_route_add;
+      break;
+    case ZEBRA_IPV4_ROUTE_DELETE:
+      func = zclient->ipv4_route_delete;
+      break;
+    case ZEBRA_IPV6_ROUTE_ADD:
+      func = zclient->ipv6_route_add;
+      break;
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      func = zclient->ipv6_route_delete;
+      break;
+    default:
+      func = NULL;
+      break;
+    }
+  if (! func)
+    return 0;
+
+  if (route && STREAM_SIZE (route) < STREAM_SIZE (s))
+    {
+      stream_free (route);
+      route = NULL;
+    }
+  if (! route)
+    route = stream_new (STREAM_SIZE (s));
+
+  /* The daemons read route messages from zclient->ibuf. */
+  zclient->ibuf = route;
+  while (batch.count && zclient->sock >= 0)
+    {
+      if (zapi_batch_route (s, &batch, route) < 0)
+	{
+	  zlog_warn ("%s: malformed route batch on socket %d",
+		     __func__, zclient->sock);
+	  break;
+	}
+      (*func) (batch.command, zclient,
+	       stream_get_endp (route) - ZEBRA_HEADER_SIZE);
+    }
+  zclient->ibuf = s;
+
+  /* Closing the connection reset the stream read from instead. */
+  if (zclient->sock < 0)
+    stream_reset (s);
+  return 0;
+}
+
+/* Offer zebra rings to exchange messages through. */
+static int
+zclient_ring_setup (struct zclient *zclient)
+{
+  struct stream *s;
+  size_t namelen;
+
+  zclient->ring = zring_create (ZRING_SIZE_DEFAULT);
+  if (! zclient->ring)
+    return -1;
+  namelen = strlen (zclient->ring->name);
+
+  s = zclient->obuf;
+  stream_reset (s);
+
+  zclient_create_header (s, ZEBRA_RING_SETUP);
+  stream_putl (s, zclient->ring->size);
+  stream_putc (s, namelen);
+  stream_put (s, zclient->ring->name, namelen);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zclient_send_message (zclient);
+}
+
+/* Zebra has mapped the rings, or given up. */
+static void
+zclient_ring_answer (struct zclient *zclient, uint16_t length)
+{
+  u_char ok = 0;
+
+  if (length >= 1)
+    ok = stream_getc (zclient->ibuf);
+  if (! zclient->ring || zclient->ring_up)
+    return;
+
+  zring_unlink (zclient->ring);
+  if (! ok)
+    {
+      zring_free (zclient->ring);
+      zclient->ring = NULL;
+      return;
+    }
+
+  if (! zclient->ring_ibuf)
+    zclient->ring_ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  if (! zclient->ring_backlog)
+    zclient->ring_backlog = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->ring_up = 1;
+  if (zclient_debug)
+    zlog_debug ("zclient ring %s of %u bytes each way is up",
+		zclient->ring->name, zclient->ring->size);
+}
+
+/* Read the messages zebra put in the ring, a number at a time. */
+#define ZCLIENT_RING_READ_MAX 100
+
+static int
+zclient_ring_read (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+  struct stream *s;
+  int length, i;
+  uint16_t command;
+  uint8_t marker, version;
+
+  zclient->t_ring = NULL;
+  for (i = 0; i < ZCLIENT_RING_READ_MAX; i++)
+    {
+      length = zring_msg_peek (zclient->ring);
+      if (length == 0)
+	return 0;
+      if (length < 0)
+	{
+	  zlog_err ("%s: ring from zebra is broken", __func__);
+	  return zclient_failed (zclient);
+	}
+
+      if (length > (int) STREAM_SIZE (zclient->ring_ibuf))
+	{
+	  stream_free (zclient->ring_ibuf);
+	  zclient->ring_ibuf = stream_new (length);
+	}
+      zring_msg_get (zclient->ring, zclient->ring_ibuf, length);
+
+      /* Zebra may wait for the room just made. */
+      if (zring_kick_writer (zclient->ring))
+	{
+	  zclient_ring_kick (zclient);
+	  if (zclient->sock < 0)
+	    return -1;
+	}
+
+      s = zclient->ibuf;
+      zclient->ibuf = zclient->ring_ibuf;
+      stream_getw (zclient->ibuf);
+      marker = stream_getc (zclient->ibuf);
+      version = stream_getc (zclient->ibuf);
+      command = stream_getw (zclient->ibuf);
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
+	{
+	  zclient->ibuf = s;
+	  zlog_err ("%s: ring version mismatch, marker %d, version %d",
+		    __func__, marker, version);
+	  return zclient_failed (zclient);
+	}
+
+      if (zclient_debug)
+	zlog_debug ("zclient 0x%p ring command 0x%x", zclient, command);
+      zclient_dispatch (zclient, command, length - ZEBRA_HEADER_SIZE);
+      zclient->ibuf = s;
+
+      /* Connection was closed during packet processing. */
+      if (zclient->sock < 0)
+	return -1;
+    }
+
+  zclient->t_ring = thread_add_event (master, zclient_ring_read, zclient, 0);
+  return 0;
+}
+
+/* Zebra put messages in the ring, or made room in its own. */
+static void
+zclient_ring_kicked (struct zclient *zclient)
+{
+  if (! zclient->ring_up)
+    return;
+  if (zclient->ring_out && zclient_ring_flush (zclient) < 0)
+    return;
+  if (! zclient->t_ring)
+    zclient->t_ring = thread_add_event (master, zclient_ring_read, zclient, 0);
+}
+
+/* Hand a message from zebra, in zclient->ibuf, to the daemon. */
+static int
+zclient_dispatch (struct zclient *zclient, uint16_t command, uint16_t length)
+{
+  int ret = 0;
+
+  switch (command)
+    {
+    case ZEBRA_ROUTER_ID_UPDATE:
+      if (zclient->router_id_update)
+	ret = (*zclient->router_id_update) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_ADD:
+      if (zclient->interface_add)
+	ret = (*zclient->interface_add) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_DELETE:
+      if (zclient->interface_delete)
+	ret = (*zclient->interface_delete) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_ADDRESS_ADD:
+      if (zclient->interface_address_add)
+	ret = (*zclient->interface_address_add) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_ADDRESS_DELETE:
+      if (zclient->interface_address_delete)
+	ret = (*zclient->interface_address_delete) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_UP:
+      if (zclient->interface_up)
+	ret = (*zclient->interface_up) (command, zclient, length);
+      break;
+    case ZEBRA_INTERFACE_DOWN:
+      if (zclient->interface_down)
+	ret = (*zclient->interface_down) (command, zclient, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_ADD:
+      if (zclient->ipv4_route_add)
+	ret = (*zclient->ipv4_route_add) (command, zclient, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_DELETE:
+      if (zclient->ipv4_route_delete)
+	ret = (*zclient->ipv4_route_delete) (command, zclient, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_ADD:
+      if (zclient->ipv6_route_add)
+	ret = (*zclient->ipv6_route_add) (command, zclient, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      if (zclient->ipv6_route_delete)
+	ret = (*zclient->ipv6_route_delete) (command, zclient, length);
+      break;
+    case ZEBRA_ROUTE_BATCH:
+      ret = zclient_read_batch (zclient);
+      break;
+    case ZEBRA_HELLO:
+      if (length >= 4)
+	zclient->capabilities = stream_getl (zclient->ibuf)
+	  & ZEBRA_CAPABILITIES;
+      if (! zclient->ring_enable)
+	UNSET_FLAG (zclient->capabilities, ZEBRA_CAPABILITY_RING);
+      if (zclient_debug)
+	zlog_debug ("zclient capabilities 0x%x", zclient->capabilities);
+      if (CHECK_FLAG (zclient->capabilities, ZEBRA_CAPABILITY_RING)
+	  && ! zclient->ring)
+	ret = zclient_ring_setup (zclient);
+      break;
+    case ZEBRA_RING_SETUP:
+      zclient_ring_answer (zclient, length);
+      break;
+    case ZEBRA_RING_KICK:
+      zclient_ring_kicked (zclient);
+      break;
+    default:
+      break;
+    }
+
+  return ret;
+}
+
 /* Zebra client message read function. */
 static int
 zclient_read (struct thread *thread)
 {
-  int ret;
   size_t already;
   uint16_t length, command;
   uint8_t marker, version;
@@ -890,55 +1509,7 @@ zclient_read (struct thread *thread)
   if (zclient_debug)
     zlog_debug("zclient 0x%p command 0x%x \n", zclient, command);
 
-  switch (command)
-    {
-    case ZEBRA_ROUTER_ID_UPDATE:
-      if (zclient->router_id_update)
-	ret = (*zclient->router_id_update) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_ADD:
-      if (zclient->interface_add)
-	ret = (*zclient->interface_add) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_DELETE:
-      if (zclient->interface_delete)
-	ret = (*zclient->interface_delete) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_ADDRESS_ADD:
-      if (zclient->interface_address_add)
-	ret = (*zclient->interface_address_add) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_ADDRESS_DELETE:
-      if (zclient->interface_address_delete)
-	ret = (*zclient->interface_address_delete) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_UP:
-      if (zclient->interface_up)
-	ret = (*zclient->interface_up) (command, zclient, length);
-      break;
-    case ZEBRA_INTERFACE_DOWN:
-      if (zclient->interface_down)
-	ret = (*zclient->interface_down) (command, zclient, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_ADD:
-      if (zclient->ipv4_route_add)
-	ret = (*zclient->ipv4_route_add) (command, zclient, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_DELETE:
-      if (zclient->ipv4_route_delete)
-	ret = (*zclient->ipv4_route_delete) (command, zclient, length);
-      break;
-    case ZEBRA_IPV6_ROUTE_ADD:
-      if (zclient->ipv6_route_add)
-	ret = (*zclient->ipv6_route_add) (command, zclient, length);
-      break;
-    case ZEBRA_IPV6_ROUTE_DELETE:
-      if (zclient->ipv6_route_delete)
-	ret = (*zclient->ipv6_route_delete) (command, zclient, length);
-      break;
-    default:
-      break;
-    }
+  zclient_dispatch (zclient, command, length);
 
   if (zclient->sock < 0)
     /* Connection was closed during packet processing. */
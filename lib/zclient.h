@@ -25,6 +25,9 @@
 /* For struct interface and struct connected. */
 #include "if.h"
 
+/* For the shared memory rings to zebra. */
+#include "zring.h"
+
 /* For input/output buffer to zebra. */
 #define ZEBRA_MAX_PACKET_SIZ          4096
 
@@ -60,6 +63,29 @@ struct zclient
   /* Thread to write buffered data to zebra. */
   struct thread *t_write;
 
+  /* Capabilities agreed on with zebra, see ZEBRA_HELLO. */
+  u_int32_t capabilities;
+
+  /* Route messages waiting to be sent as one ZEBRA_ROUTE_BATCH, and
+     the event sending them. */
+  struct stream *batch;
+  struct thread *t_batch;
+
+  /* Shared memory rings to zebra, see ZEBRA_RING_SETUP.  Once zebra
+     has taken them up, and what was buffered for the socket is
+     written, messages go in the ring; the socket then only carries
+     ZEBRA_RING_KICK.  What does not fit in the ring waits in the
+     backlog.  Rings are only offered by clients setting ring_enable,
+     as they take shared memory which only pays off for clients
+     exchanging many routes. */
+  u_char ring_enable;
+  struct zring_map *ring;
+  u_char ring_up;
+  u_char ring_out;
+  struct stream *ring_ibuf;
+  struct stream *ring_backlog;
+  struct thread *t_ring;
+
   /* Redistribute information. */
   u_char redist_default;
   u_char redist[ZEBRA_ROUTE_MAX];
@@ -86,6 +112,19 @@ struct zclient
 #define ZAPI_MESSAGE_IFINDEX  0x02
 #define ZAPI_MESSAGE_DISTANCE 0x04
 #define ZAPI_MESSAGE_METRIC   0x08
+#define ZAPI_MESSAGE_TIMESTAMP 0x10
+
+/* Capabilities exchanged in ZEBRA_HELLO.  A client offers them after
+   connecting, zebra answers with the ones it takes up; a side only
+   uses a capability once both have agreed on it. */
+#define ZEBRA_CAPABILITY_ROUTE_BATCH 0x01
+#define ZEBRA_CAPABILITY_RING        0x02
+#ifdef HAVE_ZRING
+#define ZEBRA_CAPABILITIES \
+  (ZEBRA_CAPABILITY_ROUTE_BATCH | ZEBRA_CAPABILITY_RING)
+#else
+#define ZEBRA_CAPABILITIES           ZEBRA_CAPABILITY_ROUTE_BATCH
+#endif /* HAVE_ZRING */
 
 /* Zserv protocol message header */
 struct zserv_header
@@ -117,6 +156,44 @@ struct zapi_ipv4
   u_char distance;
 
   u_int32_t metric;
+
+  /* Monotonic time the route was received by the client.  */
+  struct timeval timestamp;
+};
+
+/*
+ * A ZEBRA_ROUTE_BATCH message carries the prefixes of many route
+ * messages of the same command, type, flags and attributes:
+ *
+ *  0 1 2 3 4 5 6 7 8 9 A B C D E F 0 1 2 3 4 5 6 7 8 9 A B C D E F
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |        Command (2)            |  Route Type   |  ZEBRA Flags  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | Message Flags |  Attribute length (2)         | Attributes... |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |       Prefix count (2)        | Prefixes...
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * The attributes are what follows the prefix in the route message:
+ * nexthops, distance and metric.  Each prefix is its length and
+ * address, followed by the timestamp if the message flags have
+ * ZAPI_MESSAGE_TIMESTAMP.  Route message N is thus the batch's type,
+ * flags and message flags, prefix N, the attributes and timestamp N,
+ * which is how both sides build batches and take them apart.
+ */
+struct zapi_batch
+{
+  u_int16_t command;
+  u_char type;
+  u_char flags;
+  u_char message;
+
+  /* Where the attributes are in the batch. */
+  size_t attr;
+  u_int16_t attrlen;
+
+  /* Prefixes left to read. */
+  u_int16_t count;
 };
 
 /* Prototypes of zebra client service functions. */
@@ -156,6 +233,17 @@ extern void zebra_router_id_update_read (struct stream *s, struct prefix *rid);
 extern int zapi_ipv4_route (u_char, struct zclient *, struct prefix_ipv4 *, 
                             struct zapi_ipv4 *);
 
+/* Append the route message in the second stream to the batch in the
+   first.  Returns 0 if it does not fit or does not share the batch's
+   attributes, the batch has to be sent first. */
+extern int zapi_batch_add (struct stream *, struct stream *);
+
+/* Read the head of a received batch, then rebuild its route messages
+   one by one into the second stream.  Return -1 if malformed. */
+extern int zapi_batch_read (struct stream *, struct zapi_batch *);
+extern int zapi_batch_route (struct stream *, struct zapi_batch *,
+                             struct stream *);
+
 #ifdef HAVE_IPV6
 /* IPv6 prefix add and delete function prototype. */
 
@@ -176,6 +264,9 @@ struct zapi_ipv6
   u_char distance;
 
   u_int32_t metric;
+
+  /* Monotonic time the route was received by the client.  */
+  struct timeval timestamp;
 };
 
 extern int zapi_ipv6_route (u_char cmd, struct zclient *zclient, 
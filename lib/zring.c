@@ -0,0 +1,356 @@
+/* Shared memory rings between zebra and its clients.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#ifdef HAVE_SHM_OPEN
+#include <sys/mman.h>
+#endif /* HAVE_SHM_OPEN */
+
+#include "log.h"
+#include "memory.h"
+#include "stream.h"
+#include "zclient.h"
+#include "zring.h"
+
+/* Each ring carries zserv messages one way as a stream of bytes, with
+   a single writer and a single reader.  Head and tail count the bytes
+   ever written and read, and only grow.  A side which finds the ring
+   empty, or full, raises its flag; the other side clears it when it
+   has written, or read, and tells the first to look again.  Both
+   offsets are checked against the size of the ring before being
+   used, as the other side may be broken. */
+#define ZRING_MAGIC       0x5a52494e /* "ZRIN" */
+#define ZRING_VERSION     1
+#define ZRING_CACHELINE   64
+
+struct zring_header
+{
+  u_int32_t magic;
+  u_int32_t version;
+  u_int32_t size;
+  u_char pad[ZRING_CACHELINE - 12];
+};
+
+struct zring
+{
+  /* Written by the writer, and the flag it raises when full. */
+  volatile u_int32_t head;
+  volatile u_int32_t full;
+  u_char pad1[ZRING_CACHELINE - 8];
+
+  /* Written by the reader, and the flag it raises when empty. */
+  volatile u_int32_t tail;
+  volatile u_int32_t empty;
+  u_char pad2[ZRING_CACHELINE - 8];
+};
+#define ZRING_DATA(R) ((u_char *) ((R) + 1))
+
+/* The ring from the client to zebra comes first. */
+#define ZRING_LEN(S) \
+  (sizeof (struct zring_header) + 2 * (sizeof (struct zring) + (S)))
+#define ZRING_NTH(B,S,N) \
+  ((struct zring *) ((u_char *) (B) + sizeof (struct zring_header) \
+		     + (N) * (sizeof (struct zring) + (S))))
+
+#define zring_barrier() __sync_synchronize ()
+
+static struct zring_map *
+zring_map_new (void *base, size_t len, u_int32_t size, const char *name,
+	       int client)
+{
+  struct zring_map *map;
+
+  map = XCALLOC (MTYPE_ZRING, sizeof (struct zring_map));
+  map->base = base;
+  map->len = len;
+  map->size = size;
+  map->in = ZRING_NTH (base, size, client ? 1 : 0);
+  map->out = ZRING_NTH (base, size, client ? 0 : 1);
+  snprintf (map->name, ZRING_NAME_SIZE, "%s", name);
+  return map;
+}
+
+/* Create rings of the given size for a client, to be handed to zebra
+   by name. */
+struct zring_map *
+zring_create (u_int32_t size)
+{
+#ifdef HAVE_ZRING
+  static unsigned int seq;
+  char name[ZRING_NAME_SIZE];
+  struct zring_header *header;
+  void *base;
+  size_t len;
+  int fd;
+  int tries;
+
+  len = ZRING_LEN (size);
+  for (tries = 0; tries < 8; tries++)
+    {
+      snprintf (name, sizeof (name), "/quagga-zring-%d-%u",
+		(int) getpid (), seq++);
+      fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd >= 0 || errno != EEXIST)
+	break;
+    }
+  if (fd < 0)
+    {
+      zlog_warn ("%s: shm_open failed: %s", __func__, safe_strerror (errno));
+      return NULL;
+    }
+
+  if (ftruncate (fd, len) < 0)
+    {
+      zlog_warn ("%s: ftruncate of %s failed: %s", __func__, name,
+		 safe_strerror (errno));
+      close (fd);
+      shm_unlink (name);
+      return NULL;
+    }
+  base = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    {
+      zlog_warn ("%s: mmap of %s failed: %s", __func__, name,
+		 safe_strerror (errno));
+      shm_unlink (name);
+      return NULL;
+    }
+
+  /* The memory comes zeroed.  Readers start out waiting, so that the
+     first message written tells them to look. */
+  header = base;
+  header->magic = ZRING_MAGIC;
+  header->version = ZRING_VERSION;
+  header->size = size;
+  ZRING_NTH (base, size, 0)->empty = 1;
+  ZRING_NTH (base, size, 1)->empty = 1;
+
+  return zring_map_new (base, len, size, name, 1);
+#else
+  return NULL;
+#endif /* HAVE_ZRING */
+}
+
+/* Map the rings a client created, for zebra.  The name is removed at
+   once, so that nothing else can map them. */
+struct zring_map *
+zring_attach (const char *name, u_int32_t size)
+{
+#ifdef HAVE_ZRING
+  struct zring_header *header;
+  struct stat st;
+  void *base;
+  size_t len;
+  int fd;
+
+  if (size < ZRING_SIZE_MIN || size > ZRING_SIZE_MAX || (size & (size - 1))
+      || strncmp (name, "/quagga-zring-", 14) || strchr (name + 1, '/'))
+    {
+      zlog_warn ("%s: refusing ring %s of %u bytes", __func__, name, size);
+      return NULL;
+    }
+
+  len = ZRING_LEN (size);
+  fd = shm_open (name, O_RDWR, 0);
+  if (fd < 0)
+    {
+      zlog_warn ("%s: shm_open of %s failed: %s", __func__, name,
+		 safe_strerror (errno));
+      return NULL;
+    }
+  shm_unlink (name);
+
+  if (fstat (fd, &st) < 0 || st.st_size != (off_t) len)
+    {
+      zlog_warn ("%s: ring %s is not %lu bytes long", __func__, name,
+		 (u_long) len);
+      close (fd);
+      return NULL;
+    }
+  base = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    {
+      zlog_warn ("%s: mmap of %s failed: %s", __func__, name,
+		 safe_strerror (errno));
+      return NULL;
+    }
+
+  header = base;
+  if (header->magic != ZRING_MAGIC || header->version != ZRING_VERSION
+      || header->size != size)
+    {
+      zlog_warn ("%s: ring %s has a bad header", __func__, name);
+      munmap (base, len);
+      return NULL;
+    }
+
+  return zring_map_new (base, len, size, name, 0);
+#else
+  return NULL;
+#endif /* HAVE_ZRING */
+}
+
+/* Remove the name of the rings, once zebra has mapped them or given
+   up doing so. */
+void
+zring_unlink (struct zring_map *map)
+{
+#ifdef HAVE_ZRING
+  shm_unlink (map->name);
+#endif /* HAVE_ZRING */
+}
+
+void
+zring_free (struct zring_map *map)
+{
+#ifdef HAVE_ZRING
+  munmap (map->base, map->len);
+#endif /* HAVE_ZRING */
+  XFREE (MTYPE_ZRING, map);
+}
+
+/* Write as much of buf as there is room for, like write(2) on a
+   non-blocking socket.  When it all does not fit, the reader is asked
+   to say when it has made room.  Returns -1 if the ring is broken. */
+ssize_t
+zring_write (struct zring_map *map, const void *buf, size_t len)
+{
+  struct zring *r = map->out;
+  u_int32_t mask = map->size - 1;
+  u_int32_t head, tail, used;
+  size_t done = 0;
+  size_t n, first;
+
+  for (;;)
+    {
+      head = r->head;
+      tail = r->tail;
+      zring_barrier ();
+
+      used = head - tail;
+      if (used > map->size)
+	{
+	  errno = EINVAL;
+	  return -1;
+	}
+
+      n = MIN (len - done, map->size - used);
+      first = MIN (n, map->size - (head & mask));
+      memcpy (ZRING_DATA (r) + (head & mask), (const u_char *) buf + done,
+	      first);
+      memcpy (ZRING_DATA (r), (const u_char *) buf + done + first, n - first);
+
+      zring_barrier ();
+      r->head = head + n;
+      done += n;
+      if (done == len)
+	break;
+
+      /* Full.  Raise the flag, then look again in case the reader made
+	 room meanwhile and will not be told. */
+      r->full = 1;
+      zring_barrier ();
+      if (r->tail == tail)
+	break;
+      __sync_bool_compare_and_swap (&r->full, 1, 0);
+    }
+  return done;
+}
+
+/* The length of the next message, if all of it is there to be read,
+   0 if not, -1 if the ring or the message are broken.  When there is
+   no message, the writer is asked to say when there is one. */
+int
+zring_msg_peek (struct zring_map *map)
+{
+  struct zring *r = map->in;
+  u_int32_t mask = map->size - 1;
+  u_int32_t head, tail, avail;
+  u_int16_t length;
+
+  for (;;)
+    {
+      tail = r->tail;
+      head = r->head;
+      zring_barrier ();
+
+      avail = head - tail;
+      if (avail > map->size)
+	return -1;
+      if (avail >= ZEBRA_HEADER_SIZE)
+	{
+	  length = ZRING_DATA (r)[tail & mask] << 8;
+	  length |= ZRING_DATA (r)[(tail + 1) & mask];
+	  if (length < ZEBRA_HEADER_SIZE)
+	    return -1;
+	  if (avail >= length)
+	    return length;
+	}
+
+      r->empty = 1;
+      zring_barrier ();
+      if (r->head == head)
+	return 0;
+      __sync_bool_compare_and_swap (&r->empty, 1, 0);
+    }
+}
+
+/* Read the next message, of the length zring_msg_peek() found, into
+   the stream. */
+void
+zring_msg_get (struct zring_map *map, struct stream *s, u_int16_t length)
+{
+  struct zring *r = map->in;
+  u_int32_t mask = map->size - 1;
+  u_int32_t tail;
+  size_t first;
+
+  tail = r->tail;
+  first = MIN (length, map->size - (tail & mask));
+
+  stream_reset (s);
+  memcpy (STREAM_DATA (s), ZRING_DATA (r) + (tail & mask), first);
+  memcpy (STREAM_DATA (s) + first, ZRING_DATA (r), length - first);
+  stream_forward_endp (s, length);
+
+  zring_barrier ();
+  r->tail = tail + length;
+}
+
+/* After writing, whether the reader waits to be told. */
+int
+zring_kick_reader (struct zring_map *map)
+{
+  zring_barrier ();
+  return map->out->empty
+    && __sync_bool_compare_and_swap (&map->out->empty, 1, 0);
+}
+
+/* After reading, whether the writer waits for room. */
+int
+zring_kick_writer (struct zring_map *map)
+{
+  zring_barrier ();
+  return map->in->full
+    && __sync_bool_compare_and_swap (&map->in->full, 1, 0);
+}
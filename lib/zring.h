@@ -0,0 +1,69 @@
+/* Shared memory rings between zebra and its clients.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef _QUAGGA_ZRING_H
+#define _QUAGGA_ZRING_H
+
+/* Clients reaching zebra over TCP may run on another host. */
+#if defined (HAVE_SHM_OPEN) && ! defined (HAVE_TCP_ZEBRA)
+#define HAVE_ZRING
+#endif
+
+/* Bytes each way.  A ring holds at least one message of the largest
+   size, so that a full ring always has a message to read. */
+#define ZRING_SIZE_DEFAULT (1 << 21)
+#define ZRING_SIZE_MIN     (1 << 17)
+#define ZRING_SIZE_MAX     (1 << 26)
+
+#define ZRING_NAME_SIZE    64
+
+struct zring;
+struct stream;
+
+/* A mapping of the two rings a client and zebra share, one for each
+   way, as seen by one of them. */
+struct zring_map
+{
+  void *base;
+  size_t len;
+
+  /* Bytes in each ring, as checked when mapped. */
+  u_int32_t size;
+
+  /* The ring read from and the one written to. */
+  struct zring *in;
+  struct zring *out;
+
+  char name[ZRING_NAME_SIZE];
+};
+
+extern struct zring_map *zring_create (u_int32_t size);
+extern struct zring_map *zring_attach (const char *name, u_int32_t size);
+extern void zring_unlink (struct zring_map *);
+extern void zring_free (struct zring_map *);
+
+extern ssize_t zring_write (struct zring_map *, const void *, size_t);
+extern int zring_msg_peek (struct zring_map *);
+extern void zring_msg_get (struct zring_map *, struct stream *, u_int16_t);
+
+extern int zring_kick_reader (struct zring_map *);
+extern int zring_kick_writer (struct zring_map *);
+
+#endif /* _QUAGGA_ZRING_H */
@@ -611,30 +611,34 @@ struct compare_tests
 #define CMP_RES_NO 0
   char shouldbe_cmp;
   char shouldbe_confed;
+  /* whether aspath_left_as puts both in the same MED group */
+  char shouldbe_group;
 } left_compare [] =
 {
-  { 0, 1, CMP_RES_NO, CMP_RES_NO },
-  { 0, 2, CMP_RES_YES, CMP_RES_NO },
-  { 0, 11, CMP_RES_YES, CMP_RES_NO },
-  { 0, 15, CMP_RES_YES, CMP_RES_NO },
-  { 0, 16, CMP_RES_NO, CMP_RES_NO },
-  { 1, 11, CMP_RES_NO, CMP_RES_NO },
-  { 6, 7, CMP_RES_NO, CMP_RES_YES },
-  { 6, 8, CMP_RES_NO, CMP_RES_NO },
-  { 7, 8, CMP_RES_NO, CMP_RES_NO },
-  { 1, 9, CMP_RES_YES, CMP_RES_NO },
-  { 0, 9, CMP_RES_NO, CMP_RES_NO },
-  { 3, 9, CMP_RES_NO, CMP_RES_NO },
-  { 0, 6, CMP_RES_NO, CMP_RES_NO },
-  { 1, 6, CMP_RES_NO, CMP_RES_NO },
-  { 0, 8, CMP_RES_NO, CMP_RES_NO },
-  { 1, 8, CMP_RES_NO, CMP_RES_NO },
-  { 11, 6, CMP_RES_NO, CMP_RES_NO },
-  { 11, 7, CMP_RES_NO, CMP_RES_NO },
-  { 11, 8, CMP_RES_NO, CMP_RES_NO },
-  { 9, 6, CMP_RES_NO, CMP_RES_YES },
-  { 9, 7, CMP_RES_NO, CMP_RES_YES },
-  { 9, 8, CMP_RES_NO, CMP_RES_NO },
+  { 0, 1, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 0, 2, CMP_RES_YES, CMP_RES_NO, CMP_RES_YES },
+  { 0, 11, CMP_RES_YES, CMP_RES_NO, CMP_RES_YES },
+  { 0, 15, CMP_RES_YES, CMP_RES_NO, CMP_RES_YES },
+  { 0, 16, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 1, 11, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 6, 7, CMP_RES_NO, CMP_RES_YES, CMP_RES_YES },
+  { 6, 8, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 7, 8, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 1, 9, CMP_RES_YES, CMP_RES_NO, CMP_RES_YES },
+  { 0, 9, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 3, 9, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 0, 6, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 1, 6, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 0, 8, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 1, 8, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 11, 6, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 11, 7, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 11, 8, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 9, 6, CMP_RES_NO, CMP_RES_YES, CMP_RES_NO },
+  { 9, 7, CMP_RES_NO, CMP_RES_YES, CMP_RES_NO },
+  { 9, 8, CMP_RES_NO, CMP_RES_NO, CMP_RES_NO },
+  { 9, 20, CMP_RES_NO, CMP_RES_YES, CMP_RES_NO },
+  { 5, 20, CMP_RES_YES, CMP_RES_NO, CMP_RES_YES },
 };
 
 /* make an aspath from a data stream */
@@ -960,6 +964,8 @@ cmp_test ()
       struct test_segment *t1 = &test_segments[left_compare[i].test_index1];
       struct test_segment *t2 = &test_segments[left_compare[i].test_index2];
       struct aspath *asp1, *asp2;
+      as_t as1, as2;
+      int type1, type2, same;
       
       printf ("left cmp %s: %s\n", t1->name, t1->desc);
       printf ("and %s: %s\n", t2->name, t2->desc);
@@ -967,7 +973,12 @@ cmp_test ()
       asp1 = make_aspath (t1->asdata, t1->len, 0);
       asp2 = make_aspath (t2->asdata, t2->len, 0);
       
+      type1 = aspath_left_as (asp1, &as1);
+      type2 = aspath_left_as (asp2, &as2);
+      same = (type1 && type1 == type2 && as1 == as2);
+      
       if (aspath_cmp_left (asp1, asp2) != left_compare[i].shouldbe_cmp
+          || same != left_compare[i].shouldbe_group
           || aspath_cmp_left (asp2, asp1) != left_compare[i].shouldbe_cmp
           || aspath_cmp_left_confed (asp1, asp2) 
                != left_compare[i].shouldbe_confed
@@ -976,12 +987,13 @@ cmp_test ()
         {
           failed++;
           printf (FAILED "\n");
-          printf ("result should be: cmp: %d, confed: %d\n", 
+          printf ("result should be: cmp: %d, confed: %d, group: %d\n", 
                   left_compare[i].shouldbe_cmp,
-                  left_compare[i].shouldbe_confed);
-          printf ("got: cmp %d, cmp_confed: %d\n",
+                  left_compare[i].shouldbe_confed,
+                  left_compare[i].shouldbe_group);
+          printf ("got: cmp %d, cmp_confed: %d, group: %d\n",
                   aspath_cmp_left (asp1, asp2),
-                  aspath_cmp_left_confed (asp1, asp2));
+                  aspath_cmp_left_confed (asp1, asp2), same);
           printf("path1: %s\npath2: %s\n", aspath_print (asp1),
                  aspath_print (asp2));
         }
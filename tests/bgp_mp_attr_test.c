@@ -490,6 +490,7 @@ int
 main (void)
 {
   struct peer *peer;
+  union sockunion su;
   int i, j;
   
   conf_bgp_debug_fsm = -1UL;
@@ -512,7 +513,8 @@ main (void)
   if (bgp_get (&bgp, &asn, NULL))
     return -1;
   
-  peer = peer_create_accept (bgp);
+  memset (&su, 0, sizeof (union sockunion));
+  peer = peer_create_accept (bgp, &su);
   peer->host = "foo";
   
   for (i = AFI_IP; i < AFI_MAX; i++)
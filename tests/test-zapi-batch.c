@@ -0,0 +1,328 @@
+#include <zebra.h>
+
+#include "stream.h"
+#include "thread.h"
+#include "zclient.h"
+
+/* need this to link in zclient */
+struct thread_master *master = NULL;
+
+static int failed = 0;
+
+#define ROUTE_SIZE 128
+
+/* Build an IPv4 route message the way zapi_ipv4_route does. */
+static struct stream *
+route_new (u_int16_t command, u_char type, u_char message,
+           u_int32_t prefix, u_char prefixlen, u_int32_t metric,
+           long sec, long usec)
+{
+  struct stream *s;
+  struct in_addr addr;
+
+  s = stream_new (ROUTE_SIZE);
+  zclient_create_header (s, command);
+  stream_putc (s, type);
+  stream_putc (s, 0);
+  stream_putc (s, message);
+
+  addr.s_addr = htonl (prefix);
+  stream_putc (s, prefixlen);
+  stream_write (s, (u_char *) &addr, PSIZE (prefixlen));
+
+  stream_putc (s, 1);
+  stream_putc (s, ZEBRA_NEXTHOP_IPV4);
+  stream_put_ipv4 (s, htonl (0x0a000001));
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
+    stream_putl (s, metric);
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_TIMESTAMP))
+    {
+      stream_putl (s, sec);
+      stream_putl (s, usec);
+    }
+  stream_putw_at (s, 0, stream_get_endp (s));
+  return s;
+}
+
+static void
+check (int ok, const char *what)
+{
+  if (ok)
+    return;
+  printf ("  %s: failed\n", what);
+  failed++;
+}
+
+/* Take the batch apart and compare each route message with the ones
+   that went into it. */
+static void
+unbatch (struct stream *batch, struct stream **routes, int num)
+{
+  struct zapi_batch zb;
+  struct stream *route;
+  int i;
+
+  route = stream_new (ROUTE_SIZE);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (stream_getw_from (batch, 4) == ZEBRA_ROUTE_BATCH, "batch command");
+  check (zapi_batch_read (batch, &zb) == 0, "batch read");
+  check (zb.count == num, "batch count");
+
+  for (i = 0; i < num; i++)
+    {
+      if (zapi_batch_route (batch, &zb, route) < 0)
+        {
+          check (0, "batch route");
+          break;
+        }
+      check (stream_get_endp (route) == stream_get_endp (routes[i])
+             && ! memcmp (STREAM_DATA (route), STREAM_DATA (routes[i]),
+                          stream_get_endp (route)), "route same");
+      check (stream_get_getp (route) == ZEBRA_HEADER_SIZE, "route getp");
+    }
+  check (zapi_batch_route (batch, &zb, route) < 0, "end of batch");
+  check (STREAM_READABLE (batch) == 0, "batch consumed");
+  stream_free (route);
+}
+
+/* The first len bytes of the batch, ready to be read. */
+static struct stream *
+truncated (struct stream *batch, size_t len)
+{
+  struct stream *s;
+
+  s = stream_new (len);
+  stream_put (s, STREAM_DATA (batch), len);
+  stream_set_getp (s, ZEBRA_HEADER_SIZE);
+  return s;
+}
+
+static void
+routes_free (struct stream **routes, int num)
+{
+  int i;
+
+  for (i = 0; i < num; i++)
+    stream_free (routes[i]);
+}
+
+/* Routes sharing their attributes go in one batch, each with its own
+   prefix and timestamp. */
+static void
+test_roundtrip (u_char message)
+{
+  struct stream *batch;
+  struct stream *routes[8];
+  int i;
+
+  printf ("roundtrip, %s timestamps\n",
+          CHECK_FLAG (message, ZAPI_MESSAGE_TIMESTAMP) ? "with" : "without");
+  batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  for (i = 0; i < 8; i++)
+    {
+      routes[i] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                             0x14000000 + (i << 8), 24 + i, 20,
+                             1000 + i, 999990 + i);
+      check (zapi_batch_add (batch, routes[i]) == 1, "add");
+    }
+  unbatch (batch, routes, 8);
+  routes_free (routes, 8);
+  stream_free (batch);
+}
+
+/* A route which does not share the batch's command, type or attributes
+   is refused, leaving the batch as it was, and starts the next one. */
+static void
+test_mismatch (void)
+{
+  struct stream *batch;
+  struct stream *routes[2];
+  struct stream *other[4];
+  u_char message = ZAPI_MESSAGE_NEXTHOP | ZAPI_MESSAGE_METRIC
+                   | ZAPI_MESSAGE_TIMESTAMP;
+  size_t endp;
+  int i;
+
+  printf ("attribute mismatch\n");
+  batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  routes[0] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                         0x14000000, 24, 20, 1, 2);
+  routes[1] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                         0x14000100, 24, 20, 3, 4);
+  other[0] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                        0x14000200, 24, 30, 5, 6);
+  other[1] = route_new (ZEBRA_IPV4_ROUTE_DELETE, ZEBRA_ROUTE_BGP, message,
+                        0x14000200, 24, 20, 5, 6);
+  other[2] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_OSPF, message,
+                        0x14000200, 24, 20, 5, 6);
+  other[3] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP,
+                        message & ~ZAPI_MESSAGE_TIMESTAMP,
+                        0x14000200, 24, 20, 5, 6);
+
+  check (zapi_batch_add (batch, routes[0]) == 1, "add");
+  check (zapi_batch_add (batch, routes[1]) == 1, "add");
+  endp = stream_get_endp (batch);
+  for (i = 0; i < 4; i++)
+    {
+      check (zapi_batch_add (batch, other[i]) == 0, "mismatch refused");
+      check (stream_get_endp (batch) == endp, "batch untouched");
+    }
+  unbatch (batch, routes, 2);
+
+  /* Flushed, the refused route starts a batch of its own. */
+  stream_reset (batch);
+  check (zapi_batch_add (batch, other[0]) == 1, "add after flush");
+  unbatch (batch, other, 1);
+
+  routes_free (routes, 2);
+  routes_free (other, 4);
+  stream_free (batch);
+}
+
+/* Routes are refused once the batch has no room left for them, and a
+   route too big for an empty batch is not started. */
+static void
+test_full (void)
+{
+  struct stream *batch;
+  struct stream *routes[16];
+  u_char message = ZAPI_MESSAGE_NEXTHOP | ZAPI_MESSAGE_TIMESTAMP;
+  size_t entry;
+  int num;
+
+  printf ("full batch\n");
+  /* Head, 6 bytes of nexthop, count, and 3 /24 entries of 12 bytes. */
+  entry = 1 + 3 + 8;
+  batch = stream_new (ZEBRA_HEADER_SIZE + 7 + 6 + 2 + 3 * entry);
+  for (num = 0; num < 16; num++)
+    {
+      routes[num] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                               0x14000000 + (num << 8), 24, 0, num, 0);
+      if (! zapi_batch_add (batch, routes[num]))
+        break;
+    }
+  check (num == 3, "routes fitting");
+  check (STREAM_WRITEABLE (batch) == 0, "batch filled");
+  unbatch (batch, routes, num);
+
+  if (num < 16)
+    {
+      stream_reset (batch);
+      check (zapi_batch_add (batch, routes[num]) == 1, "add after flush");
+      num++;
+    }
+  routes_free (routes, num);
+
+  stream_free (batch);
+  batch = stream_new (ZEBRA_HEADER_SIZE + 8);
+  routes[0] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                         0x14000000, 24, 0, 0, 0);
+  check (zapi_batch_add (batch, routes[0]) == 0, "too big refused");
+  check (stream_get_endp (batch) == 0, "batch not started");
+  stream_free (routes[0]);
+  stream_free (batch);
+}
+
+/* Batches whose head, count or prefixes do not match their length are
+   refused rather than read past. */
+static void
+test_malformed (void)
+{
+  struct stream *batch;
+  struct stream *route;
+  struct stream *routes[2];
+  struct stream *cut;
+  struct zapi_batch zb;
+  u_char message = ZAPI_MESSAGE_NEXTHOP | ZAPI_MESSAGE_TIMESTAMP;
+  size_t countp, endp;
+  int i;
+
+  printf ("malformed batch\n");
+  batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  route = stream_new (ROUTE_SIZE);
+  for (i = 0; i < 2; i++)
+    {
+      routes[i] = route_new (ZEBRA_IPV4_ROUTE_ADD, ZEBRA_ROUTE_BGP, message,
+                             0x14000000 + (i << 8), 24, 0, i, 0);
+      zapi_batch_add (batch, routes[i]);
+    }
+  endp = stream_get_endp (batch);
+  countp = ZEBRA_HEADER_SIZE + 7 + 6;
+
+  /* Count claiming more prefixes than there are. */
+  stream_putw_at (batch, countp, 3);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (zapi_batch_read (batch, &zb) == 0, "read");
+  check (zapi_batch_route (batch, &zb, route) == 0, "route 1");
+  check (zapi_batch_route (batch, &zb, route) == 0, "route 2");
+  check (zapi_batch_route (batch, &zb, route) < 0, "count past end");
+
+  /* Last prefix cut short, in its address and in its timestamp. */
+  stream_putw_at (batch, countp, 2);
+  for (i = 1; i < 12; i++)
+    {
+      cut = truncated (batch, endp - i);
+      check (zapi_batch_read (cut, &zb) == 0, "read");
+      check (zapi_batch_route (cut, &zb, route) == 0, "route 1");
+      check (zapi_batch_route (cut, &zb, route) < 0, "truncated prefix");
+      stream_free (cut);
+    }
+
+  /* Head cut short before the count, or before the attributes. */
+  for (i = ZEBRA_HEADER_SIZE; i < (int) countp + 2; i++)
+    {
+      cut = truncated (batch, i);
+      check (zapi_batch_read (cut, &zb) < 0, "truncated head");
+      stream_free (cut);
+    }
+
+  /* Attribute length past the end. */
+  stream_putw_at (batch, ZEBRA_HEADER_SIZE + 5, 0x1000);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (zapi_batch_read (batch, &zb) < 0, "attribute length");
+  stream_putw_at (batch, ZEBRA_HEADER_SIZE + 5, 6);
+
+  /* Not a route command. */
+  stream_putw_at (batch, ZEBRA_HEADER_SIZE, ZEBRA_ROUTER_ID_ADD);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (zapi_batch_read (batch, &zb) < 0, "command");
+  stream_putw_at (batch, ZEBRA_HEADER_SIZE, ZEBRA_IPV4_ROUTE_ADD);
+
+  /* Prefix too long for the family. */
+  stream_putc_at (batch, countp + 2, 33);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (zapi_batch_read (batch, &zb) == 0, "read");
+  check (zapi_batch_route (batch, &zb, route) < 0, "prefix length");
+
+  /* Route stream too small for the rebuilt message. */
+  stream_putc_at (batch, countp + 2, 24);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (zapi_batch_read (batch, &zb) == 0, "read");
+  stream_free (route);
+  route = stream_new (ZEBRA_HEADER_SIZE + 8);
+  check (zapi_batch_route (batch, &zb, route) < 0, "route stream size");
+
+  /* No prefix at all. */
+  stream_putw_at (batch, countp, 0);
+  stream_set_getp (batch, ZEBRA_HEADER_SIZE);
+  check (zapi_batch_read (batch, &zb) == 0, "read");
+  check (zapi_batch_route (batch, &zb, route) < 0, "empty count");
+
+  routes_free (routes, 2);
+  stream_free (route);
+  stream_free (batch);
+}
+
+int
+main (void)
+{
+  test_roundtrip (ZAPI_MESSAGE_NEXTHOP | ZAPI_MESSAGE_METRIC);
+  test_roundtrip (ZAPI_MESSAGE_NEXTHOP | ZAPI_MESSAGE_METRIC
+                  | ZAPI_MESSAGE_TIMESTAMP);
+  test_mismatch ();
+  test_full ();
+  test_malformed ();
+
+  printf ("failures: %d\n", failed);
+  return failed;
+}
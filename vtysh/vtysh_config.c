@@ -246,6 +246,9 @@ vtysh_config_parse_line (const char *line)
 	config = config_get (AAA_NODE, line);
       else if (strncmp (line, "ip protocol", strlen ("ip protocol")) == 0)
 	config = config_get (PROTOCOL_NODE, line);
+      else if (strncmp (line, "client-", strlen ("client-")) == 0
+	       || strncmp (line, "no client-", strlen ("no client-")) == 0)
+	config = config_get (ZSERV_NODE, line);
       else
 	{
 	  if (strncmp (line, "log", strlen ("log")) == 0
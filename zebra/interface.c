@@ -107,6 +107,8 @@ if_zebra_delete_hook (struct interface *ifp)
       if (zebra_if->ipv4_subnets)
 	route_table_finish (zebra_if->ipv4_subnets);
 
+      THREAD_TIMER_OFF (zebra_if->t_rib_hold);
+
       XFREE (MTYPE_TMP, zebra_if);
     }
 
@@ -501,6 +503,10 @@ if_up (struct interface *ifp)
   /* Notify the protocol daemons. */
   zebra_interface_up_update (ifp);
 
+  /* Examine the routes through the interface, unless held back while
+     it keeps flapping. */
+  rib_update_interface (ifp, 1);
+
   /* Install connected routes to the kernel. */
   if (ifp->connected)
     {
@@ -516,9 +522,6 @@ if_up (struct interface *ifp)
 #endif /* HAVE_IPV6 */
 	}
     }
-
-  /* Examine all static routes. */
-  rib_update ();
 }
 
 /* Interface goes down.  We have to manage different behavior of based
@@ -550,8 +553,8 @@ if_down (struct interface *ifp)
 	}
     }
 
-  /* Examine all static routes which direct to the interface. */
-  rib_update ();
+  /* Examine the routes through the interface. */
+  rib_update_interface (ifp, 0);
 }
 
 void
@@ -728,6 +731,11 @@ if_dump_vty (struct vty *vty, struct interface *ifp)
     }
 #endif /* HAVE_STRUCT_SOCKADDR_DL */
   
+  if (zebra_if->t_rib_hold)
+    vty_out (vty, "  flapped %u times, routes held back for %lu seconds%s",
+	     zebra_if->flaps, thread_timer_remain_second (zebra_if->t_rib_hold),
+	     VTY_NEWLINE);
+
   /* Bandwidth in kbps */
   if (ifp->bandwidth != 0)
     {
@@ -197,6 +197,12 @@ struct zebra_if
   /* Installed addresses chains tree. */
   struct route_table *ipv4_subnets;
 
+  /* Flaps in a row, the time of the last one, and the timer holding
+     back the routes through the interface until it settles. */
+  unsigned int flaps;
+  time_t flap_time;
+  struct thread *t_rib_hold;
+
 #ifdef RTADV
   struct rtadvconf rtadv;
 #endif /* RTADV */
@@ -19,6 +19,8 @@ int kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
 int kernel_add_route (struct prefix_ipv4 *a, struct in_addr *b, int c, int d)
 { return 0; }
 
+void kernel_flush (void) { return; }
+
 int kernel_address_add_ipv4 (struct interface *a, struct connected *b)
 {
   zlog_debug ("%s", __func__);
@@ -84,6 +84,163 @@ is_default (struct prefix *p)
   return 0;
 }
 
+/* Routes held back from a client while its output queue drains: the
+   first withdrawal of each route type, the route now selected is sent
+   when it is released. */
+struct redist_held
+{
+  u_int32_t types;
+  struct stream *withdraw;
+};
+
+static void
+redistribute_hold (int cmd, struct zserv *client, struct prefix *p,
+		   struct rib *rib)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct redist_held *held;
+  struct stream *s;
+  afi_t afi;
+
+  afi = family2afi (p->family);
+  table = client->redist_pending[afi];
+  if (! table)
+    table = client->redist_pending[afi] = route_table_init ();
+
+  rn = route_node_get (table, p);
+  if (rn->info)
+    route_unlock_node (rn);
+  else
+    rn->info = XCALLOC (MTYPE_REDIST_HELD, sizeof (struct redist_held));
+  held = rn->info;
+
+  if ((cmd != ZEBRA_IPV4_ROUTE_DELETE && cmd != ZEBRA_IPV6_ROUTE_DELETE)
+      || CHECK_FLAG (held->types, 1 << rib->type))
+    return;
+
+  SET_FLAG (held->types, 1 << rib->type);
+  zserv_route_encode (cmd, client, p, rib);
+  if (! held->withdraw)
+    held->withdraw = stream_new (stream_get_endp (client->obuf));
+  s = held->withdraw;
+  if (STREAM_WRITEABLE (s) < stream_get_endp (client->obuf))
+    stream_resize (s, stream_get_size (s) + stream_get_endp (client->obuf));
+  stream_put (s, STREAM_DATA (client->obuf), stream_get_endp (client->obuf));
+}
+
+static void
+redistribute_held_free (struct redist_held *held)
+{
+  if (held->withdraw)
+    stream_free (held->withdraw);
+  XFREE (MTYPE_REDIST_HELD, held);
+}
+
+/* Send the withdrawals held back for a prefix, then the route selected
+   for it now. */
+static void
+redistribute_release (struct zserv *client, struct route_node *rn)
+{
+  struct redist_held *held = rn->info;
+  struct route_table *table;
+  struct route_node *node;
+  struct stream *s;
+  struct rib *rib;
+  size_t getp;
+  u_int16_t length;
+
+  if ((s = held->withdraw))
+    for (getp = 0; getp < stream_get_endp (s); getp += length)
+      {
+	length = stream_getw_from (s, getp);
+	stream_reset (client->obuf);
+	stream_put (client->obuf, STREAM_DATA (s) + getp, length);
+	zserv_route_send (client);
+      }
+
+  table = vrf_table (family2afi (rn->p.family), SAFI_UNICAST, 0);
+  if (! table || ! (node = route_node_lookup (table, &rn->p)))
+    return;
+  for (rib = node->info; rib; rib = rib->next)
+    if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
+	&& rib->distance != DISTANCE_INFINITY
+	&& (client->redist[rib->type]
+	    || (is_default (&rn->p) && client->redist_default))
+	&& zebra_check_addr (&rn->p))
+      zsend_route_multipath (rn->p.family == AF_INET ?
+			     ZEBRA_IPV4_ROUTE_ADD : ZEBRA_IPV6_ROUTE_ADD,
+			     client, &rn->p, rib);
+  route_unlock_node (node);
+}
+
+/* Carry on with the routes held back from a client, as long as its
+   output queue keeps draining. */
+void
+redistribute_resume (struct zserv *client)
+{
+  struct route_node *rn;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    {
+      if (! client->redist_pending[afi])
+	continue;
+      for (rn = route_top (client->redist_pending[afi]); rn;
+	   rn = route_next (rn))
+	{
+	  if (! rn->info)
+	    continue;
+	  if (client->redist_held)
+	    {
+	      route_unlock_node (rn);
+	      return;
+	    }
+	  redistribute_release (client, rn);
+	  redistribute_held_free (rn->info);
+	  rn->info = NULL;
+	  route_unlock_node (rn);
+	}
+      route_table_finish (client->redist_pending[afi]);
+      client->redist_pending[afi] = NULL;
+    }
+}
+
+/* Forget the routes held back from a client going away. */
+void
+redistribute_finish (struct zserv *client)
+{
+  struct route_node *rn;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    {
+      if (! client->redist_pending[afi])
+	continue;
+      for (rn = route_top (client->redist_pending[afi]); rn;
+	   rn = route_next (rn))
+	if (rn->info)
+	  {
+	    redistribute_held_free (rn->info);
+	    rn->info = NULL;
+	  }
+      route_table_finish (client->redist_pending[afi]);
+      client->redist_pending[afi] = NULL;
+    }
+}
+
+/* Send a route to a client, or hold it back while the client is slow
+   to read what it was sent already. */
+static void
+redistribute_send (int cmd, struct zserv *client, struct prefix *p,
+		   struct rib *rib)
+{
+  if (client->redist_held || client->redist_pending[family2afi (p->family)])
+    redistribute_hold (cmd, client, p, rib);
+  else
+    zsend_route_multipath (cmd, client, p, rib);
+}
+
 static void
 zebra_redistribute_default (struct zserv *client)
 {
@@ -110,7 +267,7 @@ zebra_redistribute_default (struct zserv *client)
 	  for (newrib = rn->info; newrib; newrib = newrib->next)
 	    if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
 		&& newrib->distance != DISTANCE_INFINITY)
-	      zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
+	      redistribute_send (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
 	  route_unlock_node (rn);
 	}
     }
@@ -130,7 +287,7 @@ zebra_redistribute_default (struct zserv *client)
 	  for (newrib = rn->info; newrib; newrib = newrib->next)
 	    if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
 		&& newrib->distance != DISTANCE_INFINITY)
-	      zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
+	      redistribute_send (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
 	  route_unlock_node (rn);
 	}
     }
@@ -153,7 +310,7 @@ zebra_redistribute (struct zserv *client, int type)
 	    && newrib->type == type 
 	    && newrib->distance != DISTANCE_INFINITY
 	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
+	  redistribute_send (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
   
 #ifdef HAVE_IPV6
   table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
@@ -164,7 +321,7 @@ zebra_redistribute (struct zserv *client, int type)
 	    && newrib->type == type 
 	    && newrib->distance != DISTANCE_INFINITY
 	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
+	  redistribute_send (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
 #endif /* HAVE_IPV6 */
 }
 
@@ -181,20 +338,20 @@ redistribute_add (struct prefix *p, struct rib *rib)
           if (client->redist_default || client->redist[rib->type])
             {
               if (p->family == AF_INET)
-                zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, p, rib);
+                redistribute_send (ZEBRA_IPV4_ROUTE_ADD, client, p, rib);
 #ifdef HAVE_IPV6
               if (p->family == AF_INET6)
-                zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
+                redistribute_send (ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
 #endif /* HAVE_IPV6 */	  
 	    }
         }
       else if (client->redist[rib->type])
         {
           if (p->family == AF_INET)
-            zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, p, rib);
+            redistribute_send (ZEBRA_IPV4_ROUTE_ADD, client, p, rib);
 #ifdef HAVE_IPV6
           if (p->family == AF_INET6)
-            zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
+            redistribute_send (ZEBRA_IPV6_ROUTE_ADD, client, p, rib);
 #endif /* HAVE_IPV6 */	  
         }
     }
@@ -217,22 +374,22 @@ redistribute_delete (struct prefix *p, struct rib *rib)
 	  if (client->redist_default || client->redist[rib->type])
 	    {
 	      if (p->family == AF_INET)
-		zsend_route_multipath (ZEBRA_IPV4_ROUTE_DELETE, client, p,
-				       rib);
+		redistribute_send (ZEBRA_IPV4_ROUTE_DELETE, client, p,
+				   rib);
 #ifdef HAVE_IPV6
 	      if (p->family == AF_INET6)
-		zsend_route_multipath (ZEBRA_IPV6_ROUTE_DELETE, client, p,
-				       rib);
+		redistribute_send (ZEBRA_IPV6_ROUTE_DELETE, client, p,
+				   rib);
 #endif /* HAVE_IPV6 */
 	    }
 	}
       else if (client->redist[rib->type])
 	{
 	  if (p->family == AF_INET)
-	    zsend_route_multipath (ZEBRA_IPV4_ROUTE_DELETE, client, p, rib);
+	    redistribute_send (ZEBRA_IPV4_ROUTE_DELETE, client, p, rib);
 #ifdef HAVE_IPV6
 	  if (p->family == AF_INET6)
-	    zsend_route_multipath (ZEBRA_IPV6_ROUTE_DELETE, client, p, rib);
+	    redistribute_send (ZEBRA_IPV6_ROUTE_DELETE, client, p, rib);
 #endif /* HAVE_IPV6 */
 	}
     }
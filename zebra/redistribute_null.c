@@ -14,6 +14,10 @@ void redistribute_add (struct prefix *a, struct rib *b)
 { return; }
 #pragma weak redistribute_delete = redistribute_add
 
+void redistribute_resume (struct zserv *a)
+{ return; }
+#pragma weak redistribute_finish = redistribute_resume
+
 void zebra_interface_up_update (struct interface *a)
 { return; }
 #pragma weak zebra_interface_down_update = zebra_interface_up_update
@@ -24,6 +24,8 @@
 #define _ZEBRA_RIB_H
 
 #include "prefix.h"
+#include "vty.h"
+#include "if.h"
 
 #define DISTANCE_INFINITY  255
 
@@ -81,6 +83,38 @@ struct rib
   u_char nexthop_num;
   u_char nexthop_active_num;
   u_char nexthop_fib_num;
+
+  /* Convergence timestamps, when the client sent them.  */
+  struct rib_stamp *stamp;
+
+  /* Interfaces and gateways the nexthops depend on.  */
+  struct rib_dep *deps;
+
+  /* Group sharing the nexthops, NULL while they are the entry's own.  */
+  struct nexthop_group *nhg;
+
+  /* Flags of each nexthop, in the order of the list.  They are the
+     state of the nexthops in this entry, so are kept here rather than
+     in the nexthops, which may be shared.  */
+  u_char *nexthop_flags;
+#define NEXTHOP_FLAG_ACTIVE     (1 << 0) /* This nexthop is alive. */
+#define NEXTHOP_FLAG_FIB        (1 << 1) /* FIB nexthop. */
+#define NEXTHOP_FLAG_RECURSIVE  (1 << 2) /* Recursive nexthop. */
+};
+
+/* Walk the nexthops of rib, flags pointing at the flags of each.
+ * Usage: for (ALL_RIB_NEXTHOPS (rib, nexthop, flags)) { ... }
+ */
+#define ALL_RIB_NEXTHOPS(rib,nh,fl) \
+  (nh) = (rib)->nexthop, (fl) = (rib)->nexthop_flags; \
+  (nh) != NULL; \
+  (nh) = (nh)->next, (fl)++
+
+/* Monotonic times a route was received by the client and by zebra.  */
+struct rib_stamp
+{
+  struct timeval origin;
+  struct timeval recv;
 };
 
 /* meta-queue structure:
@@ -183,11 +217,6 @@ struct nexthop
   
   enum nexthop_types_t type;
 
-  u_char flags;
-#define NEXTHOP_FLAG_ACTIVE     (1 << 0) /* This nexthop is alive. */
-#define NEXTHOP_FLAG_FIB        (1 << 1) /* FIB nexthop. */
-#define NEXTHOP_FLAG_RECURSIVE  (1 << 2) /* Recursive nexthop. */
-
   /* Nexthop address or interface name. */
   union g_addr gate;
 
@@ -261,7 +290,15 @@ extern struct rib *rib_match_ipv4 (struct in_addr);
 
 extern struct rib *rib_lookup_ipv4 (struct prefix_ipv4 *);
 
+extern void rib_nexthop_intern (struct rib *);
+extern void rib_nexthop_unshare (struct rib *);
+extern void rib_nexthop_group_vty (struct vty *);
 extern void rib_update (void);
+extern void rib_update_interface (struct interface *, int);
+extern void rib_update_connected (struct interface *, struct prefix *);
+extern void rib_stamp_received (struct rib *, struct timeval *);
+extern void rib_latency_vty (struct vty *);
+extern void rib_latency_reset (void);
 extern void rib_weed_tables (void);
 extern void rib_sweep_route (void);
 extern void rib_close (void);
@@ -281,6 +318,8 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 	      struct in6_addr *gate, unsigned int ifindex, u_int32_t vrf_id,
 	      u_int32_t metric, u_char distance);
 
+extern int rib_add_ipv6_multipath (struct prefix_ipv6 *, struct rib *);
+
 extern int
 rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 		 struct in6_addr *gate, unsigned int ifindex, u_int32_t vrf_id);
@@ -32,6 +32,7 @@ extern int kernel_delete_ipv4 (struct prefix *, struct rib *);
 extern int kernel_add_route (struct prefix_ipv4 *, struct in_addr *, int, int);
 extern int kernel_address_add_ipv4 (struct interface *, struct connected *);
 extern int kernel_address_delete_ipv4 (struct interface *, struct connected *);
+extern void kernel_flush (void);
 
 #ifdef HAVE_IPV6
 extern int kernel_add_ipv6 (struct prefix *, struct rib *);
@@ -41,4 +42,9 @@ extern int kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *ga
 
 #endif /* HAVE_IPV6 */
 
+#ifdef HAVE_NETLINK
+extern void kernel_fib_statistics (struct vty *);
+extern void kernel_fib_statistics_reset (void);
+#endif /* HAVE_NETLINK */
+
 #endif /* _ZEBRA_RT_H */
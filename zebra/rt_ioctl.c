@@ -170,6 +170,7 @@ kernel_ioctl_ipv4 (u_long cmd, struct prefix *p, struct rib *rib, int family)
   struct rtentry rtentry;
   struct sockaddr_in sin_dest, sin_mask, sin_gate;
   struct nexthop *nexthop;
+  u_char *flags;
   int nexthop_num = 0;
   struct interface *ifp;
 
@@ -188,8 +189,8 @@ kernel_ioctl_ipv4 (u_long cmd, struct prefix *p, struct rib *rib, int family)
       SET_FLAG (rtentry.rt_flags, RTF_REJECT);
 
       if (cmd == SIOCADDRT)
-	for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	  SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+	  SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
       goto skip;
     }
@@ -197,14 +198,14 @@ kernel_ioctl_ipv4 (u_long cmd, struct prefix *p, struct rib *rib, int family)
   memset (&sin_gate, 0, sizeof (struct sockaddr_in));
 
   /* Make gateway. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
       if ((cmd == SIOCADDRT 
-	   && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	   && CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	  || (cmd == SIOCDELRT
-	      && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)))
+	      && CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)))
 	{
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	    {
 	      if (nexthop->rtype == NEXTHOP_TYPE_IPV4 ||
 		  nexthop->rtype == NEXTHOP_TYPE_IPV4_IFINDEX)
@@ -250,7 +251,7 @@ kernel_ioctl_ipv4 (u_long cmd, struct prefix *p, struct rib *rib, int family)
 	    }
 
 	  if (cmd == SIOCADDRT)
-	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	    SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
 	  nexthop_num++;
 	  break;
@@ -431,6 +432,7 @@ kernel_ioctl_ipv6_multipath (u_long cmd, struct prefix *p, struct rib *rib,
   int sock;
   struct in6_rtmsg rtm;
   struct nexthop *nexthop;
+  u_char *flags;
   int nexthop_num = 0;
     
   memset (&rtm, 0, sizeof (struct in6_rtmsg));
@@ -456,14 +458,14 @@ kernel_ioctl_ipv6_multipath (u_long cmd, struct prefix *p, struct rib *rib,
   /* rtm.rtmsg_flags |= RTF_DYNAMIC; */
 
   /* Make gateway. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
       if ((cmd == SIOCADDRT 
-	   && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	   && CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	  || (cmd == SIOCDELRT
-	      && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)))
+	      && CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)))
 	{
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	    {
 	      if (nexthop->rtype == NEXTHOP_TYPE_IPV6
 		  || nexthop->rtype == NEXTHOP_TYPE_IPV6_IFNAME
@@ -500,7 +502,7 @@ kernel_ioctl_ipv6_multipath (u_long cmd, struct prefix *p, struct rib *rib,
 	    }
 
 	  if (cmd == SIOCADDRT)
-	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	    SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
 	  nexthop_num++;
 	  break;
@@ -558,3 +560,9 @@ kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
   return kernel_ioctl_ipv6 (SIOCDELRT, dest, gate, index, flags);
 }
 #endif /* HAVE_IPV6 */
+
+/* Routes are installed as they are processed, nothing is queued. */
+void
+kernel_flush (void)
+{
+}
@@ -35,6 +35,9 @@
 #include "rib.h"
 #include "thread.h"
 #include "privs.h"
+#include "memory.h"
+#include "network.h"
+#include "workqueue.h"
 
 #include "zebra/zserv.h"
 #include "zebra/rt.h"
@@ -42,6 +45,14 @@
 #include "zebra/interface.h"
 #include "zebra/debug.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+/* Room for the attributes of a route message, enough for a route with
+   many nexthops. */
+#define NL_PKT_BUF_SIZE 4096
+
 /* Socket interface to kernel */
 struct nlsock
 {
@@ -50,7 +61,113 @@ struct nlsock
   struct sockaddr_nl snl;
   const char *name;
 } netlink      = { -1, 0, {0}, "netlink-listen"},     /* kernel messages */
-  netlink_cmd  = { -1, 0, {0}, "netlink-cmd"};        /* command channel */
+  netlink_cmd  = { -1, 0, {0}, "netlink-cmd"},        /* command channel */
+  netlink_fib  = { -1, 0, {0}, "netlink-fib"};        /* route updates */
+
+/* Route messages for the FIB socket are packed into batches.  A batch
+   goes to the dataplane when it is full, at the latest once the
+   current run of the RIB work queue is over. */
+#define NL_BATCH_BUF_SIZE 16384
+
+/* Each message is answered, and the answers to a batch are queued on
+   the socket while it is sent: keep them within the receive buffer. */
+#define NL_BATCH_MAX_MSGS 128
+
+struct nl_batch
+{
+  struct nl_batch *next;
+
+  char buf[NL_BATCH_BUF_SIZE];
+  size_t len;
+  int count;
+
+  /* Filled in by the dataplane: the sendmsg error, whether answers
+     were lost to a receive buffer overrun, and the answers. */
+  int error;
+  int overrun;
+  int nanswers;
+  struct
+  {
+    u_int32_t seq;
+    int errnum;
+    int type;
+  } answers[NL_BATCH_MAX_MSGS];
+};
+
+/* Batches with the dataplane.  Past the first limit the RIB work queue
+   is held back, past the second zebra waits for the dataplane. */
+#define NL_DPLANE_QUEUE_MAX  8
+#define NL_DPLANE_QUEUE_HARD (2 * NL_DPLANE_QUEUE_MAX)
+
+/* Route messages not yet answered, oldest first.  The kernel answers
+   the messages of a socket in order. */
+#define NL_FIB_PENDING_SIZE 4096
+
+struct nl_fib_pending
+{
+  u_int32_t seq;
+  int cmd;
+  struct prefix p;
+};
+
+/* The batch being filled, spare batches, and the event handing the
+   batch over. */
+static struct nl_batch *nl_batch;
+static struct nl_batch *nl_batch_free;
+static struct thread *nl_batch_t_flush;
+
+static struct nl_fib_pending nl_fib_pending[NL_FIB_PENDING_SIZE];
+static unsigned int nl_fib_head;
+static unsigned int nl_fib_tail;
+
+#define NL_FIB_PENDING_COUNT() (nl_fib_head - nl_fib_tail)
+
+/* The dataplane sends the batches and reads back the answers, in a
+   thread of its own where there are POSIX threads, inline otherwise. */
+static struct
+{
+  int depth;			/* batches not yet collected */
+  int depth_max;
+  int plugged;			/* RIB work queue held back */
+  unsigned long plugs;
+  unsigned long waits;
+
+#ifdef HAVE_PTHREAD
+  int started;
+  int running;
+  pthread_t thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t work;		/* a batch was queued */
+  pthread_cond_t done;		/* a batch was sent */
+
+  /* Protected by mtx. */
+  struct nl_batch *queue;
+  struct nl_batch **queue_tail;
+  struct nl_batch *results;
+  struct nl_batch **results_tail;
+  int signalled;
+
+  /* Wakes the main thread up when there are results. */
+  int wakeup[2];
+  struct thread *t_wakeup;
+#endif /* HAVE_PTHREAD */
+} nl_dplane;
+
+static struct
+{
+  unsigned long sent;
+  unsigned long batches;
+  unsigned long acked;
+  unsigned long failed;
+  unsigned long lost;
+  unsigned int pending_max;
+
+  /* Burst of messages between two moments with nothing pending. */
+  struct timeval burst_start;
+  unsigned long burst_count;
+  unsigned long last_count;
+  unsigned long last_usec;
+} nl_fib_stats;
 
 static const struct message nlmsg_str[] = {
   {RTM_NEWROUTE, "RTM_NEWROUTE"},
@@ -1216,6 +1333,585 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   return netlink_parse_info (netlink_talk_filter, nl);
 }
 
+/* Is there a message for p sent after the pending one at index? */
+static int
+netlink_fib_pending_later (unsigned int index, struct prefix *p)
+{
+  for (index++; index != nl_fib_head; index++)
+    if (prefix_same (&nl_fib_pending[index % NL_FIB_PENDING_SIZE].p, p))
+      return 1;
+  return 0;
+}
+
+/* The kernel refused to install p, so it is not in the FIB after all. */
+static void
+netlink_fib_install_failed (unsigned int index, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib;
+  struct nexthop *nexthop;
+  u_char *flags;
+
+  /* A later message decides what the kernel holds. */
+  if (netlink_fib_pending_later (index, p))
+    return;
+
+  table = vrf_table (p->family == AF_INET ? AFI_IP : AFI_IP6, SAFI_UNICAST, 0);
+  if (! table)
+    return;
+
+  rn = route_node_lookup (table, p);
+  if (! rn)
+    return;
+
+  for (rib = rn->info; rib; rib = rib->next)
+    if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED))
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+	UNSET_FLAG (*flags, NEXTHOP_FLAG_FIB);
+
+  route_unlock_node (rn);
+}
+
+/* The last pending message has been answered. */
+static void
+netlink_fib_burst_end (void)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  nl_fib_stats.last_count = nl_fib_stats.burst_count;
+  nl_fib_stats.last_usec =
+    (now.tv_sec - nl_fib_stats.burst_start.tv_sec) * 1000000
+    + (now.tv_usec - nl_fib_stats.burst_start.tv_usec);
+  nl_fib_stats.burst_count = 0;
+}
+
+/* Answer from the kernel to the route message seq: errnum is zero for
+   an acknowledgement. */
+static void
+netlink_fib_ack (u_int32_t seq, int errnum, int msg_type)
+{
+  struct nl_fib_pending *pend = NULL;
+  char buf[INET6_ADDRSTRLEN];
+
+  while (NL_FIB_PENDING_COUNT ())
+    {
+      pend = &nl_fib_pending[nl_fib_tail % NL_FIB_PENDING_SIZE];
+      if (pend->seq == seq)
+	break;
+
+      /* Not one of ours, or already given up on. */
+      if ((int32_t) (seq - pend->seq) < 0)
+	return;
+
+      nl_fib_stats.lost++;
+      nl_fib_tail++;
+      pend = NULL;
+    }
+  if (! pend)
+    return;
+
+  if (errnum == 0)
+    nl_fib_stats.acked++;
+  else if ((msg_type == RTM_DELROUTE && (errnum == ENODEV || errnum == ESRCH))
+	   || (msg_type == RTM_NEWROUTE && errnum == EEXIST))
+    {
+      /* Races in link handling, as for the command socket. */
+      nl_fib_stats.acked++;
+      if (IS_ZEBRA_DEBUG_KERNEL)
+	zlog_debug ("%s: error: %s, %s %s/%d, seq=%u", netlink_fib.name,
+		    safe_strerror (errnum), lookup (nlmsg_str, msg_type),
+		    inet_ntop (pend->p.family, &pend->p.u.prefix, buf,
+			       sizeof buf), pend->p.prefixlen, seq);
+    }
+  else
+    {
+      nl_fib_stats.failed++;
+      zlog_err ("%s error: %s, %s %s/%d, seq=%u", netlink_fib.name,
+		safe_strerror (errnum), lookup (nlmsg_str, msg_type),
+		inet_ntop (pend->p.family, &pend->p.u.prefix, buf, sizeof buf),
+		pend->p.prefixlen, seq);
+      if (pend->cmd == RTM_NEWROUTE)
+	netlink_fib_install_failed (nl_fib_tail, &pend->p);
+    }
+
+  nl_fib_tail++;
+  if (! NL_FIB_PENDING_COUNT ())
+    netlink_fib_burst_end ();
+}
+
+/* Messages up to seq which are still pending will not be answered. */
+static void
+netlink_fib_unanswered (u_int32_t seq)
+{
+  int lost = 0;
+
+  while (NL_FIB_PENDING_COUNT ()
+	 && (int32_t) (nl_fib_pending[nl_fib_tail % NL_FIB_PENDING_SIZE].seq
+		       - seq) <= 0)
+    {
+      nl_fib_stats.lost++;
+      nl_fib_tail++;
+      lost = 1;
+    }
+  if (lost && ! NL_FIB_PENDING_COUNT ())
+    netlink_fib_burst_end ();
+}
+
+/* Send batch on the FIB socket and read back the answers, which the
+   kernel has queued by the time sendmsg returns.  This runs in the
+   dataplane thread: it must not log, allocate or look at the RIB. */
+static void
+netlink_dplane_send (struct nl_batch *batch)
+{
+  struct sockaddr_nl snl;
+  struct iovec iov = { batch->buf, batch->len };
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  char buf[4096];
+  struct iovec riov = { buf, sizeof buf };
+  struct msghdr rmsg = { (void *) &snl, sizeof snl, &riov, 1, NULL, 0, 0 };
+  struct nlmsghdr *h;
+  struct nlmsgerr *err;
+  int status;
+
+  batch->error = 0;
+  batch->overrun = 0;
+  batch->nanswers = 0;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  do
+    status = sendmsg (netlink_fib.sock, &msg, 0);
+  while (status < 0 && errno == EINTR);
+  if (status < 0)
+    {
+      batch->error = errno;
+      return;
+    }
+
+  while (1)
+    {
+      rmsg.msg_namelen = sizeof snl;
+      status = recvmsg (netlink_fib.sock, &rmsg, 0);
+      if (status < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno == ENOBUFS)
+	    {
+	      batch->overrun = 1;
+	      continue;
+	    }
+	  break;
+	}
+      if (status == 0)
+	break;
+
+      for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
+	   h = NLMSG_NEXT (h, status))
+	{
+	  if (h->nlmsg_type != NLMSG_ERROR
+	      || h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr))
+	      || batch->nanswers == NL_BATCH_MAX_MSGS)
+	    continue;
+
+	  err = (struct nlmsgerr *) NLMSG_DATA (h);
+	  batch->answers[batch->nanswers].seq = err->msg.nlmsg_seq;
+	  batch->answers[batch->nanswers].errnum = -err->error;
+	  batch->answers[batch->nanswers].type = err->msg.nlmsg_type;
+	  batch->nanswers++;
+	}
+    }
+}
+
+/* The dataplane is done with batch: match its answers to the pending
+   messages. */
+static void
+netlink_dplane_collect (struct nl_batch *batch)
+{
+  struct nlmsghdr *h;
+  unsigned int len = batch->len;
+  u_int32_t last = 0;
+  int i;
+
+  if (batch->error)
+    zlog (NULL, LOG_ERR, "%s sendmsg() error: %s", netlink_fib.name,
+	  safe_strerror (batch->error));
+  else
+    nl_fib_stats.batches++;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: %d route messages sent, %d answers",
+		netlink_fib.name, batch->count, batch->nanswers);
+
+  /* None of the batch reached the kernel when sendmsg failed. */
+  for (h = (struct nlmsghdr *) batch->buf; NLMSG_OK (h, len);
+       h = NLMSG_NEXT (h, len))
+    {
+      if (batch->error)
+	netlink_fib_ack (h->nlmsg_seq, batch->error, h->nlmsg_type);
+      last = h->nlmsg_seq;
+    }
+
+  for (i = 0; i < batch->nanswers; i++)
+    netlink_fib_ack (batch->answers[i].seq, batch->answers[i].errnum,
+		     batch->answers[i].type);
+
+  if (batch->overrun)
+    zlog_warn ("%s: answers lost to a receive buffer overrun",
+	       netlink_fib.name);
+  netlink_fib_unanswered (last);
+
+  batch->next = nl_batch_free;
+  nl_batch_free = batch;
+
+  nl_dplane.depth--;
+  if (nl_dplane.plugged && nl_dplane.depth <= NL_DPLANE_QUEUE_MAX / 2)
+    {
+      nl_dplane.plugged = 0;
+      work_queue_unplug (zebrad.ribq);
+    }
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+netlink_dplane_thread (void *arg)
+{
+  struct nl_batch *batch;
+
+  pthread_mutex_lock (&nl_dplane.mtx);
+
+#ifdef HAVE_LCAPS
+  /* Capabilities belong to a thread, this one keeps them raised. */
+  zserv_privs.change (ZPRIVS_RAISE);
+#endif /* HAVE_LCAPS */
+
+  nl_dplane.running = 1;
+  pthread_cond_signal (&nl_dplane.done);
+
+  while (1)
+    {
+      while (! nl_dplane.queue)
+	pthread_cond_wait (&nl_dplane.work, &nl_dplane.mtx);
+
+      batch = nl_dplane.queue;
+      nl_dplane.queue = batch->next;
+      if (! nl_dplane.queue)
+	nl_dplane.queue_tail = &nl_dplane.queue;
+      pthread_mutex_unlock (&nl_dplane.mtx);
+
+      netlink_dplane_send (batch);
+
+      pthread_mutex_lock (&nl_dplane.mtx);
+      batch->next = NULL;
+      *nl_dplane.results_tail = batch;
+      nl_dplane.results_tail = &batch->next;
+      pthread_cond_signal (&nl_dplane.done);
+
+      if (! nl_dplane.signalled
+	  && write (nl_dplane.wakeup[1], "", 1) == 1)
+	nl_dplane.signalled = 1;
+    }
+
+  return NULL;
+}
+
+/* Collect the batches the dataplane thread has sent. */
+static void
+netlink_dplane_results (void)
+{
+  struct nl_batch *batch;
+  struct nl_batch *next;
+
+  pthread_mutex_lock (&nl_dplane.mtx);
+  batch = nl_dplane.results;
+  nl_dplane.results = NULL;
+  nl_dplane.results_tail = &nl_dplane.results;
+  nl_dplane.signalled = 0;
+  pthread_mutex_unlock (&nl_dplane.mtx);
+
+  for (; batch; batch = next)
+    {
+      next = batch->next;
+      netlink_dplane_collect (batch);
+    }
+}
+
+static int
+netlink_dplane_wakeup (struct thread *thread)
+{
+  char buf[64];
+
+  nl_dplane.t_wakeup = thread_add_read (zebrad.master, netlink_dplane_wakeup,
+					NULL, nl_dplane.wakeup[0]);
+
+  while (read (nl_dplane.wakeup[0], buf, sizeof buf) > 0)
+    ;
+  netlink_dplane_results ();
+  return 0;
+}
+
+/* Wait until at most depth batches are left with the dataplane. */
+static void
+netlink_dplane_wait (int depth)
+{
+  while (nl_dplane.depth > depth)
+    {
+      pthread_mutex_lock (&nl_dplane.mtx);
+      while (! nl_dplane.results)
+	pthread_cond_wait (&nl_dplane.done, &nl_dplane.mtx);
+      pthread_mutex_unlock (&nl_dplane.mtx);
+
+      netlink_dplane_results ();
+    }
+}
+
+/* Start the dataplane thread.  This happens on the first batch, as
+   the thread would not survive zebra going into the background. */
+static void
+netlink_dplane_start (void)
+{
+  sigset_t all, old;
+  int ret;
+
+  nl_dplane.started = 1;
+
+#ifndef HAVE_LCAPS
+  /* Without capabilities privileges are switched for the whole process,
+     which is no good while another thread sends on its own. */
+  if (geteuid () != 0)
+    return;
+#endif /* HAVE_LCAPS */
+
+  if (pipe (nl_dplane.wakeup) < 0)
+    {
+      zlog_err ("Can't create dataplane wakeup pipe: %s",
+		safe_strerror (errno));
+      return;
+    }
+  set_nonblocking (nl_dplane.wakeup[0]);
+  set_nonblocking (nl_dplane.wakeup[1]);
+
+  pthread_mutex_init (&nl_dplane.mtx, NULL);
+  pthread_cond_init (&nl_dplane.work, NULL);
+  pthread_cond_init (&nl_dplane.done, NULL);
+  nl_dplane.queue_tail = &nl_dplane.queue;
+  nl_dplane.results_tail = &nl_dplane.results;
+
+  /* Signals are for the main thread, whose select() they interrupt so
+     that quagga_sigevent_process runs: the thread starts with all of
+     them blocked. */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  pthread_mutex_lock (&nl_dplane.mtx);
+  ret = pthread_create (&nl_dplane.thread, NULL, netlink_dplane_thread, NULL);
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+  if (ret == 0)
+    while (! nl_dplane.running)
+      pthread_cond_wait (&nl_dplane.done, &nl_dplane.mtx);
+  pthread_mutex_unlock (&nl_dplane.mtx);
+
+  if (ret != 0)
+    {
+      zlog_err ("Can't start dataplane thread: %s", safe_strerror (ret));
+      close (nl_dplane.wakeup[0]);
+      close (nl_dplane.wakeup[1]);
+      return;
+    }
+
+  nl_dplane.t_wakeup = thread_add_read (zebrad.master, netlink_dplane_wakeup,
+					NULL, nl_dplane.wakeup[0]);
+  zlog_info ("%s: dataplane thread started", netlink_fib.name);
+}
+#endif /* HAVE_PTHREAD */
+
+/* Hand the batch being filled to the dataplane. */
+static void
+netlink_batch_flush (void)
+{
+  struct nl_batch *batch = nl_batch;
+
+  THREAD_OFF (nl_batch_t_flush);
+
+  if (! batch || ! batch->count)
+    return;
+  nl_batch = NULL;
+
+  nl_dplane.depth++;
+  if (nl_dplane.depth > nl_dplane.depth_max)
+    nl_dplane.depth_max = nl_dplane.depth;
+
+#ifdef HAVE_PTHREAD
+  if (! nl_dplane.started)
+    netlink_dplane_start ();
+
+  if (nl_dplane.running)
+    {
+      pthread_mutex_lock (&nl_dplane.mtx);
+      batch->next = NULL;
+      *nl_dplane.queue_tail = batch;
+      nl_dplane.queue_tail = &batch->next;
+      pthread_cond_signal (&nl_dplane.work);
+      pthread_mutex_unlock (&nl_dplane.mtx);
+
+      /* Hold the RIB back until the dataplane catches up. */
+      if (nl_dplane.depth >= NL_DPLANE_QUEUE_HARD)
+	{
+	  nl_dplane.waits++;
+	  netlink_dplane_wait (NL_DPLANE_QUEUE_MAX);
+	}
+      if (nl_dplane.depth >= NL_DPLANE_QUEUE_MAX && ! nl_dplane.plugged
+	  && zebrad.ribq)
+	{
+	  nl_dplane.plugged = 1;
+	  nl_dplane.plugs++;
+	  work_queue_plug (zebrad.ribq);
+	}
+      return;
+    }
+#endif /* HAVE_PTHREAD */
+
+  /* The kernel checks capabilities when the batch is sent. */
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  netlink_dplane_send (batch);
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  netlink_dplane_collect (batch);
+}
+
+static int
+netlink_batch_timer (struct thread *thread)
+{
+  nl_batch_t_flush = NULL;
+  netlink_batch_flush ();
+  return 0;
+}
+
+/* Queue route message n for p on the FIB socket. */
+static int
+netlink_batch_add (struct nlmsghdr *n, struct prefix *p)
+{
+  struct nl_fib_pending *pend;
+
+  if (nl_batch
+      && (nl_batch->len + NLMSG_ALIGN (n->nlmsg_len) > NL_BATCH_BUF_SIZE
+	  || nl_batch->count == NL_BATCH_MAX_MSGS))
+    netlink_batch_flush ();
+
+  if (NL_FIB_PENDING_COUNT () == NL_FIB_PENDING_SIZE)
+    {
+      netlink_batch_flush ();
+#ifdef HAVE_PTHREAD
+      if (nl_dplane.running)
+	netlink_dplane_wait (0);
+#endif /* HAVE_PTHREAD */
+
+      /* Whatever is still unanswered will not be. */
+      if (NL_FIB_PENDING_COUNT () == NL_FIB_PENDING_SIZE)
+	{
+	  nl_fib_stats.lost++;
+	  nl_fib_tail++;
+	}
+    }
+
+  if (! nl_batch)
+    {
+      if (nl_batch_free)
+	{
+	  nl_batch = nl_batch_free;
+	  nl_batch_free = nl_batch->next;
+	}
+      else
+	nl_batch = XMALLOC (MTYPE_NETLINK_BATCH, sizeof (struct nl_batch));
+      nl_batch->len = 0;
+      nl_batch->count = 0;
+    }
+
+  n->nlmsg_seq = ++netlink_fib.seq;
+  n->nlmsg_flags |= NLM_F_ACK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("netlink_batch_add: %s type %s(%u), seq=%u", netlink_fib.name,
+		lookup (nlmsg_str, n->nlmsg_type), n->nlmsg_type,
+		n->nlmsg_seq);
+
+  memcpy (nl_batch->buf + nl_batch->len, n, n->nlmsg_len);
+  nl_batch->len += NLMSG_ALIGN (n->nlmsg_len);
+  nl_batch->count++;
+
+  if (! NL_FIB_PENDING_COUNT ())
+    quagga_gettime (QUAGGA_CLK_MONOTONIC, &nl_fib_stats.burst_start);
+
+  pend = &nl_fib_pending[nl_fib_head % NL_FIB_PENDING_SIZE];
+  pend->seq = n->nlmsg_seq;
+  pend->cmd = n->nlmsg_type;
+  prefix_copy (&pend->p, p);
+  nl_fib_head++;
+
+  nl_fib_stats.sent++;
+  nl_fib_stats.burst_count++;
+  if (NL_FIB_PENDING_COUNT () > nl_fib_stats.pending_max)
+    nl_fib_stats.pending_max = NL_FIB_PENDING_COUNT ();
+
+  if (! nl_batch_t_flush)
+    nl_batch_t_flush = thread_add_event (zebrad.master, netlink_batch_timer,
+					 NULL, 0);
+  return 0;
+}
+
+/* Send out the route messages queued so far, and wait for them. */
+void
+kernel_flush (void)
+{
+  netlink_batch_flush ();
+#ifdef HAVE_PTHREAD
+  if (nl_dplane.running)
+    netlink_dplane_wait (0);
+#endif /* HAVE_PTHREAD */
+}
+
+void
+kernel_fib_statistics (struct vty *vty)
+{
+#ifdef HAVE_PTHREAD
+  if (nl_dplane.running)
+    vty_out (vty, "Dataplane thread running%s", VTY_NEWLINE);
+  else
+#endif /* HAVE_PTHREAD */
+    vty_out (vty, "Dataplane running inline%s", VTY_NEWLINE);
+  vty_out (vty, "Batches queued %d, at most %d%s",
+	   nl_dplane.depth, nl_dplane.depth_max, VTY_NEWLINE);
+  vty_out (vty, "RIB held back %lu times, waited for the dataplane %lu times%s",
+	   nl_dplane.plugs, nl_dplane.waits, VTY_NEWLINE);
+  vty_out (vty, "Route messages %lu, sent in %lu batches%s",
+	   nl_fib_stats.sent, nl_fib_stats.batches, VTY_NEWLINE);
+  vty_out (vty, "  acknowledged %lu, failed %lu, unanswered %lu%s",
+	   nl_fib_stats.acked, nl_fib_stats.failed, nl_fib_stats.lost,
+	   VTY_NEWLINE);
+  vty_out (vty, "Queued or in flight %u, at most %u%s",
+	   NL_FIB_PENDING_COUNT (), nl_fib_stats.pending_max, VTY_NEWLINE);
+  if (nl_fib_stats.last_count)
+    vty_out (vty, "Last burst %lu routes in %lu usec, %lu routes/s%s",
+	     nl_fib_stats.last_count, nl_fib_stats.last_usec,
+	     nl_fib_stats.last_usec ?
+	     (unsigned long) ((unsigned long long) nl_fib_stats.last_count
+			      * 1000000 / nl_fib_stats.last_usec) : 0,
+	     VTY_NEWLINE);
+}
+
+void
+kernel_fib_statistics_reset (void)
+{
+  memset (&nl_fib_stats, 0, sizeof nl_fib_stats);
+  nl_dplane.depth_max = nl_dplane.depth;
+  nl_dplane.plugs = 0;
+  nl_dplane.waits = 0;
+}
+
 /* Routing table change via netlink interface. */
 static int
 netlink_route (int cmd, int family, void *dest, int length, void *gate,
@@ -1298,6 +1994,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   int bytelen;
   struct sockaddr_nl snl;
   struct nexthop *nexthop = NULL;
+  u_char *flags;
   int nexthop_num = 0;
   int discard;
 
@@ -1305,7 +2002,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   {
     struct nlmsghdr n;
     struct rtmsg r;
-    char buf[1024];
+    char buf[NL_PKT_BUF_SIZE];
   } req;
 
   memset (&req, 0, sizeof req);
@@ -1349,24 +2046,24 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
   if (discard)
     {
       if (cmd == RTM_NEWROUTE)
-        for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-          SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+        for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+          SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
       goto skip;
     }
 
   /* Multipath case. */
   if (rib->nexthop_active_num == 1 || MULTIPATH_NUM == 1)
     {
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
         {
 
           if ((cmd == RTM_NEWROUTE
-               && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+               && CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
               || (cmd == RTM_DELROUTE
-                  && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)))
+                  && CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)))
             {
 
-              if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+              if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
                 {
                   if (IS_ZEBRA_DEBUG_KERNEL)
                     {
@@ -1504,7 +2201,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                 }
 
               if (cmd == RTM_NEWROUTE)
-                SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+                SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
               nexthop_num++;
               break;
@@ -1513,7 +2210,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
     }
   else
     {
-      char buf[1024];
+      char buf[NL_PKT_BUF_SIZE];
       struct rtattr *rta = (void *) buf;
       struct rtnexthop *rtnh;
       union g_addr *src = NULL;
@@ -1523,14 +2220,14 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
       rtnh = RTA_DATA (rta);
 
       nexthop_num = 0;
-      for (nexthop = rib->nexthop;
+      for (nexthop = rib->nexthop, flags = rib->nexthop_flags;
            nexthop && (MULTIPATH_NUM == 0 || nexthop_num < MULTIPATH_NUM);
-           nexthop = nexthop->next)
+           nexthop = nexthop->next, flags++)
         {
           if ((cmd == RTM_NEWROUTE
-               && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+               && CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
               || (cmd == RTM_DELROUTE
-                  && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)))
+                  && CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)))
             {
               nexthop_num++;
 
@@ -1539,7 +2236,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
               rtnh->rtnh_hops = 0;
               rta->rta_len += rtnh->rtnh_len;
 
-              if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+              if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
                 {
                   if (IS_ZEBRA_DEBUG_KERNEL)
                     {
@@ -1557,7 +2254,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                   if (nexthop->rtype == NEXTHOP_TYPE_IPV4
                       || nexthop->rtype == NEXTHOP_TYPE_IPV4_IFINDEX)
                     {
-                      rta_addattr_l (rta, 4096, RTA_GATEWAY,
+                      rta_addattr_l (rta, NL_PKT_BUF_SIZE, RTA_GATEWAY,
                                      &nexthop->rgate.ipv4, bytelen);
                       rtnh->rtnh_len += sizeof (struct rtattr) + 4;
 
@@ -1575,7 +2272,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                       || nexthop->rtype == NEXTHOP_TYPE_IPV6_IFNAME
                       || nexthop->rtype == NEXTHOP_TYPE_IPV6_IFINDEX)
 		    {
-		      rta_addattr_l (rta, 4096, RTA_GATEWAY,
+		      rta_addattr_l (rta, NL_PKT_BUF_SIZE, RTA_GATEWAY,
 				     &nexthop->rgate.ipv6, bytelen);
 
 		      if (IS_ZEBRA_DEBUG_KERNEL)
@@ -1631,7 +2328,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                   if (nexthop->type == NEXTHOP_TYPE_IPV4
                       || nexthop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
                     {
-		      rta_addattr_l (rta, 4096, RTA_GATEWAY,
+		      rta_addattr_l (rta, NL_PKT_BUF_SIZE, RTA_GATEWAY,
 				     &nexthop->gate.ipv4, bytelen);
 		      rtnh->rtnh_len += sizeof (struct rtattr) + 4;
 
@@ -1649,7 +2346,7 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                       || nexthop->type == NEXTHOP_TYPE_IPV6_IFNAME
                       || nexthop->type == NEXTHOP_TYPE_IPV6_IFINDEX)
 		    { 
-		      rta_addattr_l (rta, 4096, RTA_GATEWAY,
+		      rta_addattr_l (rta, NL_PKT_BUF_SIZE, RTA_GATEWAY,
 				     &nexthop->gate.ipv6, bytelen);
 
 		      if (IS_ZEBRA_DEBUG_KERNEL)
@@ -1688,14 +2385,14 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
               rtnh = RTNH_NEXT (rtnh);
 
               if (cmd == RTM_NEWROUTE)
-                SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+                SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
             }
         }
       if (src)
         addattr_l (&req.n, sizeof req, RTA_PREFSRC, &src->ipv4, bytelen);
 
       if (rta->rta_len > RTA_LENGTH (0))
-        addattr_l (&req.n, 1024, RTA_MULTIPATH, RTA_DATA (rta),
+        addattr_l (&req.n, sizeof req, RTA_MULTIPATH, RTA_DATA (rta),
                    RTA_PAYLOAD (rta));
     }
 
@@ -1713,7 +2410,9 @@ skip:
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
-  /* Talk to netlink socket. */
+  /* Queue the message on the FIB socket, when there is one. */
+  if (netlink_fib.sock >= 0)
+    return netlink_batch_add (&req.n, p);
   return netlink_talk (&req.n, &netlink_cmd);
 }
 
@@ -1834,22 +2533,24 @@ kernel_read (struct thread *thread)
 /* Filter out messages from self that occur on listener socket,
    caused by our actions on the command socket
  */
-static void netlink_install_filter (int sock, __u32 pid)
+static void netlink_install_filter (int sock, __u32 pid, __u32 fib_pid)
 {
   struct sock_filter filter[] = {
     /* 0: ldh [4]	          */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_H, offsetof(struct nlmsghdr, nlmsg_type)),
     /* 1: jeq 0x18 jt 3 jf 6  */
     BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_NEWROUTE), 1, 0),
-    /* 2: jeq 0x19 jt 3 jf 6  */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 3),
+    /* 2: jeq 0x19 jt 3 jf 7  */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htons(RTM_DELROUTE), 0, 4),
     /* 3: ldw [12]		  */
     BPF_STMT(BPF_LD|BPF_ABS|BPF_W, offsetof(struct nlmsghdr, nlmsg_pid)),
-    /* 4: jeq XX  jt 5 jf 6   */
-    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 0, 1),
-    /* 5: ret 0    (skip)     */
+    /* 4: jeq XX  jt 6 jf 5   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(pid), 1, 0),
+    /* 5: jeq YY  jt 6 jf 7   */
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, htonl(fib_pid), 0, 1),
+    /* 6: ret 0    (skip)     */
     BPF_STMT(BPF_RET|BPF_K, 0),
-    /* 6: ret 0xffff (keep)   */
+    /* 7: ret 0xffff (keep)   */
     BPF_STMT(BPF_RET|BPF_K, 0xffff),
   };
 
@@ -1875,6 +2576,28 @@ kernel_init (void)
 #endif /* HAVE_IPV6 */
   netlink_socket (&netlink, groups);
   netlink_socket (&netlink_cmd, 0);
+  netlink_socket (&netlink_fib, 0);
+
+  /* Route updates go out in batches through the dataplane. */
+  if (netlink_fib.sock > 0)
+    {
+      if (fcntl (netlink_fib.sock, F_SETFL, O_NONBLOCK) < 0)
+	zlog (NULL, LOG_ERR, "Can't set %s socket flags: %s",
+	      netlink_fib.name, safe_strerror (errno));
+      if (nl_rcvbufsize)
+	netlink_recvbuf (&netlink_fib, nl_rcvbufsize);
+#if defined (SOL_NETLINK) && defined (NETLINK_CAP_ACK)
+      /* Errors need not carry the whole route message back. */
+      {
+	int one = 1;
+
+	if (setsockopt (netlink_fib.sock, SOL_NETLINK, NETLINK_CAP_ACK,
+			&one, sizeof one) < 0)
+	  zlog_warn ("Can't set %s to capped acknowledgements: %s",
+		     netlink_fib.name, safe_strerror (errno));
+      }
+#endif /* NETLINK_CAP_ACK */
+    }
 
   /* Register kernel socket. */
   if (netlink.sock > 0)
@@ -1888,7 +2611,9 @@ kernel_init (void)
       if (nl_rcvbufsize)
 	netlink_recvbuf (&netlink, nl_rcvbufsize);
 
-      netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid);
+      netlink_install_filter (netlink.sock, netlink_cmd.snl.nl_pid,
+			      netlink_fib.sock > 0 ? netlink_fib.snl.nl_pid
+			      : netlink_cmd.snl.nl_pid);
       thread_add_read (zebrad.master, kernel_read, NULL, netlink.sock);
     }
 }
@@ -72,6 +72,7 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib, int family)
   struct sockaddr_in *mask = NULL;
   struct sockaddr_in sin_dest, sin_mask, sin_gate;
   struct nexthop *nexthop;
+  u_char *flags;
   int nexthop_num = 0;
   unsigned int ifindex = 0;
   int gate = 0;
@@ -96,7 +97,7 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib, int family)
 #endif /* HAVE_STRUCT_SOCKADDR_IN_SIN_LEN */
 
   /* Make gateway. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
       gate = 0;
       char gate_buf[INET_ADDRSTRLEN] = "NULL";
@@ -107,12 +108,12 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib, int family)
        * other than ADD and DELETE?
        */
       if ((cmd == RTM_ADD
-	   && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	   && CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	  || (cmd == RTM_DELETE
-	      && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+	      && CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)
 	      ))
 	{
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	    {
 	      if (nexthop->rtype == NEXTHOP_TYPE_IPV4 ||
 		  nexthop->rtype == NEXTHOP_TYPE_IPV4_IFINDEX)
@@ -187,7 +188,7 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib, int family)
                  zlog_debug ("%s: %s/%d: successfully did NH %s",
                    __func__, prefix_buf, p->prefixlen, gate_buf);
                if (cmd == RTM_ADD)
-                 SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+                 SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
                break;
  
              /* The only valid case for this error is kernel's failure to install
@@ -218,7 +219,7 @@ kernel_rtm_ipv4 (int cmd, struct prefix *p, struct rib *rib, int family)
        else
          if (IS_ZEBRA_DEBUG_RIB)
            zlog_debug ("%s: odd command %s for flags %d",
-             __func__, lookup (rtm_type_str, cmd), nexthop->flags);
+             __func__, lookup (rtm_type_str, cmd), *flags);
      } /* for (nexthop = ... */
  
    /* If there was no useful nexthop, then complain. */
@@ -355,6 +356,7 @@ kernel_rtm_ipv6_multipath (int cmd, struct prefix *p, struct rib *rib,
   struct sockaddr_in6 *mask;
   struct sockaddr_in6 sin_dest, sin_mask, sin_gate;
   struct nexthop *nexthop;
+  u_char *flags;
   int nexthop_num = 0;
   unsigned int ifindex = 0;
   int gate = 0;
@@ -376,19 +378,19 @@ kernel_rtm_ipv6_multipath (int cmd, struct prefix *p, struct rib *rib,
 #endif /* HAVE_STRUCT_SOCKADDR_IN_SIN_LEN */
 
   /* Make gateway. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
       gate = 0;
 
       if ((cmd == RTM_ADD
-	   && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	   && CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	  || (cmd == RTM_DELETE
 #if 0
-	      && CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+	      && CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)
 #endif
 	      ))
 	{
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	    {
 	      if (nexthop->rtype == NEXTHOP_TYPE_IPV6
 		  || nexthop->rtype == NEXTHOP_TYPE_IPV6_IFNAME
@@ -420,7 +422,7 @@ kernel_rtm_ipv6_multipath (int cmd, struct prefix *p, struct rib *rib,
 	    }
 
 	  if (cmd == RTM_ADD)
-	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	    SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 	}
 
       /* Under kame set interface index to link local address. */
@@ -522,3 +524,9 @@ kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
   return route;
 }
 #endif /* HAVE_IPV6 */
+
+/* Routes are installed as they are processed, nothing is queued. */
+void
+kernel_flush (void)
+{
+}
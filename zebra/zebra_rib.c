@@ -30,12 +30,16 @@
 #include "log.h"
 #include "sockunion.h"
 #include "linklist.h"
+#include "hash.h"
+#include "jhash.h"
 #include "thread.h"
 #include "workqueue.h"
 #include "prefix.h"
 #include "routemap.h"
+#include "latency.h"
 
 #include "zebra/rib.h"
+#include "zebra/interface.h"
 #include "zebra/rt.h"
 #include "zebra/zserv.h"
 #include "zebra/redistribute.h"
@@ -171,6 +175,7 @@ nexthop_add (struct rib *rib, struct nexthop *nexthop)
 {
   struct nexthop *last;
 
+  rib_nexthop_unshare (rib);
   for (last = rib->nexthop; last && last->next; last = last->next)
     ;
   if (last)
@@ -179,6 +184,9 @@ nexthop_add (struct rib *rib, struct nexthop *nexthop)
     rib->nexthop = nexthop;
   nexthop->prev = last;
 
+  rib->nexthop_flags = XREALLOC (MTYPE_NEXTHOP_FLAGS, rib->nexthop_flags,
+				 rib->nexthop_num + 1);
+  rib->nexthop_flags[rib->nexthop_num] = 0;
   rib->nexthop_num++;
 }
 
@@ -186,6 +194,14 @@ nexthop_add (struct rib *rib, struct nexthop *nexthop)
 static void
 nexthop_delete (struct rib *rib, struct nexthop *nexthop)
 {
+  struct nexthop *prev;
+  int i;
+
+  for (i = 0, prev = nexthop->prev; prev; prev = prev->prev)
+    i++;
+  memmove (&rib->nexthop_flags[i], &rib->nexthop_flags[i + 1],
+	   rib->nexthop_num - i - 1);
+
   if (nexthop->next)
     nexthop->next->prev = nexthop->prev;
   if (nexthop->prev)
@@ -204,6 +220,213 @@ nexthop_free (struct nexthop *nexthop)
   XFREE (MTYPE_NEXTHOP, nexthop);
 }
 
+/* RIB entries with the very same nexthops share one list of them,
+ * interned here.  The many routes reached through a few gateways thus
+ * hold a handful of lists between them.  Whether a nexthop is active,
+ * installed or recursive is up to each entry, so the flags saying so
+ * are kept in rib->nexthop_flags and are not part of the key.
+ *
+ * A shared list is never written to.  rib_nexthop_unshare gives the
+ * entry a list of its own before anything changes it, and rib_process
+ * interns the lists of the entries of a node again once done with it.
+ * rib->nhg is the group of an entry sharing its list, NULL while the
+ * entry has a list of its own.
+ */
+struct nexthop_group
+{
+  struct nexthop *nexthop;
+  unsigned int nexthop_num;
+  unsigned long refcnt;
+};
+
+static struct hash *nexthop_groups;
+
+/* Entries sharing the lists, nexthops in these, and nexthops the
+   entries would have without sharing. */
+static unsigned long nexthop_group_refs;
+static unsigned long nexthop_group_nexthops;
+static unsigned long nexthop_group_ref_nexthops;
+
+static unsigned int
+nexthop_group_hash (void *arg)
+{
+  struct nexthop_group *nhg = arg;
+  struct nexthop *nexthop;
+  u_int32_t key = 0;
+
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      key = jhash_2words (nexthop->type, nexthop->ifindex, key);
+      key = jhash (&nexthop->gate, sizeof (union g_addr), key);
+      key = jhash_2words (nexthop->rtype, nexthop->rifindex, key);
+      key = jhash (&nexthop->rgate, sizeof (union g_addr), key);
+      key = jhash (&nexthop->src, sizeof (union g_addr), key);
+      if (nexthop->ifname)
+	key = jhash (nexthop->ifname, strlen (nexthop->ifname), key);
+    }
+  return key;
+}
+
+static int
+nexthop_group_cmp (const void *a, const void *b)
+{
+  const struct nexthop *na = ((const struct nexthop_group *) a)->nexthop;
+  const struct nexthop *nb = ((const struct nexthop_group *) b)->nexthop;
+
+  for (; na && nb; na = na->next, nb = nb->next)
+    {
+      if (na->type != nb->type
+	  || na->ifindex != nb->ifindex
+	  || na->rtype != nb->rtype
+	  || na->rifindex != nb->rifindex
+	  || memcmp (&na->gate, &nb->gate, sizeof (union g_addr))
+	  || memcmp (&na->rgate, &nb->rgate, sizeof (union g_addr))
+	  || memcmp (&na->src, &nb->src, sizeof (union g_addr)))
+	return 0;
+      if ((na->ifname || nb->ifname)
+	  && (! na->ifname || ! nb->ifname || strcmp (na->ifname, nb->ifname)))
+	return 0;
+    }
+  return na == NULL && nb == NULL;
+}
+
+static void *
+nexthop_group_alloc (void *arg)
+{
+  struct nexthop_group *nhg;
+  struct nexthop *nexthop;
+
+  nhg = XCALLOC (MTYPE_NEXTHOP_GROUP, sizeof (struct nexthop_group));
+  nhg->nexthop = ((struct nexthop_group *) arg)->nexthop;
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    nhg->nexthop_num++;
+  nexthop_group_nexthops += nhg->nexthop_num;
+  return nhg;
+}
+
+static void
+nexthop_list_free (struct nexthop *nexthop)
+{
+  struct nexthop *next;
+
+  for (; nexthop; nexthop = next)
+    {
+      next = nexthop->next;
+      nexthop_free (nexthop);
+    }
+}
+
+static struct nexthop *
+nexthop_list_dup (struct nexthop *nexthop)
+{
+  struct nexthop *head = NULL;
+  struct nexthop *last = NULL;
+  struct nexthop *copy;
+
+  for (; nexthop; nexthop = nexthop->next)
+    {
+      copy = XMALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      *copy = *nexthop;
+      if (nexthop->ifname)
+	copy->ifname = XSTRDUP (0, nexthop->ifname);
+      copy->next = NULL;
+      copy->prev = last;
+      if (last)
+	last->next = copy;
+      else
+	head = copy;
+      last = copy;
+    }
+  return head;
+}
+
+/* Drop the group of rib, freeing it with the last entry using it.  The
+   entry keeps the list when it was the last one. */
+static void
+nexthop_group_unlock (struct rib *rib, int keep)
+{
+  struct nexthop_group *nhg = rib->nhg;
+
+  rib->nhg = NULL;
+  nexthop_group_refs--;
+  nexthop_group_ref_nexthops -= nhg->nexthop_num;
+  if (--nhg->refcnt)
+    return;
+
+  hash_release (nexthop_groups, nhg);
+  nexthop_group_nexthops -= nhg->nexthop_num;
+  if (! keep)
+    nexthop_list_free (nhg->nexthop);
+  XFREE (MTYPE_NEXTHOP_GROUP, nhg);
+}
+
+/* Share the nexthops of rib with the entries having the same ones. */
+void
+rib_nexthop_intern (struct rib *rib)
+{
+  struct nexthop_group lookup;
+  struct nexthop_group *nhg;
+
+  if (rib->nhg || ! rib->nexthop)
+    return;
+
+  if (! nexthop_groups)
+    nexthop_groups = hash_create (nexthop_group_hash, nexthop_group_cmp);
+
+  lookup.nexthop = rib->nexthop;
+  nhg = hash_get (nexthop_groups, &lookup, nexthop_group_alloc);
+  if (nhg->nexthop != rib->nexthop)
+    {
+      nexthop_list_free (rib->nexthop);
+      rib->nexthop = nhg->nexthop;
+    }
+  nhg->refcnt++;
+  nexthop_group_refs++;
+  nexthop_group_ref_nexthops += nhg->nexthop_num;
+  rib->nhg = nhg;
+}
+
+/* Give rib a list of nexthops of its own, about to be changed. */
+void
+rib_nexthop_unshare (struct rib *rib)
+{
+  struct nexthop_group *nhg = rib->nhg;
+
+  if (! nhg)
+    return;
+
+  if (nhg->refcnt == 1)
+    nexthop_group_unlock (rib, 1);
+  else
+    {
+      nexthop_group_unlock (rib, 0);
+      rib->nexthop = nexthop_list_dup (nhg->nexthop);
+    }
+}
+
+/* Free the nexthops of rib, or its share of them. */
+static void
+rib_nexthop_free (struct rib *rib)
+{
+  if (rib->nhg)
+    nexthop_group_unlock (rib, 0);
+  else
+    nexthop_list_free (rib->nexthop);
+  rib->nexthop = NULL;
+  if (rib->nexthop_flags)
+    XFREE (MTYPE_NEXTHOP_FLAGS, rib->nexthop_flags);
+}
+
+void
+rib_nexthop_group_vty (struct vty *vty)
+{
+  vty_out (vty, "Nexthop groups: %lu, used by %lu RIB entries%s",
+	   nexthop_groups ? nexthop_groups->count : 0UL, nexthop_group_refs,
+	   VTY_NEWLINE);
+  vty_out (vty, "Nexthops in groups: %lu, standing for %lu%s",
+	   nexthop_group_nexthops, nexthop_group_ref_nexthops, VTY_NEWLINE);
+}
+
 struct nexthop *
 nexthop_ifindex_add (struct rib *rib, unsigned int ifindex)
 {
@@ -328,23 +551,196 @@ nexthop_blackhole_add (struct rib *rib)
   return nexthop;
 }
 
+/* Index from interfaces, and from the addresses of gateways, to the
+ * route nodes with RIB entries whose nexthops depend on them, so that
+ * an interface or address event only re-examines these nodes instead
+ * of every route in the tables.
+ *
+ * - Interface keys are hashed by ifindex.  Nexthops naming their
+ *   interface, which may not exist yet or come back with another
+ *   index, all share the IFINDEX_INTERNAL key, looked at on every
+ *   interface event.
+ * - Gateway keys are host prefixes in a table per address family, so
+ *   that the gateways within a connected subnet, or within any other
+ *   route, are found by walking the subtree under it.  They also
+ *   cache the node the gateway resolves through, see nexthop_resolve.
+ *
+ * Entries are indexed by rib_link, and dropped by rib_unlink, or when
+ * the nexthops of a static route change, by rib_dep_reindex.
+ */
+struct rib_dep_key
+{
+  struct rib_dep *deps;
+
+  /* Interface key. */
+  unsigned int ifindex;
+
+  /* Gateway key, with node->info pointing back here. */
+  struct route_node *node;
+
+  /* Whether the gateway was looked up since the routes covering it
+     last changed, and the node it resolved through, locked, if any. */
+  u_char resolved;
+  struct route_node *resolving;
+};
+
+struct rib_dep
+{
+  /* Dependencies of the same RIB entry. */
+  struct rib_dep *next;
+
+  /* Dependencies on the same key. */
+  struct rib_dep *key_next;
+  struct rib_dep **key_prev;
+
+  struct rib_dep_key *key;
+  struct rib *rib;
+  struct route_node *rn;
+};
+
+static struct hash *rib_dep_ifs;
+static struct route_table *rib_dep_gws[AFI_MAX];
+
+static void rib_dep_resolve_changed (struct route_node *);
+
+/* The selected entry at rn, if gateways may resolve through it, that
+   is unless it is BGP. */
+static struct rib *
+rib_resolving_select (struct route_node *rn)
+{
+  struct rib *match;
+
+  for (match = rn->info; match; match = match->next)
+    {
+      if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
+	continue;
+      if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
+	break;
+    }
+  if (match && match->type == ZEBRA_ROUTE_BGP)
+    return NULL;
+  return match;
+}
+
+/* The entry the gateway p of a nexthop of rib resolves through: the
+   one selected at the most specific node covering p which has one
+   other than BGP.  The route being resolved, at top, resolves nothing
+   of its own when met on the way there.
+
+   Once looked up, the node is cached in the gateway key of rib until
+   rib_dep_resolve_changed, so that the routes sharing a gateway look
+   it up once between changes of the routes covering it. */
+static struct rib *
+nexthop_resolve (struct rib *rib, struct route_table *table,
+		 struct prefix *p, struct route_node *top)
+{
+  struct rib_dep *dep;
+  struct rib_dep_key *key = NULL;
+  struct route_node *rn;
+  struct rib *match = NULL;
+
+  for (dep = rib->deps; dep; dep = dep->next)
+    if (dep->key->node && prefix_same (&dep->key->node->p, p))
+      {
+	key = dep->key;
+	break;
+      }
+
+  /* The entry cached may have been deselected ahead of rib_process
+     looking at its node again, look up afresh then. */
+  if (key && key->resolved
+      && (! key->resolving
+	  || (match = rib_resolving_select (key->resolving)) != NULL))
+    rn = key->resolving;
+  else
+    {
+      rn = route_node_match (table, p);
+      while (rn)
+	{
+	  route_unlock_node (rn);
+	  if ((match = rib_resolving_select (rn)) != NULL)
+	    break;
+
+	  do {
+	    rn = rn->parent;
+	  } while (rn && rn->info == NULL);
+	  if (rn)
+	    route_lock_node (rn);
+	}
+
+      if (key)
+	{
+	  if (rn)
+	    route_lock_node (rn);
+	  if (key->resolving)
+	    route_unlock_node (key->resolving);
+	  key->resolving = rn;
+	  key->resolved = 1;
+	}
+    }
+
+  if (! rn)
+    return NULL;
+
+  /* Self lookup, the route covers its own gateway. */
+  if (top && top->p.family == p->family
+      && top->p.prefixlen >= rn->p.prefixlen
+      && prefix_match (&top->p, p))
+    return NULL;
+
+  return match;
+}
+
+/* Whether nexthop, with flags, already resolves recursively through
+   newhop. */
+static int
+nexthop_recursive_same (struct nexthop *nexthop, u_char *flags,
+			struct nexthop *newhop)
+{
+  if (! CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE)
+      || nexthop->rtype != newhop->type)
+    return 0;
+
+  switch (newhop->type)
+    {
+    case NEXTHOP_TYPE_IPV4:
+      return IPV4_ADDR_SAME (&nexthop->rgate.ipv4, &newhop->gate.ipv4);
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+      return IPV4_ADDR_SAME (&nexthop->rgate.ipv4, &newhop->gate.ipv4)
+	&& nexthop->rifindex == newhop->ifindex;
+    case NEXTHOP_TYPE_IFINDEX:
+    case NEXTHOP_TYPE_IFNAME:
+      return nexthop->rifindex == newhop->ifindex;
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6:
+      return IPV6_ADDR_SAME (&nexthop->rgate.ipv6, &newhop->gate.ipv6);
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      return IPV6_ADDR_SAME (&nexthop->rgate.ipv6, &newhop->gate.ipv6)
+	&& nexthop->rifindex == newhop->ifindex;
+#endif /* HAVE_IPV6 */
+    default:
+      return 1;
+    }
+}
+
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
-nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
-		     struct route_node *top)
+nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, u_char *flags,
+		     int set, struct route_node *top)
 {
   struct prefix_ipv4 p;
   struct route_table *table;
-  struct route_node *rn;
   struct rib *match;
   struct nexthop *newhop;
+  u_char *newflags;
 
   if (nexthop->type == NEXTHOP_TYPE_IPV4)
     nexthop->ifindex = 0;
 
   if (set)
-    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+    UNSET_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE);
 
   /* Make lookup prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv4));
@@ -357,73 +753,46 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
   if (! table)
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
+  match = nexthop_resolve (rib, table, (struct prefix *) &p, top);
+  if (! match)
+    return 0;
+
+  if (match->type == ZEBRA_ROUTE_CONNECT)
     {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immidiately. */
-      if (rn == top)
-	return 0;
+      /* Directly point connected route. */
+      newhop = match->nexthop;
+      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
+	nexthop->ifindex = newhop->ifindex;
 
-      /* Pick up selected route. */
-      for (match = rn->info; match; match = match->next)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
-	    break;
-	}
+      /* No longer recursive, resolve again on installing. */
+      if (! set && CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
+	SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match 
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV4)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
-		  {
-		    if (set)
-		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-			nexthop->rtype = newhop->type;
-			if (newhop->type == NEXTHOP_TYPE_IPV4 ||
-			    newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
-			  nexthop->rgate.ipv4 = newhop->gate.ipv4;
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME
-			    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
-			  nexthop->rifindex = newhop->ifindex;
-		      }
-		    return 1;
-		  }
-	      return 0;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+      return 1;
+    }
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
+    {
+      for (ALL_RIB_NEXTHOPS (match, newhop, newflags))
+	if (CHECK_FLAG (*newflags, NEXTHOP_FLAG_FIB)
+	    && ! CHECK_FLAG (*newflags, NEXTHOP_FLAG_RECURSIVE))
+	  {
+	    if (set)
+	      {
+		SET_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE);
+		nexthop->rtype = newhop->type;
+		if (newhop->type == NEXTHOP_TYPE_IPV4 ||
+		    newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
+		  nexthop->rgate.ipv4 = newhop->gate.ipv4;
+		if (newhop->type == NEXTHOP_TYPE_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IFNAME
+		    || newhop->type == NEXTHOP_TYPE_IPV4_IFINDEX)
+		  nexthop->rifindex = newhop->ifindex;
+	      }
+	    else if (! nexthop_recursive_same (nexthop, flags, newhop))
+	      SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+	    return 1;
+	  }
+      return 0;
     }
   return 0;
 }
@@ -432,20 +801,20 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
-nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
-		     struct route_node *top)
+nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, u_char *flags,
+		     int set, struct route_node *top)
 {
   struct prefix_ipv6 p;
   struct route_table *table;
-  struct route_node *rn;
   struct rib *match;
   struct nexthop *newhop;
+  u_char *newflags;
 
   if (nexthop->type == NEXTHOP_TYPE_IPV6)
     nexthop->ifindex = 0;
 
   if (set)
-    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
+    UNSET_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE);
 
   /* Make lookup prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv6));
@@ -458,76 +827,49 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
   if (! table)
     return 0;
 
-  rn = route_node_match (table, (struct prefix *) &p);
-  while (rn)
+  match = nexthop_resolve (rib, table, (struct prefix *) &p, top);
+  if (! match)
+    return 0;
+
+  if (match->type == ZEBRA_ROUTE_CONNECT)
     {
-      route_unlock_node (rn);
-      
-      /* If lookup self prefix return immidiately. */
-      if (rn == top)
-	return 0;
+      /* Directly point connected route. */
+      newhop = match->nexthop;
 
-      /* Pick up selected route. */
-      for (match = rn->info; match; match = match->next)
-	{
-	  if (CHECK_FLAG (match->status, RIB_ENTRY_REMOVED))
-	    continue;
-	  if (CHECK_FLAG (match->flags, ZEBRA_FLAG_SELECTED))
-	    break;
-	}
+      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
+	nexthop->ifindex = newhop->ifindex;
 
-      /* If there is no selected route or matched route is EGP, go up
-         tree. */
-      if (! match
-	  || match->type == ZEBRA_ROUTE_BGP)
-	{
-	  do {
-	    rn = rn->parent;
-	  } while (rn && rn->info == NULL);
-	  if (rn)
-	    route_lock_node (rn);
-	}
-      else
-	{
-	  if (match->type == ZEBRA_ROUTE_CONNECT)
-	    {
-	      /* Directly point connected route. */
-	      newhop = match->nexthop;
+      /* No longer recursive, resolve again on installing. */
+      if (! set && CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
+	SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
 
-	      if (newhop && nexthop->type == NEXTHOP_TYPE_IPV6)
-		nexthop->ifindex = newhop->ifindex;
-	      
-	      return 1;
-	    }
-	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
-	    {
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
-		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
-		  {
-		    if (set)
-		      {
-			SET_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE);
-			nexthop->rtype = newhop->type;
-			if (newhop->type == NEXTHOP_TYPE_IPV6
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
-			  nexthop->rgate.ipv6 = newhop->gate.ipv6;
-			if (newhop->type == NEXTHOP_TYPE_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IFNAME
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
-			    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
-			  nexthop->rifindex = newhop->ifindex;
-		      }
-		    return 1;
-		  }
-	      return 0;
-	    }
-	  else
-	    {
-	      return 0;
-	    }
-	}
+      return 1;
+    }
+  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
+    {
+      for (ALL_RIB_NEXTHOPS (match, newhop, newflags))
+	if (CHECK_FLAG (*newflags, NEXTHOP_FLAG_FIB)
+	    && ! CHECK_FLAG (*newflags, NEXTHOP_FLAG_RECURSIVE))
+	  {
+	    if (set)
+	      {
+		SET_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE);
+		nexthop->rtype = newhop->type;
+		if (newhop->type == NEXTHOP_TYPE_IPV6
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
+		  nexthop->rgate.ipv6 = newhop->gate.ipv6;
+		if (newhop->type == NEXTHOP_TYPE_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IFNAME
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFINDEX
+		    || newhop->type == NEXTHOP_TYPE_IPV6_IFNAME)
+		  nexthop->rifindex = newhop->ifindex;
+	      }
+	    else if (! nexthop_recursive_same (nexthop, flags, newhop))
+	      SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+	    return 1;
+	  }
+      return 0;
     }
   return 0;
 }
@@ -541,6 +883,7 @@ rib_match_ipv4 (struct in_addr addr)
   struct route_node *rn;
   struct rib *match;
   struct nexthop *newhop;
+  u_char *flags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
@@ -585,8 +928,8 @@ rib_match_ipv4 (struct in_addr addr)
 	    return match;
 	  else
 	    {
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB))
+	      for (ALL_RIB_NEXTHOPS (match, newhop, flags))
+		if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
 		  return match;
 	      return NULL;
 	    }
@@ -602,6 +945,7 @@ rib_lookup_ipv4 (struct prefix_ipv4 *p)
   struct route_node *rn;
   struct rib *match;
   struct nexthop *nexthop;
+  u_char *flags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
@@ -631,8 +975,8 @@ rib_lookup_ipv4 (struct prefix_ipv4 *p)
   if (match->type == ZEBRA_ROUTE_CONNECT)
     return match;
   
-  for (nexthop = match->nexthop; nexthop; nexthop = nexthop->next)
-    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+  for (ALL_RIB_NEXTHOPS (match, nexthop, flags))
+    if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
       return match;
 
   return NULL;
@@ -657,6 +1001,7 @@ rib_lookup_ipv4_route (struct prefix_ipv4 *p, union sockunion * qgate)
   struct route_node *rn;
   struct rib *match;
   struct nexthop *nexthop;
+  u_char *flags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
@@ -690,8 +1035,8 @@ rib_lookup_ipv4_route (struct prefix_ipv4 *p, union sockunion * qgate)
     return ZEBRA_RIB_FOUND_CONNECTED;
   
   /* Ok, we have a cood candidate, let's check it's nexthop list... */
-  for (nexthop = match->nexthop; nexthop; nexthop = nexthop->next)
-    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+  for (ALL_RIB_NEXTHOPS (match, nexthop, flags))
+    if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
     {
       /* We are happy with either direct or recursive hexthop */
       if (nexthop->gate.ipv4.s_addr == qgate->sin.sin_addr.s_addr ||
@@ -723,6 +1068,7 @@ rib_match_ipv6 (struct in6_addr *addr)
   struct route_node *rn;
   struct rib *match;
   struct nexthop *newhop;
+  u_char *flags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
@@ -767,8 +1113,8 @@ rib_match_ipv6 (struct in6_addr *addr)
 	    return match;
 	  else
 	    {
-	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB))
+	      for (ALL_RIB_NEXTHOPS (match, newhop, flags))
+		if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
 		  return match;
 	      return NULL;
 	    }
@@ -783,7 +1129,7 @@ rib_match_ipv6 (struct in6_addr *addr)
 
 /* This function verifies reachability of one given nexthop, which can be
  * numbered or unnumbered, IPv4 or IPv6. The result is unconditionally stored
- * in nexthop->flags field. If the 4th parameter, 'set', is non-zero,
+ * in flags, those of nexthop in rib. If the 5th parameter, 'set', is non-zero,
  * nexthop->ifindex will be updated appropriately as well.
  * An existing route map can turn (otherwise active) nexthop into inactive, but
  * not vice versa.
@@ -793,7 +1139,7 @@ rib_match_ipv6 (struct in6_addr *addr)
 
 static int
 nexthop_active_check (struct route_node *rn, struct rib *rib,
-		      struct nexthop *nexthop, int set)
+		      struct nexthop *nexthop, u_char *flags, int set)
 {
   struct interface *ifp;
   route_map_result_t ret = RMAP_MATCH;
@@ -807,9 +1153,9 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
     case NEXTHOP_TYPE_IFINDEX:
       ifp = if_lookup_by_index (nexthop->ifindex);
       if (ifp && if_is_operative(ifp))
-	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       else
-	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       break;
     case NEXTHOP_TYPE_IPV6_IFNAME:
       family = AFI_IP6;
@@ -819,30 +1165,30 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
 	{
 	  if (set)
 	    nexthop->ifindex = ifp->ifindex;
-	  SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	  SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 	}
       else
 	{
 	  if (set)
 	    nexthop->ifindex = 0;
-	  UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	  UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 	}
       break;
     case NEXTHOP_TYPE_IPV4:
     case NEXTHOP_TYPE_IPV4_IFINDEX:
       family = AFI_IP;
-      if (nexthop_active_ipv4 (rib, nexthop, set, rn))
-	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+      if (nexthop_active_ipv4 (rib, nexthop, flags, set, rn))
+	SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       else
-	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       break;
 #ifdef HAVE_IPV6
     case NEXTHOP_TYPE_IPV6:
       family = AFI_IP6;
-      if (nexthop_active_ipv6 (rib, nexthop, set, rn))
-	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+      if (nexthop_active_ipv6 (rib, nexthop, flags, set, rn))
+	SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       else
-	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       break;
     case NEXTHOP_TYPE_IPV6_IFINDEX:
       family = AFI_IP6;
@@ -850,32 +1196,32 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
 	{
 	  ifp = if_lookup_by_index (nexthop->ifindex);
 	  if (ifp && if_is_operative(ifp))
-	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	    SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 	  else
-	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	    UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 	}
       else
 	{
-	  if (nexthop_active_ipv6 (rib, nexthop, set, rn))
-	    SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	  if (nexthop_active_ipv6 (rib, nexthop, flags, set, rn))
+	    SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 	  else
-	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+	    UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 	}
       break;
 #endif /* HAVE_IPV6 */
     case NEXTHOP_TYPE_BLACKHOLE:
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+      SET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
       break;
     default:
       break;
     }
-  if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+  if (! CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
     return 0;
 
   if (RIB_SYSTEM_ROUTE(rib) ||
       (family == AFI_IP && rn->p.family != AF_INET) ||
       (family == AFI_IP6 && rn->p.family != AF_INET6))
-    return CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+    return CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 
   rmap = 0;
   if (rib->type >= 0 && rib->type < ZEBRA_ROUTE_MAX &&
@@ -888,8 +1234,8 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
   }
 
   if (ret == RMAP_DENYMATCH)
-    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
-  return CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
+    UNSET_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
+  return CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
 }
 
 /* Iterate over all nexthops of the given RIB entry and refresh their
@@ -898,6 +1244,10 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
  * is flagged with ZEBRA_FLAG_CHANGED. The 4th 'set' argument is
  * transparently passed to nexthop_active_check().
  *
+ * Each nexthop is checked on a copy, so that a shared list is only
+ * given up when the nexthop itself changes, its interface index or
+ * recursive gateway being resolved anew.
+ *
  * Return value is the new number of active nexthops.
  */
 
@@ -905,31 +1255,51 @@ static int
 nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
 {
   struct nexthop *nexthop;
-  int prev_active, prev_index, new_active;
+  struct nexthop check;
+  u_char *flags;
+  int prev_active, new_active, i;
 
   rib->nexthop_active_num = 0;
   UNSET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
 
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
   {
-    prev_active = CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
-    prev_index = nexthop->ifindex;
-    if ((new_active = nexthop_active_check (rn, rib, nexthop, set)))
+    prev_active = CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE);
+    check = *nexthop;
+    if ((new_active = nexthop_active_check (rn, rib, &check, flags, set)))
       rib->nexthop_active_num++;
     if (prev_active != new_active ||
-	prev_index != nexthop->ifindex)
+	check.ifindex != nexthop->ifindex)
       SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+
+    if (check.ifindex == nexthop->ifindex
+	&& check.rtype == nexthop->rtype
+	&& check.rifindex == nexthop->rifindex
+	&& ! memcmp (&check.rgate, &nexthop->rgate, sizeof (union g_addr)))
+      continue;
+
+    if (rib->nhg)
+      {
+	rib_nexthop_unshare (rib);
+	for (i = flags - rib->nexthop_flags, nexthop = rib->nexthop; i; i--)
+	  nexthop = nexthop->next;
+      }
+    nexthop->ifindex = check.ifindex;
+    nexthop->rtype = check.rtype;
+    nexthop->rifindex = check.rifindex;
+    nexthop->rgate = check.rgate;
   }
   return rib->nexthop_active_num;
 }
 
-
+
 
 static void
 rib_install_kernel (struct route_node *rn, struct rib *rib)
 {
   int ret = 0;
   struct nexthop *nexthop;
+  u_char *flags;
 
   switch (PREFIX_FAMILY (&rn->p))
     {
@@ -946,8 +1316,8 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
   /* This condition is never met, if we are using rt_socket.c */
   if (ret < 0)
     {
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+	UNSET_FLAG (*flags, NEXTHOP_FLAG_FIB);
     }
 }
 
@@ -957,6 +1327,7 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
 {
   int ret = 0;
   struct nexthop *nexthop;
+  u_char *flags;
 
   switch (PREFIX_FAMILY (&rn->p))
     {
@@ -970,8 +1341,8 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
 #endif /* HAVE_IPV6 */
     }
 
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+    UNSET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
   return ret;
 }
@@ -991,6 +1362,68 @@ rib_uninstall (struct route_node *rn, struct rib *rib)
 
 static void rib_unlink (struct route_node *, struct rib *);
 
+/* Convergence statistics, from the receipt of a route by the client
+   until the kernel has acknowledged its installation.  */
+enum
+{
+  RIB_LATENCY_ZSERV,
+  RIB_LATENCY_QUEUE,
+  RIB_LATENCY_KERNEL,
+  RIB_LATENCY_TOTAL,
+  RIB_LATENCY_MAX
+};
+
+static struct latency rib_latency[RIB_LATENCY_MAX] =
+{
+  { "zserv" },
+  { "queue" },
+  { "kernel" },
+  { "total" },
+};
+
+/* rib arrived from a client which received it at origin.  */
+void
+rib_stamp_received (struct rib *rib, struct timeval *origin)
+{
+  rib->stamp = XCALLOC (MTYPE_RIB_STAMP, sizeof (struct rib_stamp));
+  rib->stamp->origin = *origin;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &rib->stamp->recv);
+
+  latency_add (&rib_latency[RIB_LATENCY_ZSERV], origin, &rib->stamp->recv);
+}
+
+/* rib, processed from start, has been installed in the kernel.  */
+static void
+rib_stamp_installed (struct rib *rib, struct timeval *start)
+{
+  struct timeval now;
+
+  if (! rib->stamp)
+    return;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  latency_add (&rib_latency[RIB_LATENCY_KERNEL], start, &now);
+  latency_add (&rib_latency[RIB_LATENCY_TOTAL], &rib->stamp->origin, &now);
+
+  XFREE (MTYPE_RIB_STAMP, rib->stamp);
+  rib->stamp = NULL;
+}
+
+void
+rib_latency_vty (struct vty *vty)
+{
+  latency_vty (vty, rib_latency, RIB_LATENCY_MAX);
+}
+
+void
+rib_latency_reset (void)
+{
+  int i;
+
+  for (i = 0; i < RIB_LATENCY_MAX; i++)
+    latency_reset (&rib_latency[i]);
+}
+
 /* Core function for processing routing information base. */
 static void
 rib_process (struct route_node *rn)
@@ -1002,13 +1435,25 @@ rib_process (struct route_node *rn)
   struct rib *del = NULL;
   int installed = 0;
   struct nexthop *nexthop = NULL;
+  u_char *flags;
   char buf[INET6_ADDRSTRLEN];
+  struct timeval start;
   
   assert (rn);
   
   if (IS_ZEBRA_DEBUG_RIB || IS_ZEBRA_DEBUG_RIB_Q)
     inet_ntop (rn->p.family, &rn->p.u.prefix, buf, INET6_ADDRSTRLEN);
 
+  timerclear (&start);
+  for (rib = rn->info; rib; rib = rib->next)
+    if (rib->stamp)
+      {
+	if (! timerisset (&start))
+	  quagga_gettime (QUAGGA_CLK_MONOTONIC, &start);
+	latency_add (&rib_latency[RIB_LATENCY_QUEUE], &rib->stamp->recv,
+		     &start);
+      }
+
   for (rib = rn->info; rib; rib = next)
     {
       /* The next pointer is saved, because current pointer
@@ -1115,7 +1560,10 @@ rib_process (struct route_node *rn)
           nexthop_active_update (rn, select, 1);
   
           if (! RIB_SYSTEM_ROUTE (select))
-            rib_install_kernel (rn, select);
+            {
+              rib_install_kernel (rn, select);
+              rib_stamp_installed (select, &start);
+            }
           redistribute_add (&rn->p, select);
         }
       else if (! RIB_SYSTEM_ROUTE (select))
@@ -1127,8 +1575,8 @@ rib_process (struct route_node *rn)
              This makes sure the routes are IN the kernel.
            */
 
-          for (nexthop = select->nexthop; nexthop; nexthop = nexthop->next)
-            if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+          for (ALL_RIB_NEXTHOPS (select, nexthop, flags))
+            if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
             {
               installed = 1;
               break;
@@ -1170,11 +1618,19 @@ rib_process (struct route_node *rn)
       nexthop_active_update (rn, select, 1);
 
       if (! RIB_SYSTEM_ROUTE (select))
-        rib_install_kernel (rn, select);
+        {
+          rib_install_kernel (rn, select);
+          rib_stamp_installed (select, &start);
+        }
       SET_FLAG (select->flags, ZEBRA_FLAG_SELECTED);
       redistribute_add (&rn->p, select);
     }
 
+  /* Gateways within rn may resolve through another node now. */
+  if ((fib && fib->type != ZEBRA_ROUTE_BGP)
+      || (select && select->type != ZEBRA_ROUTE_BGP))
+    rib_dep_resolve_changed (rn);
+
   /* FIB route was removed, should be deleted */
   if (del)
     {
@@ -1185,6 +1641,18 @@ rib_process (struct route_node *rn)
     }
 
 end:
+  for (rib = rn->info; rib; rib = rib->next)
+    rib_nexthop_intern (rib);
+
+  /* Routes which did not make it to the kernel are not accounted.  */
+  if (timerisset (&start))
+    for (rib = rn->info; rib; rib = rib->next)
+      if (rib->stamp)
+	{
+	  XFREE (MTYPE_RIB_STAMP, rib->stamp);
+	  rib->stamp = NULL;
+	}
+
   if (IS_ZEBRA_DEBUG_RIB_Q)
     zlog_debug ("%s: %s/%d: rn %p dequeued", __func__, buf, rn->p.prefixlen, rn);
 }
@@ -1424,6 +1892,266 @@ rib_queue_init (struct zebra_t *zebra)
  *
  */
  
+static unsigned int
+rib_dep_if_hash (void *arg)
+{
+  return ((struct rib_dep_key *) arg)->ifindex;
+}
+
+static int
+rib_dep_if_cmp (const void *a, const void *b)
+{
+  return ((const struct rib_dep_key *) a)->ifindex
+    == ((const struct rib_dep_key *) b)->ifindex;
+}
+
+static void *
+rib_dep_if_alloc (void *arg)
+{
+  struct rib_dep_key *key;
+
+  key = XCALLOC (MTYPE_RIB_DEP_KEY, sizeof (struct rib_dep_key));
+  key->ifindex = ((struct rib_dep_key *) arg)->ifindex;
+  return key;
+}
+
+static struct rib_dep_key *
+rib_dep_if_key (unsigned int ifindex)
+{
+  struct rib_dep_key lookup;
+
+  if (! rib_dep_ifs)
+    rib_dep_ifs = hash_create (rib_dep_if_hash, rib_dep_if_cmp);
+
+  lookup.ifindex = ifindex;
+  return hash_get (rib_dep_ifs, &lookup, rib_dep_if_alloc);
+}
+
+static struct rib_dep_key *
+rib_dep_gw_key (int family, union g_addr *gate)
+{
+  struct prefix p;
+  struct route_node *node;
+  struct rib_dep_key *key;
+  afi_t afi;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = family;
+  if (family == AF_INET)
+    {
+      p.prefixlen = IPV4_MAX_BITLEN;
+      p.u.prefix4 = gate->ipv4;
+    }
+#ifdef HAVE_IPV6
+  else
+    {
+      p.prefixlen = IPV6_MAX_BITLEN;
+      p.u.prefix6 = gate->ipv6;
+    }
+#endif /* HAVE_IPV6 */
+
+  afi = family2afi (family);
+  if (! rib_dep_gws[afi])
+    rib_dep_gws[afi] = route_table_init ();
+
+  /* The key holds the lock taken here. */
+  node = route_node_get (rib_dep_gws[afi], &p);
+  if (node->info)
+    {
+      route_unlock_node (node);
+      return node->info;
+    }
+
+  key = XCALLOC (MTYPE_RIB_DEP_KEY, sizeof (struct rib_dep_key));
+  key->node = node;
+  node->info = key;
+  return key;
+}
+
+static void
+rib_dep_add (struct route_node *rn, struct rib *rib, struct rib_dep_key *key)
+{
+  struct rib_dep *dep;
+
+  for (dep = rib->deps; dep; dep = dep->next)
+    if (dep->key == key)
+      return;
+
+  dep = XCALLOC (MTYPE_RIB_DEP, sizeof (struct rib_dep));
+  dep->key = key;
+  dep->rib = rib;
+  dep->rn = rn;
+
+  dep->key_next = key->deps;
+  if (key->deps)
+    key->deps->key_prev = &dep->key_next;
+  dep->key_prev = &key->deps;
+  key->deps = dep;
+
+  dep->next = rib->deps;
+  rib->deps = dep;
+}
+
+/* Index rib by what nexthop_active_check looks at for its nexthops. */
+static void
+rib_dep_index (struct route_node *rn, struct rib *rib)
+{
+  struct nexthop *nexthop;
+
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    switch (nexthop->type)
+      {
+      case NEXTHOP_TYPE_IFINDEX:
+	rib_dep_add (rn, rib, rib_dep_if_key (nexthop->ifindex));
+	break;
+      case NEXTHOP_TYPE_IFNAME:
+      case NEXTHOP_TYPE_IPV6_IFNAME:
+	rib_dep_add (rn, rib, rib_dep_if_key (IFINDEX_INTERNAL));
+	break;
+      case NEXTHOP_TYPE_IPV4:
+      case NEXTHOP_TYPE_IPV4_IFINDEX:
+	rib_dep_add (rn, rib, rib_dep_gw_key (AF_INET, &nexthop->gate));
+	break;
+#ifdef HAVE_IPV6
+      case NEXTHOP_TYPE_IPV6:
+	rib_dep_add (rn, rib, rib_dep_gw_key (AF_INET6, &nexthop->gate));
+	break;
+      case NEXTHOP_TYPE_IPV6_IFINDEX:
+	if (IN6_IS_ADDR_LINKLOCAL (&nexthop->gate.ipv6))
+	  rib_dep_add (rn, rib, rib_dep_if_key (nexthop->ifindex));
+	else
+	  rib_dep_add (rn, rib, rib_dep_gw_key (AF_INET6, &nexthop->gate));
+	break;
+#endif /* HAVE_IPV6 */
+      default:
+	break;
+      }
+}
+
+static void
+rib_dep_unindex (struct rib *rib)
+{
+  struct rib_dep *dep;
+  struct rib_dep_key *key;
+
+  while ((dep = rib->deps) != NULL)
+    {
+      rib->deps = dep->next;
+
+      *dep->key_prev = dep->key_next;
+      if (dep->key_next)
+	dep->key_next->key_prev = dep->key_prev;
+
+      key = dep->key;
+      if (! key->deps)
+	{
+	  if (key->node)
+	    {
+	      key->node->info = NULL;
+	      route_unlock_node (key->node);
+	      if (key->resolving)
+		route_unlock_node (key->resolving);
+	    }
+	  else
+	    hash_release (rib_dep_ifs, key);
+	  XFREE (MTYPE_RIB_DEP_KEY, key);
+	}
+      XFREE (MTYPE_RIB_DEP, dep);
+    }
+}
+
+/* The nexthops of rib, linked at rn, have changed. */
+static void
+rib_dep_reindex (struct route_node *rn, struct rib *rib)
+{
+  rib_dep_unindex (rib);
+  rib_dep_index (rn, rib);
+}
+
+/* Queue the nodes with entries depending on key.  Nodes with entries
+   which the gateways of other routes may resolve through, that is
+   anything but BGP, are also added to the resolving list. */
+static void
+rib_dep_queue (struct rib_dep_key *key, struct list *resolving)
+{
+  struct rib_dep *dep;
+
+  for (dep = key->deps; dep; dep = dep->key_next)
+    {
+      rib_queue_add (&zebrad, dep->rn);
+      if (resolving && dep->rib->type != ZEBRA_ROUTE_BGP)
+	listnode_add (resolving, dep->rn);
+    }
+}
+
+/* Queue the nodes with entries whose gateways are within p. */
+static void
+rib_dep_queue_gateways (struct prefix *p, struct list *resolving)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *node;
+
+  table = rib_dep_gws[family2afi (p->family)];
+  if (! table)
+    return;
+
+  /* route_next_until drops the lock on top once past it. */
+  top = route_node_get (table, p);
+  for (node = top; node; node = route_next_until (node, top))
+    if (node->info)
+      rib_dep_queue (node->info, resolving);
+}
+
+/* The entry selected at rn changed, from or to one gateways may
+   resolve through.  Forget how the gateways within rn resolved, bar
+   those resolving through a more specific node, and queue the routes
+   through them. */
+static void
+rib_dep_resolve_changed (struct route_node *rn)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *node;
+  struct rib_dep_key *key;
+
+  table = rib_dep_gws[family2afi (rn->p.family)];
+  if (! table)
+    return;
+
+  top = route_node_get (table, &rn->p);
+  for (node = top; node; node = route_next_until (node, top))
+    {
+      if ((key = node->info) == NULL)
+	continue;
+
+      if (key->resolving
+	  && key->resolving->p.prefixlen > rn->p.prefixlen)
+	continue;
+
+      if (key->resolving)
+	route_unlock_node (key->resolving);
+      key->resolving = NULL;
+      key->resolved = 0;
+      rib_dep_queue (key, NULL);
+    }
+}
+
+/* Queue the nodes with entries resolving their gateways through the
+   nodes on the resolving list in turn, as nexthop_active_ipv4 does
+   one level deep, then free the list.  The walks of the gateway table
+   are done after the first round, rather than while in it. */
+static void
+rib_dep_queue_resolved (struct list *resolving)
+{
+  struct listnode *node;
+  struct route_node *rn;
+
+  for (ALL_LIST_ELEMENTS_RO (resolving, node, rn))
+    rib_dep_queue_gateways (&rn->p, NULL);
+  list_delete (resolving);
+}
+
 /* Add RIB to head of the route node. */
 static void
 rib_link (struct route_node *rn, struct rib *rib)
@@ -1454,6 +2182,7 @@ rib_link (struct route_node *rn, struct rib *rib)
     }
   rib->next = head;
   rn->info = rib;
+  rib_dep_index (rn, rib);
   rib_queue_add (&zebrad, rn);
 }
 
@@ -1481,7 +2210,6 @@ rib_addnode (struct route_node *rn, struct rib *rib)
 static void
 rib_unlink (struct route_node *rn, struct rib *rib)
 {
-  struct nexthop *nexthop, *next;
   char buf[INET6_ADDRSTRLEN];
 
   assert (rn && rib);
@@ -1511,17 +2239,74 @@ rib_unlink (struct route_node *rn, struct rib *rib)
         }
     }
 
+  rib_dep_unindex (rib);
+
   /* free RIB and nexthops */
-  for (nexthop = rib->nexthop; nexthop; nexthop = next)
-    {
-      next = nexthop->next;
-      nexthop_free (nexthop);
-    }
+  rib_nexthop_free (rib);
+  if (rib->stamp)
+    XFREE (MTYPE_RIB_STAMP, rib->stamp);
   XFREE (MTYPE_RIB, rib);
 
   route_unlock_node (rn); /* rn route table reference */
 }
 
+/* Whether rib, about to be added, is the very route of the existing
+   entry same.  A client announcing again what zebra still has, as
+   bgpd does when it restarts from a checkpoint, then changes nothing,
+   unless the entry was selected but did not make it into the kernel. */
+static int
+rib_same_route (struct rib *rib, struct rib *same)
+{
+  struct nexthop *nexthop;
+  struct nexthop *snexthop;
+  u_char *flags;
+
+  if (rib->distance != same->distance
+      || rib->metric != same->metric
+      || (rib->flags & ~ZEBRA_FLAG_SELECTED)
+	 != (same->flags & ~ZEBRA_FLAG_SELECTED)
+      || rib->nexthop_num != same->nexthop_num)
+    return 0;
+
+  for (nexthop = rib->nexthop, snexthop = same->nexthop;
+       nexthop && snexthop;
+       nexthop = nexthop->next, snexthop = snexthop->next)
+    {
+      if (nexthop->type != snexthop->type
+	  || nexthop->ifindex != snexthop->ifindex
+	  || memcmp (&nexthop->gate, &snexthop->gate, sizeof (union g_addr))
+	  || memcmp (&nexthop->src, &snexthop->src, sizeof (union g_addr)))
+	return 0;
+      if ((nexthop->ifname || snexthop->ifname)
+	  && (! nexthop->ifname || ! snexthop->ifname
+	      || strcmp (nexthop->ifname, snexthop->ifname)))
+	return 0;
+    }
+  if (nexthop || snexthop)
+    return 0;
+
+  if (CHECK_FLAG (same->flags, ZEBRA_FLAG_SELECTED))
+    {
+      for (ALL_RIB_NEXTHOPS (same, snexthop, flags))
+	if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
+	  break;
+      if (! snexthop)
+	return 0;
+    }
+
+  return 1;
+}
+
+/* Free a rib which was never linked to a node. */
+static void
+rib_discard (struct rib *rib)
+{
+  rib_nexthop_free (rib);
+  if (rib->stamp)
+    XFREE (MTYPE_RIB_STAMP, rib->stamp);
+  XFREE (MTYPE_RIB, rib);
+}
+
 static void
 rib_delnode (struct route_node *rn, struct rib *rib)
 {
@@ -1547,6 +2332,7 @@ rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
   struct route_table *table;
   struct route_node *rn;
   struct nexthop *nexthop;
+  u_char *nhflags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
@@ -1617,8 +2403,8 @@ rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
 
   /* If this route is kernel route, set FIB flag to the route. */
   if (type == ZEBRA_ROUTE_KERNEL || type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    for (ALL_RIB_NEXTHOPS (rib, nexthop, nhflags))
+      SET_FLAG (*nhflags, NEXTHOP_FLAG_FIB);
 
   /* Link new rib to node.*/
   if (IS_ZEBRA_DEBUG_RIB)
@@ -1646,6 +2432,7 @@ void rib_dump (const char * func, const struct prefix_ipv4 * p, const struct rib
 {
   char straddr1[INET_ADDRSTRLEN], straddr2[INET_ADDRSTRLEN];
   struct nexthop *nexthop;
+  u_char *flags;
 
   inet_ntop (AF_INET, &p->prefix, straddr1, INET_ADDRSTRLEN);
   zlog_debug ("%s: dumping RIB entry %p for %s/%d", func, rib, straddr1, p->prefixlen);
@@ -1675,7 +2462,7 @@ void rib_dump (const char * func, const struct prefix_ipv4 * p, const struct rib
     rib->nexthop_active_num,
     rib->nexthop_fib_num
   );
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
   {
     inet_ntop (AF_INET, &nexthop->gate.ipv4.s_addr, straddr1, INET_ADDRSTRLEN);
     inet_ntop (AF_INET, &nexthop->rgate.ipv4.s_addr, straddr2, INET_ADDRSTRLEN);
@@ -1685,9 +2472,9 @@ void rib_dump (const char * func, const struct prefix_ipv4 * p, const struct rib
       func,
       straddr1,
       straddr2,
-      (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE) ? "ACTIVE " : ""),
-      (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? "FIB " : ""),
-      (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE) ? "RECURSIVE" : "")
+      (CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE) ? "ACTIVE " : ""),
+      (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB) ? "FIB " : ""),
+      (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE) ? "RECURSIVE" : "")
     );
   }
   zlog_debug ("%s: dump complete", func);
@@ -1801,6 +2588,7 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib)
   struct route_node *rn;
   struct rib *same;
   struct nexthop *nexthop;
+  u_char *flags;
   
   /* Lookup table.  */
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
@@ -1834,11 +2622,18 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib)
 	  && same->type != ZEBRA_ROUTE_CONNECT)
         break;
     }
+
+  if (same && rib_same_route (rib, same))
+    {
+      rib_discard (rib);
+      route_unlock_node (rn);
+      return 0;
+    }
   
   /* If this route is kernel route, set FIB flag to the route. */
   if (rib->type == ZEBRA_ROUTE_KERNEL || rib->type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+      SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
   /* Link new rib to node.*/
   rib_addnode (rn, rib);
@@ -1876,6 +2671,7 @@ rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
   struct rib *fib = NULL;
   struct rib *same = NULL;
   struct nexthop *nexthop;
+  u_char *nhflags;
   char buf1[INET_ADDRSTRLEN];
   char buf2[INET_ADDRSTRLEN];
 
@@ -1957,8 +2753,8 @@ rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
       if (fib && type == ZEBRA_ROUTE_KERNEL)
 	{
 	  /* Unset flags. */
-	  for (nexthop = fib->nexthop; nexthop; nexthop = nexthop->next)
-	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	  for (ALL_RIB_NEXTHOPS (fib, nexthop, nhflags))
+	    UNSET_FLAG (*nhflags, NEXTHOP_FLAG_FIB);
 
 	  UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 	}
@@ -2033,6 +2829,7 @@ static_install_ipv4 (struct prefix *p, struct static_ipv4 *si)
             nexthop_blackhole_add (rib);
             break;
         }
+      rib_dep_reindex (rn, rib);
       rib_queue_add (&zebrad, rn);
     }
   else
@@ -2090,6 +2887,7 @@ static_uninstall_ipv4 (struct prefix *p, struct static_ipv4 *si)
   struct route_node *rn;
   struct rib *rib;
   struct nexthop *nexthop;
+  u_char *flags;
   struct route_table *table;
 
   /* Lookup table.  */
@@ -2117,8 +2915,9 @@ static_uninstall_ipv4 (struct prefix *p, struct static_ipv4 *si)
       return;
     }
 
-  /* Lookup nexthop. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  /* Lookup nexthop, in a list of the entry's own to remove it from. */
+  rib_nexthop_unshare (rib);
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     if (static_ipv4_nexthop_same (nexthop, si))
       break;
 
@@ -2134,10 +2933,11 @@ static_uninstall_ipv4 (struct prefix *p, struct static_ipv4 *si)
     rib_delnode (rn, rib);
   else
     {
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
         rib_uninstall (rn, rib);
       nexthop_delete (rib, nexthop);
       nexthop_free (nexthop);
+      rib_dep_reindex (rn, rib);
       rib_queue_add (&zebrad, rn);
     }
   /* Unlock node. */
@@ -2336,6 +3136,7 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
   struct route_table *table;
   struct route_node *rn;
   struct nexthop *nexthop;
+  u_char *nhflags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
@@ -2406,8 +3207,71 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 
   /* If this route is kernel route, set FIB flag to the route. */
   if (type == ZEBRA_ROUTE_KERNEL || type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    for (ALL_RIB_NEXTHOPS (rib, nexthop, nhflags))
+      SET_FLAG (*nhflags, NEXTHOP_FLAG_FIB);
+
+  /* Link new rib to node.*/
+  rib_addnode (rn, rib);
+
+  /* Free implicit route.*/
+  if (same)
+    rib_delnode (rn, same);
+  
+  route_unlock_node (rn);
+  return 0;
+}
+
+int
+rib_add_ipv6_multipath (struct prefix_ipv6 *p, struct rib *rib)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *same;
+  struct nexthop *nexthop;
+  u_char *flags;
+  
+  /* Lookup table.  */
+  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
+  if (! table)
+    return 0;
+
+  /* Make sure mask is applied. */
+  apply_mask_ipv6 (p);
+
+  /* Set default distance by route type. */
+  if (rib->distance == 0)
+    rib->distance = route_info[rib->type].distance;
+
+  if (rib->type == ZEBRA_ROUTE_BGP 
+      && CHECK_FLAG (rib->flags, ZEBRA_FLAG_IBGP))
+    rib->distance = 200;
+
+  /* Lookup route node.*/
+  rn = route_node_get (table, (struct prefix *) p);
+
+  /* If same type of route are installed, treat it as a implicit
+     withdraw. */
+  for (same = rn->info; same; same = same->next)
+    {
+      if (CHECK_FLAG (same->status, RIB_ENTRY_REMOVED))
+        continue;
+      
+      if (same->type == rib->type && same->table == rib->table
+	  && same->type != ZEBRA_ROUTE_CONNECT)
+        break;
+    }
+
+  if (same && rib_same_route (rib, same))
+    {
+      rib_discard (rib);
+      route_unlock_node (rn);
+      return 0;
+    }
+  
+  /* If this route is kernel route, set FIB flag to the route. */
+  if (rib->type == ZEBRA_ROUTE_KERNEL || rib->type == ZEBRA_ROUTE_CONNECT)
+    for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+      SET_FLAG (*flags, NEXTHOP_FLAG_FIB);
 
   /* Link new rib to node.*/
   rib_addnode (rn, rib);
@@ -2431,6 +3295,7 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
   struct rib *fib = NULL;
   struct rib *same = NULL;
   struct nexthop *nexthop;
+  u_char *nhflags;
   char buf1[INET6_ADDRSTRLEN];
   char buf2[INET6_ADDRSTRLEN];
 
@@ -2505,8 +3370,8 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
       if (fib && type == ZEBRA_ROUTE_KERNEL)
 	{
 	  /* Unset flags. */
-	  for (nexthop = fib->nexthop; nexthop; nexthop = nexthop->next)
-	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	  for (ALL_RIB_NEXTHOPS (fib, nexthop, nhflags))
+	    UNSET_FLAG (*nhflags, NEXTHOP_FLAG_FIB);
 
 	  UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 	}
@@ -2582,6 +3447,7 @@ static_install_ipv6 (struct prefix *p, struct static_ipv6 *si)
 	  nexthop_ipv6_ifname_add (rib, &si->ipv6, si->ifname);
 	  break;
 	}
+      rib_dep_reindex (rn, rib);
       rib_queue_add (&zebrad, rn);
     }
   else
@@ -2641,6 +3507,7 @@ static_uninstall_ipv6 (struct prefix *p, struct static_ipv6 *si)
   struct route_node *rn;
   struct rib *rib;
   struct nexthop *nexthop;
+  u_char *flags;
 
   /* Lookup table.  */
   table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
@@ -2667,8 +3534,9 @@ static_uninstall_ipv6 (struct prefix *p, struct static_ipv6 *si)
       return;
     }
 
-  /* Lookup nexthop. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  /* Lookup nexthop, in a list of the entry's own to remove it from. */
+  rib_nexthop_unshare (rib);
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     if (static_ipv6_nexthop_same (nexthop, si))
       break;
 
@@ -2686,10 +3554,11 @@ static_uninstall_ipv6 (struct prefix *p, struct static_ipv6 *si)
     }
   else
     {
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
         rib_uninstall (rn, rib);
       nexthop_delete (rib, nexthop);
       nexthop_free (nexthop);
+      rib_dep_reindex (rn, rib);
       rib_queue_add (&zebrad, rn);
     }
   /* Unlock node. */
@@ -2858,20 +3727,132 @@ rib_update (void)
         rib_queue_add (&zebrad, rn);
 }
 
-/* Interface goes up. */
+/* Damping of interfaces flapping, see rib_update_interface. */
+#define RIB_FLAP_WINDOW      60
+#define RIB_FLAP_THRESHOLD    3
+#define RIB_FLAP_HOLD_MAX    32
+
+/* Examine again the routes through ifp, or through gateways within
+   its addresses. */
 static void
-rib_if_up (struct interface *ifp)
+rib_update_interface_now (struct interface *ifp)
 {
-  rib_update ();
+  struct list *resolving;
+  struct rib_dep_key lookup;
+  struct rib_dep_key *key;
+  struct listnode *node;
+  struct connected *ifc;
+  struct prefix p;
+
+  resolving = list_new ();
+
+  if (rib_dep_ifs)
+    {
+      lookup.ifindex = ifp->ifindex;
+      if ((key = hash_lookup (rib_dep_ifs, &lookup)) != NULL)
+	rib_dep_queue (key, resolving);
+
+      lookup.ifindex = IFINDEX_INTERNAL;
+      if (ifp->ifindex != IFINDEX_INTERNAL
+	  && (key = hash_lookup (rib_dep_ifs, &lookup)) != NULL)
+	rib_dep_queue (key, resolving);
+    }
+
+  for (ALL_LIST_ELEMENTS_RO (ifp->connected, node, ifc))
+    {
+      prefix_copy (&p, CONNECTED_PREFIX (ifc));
+      apply_mask (&p);
+      rib_dep_queue_gateways (&p, resolving);
+    }
+
+  rib_dep_queue_resolved (resolving);
 }
 
-/* Interface goes down. */
-static void
-rib_if_down (struct interface *ifp)
+static int
+rib_update_interface_hold (struct thread *thread)
 {
-  rib_update ();
+  struct interface *ifp = THREAD_ARG (thread);
+  struct zebra_if *zif = ifp->info;
+
+  zif->t_rib_hold = NULL;
+
+  if (IS_ZEBRA_DEBUG_EVENT)
+    zlog_debug ("%s: hold time over, examining its routes", ifp->name);
+  rib_update_interface_now (ifp);
+  return 0;
 }
-
+
+/* Interface ifp went up or down.  Routes through an interface going
+   down are examined right away, but once it has flapped
+   RIB_FLAP_THRESHOLD times, each flap no more than RIB_FLAP_WINDOW
+   seconds after the one before, the routes through it coming back are
+   held back for a time doubling with each further flap, up to
+   RIB_FLAP_HOLD_MAX seconds.  Called before the connected routes of
+   an interface coming up are added, so that rib_update_connected
+   honours the hold too. */
+void
+rib_update_interface (struct interface *ifp, int up)
+{
+  struct zebra_if *zif = ifp->info;
+  time_t now;
+  unsigned int hold;
+  unsigned int i;
+
+  now = recent_relative_time ().tv_sec;
+
+  if (! up)
+    {
+      if (now - zif->flap_time > RIB_FLAP_WINDOW)
+	zif->flaps = 0;
+      zif->flaps++;
+      zif->flap_time = now;
+
+      THREAD_TIMER_OFF (zif->t_rib_hold);
+      rib_update_interface_now (ifp);
+      return;
+    }
+
+  if (zif->t_rib_hold)
+    return;
+
+  if (zif->flaps < RIB_FLAP_THRESHOLD
+      || now - zif->flap_time > RIB_FLAP_WINDOW)
+    {
+      rib_update_interface_now (ifp);
+      return;
+    }
+
+  hold = 1;
+  for (i = RIB_FLAP_THRESHOLD; i < zif->flaps && hold < RIB_FLAP_HOLD_MAX; i++)
+    hold <<= 1;
+
+  zlog_info ("interface %s flapped %u times, holding back its routes "
+	     "for %u seconds", ifp->name, zif->flaps, hold);
+  zif->t_rib_hold = thread_add_timer (zebrad.master,
+				      rib_update_interface_hold, ifp, hold);
+}
+
+/* Address p of ifp was added or removed, examine again the routes
+   through gateways within it. */
+void
+rib_update_connected (struct interface *ifp, struct prefix *p)
+{
+  struct zebra_if *zif = ifp->info;
+  struct list *resolving;
+  struct prefix network;
+
+  /* All looked at once the hold is over. */
+  if (zif && zif->t_rib_hold)
+    return;
+
+  prefix_copy (&network, p);
+  apply_mask (&network);
+
+  resolving = list_new ();
+  rib_dep_queue_gateways (&network, resolving);
+  rib_dep_queue_resolved (resolving);
+}
+
 /* Remove all routes which comes from non main table.  */
 static void
 rib_weed_table (struct route_table *table)
@@ -2962,6 +3943,7 @@ rib_close (void)
 {
   rib_close_table (vrf_table (AFI_IP, SAFI_UNICAST, 0));
   rib_close_table (vrf_table (AFI_IP6, SAFI_UNICAST, 0));
+  kernel_flush ();
 }
 
 /* Routing information base initialize. */
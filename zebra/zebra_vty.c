@@ -534,6 +534,7 @@ vty_show_ip_route_detail (struct vty *vty, struct route_node *rn)
 {
   struct rib *rib;
   struct nexthop *nexthop;
+  u_char *flags;
 
   for (rib = rn->info; rib; rib = rib->next)
     {
@@ -581,12 +582,12 @@ vty_show_ip_route_detail (struct vty *vty, struct route_node *rn)
 	  vty_out (vty, " ago%s", VTY_NEWLINE);
 	}
 
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
 	{
           char addrstr[32];
 
 	  vty_out (vty, "  %c",
-		   CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? '*' : ' ');
+		   CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB) ? '*' : ' ');
 
 	  switch (nexthop->type)
 	    {
@@ -609,10 +610,10 @@ vty_show_ip_route_detail (struct vty *vty, struct route_node *rn)
       default:
 	      break;
 	    }
-	  if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	  if (! CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	    vty_out (vty, " inactive");
 
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	    {
 	      vty_out (vty, " (recursive");
 		
@@ -668,11 +669,12 @@ static void
 vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
 {
   struct nexthop *nexthop;
+  u_char *flags;
   int len = 0;
   char buf[BUFSIZ];
 
   /* Nexthop information. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
       if (nexthop == rib->nexthop)
 	{
@@ -681,7 +683,7 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
 			 zebra_route_char (rib->type),
 			 CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
 			 ? '>' : ' ',
-			 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+			 CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)
 			 ? '*' : ' ',
 			 inet_ntop (AF_INET, &rn->p.u.prefix, buf, BUFSIZ),
 			 rn->p.prefixlen);
@@ -694,7 +696,7 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
 	}
       else
 	vty_out (vty, "  %c%*c",
-		 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+		 CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)
 		 ? '*' : ' ',
 		 len - 3, ' ');
 
@@ -719,10 +721,10 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
   default:
 	  break;
 	}
-      if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+      if (! CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	vty_out (vty, " inactive");
 
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+      if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	{
 	  vty_out (vty, " (recursive");
 		
@@ -1062,6 +1064,7 @@ vty_show_ip_route_summary (struct vty *vty, struct route_table *table)
   struct route_node *rn;
   struct rib *rib;
   struct nexthop *nexthop;
+  u_char *flags;
 #define ZEBRA_ROUTE_IBGP  ZEBRA_ROUTE_MAX
 #define ZEBRA_ROUTE_TOTAL (ZEBRA_ROUTE_IBGP + 1)
   u_int32_t rib_cnt[ZEBRA_ROUTE_TOTAL + 1];
@@ -1072,11 +1075,11 @@ vty_show_ip_route_summary (struct vty *vty, struct route_table *table)
   memset (&fib_cnt, 0, sizeof(fib_cnt));
   for (rn = route_top (table); rn; rn = route_next (rn))
     for (rib = rn->info; rib; rib = rib->next)
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
         {
 	  rib_cnt[ZEBRA_ROUTE_TOTAL]++;
 	  rib_cnt[rib->type]++;
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)) 
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)) 
 	    {
 	      fib_cnt[ZEBRA_ROUTE_TOTAL]++;
 	      fib_cnt[rib->type]++;
@@ -1085,7 +1088,7 @@ vty_show_ip_route_summary (struct vty *vty, struct route_table *table)
 	      CHECK_FLAG (rib->flags, ZEBRA_FLAG_IBGP)) 
 	    {
 	      rib_cnt[ZEBRA_ROUTE_IBGP]++;
-	      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)) 
+	      if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)) 
 		fib_cnt[ZEBRA_ROUTE_IBGP]++;
 	    }
 	}
@@ -1535,6 +1538,7 @@ vty_show_ipv6_route_detail (struct vty *vty, struct route_node *rn)
 {
   struct rib *rib;
   struct nexthop *nexthop;
+  u_char *flags;
   char buf[BUFSIZ];
 
   for (rib = rn->info; rib; rib = rib->next)
@@ -1584,10 +1588,10 @@ vty_show_ipv6_route_detail (struct vty *vty, struct route_node *rn)
 	  vty_out (vty, " ago%s", VTY_NEWLINE);
 	}
 
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
 	{
 	  vty_out (vty, "  %c",
-		   CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? '*' : ' ');
+		   CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB) ? '*' : ' ');
 
 	  switch (nexthop->type)
 	    {
@@ -1612,10 +1616,10 @@ vty_show_ipv6_route_detail (struct vty *vty, struct route_node *rn)
 	    default:
 	      break;
 	    }
-	  if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+	  if (! CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	    vty_out (vty, " inactive");
 
-	  if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+	  if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	    {
 	      vty_out (vty, " (recursive");
 		
@@ -1650,11 +1654,12 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
 		     struct rib *rib)
 {
   struct nexthop *nexthop;
+  u_char *flags;
   int len = 0;
   char buf[BUFSIZ];
 
   /* Nexthop information. */
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
       if (nexthop == rib->nexthop)
 	{
@@ -1663,7 +1668,7 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
 			 zebra_route_char (rib->type),
 			 CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
 			 ? '>' : ' ',
-			 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+			 CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)
 			 ? '*' : ' ',
 			 inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, BUFSIZ),
 			 rn->p.prefixlen);
@@ -1676,7 +1681,7 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
 	}
       else
 	vty_out (vty, "  %c%*c",
-		 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+		 CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB)
 		 ? '*' : ' ',
 		 len - 3, ' ');
 
@@ -1703,10 +1708,10 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
 	default:
 	  break;
 	}
-      if (! CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+      if (! CHECK_FLAG (*flags, NEXTHOP_FLAG_ACTIVE))
 	vty_out (vty, " inactive");
 
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE))
+      if (CHECK_FLAG (*flags, NEXTHOP_FLAG_RECURSIVE))
 	{
 	  vty_out (vty, " (recursive");
 		
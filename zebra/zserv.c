@@ -42,6 +42,7 @@
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/ipforward.h"
+#include "zebra/rt.h"
 
 /* Event list of zebra. */
 enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
@@ -53,14 +54,149 @@ static void zebra_event (enum event event, int sock, struct zserv *client);
 extern struct zebra_privs_t zserv_privs;
 
 static void zebra_client_close (struct zserv *client);
+static void zserv_ring_kick (struct zserv *client);
+
+/* A message waiting to be written to a client, its data follows. */
+struct zserv_msg
+{
+  struct zserv_msg *next;
+  size_t len;
+  struct timeval queued;
+};
+#define ZSERV_MSG_DATA(M) ((u_char *) ((M) + 1))
+
+/* Most messages written to a client by one writev. */
+#if defined (IOV_MAX) && IOV_MAX < 64
+#define ZSERV_WRITE_IOV IOV_MAX
+#else
+#define ZSERV_WRITE_IOV 64
+#endif
+
+/* Watermarks of the bytes waiting to be written to a client, between
+   which redistribution to it is held back. */
+#define ZSERV_QUEUE_HIGH_DEFAULT (4 * 1024 * 1024)
+#define ZSERV_QUEUE_LOW_DEFAULT  (1024 * 1024)
+
+static size_t zserv_queue_high = ZSERV_QUEUE_HIGH_DEFAULT;
+static size_t zserv_queue_low = ZSERV_QUEUE_LOW_DEFAULT;
+
+/* Whether clients may exchange messages with zebra in shared memory. */
+static int zserv_ring_enable = 1;
 
 static int
-zserv_delayed_close(struct thread *thread)
+zserv_redist_resume (struct thread *thread)
 {
-  struct zserv *client = THREAD_ARG(thread);
+  struct zserv *client = THREAD_ARG (thread);
+
+  client->t_redist = NULL;
+  redistribute_resume (client);
+  return 0;
+}
+
+/* Whether messages go in the ring, which they do once the client's
+   rings are mapped and the messages queued before are written. */
+static int
+zserv_ring_ready (struct zserv *client)
+{
+  if (client->ring && ! client->ring_out && ! client->out_head)
+    client->ring_out = 1;
+  return client->ring_out;
+}
+
+/* Put as much of the messages in the ring as it takes, like writev. */
+static ssize_t
+zserv_ring_writev (struct zserv *client, struct iovec *iov, int iovcnt)
+{
+  ssize_t nbytes = 0;
+  ssize_t n;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      n = zring_write (client->ring, iov[i].iov_base, iov[i].iov_len);
+      if (n < 0)
+	return -1;
+      nbytes += n;
+      if ((size_t) n < iov[i].iov_len)
+	break;
+    }
+
+  if (nbytes && zring_kick_reader (client->ring))
+    zserv_ring_kick (client);
+  if (nbytes == 0)
+    {
+      errno = EAGAIN;
+      return -1;
+    }
+  return nbytes;
+}
 
-  client->t_suicide = NULL;
-  zebra_client_close(client);
+/* Write as many of the messages waiting as the socket, or the ring,
+   takes, many at a time. */
+static int
+zserv_flush (struct zserv *client)
+{
+  struct iovec iov[ZSERV_WRITE_IOV];
+  struct zserv_msg *msg;
+  struct timeval now;
+  ssize_t nbytes;
+  size_t written;
+  int iovcnt;
+
+  while (client->out_head)
+    {
+      iovcnt = 0;
+      for (msg = client->out_head; msg && iovcnt < ZSERV_WRITE_IOV;
+	   msg = msg->next)
+	{
+	  iov[iovcnt].iov_base = ZSERV_MSG_DATA (msg);
+	  iov[iovcnt].iov_len = msg->len;
+	  iovcnt++;
+	}
+      iov[0].iov_base = ZSERV_MSG_DATA (client->out_head) + client->out_written;
+      iov[0].iov_len -= client->out_written;
+
+      if (client->ring_out)
+	nbytes = zserv_ring_writev (client, iov, iovcnt);
+      else
+	nbytes = writev (client->sock, iov, iovcnt);
+      if (nbytes < 0)
+	{
+	  if (ERRNO_IO_RETRY (errno))
+	    break;
+	  zlog_warn ("%s: writev to zserv client fd %d failed: %s",
+		     __func__, client->sock, safe_strerror (errno));
+	  return -1;
+	}
+      client->out_writes++;
+
+      quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+      written = client->out_written + nbytes;
+      while ((msg = client->out_head) && written >= msg->len)
+	{
+	  written -= msg->len;
+	  client->out_head = msg->next;
+	  client->out_count--;
+	  client->out_bytes -= msg->len;
+	  latency_add (&client->out_latency, &msg->queued, &now);
+	  XFREE (MTYPE_ZSERV_MSG, msg);
+	}
+      if (! client->out_head)
+	client->out_tail = NULL;
+
+      /* The socket is full. */
+      client->out_written = written;
+      if (written)
+	break;
+    }
+
+  if (client->redist_held && client->out_bytes <= zserv_queue_low)
+    {
+      client->redist_held = 0;
+      if (! client->t_redist)
+	client->t_redist = thread_add_event (zebrad.master,
+					     zserv_redist_resume, client, 0);
+    }
   return 0;
 }
 
@@ -70,54 +206,127 @@ zserv_flush_data(struct thread *thread)
   struct zserv *client = THREAD_ARG(thread);
 
   client->t_write = NULL;
-  if (client->t_suicide)
+  if (zserv_flush (client) < 0)
     {
       zebra_client_close(client);
       return -1;
     }
-  switch (buffer_flush_available(client->wb, client->sock))
+  /* A full ring is written to again when the client has made room. */
+  if (client->out_head && ! client->ring_out)
+    client->t_write = thread_add_write(zebrad.master, zserv_flush_data,
+				       client, client->sock);
+  return 0;
+}
+
+/* Queue a message for the client.  Everything sent while the event
+   lasts goes in as few writes as possible once the socket is ready. */
+static int
+zserv_write (struct zserv *client, struct stream *s)
+{
+  struct zserv_msg *msg;
+  size_t len;
+  int ring;
+
+  ring = zserv_ring_ready (client);
+  len = stream_get_endp (s);
+  msg = XMALLOC (MTYPE_ZSERV_MSG, sizeof (struct zserv_msg) + len);
+  msg->next = NULL;
+  msg->len = len;
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &msg->queued);
+  memcpy (ZSERV_MSG_DATA (msg), STREAM_DATA (s), len);
+
+  if (client->out_tail)
+    client->out_tail->next = msg;
+  else
+    client->out_head = msg;
+  client->out_tail = msg;
+
+  client->out_count++;
+  client->out_bytes += len;
+  if (client->out_count > client->out_count_peak)
+    client->out_count_peak = client->out_count;
+  if (client->out_bytes > client->out_bytes_peak)
+    client->out_bytes_peak = client->out_bytes;
+
+  /* A client not keeping up gets no more routes for now. */
+  if (! client->redist_held && client->out_bytes >= zserv_queue_high)
     {
-    case BUFFER_ERROR:
-      zlog_warn("%s: buffer_flush_available failed on zserv client fd %d, "
-      		"closing", __func__, client->sock);
-      zebra_client_close(client);
-      break;
-    case BUFFER_PENDING:
-      client->t_write = thread_add_write(zebrad.master, zserv_flush_data,
-      					 client, client->sock);
-      break;
-    case BUFFER_EMPTY:
-      break;
+      client->redist_held = 1;
+      client->redist_holds++;
+    }
+
+  if (ring)
+    {
+      if (! client->t_write)
+	client->t_write = thread_add_event (zebrad.master, zserv_flush_data,
+					    client, 0);
     }
+  else
+    THREAD_WRITE_ON(zebrad.master, client->t_write,
+		    zserv_flush_data, client, client->sock);
   return 0;
 }
 
+/* Send the route messages batched so far, if any. */
+static int
+zserv_batch_flush (struct zserv *client)
+{
+  int ret;
+
+  THREAD_OFF (client->t_batch);
+  if (stream_get_endp (client->batch) == 0)
+    return 0;
+
+  client->route_msgs_sent++;
+  ret = zserv_write (client, client->batch);
+  stream_reset (client->batch);
+  return ret;
+}
+
+static int
+zserv_batch_send (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+
+  client->t_batch = NULL;
+  return zserv_batch_flush (client);
+}
+
 static int
 zebra_server_send_message(struct zserv *client)
 {
-  if (client->t_suicide)
+  /* Batched route messages were sent before this one. */
+  if (zserv_batch_flush (client) < 0)
     return -1;
-  switch (buffer_write(client->wb, client->sock, STREAM_DATA(client->obuf),
-		       stream_get_endp(client->obuf)))
+  return zserv_write (client, client->obuf);
+}
+
+/* Send the route message in client->obuf, batched with the routes
+   which follow it in the same event if the client takes batches. */
+int
+zserv_route_send (struct zserv *client)
+{
+  client->routes_sent++;
+  if (! CHECK_FLAG (client->capabilities, ZEBRA_CAPABILITY_ROUTE_BATCH))
     {
-    case BUFFER_ERROR:
-      zlog_warn("%s: buffer_write failed to zserv client fd %d, closing",
-      		 __func__, client->sock);
-      /* Schedule a delayed close since many of the functions that call this
-         one do not check the return code.  They do not allow for the
-	 possibility that an I/O error may have caused the client to be
-	 deleted. */
-      client->t_suicide = thread_add_event(zebrad.master, zserv_delayed_close,
-					   client, 0);
-      return -1;
-    case BUFFER_EMPTY:
-      THREAD_OFF(client->t_write);
-      break;
-    case BUFFER_PENDING:
-      THREAD_WRITE_ON(zebrad.master, client->t_write,
-		      zserv_flush_data, client, client->sock);
-      break;
+      client->route_msgs_sent++;
+      return zebra_server_send_message (client);
     }
+
+  if (! zapi_batch_add (client->batch, client->obuf))
+    {
+      if (zserv_batch_flush (client) < 0)
+	return -1;
+      if (! zapi_batch_add (client->batch, client->obuf))
+	{
+	  client->route_msgs_sent++;
+	  return zebra_server_send_message (client);
+	}
+    }
+
+  if (! client->t_batch)
+    client->t_batch = thread_add_event (zebrad.master, zserv_batch_send,
+					client, 0);
   return 0;
 }
 
@@ -131,6 +340,33 @@ zserv_create_header (struct stream *s, uint16_t cmd)
   stream_putw (s, cmd);
 }
 
+/* Tell the client to look at the rings again.  Once messages go in
+   the ring, nothing else is written to the socket and the kick goes
+   straight to it; a kick which does not fit is not needed, the client
+   has others to read. */
+static void
+zserv_ring_kick (struct zserv *client)
+{
+  static struct stream *s;
+
+  if (! s)
+    {
+      s = stream_new (ZEBRA_HEADER_SIZE);
+      zserv_create_header (s, ZEBRA_RING_KICK);
+    }
+
+  client->ring_kicks_sent++;
+  if (! zserv_ring_ready (client))
+    {
+      zserv_write (client, s);
+      return;
+    }
+  if (write (client->sock, STREAM_DATA (s), ZEBRA_HEADER_SIZE) < 0
+      && IS_ZEBRA_DEBUG_EVENT)
+    zlog_debug ("%s: client fd %d: %s", __func__, client->sock,
+		safe_strerror (errno));
+}
+
 /* Interface is added. Send ZEBRA_INTERFACE_ADD to client. */
 /*
  * This function is called in the following situations:
@@ -359,13 +595,14 @@ zsend_interface_update (int cmd, struct zserv *client, struct interface *ifp)
  * zapi_ipv{4,6}_{add, delete} should be re-written to avoid code
  * duplication.
  */
-int
-zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
-                       struct rib *rib)
+void
+zserv_route_encode (int cmd, struct zserv *client, struct prefix *p,
+		    struct rib *rib)
 {
   int psize;
   struct stream *s;
   struct nexthop *nexthop;
+  u_char *flags;
   unsigned long nhnummark = 0, messmark = 0;
   int nhnum = 0;
   u_char zapi_flags = 0;
@@ -398,9 +635,9 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
    */
   /* Nexthop */
   
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+  for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
     {
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
         {
           SET_FLAG (zapi_flags, ZAPI_MESSAGE_NEXTHOP);
           SET_FLAG (zapi_flags, ZAPI_MESSAGE_IFINDEX);
@@ -468,8 +705,14 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
   
   /* Write packet size. */
   stream_putw_at (s, 0, stream_get_endp (s));
+}
 
-  return zebra_server_send_message(client);
+int
+zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
+                       struct rib *rib)
+{
+  zserv_route_encode (cmd, client, p, rib);
+  return zserv_route_send (client);
 }
 
 #ifdef HAVE_IPV6
@@ -481,6 +724,7 @@ zsend_ipv6_nexthop_lookup (struct zserv *client, struct in6_addr *addr)
   unsigned long nump;
   u_char num;
   struct nexthop *nexthop;
+  u_char *flags;
 
   /* Lookup nexthop. */
   rib = rib_match_ipv6 (addr);
@@ -499,8 +743,8 @@ zsend_ipv6_nexthop_lookup (struct zserv *client, struct in6_addr *addr)
       num = 0;
       nump = stream_get_endp(s);
       stream_putc (s, 0);
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+	if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
 	  {
 	    stream_putc (s, nexthop->type);
 	    switch (nexthop->type)
@@ -545,6 +789,7 @@ zsend_ipv4_nexthop_lookup (struct zserv *client, struct in_addr addr)
   unsigned long nump;
   u_char num;
   struct nexthop *nexthop;
+  u_char *flags;
 
   /* Lookup nexthop. */
   rib = rib_match_ipv4 (addr);
@@ -563,8 +808,8 @@ zsend_ipv4_nexthop_lookup (struct zserv *client, struct in_addr addr)
       num = 0;
       nump = stream_get_endp(s);
       stream_putc (s, 0);
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+	if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
 	  {
 	    stream_putc (s, nexthop->type);
 	    switch (nexthop->type)
@@ -603,6 +848,7 @@ zsend_ipv4_import_lookup (struct zserv *client, struct prefix_ipv4 *p)
   unsigned long nump;
   u_char num;
   struct nexthop *nexthop;
+  u_char *flags;
 
   /* Lookup nexthop. */
   rib = rib_lookup_ipv4 (p);
@@ -621,8 +867,8 @@ zsend_ipv4_import_lookup (struct zserv *client, struct prefix_ipv4 *p)
       num = 0;
       nump = stream_get_endp(s);
       stream_putc (s, 0);
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      for (ALL_RIB_NEXTHOPS (rib, nexthop, flags))
+	if (CHECK_FLAG (*flags, NEXTHOP_FLAG_FIB))
 	  {
 	    stream_putc (s, nexthop->type);
 	    switch (nexthop->type)
@@ -681,6 +927,22 @@ zsend_router_id_update (struct zserv *client, struct prefix *p)
 
   return zebra_server_send_message(client);
 }
+
+/* Tell the client the capabilities zebra takes up. */
+static int
+zsend_hello (struct zserv *client)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_HELLO);
+  stream_putl (s, client->capabilities);
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message(client);
+}
 
 /* Register zebra server interface information.  Send current all
    interface and address information. */
@@ -800,6 +1062,15 @@ zread_ipv4_add (struct zserv *client, u_short length)
   /* Metric. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
     rib->metric = stream_getl (s);
+
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_TIMESTAMP))
+    {
+      struct timeval origin;
+
+      origin.tv_sec = stream_getl (s);
+      origin.tv_usec = stream_getl (s);
+      rib_stamp_received (rib, &origin);
+    }
     
   /* Table */
   rib->table=zebrad.rtm_table_default;
@@ -911,64 +1182,96 @@ zread_ipv6_add (struct zserv *client, u_short length)
 {
   int i;
   struct stream *s;
-  struct zapi_ipv6 api;
-  struct in6_addr nexthop;
-  unsigned long ifindex;
+  struct rib *rib;
+  struct nexthop *nexthop;
+  struct nexthop *paired;
+  struct in6_addr gate;
+  unsigned int ifindex;
   struct prefix_ipv6 p;
+  u_char message;
+  u_char nexthop_num;
+  u_char nexthop_type;
   
   s = client->ibuf;
-  ifindex = 0;
-  memset (&nexthop, 0, sizeof (struct in6_addr));
+
+  /* Allocate new rib. */
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
 
   /* Type, flags, message. */
-  api.type = stream_getc (s);
-  api.flags = stream_getc (s);
-  api.message = stream_getc (s);
+  rib->type = stream_getc (s);
+  rib->flags = stream_getc (s);
+  message = stream_getc (s);
+  rib->uptime = time (NULL);
 
-  /* IPv4 prefix. */
+  /* IPv6 prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv6));
   p.family = AF_INET6;
   p.prefixlen = stream_getc (s);
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
-  /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+  /* Nexthop parse.  The interface indexes follow the addresses, the
+     n-th index belongs to the n-th address, 0 for an address without
+     an interface. */
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
     {
-      u_char nexthop_type;
+      paired = NULL;
+      nexthop_num = stream_getc (s);
 
-      api.nexthop_num = stream_getc (s);
-      for (i = 0; i < api.nexthop_num; i++)
+      for (i = 0; i < nexthop_num; i++)
 	{
 	  nexthop_type = stream_getc (s);
 
 	  switch (nexthop_type)
 	    {
 	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop, s, 16);
+	      stream_get (&gate, s, 16);
+	      nexthop_ipv6_add (rib, &gate);
 	      break;
 	    case ZEBRA_NEXTHOP_IFINDEX:
 	      ifindex = stream_getl (s);
+	      nexthop = paired ? paired->next : rib->nexthop;
+	      if (! ifindex)
+		{
+		  if (nexthop)
+		    paired = nexthop;
+		  break;
+		}
+	      if (nexthop)
+		{
+		  if (IN6_IS_ADDR_UNSPECIFIED (&nexthop->gate.ipv6))
+		    nexthop->type = NEXTHOP_TYPE_IFINDEX;
+		  else
+		    nexthop->type = NEXTHOP_TYPE_IPV6_IFINDEX;
+		  nexthop->ifindex = ifindex;
+		}
+	      else
+		nexthop = nexthop_ifindex_add (rib, ifindex);
+	      paired = nexthop;
 	      break;
 	    }
 	}
     }
 
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
-  else
-    api.distance = 0;
+  /* Distance. */
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_DISTANCE))
+    rib->distance = stream_getc (s);
 
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
-  else
-    api.metric = 0;
+  /* Metric. */
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
+    rib->metric = stream_getl (s);
+
+  if (CHECK_FLAG (message, ZAPI_MESSAGE_TIMESTAMP))
+    {
+      struct timeval origin;
+
+      origin.tv_sec = stream_getl (s);
+      origin.tv_usec = stream_getl (s);
+      rib_stamp_received (rib, &origin);
+    }
     
-  if (IN6_IS_ADDR_UNSPECIFIED (&nexthop))
-    rib_add_ipv6 (api.type, api.flags, &p, NULL, ifindex, zebrad.rtm_table_default, api.metric,
-		  api.distance);
-  else
-    rib_add_ipv6 (api.type, api.flags, &p, &nexthop, ifindex, zebrad.rtm_table_default, api.metric,
-		  api.distance);
+  /* Table */
+  rib->table = zebrad.rtm_table_default;
+  rib_add_ipv6_multipath (&p, rib);
   return 0;
 }
 
@@ -1071,10 +1374,132 @@ zread_router_id_delete (struct zserv *client, u_short length)
   return 0;
 }
 
+/* The client offers its capabilities.  Clients which do not are
+   sent and send route messages one by one. */
+static int
+zread_hello (struct zserv *client, u_short length)
+{
+  if (length >= 4)
+    client->capabilities = stream_getl (client->ibuf) & ZEBRA_CAPABILITIES;
+  if (! zserv_ring_enable)
+    UNSET_FLAG (client->capabilities, ZEBRA_CAPABILITY_RING);
+  return zsend_hello (client);
+}
+
+/* Map the rings the client offers, and tell it whether that worked.
+   The answer is queued before the ring is, and so goes by the socket
+   like the messages before it. */
+static int
+zread_ring_setup (struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct zring_map *ring = NULL;
+  char name[ZRING_NAME_SIZE];
+  u_int32_t size;
+  u_char namelen;
+
+  s = client->ibuf;
+  if (CHECK_FLAG (client->capabilities, ZEBRA_CAPABILITY_RING)
+      && ! client->ring && length >= 5)
+    {
+      size = stream_getl (s);
+      namelen = stream_getc (s);
+      if (namelen < ZRING_NAME_SIZE && namelen <= length - 5)
+	{
+	  stream_get (name, s, namelen);
+	  name[namelen] = '\0';
+	  ring = zring_attach (name, size);
+	}
+    }
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_RING_SETUP);
+  stream_putc (s, ring != NULL);
+  stream_putw_at (s, 0, stream_get_endp (s));
+  zebra_server_send_message (client);
+
+  if (! ring)
+    return -1;
+
+  client->ring = ring;
+  if (! client->ring_ibuf)
+    client->ring_ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  if (IS_ZEBRA_DEBUG_EVENT)
+    zlog_debug ("client fd %d ring %s of %u bytes each way is up",
+		client->sock, ring->name, ring->size);
+  return 0;
+}
+
+/* Read a route message, alone or out of a batch. */
+static void
+zread_route (struct zserv *client, uint16_t command, u_short length)
+{
+  client->routes_rcvd++;
+
+  switch (command)
+    {
+    case ZEBRA_IPV4_ROUTE_ADD:
+      zread_ipv4_add (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_DELETE:
+      zread_ipv4_delete (client, length);
+      break;
+#ifdef HAVE_IPV6
+    case ZEBRA_IPV6_ROUTE_ADD:
+      zread_ipv6_add (client, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_DELETE:
+      zread_ipv6_delete (client, length);
+      break;
+#endif /* HAVE_IPV6 */
+    }
+}
+
+/* Read the routes of a ZEBRA_ROUTE_BATCH one by one, as the route
+   messages they were batched from. */
+static int
+zread_route_batch (struct zserv *client, u_short length)
+{
+  static struct stream *route;
+  struct stream *s;
+  struct zapi_batch batch;
+
+  s = client->ibuf;
+  if (zapi_batch_read (s, &batch) < 0)
+    {
+      zlog_warn ("%s: malformed route batch on socket %d",
+		 __func__, client->sock);
+      return -1;
+    }
+
+  if (! route)
+    route = stream_new (ZEBRA_MAX_PACKET_SIZ);
+
+  client->route_msgs_rcvd++;
+  client->ibuf = route;
+  while (batch.count)
+    {
+      if (zapi_batch_route (s, &batch, route) < 0)
+	{
+	  zlog_warn ("%s: malformed route batch on socket %d",
+		     __func__, client->sock);
+	  break;
+	}
+      zread_route (client, batch.command,
+		   stream_get_endp (route) - ZEBRA_HEADER_SIZE);
+    }
+  client->ibuf = s;
+  return 0;
+}
+
 /* Close zebra client. */
 static void
 zebra_client_close (struct zserv *client)
 {
+  struct zserv_msg *msg;
+
   /* Close file descriptor. */
   if (client->sock)
     {
@@ -1087,16 +1512,31 @@ zebra_client_close (struct zserv *client)
     stream_free (client->ibuf);
   if (client->obuf)
     stream_free (client->obuf);
-  if (client->wb)
-    buffer_free(client->wb);
+  while ((msg = client->out_head))
+    {
+      client->out_head = msg->next;
+      XFREE (MTYPE_ZSERV_MSG, msg);
+    }
+  if (client->batch)
+    stream_free (client->batch);
+  if (client->ring_ibuf)
+    stream_free (client->ring_ibuf);
+  if (client->ring)
+    zring_free (client->ring);
 
   /* Release threads. */
   if (client->t_read)
     thread_cancel (client->t_read);
   if (client->t_write)
     thread_cancel (client->t_write);
-  if (client->t_suicide)
-    thread_cancel (client->t_suicide);
+  if (client->t_batch)
+    thread_cancel (client->t_batch);
+  if (client->t_redist)
+    thread_cancel (client->t_redist);
+  if (client->t_ring)
+    thread_cancel (client->t_ring);
+
+  redistribute_finish (client);
 
   /* Free client structure. */
   listnode_delete (zebrad.client_list, client);
@@ -1115,7 +1555,7 @@ zebra_client_create (int sock)
   client->sock = sock;
   client->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
-  client->wb = buffer_new(0);
+  client->batch = stream_new (ZEBRA_MAX_PACKET_SIZ);
 
   /* Set table number. */
   client->rtm_table = zebrad.rtm_table_default;
@@ -1127,6 +1567,151 @@ zebra_client_create (int sock)
   zebra_event (ZEBRA_READ, sock, client);
 }
 
+static void zserv_ring_kicked (struct zserv *);
+
+/* Handle a message from the client, in client->ibuf. */
+static void
+zebra_client_dispatch (struct zserv *client, uint16_t command, u_short length)
+{
+  switch (command) 
+    {
+    case ZEBRA_ROUTER_ID_ADD:
+      zread_router_id_add (client, length);
+      break;
+    case ZEBRA_ROUTER_ID_DELETE:
+      zread_router_id_delete (client, length);
+      break;
+    case ZEBRA_INTERFACE_ADD:
+      zread_interface_add (client, length);
+      break;
+    case ZEBRA_INTERFACE_DELETE:
+      zread_interface_delete (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_ADD:
+    case ZEBRA_IPV4_ROUTE_DELETE:
+#ifdef HAVE_IPV6
+    case ZEBRA_IPV6_ROUTE_ADD:
+    case ZEBRA_IPV6_ROUTE_DELETE:
+#endif /* HAVE_IPV6 */
+      client->route_msgs_rcvd++;
+      zread_route (client, command, length);
+      break;
+    case ZEBRA_ROUTE_BATCH:
+      zread_route_batch (client, length);
+      break;
+    case ZEBRA_HELLO:
+      zread_hello (client, length);
+      break;
+    case ZEBRA_RING_SETUP:
+      zread_ring_setup (client, length);
+      break;
+    case ZEBRA_RING_KICK:
+      zserv_ring_kicked (client);
+      break;
+    case ZEBRA_REDISTRIBUTE_ADD:
+      zebra_redistribute_add (command, client, length);
+      break;
+    case ZEBRA_REDISTRIBUTE_DELETE:
+      zebra_redistribute_delete (command, client, length);
+      break;
+    case ZEBRA_REDISTRIBUTE_DEFAULT_ADD:
+      zebra_redistribute_default_add (command, client, length);
+      break;
+    case ZEBRA_REDISTRIBUTE_DEFAULT_DELETE:
+      zebra_redistribute_default_delete (command, client, length);
+      break;
+    case ZEBRA_IPV4_NEXTHOP_LOOKUP:
+      zread_ipv4_nexthop_lookup (client, length);
+      break;
+#ifdef HAVE_IPV6
+    case ZEBRA_IPV6_NEXTHOP_LOOKUP:
+      zread_ipv6_nexthop_lookup (client, length);
+      break;
+#endif /* HAVE_IPV6 */
+    case ZEBRA_IPV4_IMPORT_LOOKUP:
+      zread_ipv4_import_lookup (client, length);
+      break;
+    default:
+      zlog_info ("Zebra received unknown command %d", command);
+      break;
+    }
+}
+
+/* Read the messages the client put in the ring, a number at a time. */
+#define ZSERV_RING_READ_MAX 100
+
+static int
+zserv_ring_read (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
+  struct stream *s;
+  int length, i;
+  uint16_t command;
+  uint8_t marker, version;
+
+  client->t_ring = NULL;
+  for (i = 0; i < ZSERV_RING_READ_MAX; i++)
+    {
+      length = zring_msg_peek (client->ring);
+      if (length == 0)
+	return 0;
+      if (length < 0 || length > (int) STREAM_SIZE (client->ring_ibuf))
+	{
+	  zlog_warn ("%s: ring of client fd %d is broken, closing",
+		     __func__, client->sock);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      zring_msg_get (client->ring, client->ring_ibuf, length);
+
+      /* The client may wait for the room just made. */
+      if (zring_kick_writer (client->ring))
+	zserv_ring_kick (client);
+
+      s = client->ibuf;
+      client->ibuf = client->ring_ibuf;
+      stream_getw (client->ibuf);
+      marker = stream_getc (client->ibuf);
+      version = stream_getc (client->ibuf);
+      command = stream_getw (client->ibuf);
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
+	{
+	  client->ibuf = s;
+	  zlog_err ("%s: ring of client fd %d version mismatch, "
+		    "marker %d, version %d", __func__, client->sock,
+		    marker, version);
+	  zebra_client_close (client);
+	  return -1;
+	}
+
+      if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
+	zlog_debug ("zebra message received from ring [%s] %d",
+		    zserv_command_string (command),
+		    length - ZEBRA_HEADER_SIZE);
+      zebra_client_dispatch (client, command, length - ZEBRA_HEADER_SIZE);
+      client->ibuf = s;
+    }
+
+  client->t_ring = thread_add_event (zebrad.master, zserv_ring_read,
+				     client, 0);
+  return 0;
+}
+
+/* The client put messages in the ring, or made room in its own. */
+static void
+zserv_ring_kicked (struct zserv *client)
+{
+  if (! client->ring)
+    return;
+  client->ring_kicks_rcvd++;
+  if (! client->t_ring)
+    client->t_ring = thread_add_event (zebrad.master, zserv_ring_read,
+				       client, 0);
+  if (client->ring_out && client->out_head && ! client->t_write)
+    client->t_write = thread_add_event (zebrad.master, zserv_flush_data,
+					client, 0);
+}
+
 /* Handler of zebra service request. */
 static int
 zebra_client_read (struct thread *thread)
@@ -1142,12 +1727,6 @@ zebra_client_read (struct thread *thread)
   client = THREAD_ARG (thread);
   client->t_read = NULL;
 
-  if (client->t_suicide)
-    {
-      zebra_client_close(client);
-      return -1;
-    }
-
   /* Read length and command (if we don't have it already). */
   if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
     {
@@ -1232,68 +1811,7 @@ zebra_client_read (struct thread *thread)
     zlog_debug ("zebra message received [%s] %d", 
 	       zserv_command_string (command), length);
 
-  switch (command) 
-    {
-    case ZEBRA_ROUTER_ID_ADD:
-      zread_router_id_add (client, length);
-      break;
-    case ZEBRA_ROUTER_ID_DELETE:
-      zread_router_id_delete (client, length);
-      break;
-    case ZEBRA_INTERFACE_ADD:
-      zread_interface_add (client, length);
-      break;
-    case ZEBRA_INTERFACE_DELETE:
-      zread_interface_delete (client, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_ADD:
-      zread_ipv4_add (client, length);
-      break;
-    case ZEBRA_IPV4_ROUTE_DELETE:
-      zread_ipv4_delete (client, length);
-      break;
-#ifdef HAVE_IPV6
-    case ZEBRA_IPV6_ROUTE_ADD:
-      zread_ipv6_add (client, length);
-      break;
-    case ZEBRA_IPV6_ROUTE_DELETE:
-      zread_ipv6_delete (client, length);
-      break;
-#endif /* HAVE_IPV6 */
-    case ZEBRA_REDISTRIBUTE_ADD:
-      zebra_redistribute_add (command, client, length);
-      break;
-    case ZEBRA_REDISTRIBUTE_DELETE:
-      zebra_redistribute_delete (command, client, length);
-      break;
-    case ZEBRA_REDISTRIBUTE_DEFAULT_ADD:
-      zebra_redistribute_default_add (command, client, length);
-      break;
-    case ZEBRA_REDISTRIBUTE_DEFAULT_DELETE:
-      zebra_redistribute_default_delete (command, client, length);
-      break;
-    case ZEBRA_IPV4_NEXTHOP_LOOKUP:
-      zread_ipv4_nexthop_lookup (client, length);
-      break;
-#ifdef HAVE_IPV6
-    case ZEBRA_IPV6_NEXTHOP_LOOKUP:
-      zread_ipv6_nexthop_lookup (client, length);
-      break;
-#endif /* HAVE_IPV6 */
-    case ZEBRA_IPV4_IMPORT_LOOKUP:
-      zread_ipv4_import_lookup (client, length);
-      break;
-    default:
-      zlog_info ("Zebra received unknown command %d", command);
-      break;
-    }
-
-  if (client->t_suicide)
-    {
-      /* No need to wait for thread callback, just kill immediately. */
-      zebra_client_close(client);
-      return -1;
-    }
+  zebra_client_dispatch (client, command, length);
 
   stream_reset (client->ibuf);
   zebra_event (ZEBRA_READ, sock, client);
@@ -1488,6 +2006,30 @@ DEFUN (show_table,
   return CMD_SUCCESS;
 }
 
+#ifdef HAVE_NETLINK
+DEFUN (show_zebra_fib_statistics,
+       show_zebra_fib_statistics_cmd,
+       "show zebra fib-statistics",
+       SHOW_STR
+       "Zebra information\n"
+       "Route messages to the kernel and their acknowledgements\n")
+{
+  kernel_fib_statistics (vty);
+  return CMD_SUCCESS;
+}
+
+DEFUN (clear_zebra_fib_statistics,
+       clear_zebra_fib_statistics_cmd,
+       "clear zebra fib-statistics",
+       CLEAR_STR
+       "Zebra information\n"
+       "Route messages to the kernel and their acknowledgements\n")
+{
+  kernel_fib_statistics_reset ();
+  return CMD_SUCCESS;
+}
+#endif /* HAVE_NETLINK */
+
 DEFUN (config_table, 
        config_table_cmd,
        "table TABLENO",
@@ -1553,11 +2095,158 @@ DEFUN (show_zebra_client,
   struct zserv *client;
 
   for (ALL_LIST_ELEMENTS_RO (zebrad.client_list, node, client))
-    vty_out (vty, "Client fd %d%s", client->sock, VTY_NEWLINE);
+    {
+      vty_out (vty, "Client fd %d%s%s%s", client->sock,
+	       CHECK_FLAG (client->capabilities, ZEBRA_CAPABILITY_ROUTE_BATCH)
+	       ? ", route batches" : "",
+	       client->ring ? ", shared memory ring" : "", VTY_NEWLINE);
+      if (client->ring)
+	vty_out (vty, "  Ring of %u bytes each way, %s, "
+		 "kicks sent %lu, received %lu%s",
+		 client->ring->size,
+		 client->ring_out ? "written to" : "not written to yet",
+		 client->ring_kicks_sent, client->ring_kicks_rcvd,
+		 VTY_NEWLINE);
+      vty_out (vty, "  Routes received %lu in %lu messages, "
+	       "sent %lu in %lu messages%s",
+	       client->routes_rcvd, client->route_msgs_rcvd,
+	       client->routes_sent, client->route_msgs_sent, VTY_NEWLINE);
+      vty_out (vty, "  Output queue %lu messages, %lu bytes "
+	       "(peak %lu messages, %lu bytes)%s",
+	       client->out_count, (u_long) client->out_bytes,
+	       client->out_count_peak, (u_long) client->out_bytes_peak,
+	       VTY_NEWLINE);
+      vty_out (vty, "  Written %lu messages in %lu writev calls, "
+	       "waiting %.0f usec on average, %lu at most%s",
+	       client->out_latency.count, client->out_writes,
+	       client->out_latency.count
+	       ? client->out_latency.total / client->out_latency.count : 0.0,
+	       client->out_latency.max, VTY_NEWLINE);
+      vty_out (vty, "  Redistribution held back %lu times%s%s",
+	       client->redist_holds,
+	       client->redist_held ? ", held now"
+	       : (client->redist_pending[AFI_IP]
+		  || client->redist_pending[AFI_IP6]) ? ", resuming" : "",
+	       VTY_NEWLINE);
+    }
   
   return CMD_SUCCESS;
 }
 
+DEFUN (client_queue_watermark,
+       client_queue_watermark_cmd,
+       "client-queue watermark high <16384-1073741824> low <0-1073741824>",
+       "Queue of messages to zebra clients\n"
+       "Bytes queued between which redistribution to a client is held back\n"
+       "Hold back redistribution when this much is queued\n"
+       "Bytes\n"
+       "Resume redistribution when no more than this is queued\n"
+       "Bytes\n")
+{
+  u_int32_t high, low;
+
+  VTY_GET_INTEGER_RANGE ("high watermark", high, argv[0], 16384, 1073741824);
+  VTY_GET_INTEGER_RANGE ("low watermark", low, argv[1], 0, 1073741824);
+  if (low >= high)
+    {
+      vty_out (vty, "%% The low watermark must be below the high one%s",
+	       VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+  zserv_queue_high = high;
+  zserv_queue_low = low;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_client_queue_watermark,
+       no_client_queue_watermark_cmd,
+       "no client-queue watermark",
+       NO_STR
+       "Queue of messages to zebra clients\n"
+       "Bytes queued between which redistribution to a client is held back\n")
+{
+  zserv_queue_high = ZSERV_QUEUE_HIGH_DEFAULT;
+  zserv_queue_low = ZSERV_QUEUE_LOW_DEFAULT;
+  return CMD_SUCCESS;
+}
+
+DEFUN (client_ring,
+       client_ring_cmd,
+       "client-ring",
+       "Exchange messages with clients in shared memory\n")
+{
+  zserv_ring_enable = 1;
+  return CMD_SUCCESS;
+}
+
+DEFUN (no_client_ring,
+       no_client_ring_cmd,
+       "no client-ring",
+       NO_STR
+       "Exchange messages with clients in shared memory\n")
+{
+  zserv_ring_enable = 0;
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_zebra_convergence_statistics,
+       show_zebra_convergence_statistics_cmd,
+       "show zebra convergence-statistics",
+       SHOW_STR
+       "Zebra information\n"
+       "Latency of the stages from client to kernel\n")
+{
+  rib_latency_vty (vty);
+  return CMD_SUCCESS;
+}
+
+DEFUN (clear_zebra_convergence_statistics,
+       clear_zebra_convergence_statistics_cmd,
+       "clear zebra convergence-statistics",
+       CLEAR_STR
+       "Zebra information\n"
+       "Latency of the stages from client to kernel\n")
+{
+  rib_latency_reset ();
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_zebra_nexthop_groups,
+       show_zebra_nexthop_groups_cmd,
+       "show zebra nexthop-groups",
+       SHOW_STR
+       "Zebra information\n"
+       "Nexthops shared by RIB entries\n")
+{
+  rib_nexthop_group_vty (vty);
+  return CMD_SUCCESS;
+}
+
+/* Client service configuration write function. */
+static int
+config_write_zserv (struct vty *vty)
+{
+  int write = 0;
+
+  if (zserv_queue_high != ZSERV_QUEUE_HIGH_DEFAULT
+      || zserv_queue_low != ZSERV_QUEUE_LOW_DEFAULT)
+    {
+      vty_out (vty, "client-queue watermark high %lu low %lu%s",
+	       (u_long) zserv_queue_high, (u_long) zserv_queue_low,
+	       VTY_NEWLINE);
+      write++;
+    }
+  if (! zserv_ring_enable)
+    {
+      vty_out (vty, "no client-ring%s", VTY_NEWLINE);
+      write++;
+    }
+  return write;
+}
+
+/* zserv node for the client service. */
+static struct cmd_node zserv_node = { ZSERV_NODE, "", 1 };
+
 /* Table configuration write function. */
 static int
 config_write_table (struct vty *vty)
@@ -1714,17 +2403,30 @@ zebra_init (void)
   /* Install configuration write function. */
   install_node (&table_node, config_write_table);
   install_node (&forwarding_node, config_write_forwarding);
+  install_node (&zserv_node, config_write_zserv);
 
   install_element (VIEW_NODE, &show_ip_forwarding_cmd);
   install_element (ENABLE_NODE, &show_ip_forwarding_cmd);
   install_element (CONFIG_NODE, &ip_forwarding_cmd);
   install_element (CONFIG_NODE, &no_ip_forwarding_cmd);
   install_element (ENABLE_NODE, &show_zebra_client_cmd);
+  install_element (CONFIG_NODE, &client_queue_watermark_cmd);
+  install_element (CONFIG_NODE, &no_client_queue_watermark_cmd);
+  install_element (CONFIG_NODE, &client_ring_cmd);
+  install_element (CONFIG_NODE, &no_client_ring_cmd);
+  install_element (VIEW_NODE, &show_zebra_convergence_statistics_cmd);
+  install_element (ENABLE_NODE, &show_zebra_convergence_statistics_cmd);
+  install_element (ENABLE_NODE, &clear_zebra_convergence_statistics_cmd);
+  install_element (VIEW_NODE, &show_zebra_nexthop_groups_cmd);
+  install_element (ENABLE_NODE, &show_zebra_nexthop_groups_cmd);
 
 #ifdef HAVE_NETLINK
   install_element (VIEW_NODE, &show_table_cmd);
   install_element (ENABLE_NODE, &show_table_cmd);
   install_element (CONFIG_NODE, &config_table_cmd);
+  install_element (VIEW_NODE, &show_zebra_fib_statistics_cmd);
+  install_element (ENABLE_NODE, &show_zebra_fib_statistics_cmd);
+  install_element (ENABLE_NODE, &clear_zebra_fib_statistics_cmd);
 #endif /* HAVE_NETLINK */
 
 #ifdef HAVE_IPV6
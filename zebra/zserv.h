@@ -25,6 +25,7 @@
 #include "rib.h"
 #include "if.h"
 #include "workqueue.h"
+#include "latency.h"
 
 /* Default port information. */
 #define ZEBRA_VTY_PORT                2601
@@ -42,16 +43,26 @@ struct zserv
   struct stream *ibuf;
   struct stream *obuf;
 
-  /* Buffer of data waiting to be written to client. */
-  struct buffer *wb;
+  /* Messages waiting to be written to the client, oldest first, and
+     how much of the oldest has been written. */
+  struct zserv_msg *out_head;
+  struct zserv_msg *out_tail;
+  size_t out_written;
+
+  /* Messages and bytes waiting, and their peaks. */
+  u_long out_count;
+  u_long out_count_peak;
+  size_t out_bytes;
+  size_t out_bytes_peak;
+
+  /* writev calls, and how long messages waited to be written. */
+  u_long out_writes;
+  struct latency out_latency;
 
   /* Threads for read/write. */
   struct thread *t_read;
   struct thread *t_write;
 
-  /* Thread for delayed close. */
-  struct thread *t_suicide;
-
   /* default routing table this client munges */
   int rtm_table;
 
@@ -61,11 +72,44 @@ struct zserv
   /* Redistribute default route flag. */
   u_char redist_default;
 
+  /* Redistribution is held back while the messages waiting are over
+     the high watermark, until they drain under the low one.  The
+     prefixes held back are sent afterwards, and the event doing so. */
+  u_char redist_held;
+  u_long redist_holds;
+  struct route_table *redist_pending[AFI_MAX];
+  struct thread *t_redist;
+
   /* Interface information. */
   u_char ifinfo;
 
   /* Router-id information. */
   u_char ridinfo;
+
+  /* Capabilities agreed on with the client, see ZEBRA_HELLO. */
+  u_int32_t capabilities;
+
+  /* Route messages waiting to be sent as one ZEBRA_ROUTE_BATCH, and
+     the event sending them. */
+  struct stream *batch;
+  struct thread *t_batch;
+
+  /* Shared memory rings of the client, see ZEBRA_RING_SETUP.  Messages
+     to the client go in the ring once those queued before are written
+     to the socket, which then only carries ZEBRA_RING_KICK.  The event
+     reading the messages from the client, and the kicks exchanged. */
+  struct zring_map *ring;
+  u_char ring_out;
+  struct stream *ring_ibuf;
+  struct thread *t_ring;
+  u_long ring_kicks_sent;
+  u_long ring_kicks_rcvd;
+
+  /* Route messages and the routes in them, received and sent. */
+  u_long route_msgs_rcvd;
+  u_long routes_rcvd;
+  u_long route_msgs_sent;
+  u_long routes_sent;
 };
 
 /* Zebra instance */
@@ -105,6 +149,9 @@ extern int zsend_interface_address (int, struct zserv *, struct interface *,
 extern int zsend_interface_update (int, struct zserv *, struct interface *);
 extern int zsend_route_multipath (int, struct zserv *, struct prefix *, 
                                   struct rib *);
+extern void zserv_route_encode (int, struct zserv *, struct prefix *,
+                                struct rib *);
+extern int zserv_route_send (struct zserv *);
 extern int zsend_router_id_update(struct zserv *, struct prefix *);
 
 extern pid_t pid;